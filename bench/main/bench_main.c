@@ -0,0 +1,1083 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "can_agg.h"
+#include "can_pipe.h"
+#include "can_filter.h"
+#include "can_fmt.h"
+#include "can_load.h"
+#include "can_mon.h"
+#include "lvgl_rotate.h"
+#include "lvgl_dirty.h"
+
+/*
+ * CAN monitor pipeline benchmark (host).
+ *
+ * Each traffic profile generates the same frame sequence on every run
+ * (fixed seed, virtual timestamps), which is fed through one pipeline stage
+ * at a time:
+ *
+ *   queue      the transport can_mon had before the rings: one xQueueSend()
+ *              of a can_evt_t per frame and one xQueueReceive() per frame
+ *              on the drain, same queue length and drain schedule as push
+ *   push       can_mon_push_rx_batch() in driver-sized batches (ring, load
+ *              meter), with a consumer draining the ring like the decode
+ *              stage does; frames it could not keep count as drops
+ *   push_1     the same one frame per call, as the RX task pushed before it
+ *              drained the driver in bursts
+ *   capture    the same with the PSRAM capture store enabled
+ *   format     can_rec_decode() + can_fmt_line()
+ *   format_ref the same with the former snprintf-based format_can_line();
+ *              every line must match can_fmt_line() byte for byte (the run
+ *              fails otherwise)
+ *   decode     can_pipe_poll() on a filled ring (decode, ID table, row
+ *              formatting) plus taking the rows like the render stage;
+ *              drops are rows the row ring could not take
+ *   filter_N   can_filter_batch() with programs of 1, 10 and 100 rules
+ *   agg        can_agg_update(); drops are frames whose ID found no room in
+ *              the table
+ *
+ * After the profiles, lvgl_rotate_copy() is checked pixel for pixel against
+ * the former per-pixel rotate_copy_pixel() on a set of areas at each angle
+ * (the run fails on any difference), then timed on a full 800x480 RGB565
+ * screen and on one log line, in MPix/s. Host caches say little about PSRAM,
+ * so compare the two columns rather than the absolute numbers.
+ *
+ * Then the direct-mode frame buffer sync: invalidation patterns of the
+ * monitor UI go once through LVGL's own area join (what lvgl_port.c used to
+ * copy) and once through lvgl_dirty_merge(), and both are copied at 90
+ * degrees. The merged copy must still cover every invalidated pixel and may
+ * not move more bytes than the LVGL join; either failure fails the run.
+ *
+ * Last, the UI tick at 1k, 5k and 10k frames/s: every virtual millisecond
+ * the RX side pushes what arrived and the decode stage polls; every UI
+ * period the render side takes the rows and rebinds the visible log rows the
+ * way ui_canmon.c and ui_canlog.c do. LVGL itself is not linked, so the
+ * tick figure is the text work without drawing; it should not grow with the
+ * frame rate.
+ *
+ * Time is taken per group of CAN_BENCH_GROUP frames and divided down, so
+ * p50/p99/p999 are per-frame costs of a group, not single-call latencies.
+ * Results go to stdout and, as CSV, to $CAN_BENCH_CSV (default
+ * can_bench.csv), one row per profile and stage.
+ */
+
+#define TAG "can_bench"
+
+#ifndef CAN_BENCH_FRAMES
+#define CAN_BENCH_FRAMES      200000
+#endif
+
+#ifndef CAN_BENCH_GROUP
+#define CAN_BENCH_GROUP       32      /* frames per timed group; also the push batch */
+#endif
+
+#ifndef CAN_BENCH_RX_RING
+#define CAN_BENCH_RX_RING     1024    /* as CAN_MON_RX_QUEUE_LEN on the board */
+#endif
+
+#ifndef CAN_BENCH_DRAIN_US
+#define CAN_BENCH_DRAIN_US    50000   /* consumer period, virtual time (UI tick) */
+#endif
+
+#ifndef CAN_BENCH_DRAIN_MAX
+#define CAN_BENCH_DRAIN_MAX   4096    /* records the consumer takes per period */
+#endif
+
+#ifndef CAN_BENCH_CAPTURE_MB
+#define CAN_BENCH_CAPTURE_MB  4
+#endif
+
+#ifndef CAN_BENCH_UI_PERIOD_MS
+#define CAN_BENCH_UI_PERIOD_MS  33    /* ui_canmon tick period at rest */
+#endif
+
+#ifndef CAN_BENCH_UI_ROWS
+#define CAN_BENCH_UI_ROWS       24    /* log rows on an 800x480 screen */
+#endif
+
+#ifndef CAN_BENCH_UI_HIST
+#define CAN_BENCH_UI_HIST       1024  /* ui_canlog history, as ui_canmon creates it */
+#endif
+
+#ifndef CAN_BENCH_UI_SECONDS
+#define CAN_BENCH_UI_SECONDS    10    /* virtual time per rate */
+#endif
+
+#ifndef CAN_BENCH_ROT_PIXELS
+#define CAN_BENCH_ROT_PIXELS  50000000   /* pixels copied per timed rotation case */
+#endif
+
+/* ---------------- Traffic profiles ---------------- */
+
+typedef struct {
+    twai_message_t *msgs;
+    int64_t        *t_us;     /* arrival time of each frame */
+    size_t          n;
+} bench_traffic_t;
+
+static uint32_t s_rng = 1;
+
+static inline uint32_t rng_next(void)
+{
+    uint32_t x = s_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rng = x;
+    return x;
+}
+
+static void fill_data(twai_message_t *m)
+{
+    uint32_t a = rng_next(), b = rng_next();
+    memcpy(&m->data[0], &a, 4);
+    memcpy(&m->data[4], &b, 4);
+}
+
+/* On-wire duration at 500 kbit/s: 2 us per bit */
+static inline int64_t wire_us(const twai_message_t *m)
+{
+    return (int64_t)can_load_frame_bits(m, true) * 2;
+}
+
+/* Back-to-back 8-byte extended frames, bus 100 % busy */
+static void gen_saturated(bench_traffic_t *tr)
+{
+    int64_t t = 0;
+    for (size_t i = 0; i < tr->n; i++) {
+        twai_message_t *m = &tr->msgs[i];
+        memset(m, 0, sizeof(*m));
+        m->flags = TWAI_MSG_FLAG_EXTD;
+        m->identifier = 0x18F00000u | (rng_next() & 0x3FF);
+        m->data_length_code = 8;
+        fill_data(m);
+        t += wire_us(m);
+        tr->t_us[i] = t;
+    }
+}
+
+/* Truck-style J1939 schedule plus a little 11-bit diagnostic traffic */
+static void gen_j1939(bench_traffic_t *tr)
+{
+    static const struct {
+        uint32_t id;
+        uint32_t period_us;
+        uint8_t  dlc;
+    } k_sched[] = {
+        { 0x0CF00400, 10000,   8 },   /* EEC1 */
+        { 0x0CF00300, 50000,   8 },   /* EEC2 */
+        { 0x18FEF100, 100000,  8 },   /* CCVS */
+        { 0x18FEEE00, 1000000, 8 },   /* ET1 */
+        { 0x18FEEF00, 500000,  8 },   /* EFL/P1 */
+        { 0x18FEF200, 100000,  8 },   /* LFE */
+        { 0x0C000003, 10000,   8 },   /* TSC1 */
+        { 0x18FECA00, 1000000, 6 },   /* DM1 */
+        { 0x18F00500, 100000,  8 },   /* ETC2 */
+        { 0x0CF00203, 10000,   8 },   /* ETC1 */
+        { 0x18FEBF0B, 100000,  8 },   /* EBC2 */
+        { 0x7DF,      250000,  8 },   /* OBD request (11-bit) */
+        { 0x7E8,      250000,  8 },   /* OBD response (11-bit) */
+    };
+    const size_t k = sizeof(k_sched) / sizeof(k_sched[0]);
+    int64_t due[sizeof(k_sched) / sizeof(k_sched[0])];
+    for (size_t j = 0; j < k; j++) due[j] = (int64_t)(j * 700);
+
+    int64_t bus_free = 0;
+    for (size_t i = 0; i < tr->n; i++) {
+        size_t pick = 0;
+        for (size_t j = 1; j < k; j++) {
+            if (due[j] < due[pick]) pick = j;
+        }
+
+        twai_message_t *m = &tr->msgs[i];
+        memset(m, 0, sizeof(*m));
+        m->identifier = k_sched[pick].id;
+        if (m->identifier > 0x7FF) m->flags = TWAI_MSG_FLAG_EXTD;
+        m->data_length_code = k_sched[pick].dlc;
+        fill_data(m);
+
+        int64_t start = due[pick] > bus_free ? due[pick] : bus_free;
+        bus_free = start + wire_us(m);
+        tr->t_us[i] = bus_free;
+        due[pick] += k_sched[pick].period_us;
+    }
+}
+
+/* One frame every 10 ms, and every 500 ms a 256-frame back-to-back burst */
+static void gen_bursts(bench_traffic_t *tr)
+{
+    int64_t t = 0;
+    size_t i = 0;
+    while (i < tr->n) {
+        for (int q = 0; q < 50 && i < tr->n; q++, i++) {
+            twai_message_t *m = &tr->msgs[i];
+            memset(m, 0, sizeof(*m));
+            m->identifier = 0x100 + (q & 0xF);
+            m->data_length_code = (uint8_t)(rng_next() % 9);
+            fill_data(m);
+            t += 10000;
+            tr->t_us[i] = t;
+        }
+        for (int q = 0; q < 256 && i < tr->n; q++, i++) {
+            twai_message_t *m = &tr->msgs[i];
+            memset(m, 0, sizeof(*m));
+            m->identifier = 0x400 + (rng_next() & 0xFF);
+            m->data_length_code = 8;
+            fill_data(m);
+            t += wire_us(m);
+            tr->t_us[i] = t;
+        }
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(bench_traffic_t *tr);
+} bench_profile_t;
+
+static const bench_profile_t k_profiles[] = {
+    { "sat500k_ext8", gen_saturated },
+    { "j1939_mixed",  gen_j1939     },
+    { "idle_bursts",  gen_bursts    },
+};
+
+/* ---------------- Measurement ---------------- */
+
+typedef struct {
+    uint32_t *grp_ns;      /* per-frame ns of each group */
+    size_t    n_grp;
+    uint64_t  total_ns;
+    size_t    frames;
+    uint32_t  drops;
+} bench_result_t;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void res_add(bench_result_t *r, uint64_t ns, size_t frames)
+{
+    r->total_ns += ns;
+    r->frames += frames;
+    r->grp_ns[r->n_grp++] = (uint32_t)(ns / frames);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t pct(const bench_result_t *r, uint32_t per_mille)
+{
+    if (r->n_grp == 0) return 0;
+    size_t i = (size_t)(((uint64_t)r->n_grp * per_mille) / 1000);
+    if (i >= r->n_grp) i = r->n_grp - 1;
+    return r->grp_ns[i];
+}
+
+static void report(FILE *csv, const char *profile, const char *stage, bench_result_t *r)
+{
+    qsort(r->grp_ns, r->n_grp, sizeof(uint32_t), cmp_u32);
+
+    double ns_per = r->frames ? (double)r->total_ns / r->frames : 0;
+    double fps = r->total_ns ? r->frames * 1e9 / r->total_ns : 0;
+
+    printf("%-14s %-12s %10.0f %8.1f %7u %7u %7u %7u\n", profile, stage, fps, ns_per,
+           (unsigned)pct(r, 500), (unsigned)pct(r, 990), (unsigned)pct(r, 999), (unsigned)r->drops);
+    if (csv) {
+        fprintf(csv, "%s,%s,%u,%.0f,%.1f,%u,%u,%u,%u\n", profile, stage, (unsigned)r->frames, fps, ns_per,
+                (unsigned)pct(r, 500), (unsigned)pct(r, 990), (unsigned)pct(r, 999), (unsigned)r->drops);
+    }
+}
+
+/* ---------------- Stages ---------------- */
+
+static int64_t s_t_offset = 0;    /* keeps monitor timestamps increasing across runs */
+
+static void drain_ring(size_t max)
+{
+    const can_rec_t *recs;
+    int64_t base_us;
+    size_t n;
+    while (max > 0 && (n = can_mon_peek(&recs, &base_us, max)) > 0) {
+        can_mon_release(n);
+        max -= n;
+    }
+}
+
+static void stage_push(const bench_traffic_t *tr, size_t batch, bench_result_t *r)
+{
+    const uint32_t drop0 = can_mon_get_drop_cnt();
+    int64_t next_drain = s_t_offset + tr->t_us[0] + CAN_BENCH_DRAIN_US;
+
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+        int64_t t_last = s_t_offset + tr->t_us[i + k - 1];
+
+        uint64_t t0 = now_ns();
+        for (size_t j = 0; j < k; j += batch) {
+            size_t b = k - j < batch ? k - j : batch;
+            can_mon_push_rx_batch(&tr->msgs[i + j], b, s_t_offset + tr->t_us[i + j],
+                                  s_t_offset + tr->t_us[i + j + b - 1]);
+        }
+        if (t_last >= next_drain) {
+            drain_ring(CAN_BENCH_DRAIN_MAX);
+            next_drain = t_last + CAN_BENCH_DRAIN_US;
+        }
+        res_add(r, now_ns() - t0, k);
+    }
+
+    drain_ring(SIZE_MAX);
+    s_t_offset += tr->t_us[tr->n - 1] + 1;
+    r->drops = can_mon_get_drop_cnt() - drop0;
+}
+
+static QueueHandle_t s_queue;
+
+static void drain_queue(size_t max)
+{
+    can_evt_t e;
+    while (max > 0 && xQueueReceive(s_queue, &e, 0) == pdTRUE) max--;
+}
+
+static void stage_queue(const bench_traffic_t *tr, bench_result_t *r)
+{
+    int64_t next_drain = tr->t_us[0] + CAN_BENCH_DRAIN_US;
+
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+        int64_t t_last = tr->t_us[i + k - 1];
+
+        uint64_t t0 = now_ns();
+        for (size_t j = 0; j < k; j++) {
+            const can_evt_t e = {
+                .t_us  = tr->t_us[i + j],
+                .is_tx = false,
+                .msg   = tr->msgs[i + j],
+            };
+            if (xQueueSend(s_queue, &e, 0) != pdTRUE) r->drops++;
+        }
+        if (t_last >= next_drain) {
+            drain_queue(CAN_BENCH_DRAIN_MAX);
+            next_drain = t_last + CAN_BENCH_DRAIN_US;
+        }
+        res_add(r, now_ns() - t0, k);
+    }
+
+    drain_queue(SIZE_MAX);
+}
+
+static void stage_format(const bench_traffic_t *tr, bench_result_t *r)
+{
+    static char line[CAN_FMT_LINE_MAX];
+    volatile size_t sink = 0;
+
+    can_rec_t recs[CAN_BENCH_GROUP + 1];
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+
+        /* Encode outside the timed part: the UI only decodes and formats */
+        int64_t sync = tr->t_us[i];
+        can_rec_encode_sync(&recs[0], sync);
+        for (size_t j = 0; j < k; j++) can_rec_encode(&recs[j + 1], sync, tr->t_us[i + j], false, &tr->msgs[i + j]);
+
+        uint64_t t0 = now_ns();
+        int64_t base = 0;
+        for (size_t j = 0; j <= k; j++) {
+            can_evt_t e;
+            if (can_rec_decode(&recs[j], &base, &e)) sink += can_fmt_line(line, &e);
+        }
+        res_add(r, now_ns() - t0, k);
+    }
+    (void)sink;
+}
+
+/* format_can_line() from ui_canmon.c before can_fmt_line(), kept as the reference */
+static void format_ref(char *out, size_t out_sz, const can_evt_t *e)
+{
+    const twai_message_t *m = &e->msg;
+
+    int p = 0;
+    p += snprintf(out + p, out_sz - p, "%s ", e->is_tx ? "TX" : "RX");
+
+    if (m->flags & TWAI_MSG_FLAG_EXTD) {
+        p += snprintf(out + p, out_sz - p, "ID=%08" PRIX32 " ", (uint32_t)m->identifier);
+    } else {
+        p += snprintf(out + p, out_sz - p, "ID=%03" PRIX32 " ", (uint32_t)m->identifier);
+    }
+
+    p += snprintf(out + p, out_sz - p, "DLC=%u ", (unsigned)m->data_length_code);
+
+    if (m->flags & TWAI_MSG_FLAG_RTR) {
+        p += snprintf(out + p, out_sz - p, "RTR");
+        return;
+    }
+
+    p += snprintf(out + p, out_sz - p, "DATA=");
+    for (int i = 0; i < m->data_length_code && i < 8; i++) {
+        p += snprintf(out + p, out_sz - p, "%02X%s",
+                      (unsigned)m->data[i], (i == m->data_length_code - 1) ? "" : " ");
+    }
+}
+
+static bool s_format_ok = true;
+
+static void stage_format_ref(const bench_traffic_t *tr, bench_result_t *r)
+{
+    static char lines[CAN_BENCH_GROUP][CAN_FMT_LINE_MAX];
+    char line[CAN_FMT_LINE_MAX];
+
+    can_rec_t recs[CAN_BENCH_GROUP + 1];
+    can_evt_t evts[CAN_BENCH_GROUP];
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+
+        int64_t sync = tr->t_us[i];
+        can_rec_encode_sync(&recs[0], sync);
+        for (size_t j = 0; j < k; j++) can_rec_encode(&recs[j + 1], sync, tr->t_us[i + j], false, &tr->msgs[i + j]);
+
+        uint64_t t0 = now_ns();
+        int64_t base = 0;
+        size_t n = 0;
+        for (size_t j = 0; j <= k; j++) {
+            if (!can_rec_decode(&recs[j], &base, &evts[n])) continue;
+            format_ref(lines[n], CAN_FMT_LINE_MAX, &evts[n]);
+            n++;
+        }
+        res_add(r, now_ns() - t0, k);
+
+        for (size_t j = 0; j < n && s_format_ok; j++) {
+            can_fmt_line(line, &evts[j]);
+            if (strcmp(line, lines[j]) != 0) {
+                ESP_LOGE(TAG, "format: \"%s\" != \"%s\"", line, lines[j]);
+                s_format_ok = false;
+            }
+        }
+    }
+}
+
+static void stage_decode(const bench_traffic_t *tr, bench_result_t *r)
+{
+    const uint32_t drop0 = can_pipe_get_drop_cnt();
+
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+
+        /* Filling the ring is the push stage's cost, not this one's */
+        can_mon_push_rx_batch(&tr->msgs[i], k, s_t_offset + tr->t_us[i], s_t_offset + tr->t_us[i + k - 1]);
+
+        uint64_t t0 = now_ns();
+        can_pipe_poll();
+        const can_pipe_row_t *rows;
+        size_t n;
+        while ((n = can_pipe_peek(&rows, SIZE_MAX)) > 0) can_pipe_release(n);
+        res_add(r, now_ns() - t0, k);
+    }
+
+    s_t_offset += tr->t_us[tr->n - 1] + 1;
+    r->drops = can_pipe_get_drop_cnt() - drop0;
+}
+
+static void stage_filter(const bench_traffic_t *tr, const can_filter_t *f, bench_result_t *r)
+{
+    twai_message_t batch[CAN_BENCH_GROUP];
+    volatile size_t kept = 0;
+
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+        memcpy(batch, &tr->msgs[i], k * sizeof(twai_message_t));
+
+        uint64_t t0 = now_ns();
+        kept += can_filter_batch(f, batch, k);
+        res_add(r, now_ns() - t0, k);
+    }
+    (void)kept;
+}
+
+static void stage_agg(const bench_traffic_t *tr, bench_result_t *r)
+{
+    can_agg_clear();
+    for (size_t i = 0; i < tr->n; i += CAN_BENCH_GROUP) {
+        size_t k = tr->n - i < CAN_BENCH_GROUP ? tr->n - i : CAN_BENCH_GROUP;
+
+        uint64_t t0 = now_ns();
+        for (size_t j = 0; j < k; j++) can_agg_update(false, &tr->msgs[i + j], tr->t_us[i + j]);
+        res_add(r, now_ns() - t0, k);
+    }
+    r->drops = can_agg_get_overflow_cnt();
+}
+
+/*
+ * Filter programs of n rules, none of which is an always-true shortcut: ID
+ * matches (indexed), ranges and payload conditions (not indexed), so the
+ * cost reflects a realistic mix. Returns NULL on a compile error.
+ */
+static can_filter_t *build_filter(size_t n)
+{
+    size_t cap = n * 48 + 1;
+    char *src = malloc(cap);
+    if (!src) return NULL;
+
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        switch (i % 4) {
+        case 0:  len += snprintf(src + len, cap - len, "ext && id 0x18F00%03X;", (unsigned)(i * 7 & 0x3FF)); break;
+        case 1:  len += snprintf(src + len, cap - len, "id 0x%03X;", (unsigned)(0x100 + i)); break;
+        case 2:  len += snprintf(src + len, cap - len, "std && id 0x%X-0x%X && dlc == 8;",
+                                 (unsigned)(0x400 + i), (unsigned)(0x408 + i)); break;
+        default: len += snprintf(src + len, cap - len, "ext && d0 & 0x0F == %u;", (unsigned)(i & 0xF)); break;
+        }
+    }
+
+    can_filter_t *f = NULL;
+    char err[64];
+    if (can_filter_compile(src, &f, err, sizeof(err)) != ESP_OK) {
+        ESP_LOGE(TAG, "Filter with %u rules: %s", (unsigned)n, err);
+        f = NULL;
+    }
+    free(src);
+    return f;
+}
+
+/* ---------------- Rotation ---------------- */
+
+#define ROT_W  800
+#define ROT_H  480
+
+/* The per-pixel copy lvgl_port.c used before lvgl_rotate_copy(), kept as the reference */
+static void rotate_ref(const uint16_t *from, uint16_t *to, uint16_t x_start, uint16_t y_start,
+                       uint16_t x_end, uint16_t y_end, uint16_t w, uint16_t h, uint16_t rotation)
+{
+    int from_index, to_index, to_index_const;
+
+    switch (rotation) {
+    case 90:
+        to_index_const = (w - x_start - 1) * h;
+        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
+            from_index = from_y * w + x_start;
+            to_index = to_index_const + from_y;
+            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
+                to[to_index] = from[from_index];
+                from_index += 1;
+                to_index -= h;
+            }
+        }
+        break;
+    case 180:
+        to_index_const = h * w - x_start - 1;
+        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
+            from_index = from_y * w + x_start;
+            to_index = to_index_const - from_y * w;
+            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
+                to[to_index] = from[from_index];
+                from_index += 1;
+                to_index -= 1;
+            }
+        }
+        break;
+    case 270:
+        to_index_const = (x_start + 1) * h - 1;
+        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
+            from_index = from_y * w + x_start;
+            to_index = to_index_const - from_y;
+            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
+                to[to_index] = from[from_index];
+                from_index += 1;
+                to_index += h;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+typedef struct {
+    uint16_t x0, y0, x1, y1;
+} rot_area_t;
+
+/* Odd and even edges, single pixels, rows, columns, partial tiles, full screen */
+static const rot_area_t k_rot_areas[] = {
+    { 0, 0, ROT_W - 1, ROT_H - 1 },
+    { 0, 0, 0, 0 },
+    { ROT_W - 1, ROT_H - 1, ROT_W - 1, ROT_H - 1 },
+    { 1, 1, 2, 2 },
+    { 3, 5, 37, 70 },
+    { 0, 100, ROT_W - 1, 123 },
+    { 31, 0, 32, ROT_H - 1 },
+    { 33, 33, 94, 64 },
+    { 1, 0, ROT_W - 2, ROT_H - 1 },
+    { 500, 401, 799, 479 },
+};
+
+/* Both copies from the same source into destinations with the same
+ * background, so stray writes outside the area show up too */
+static bool rotate_check(const uint16_t *src, uint16_t *ref, uint16_t *dst, uint16_t rot)
+{
+    const size_t px = (size_t)ROT_W * ROT_H;
+    for (size_t a = 0; a < sizeof(k_rot_areas) / sizeof(k_rot_areas[0]); a++) {
+        const rot_area_t *r = &k_rot_areas[a];
+        for (size_t i = 0; i < px; i++) ref[i] = dst[i] = (uint16_t)(i * 2654435761u >> 16);
+
+        rotate_ref(src, ref, r->x0, r->y0, r->x1, r->y1, ROT_W, ROT_H, rot);
+        lvgl_rotate_copy(src, dst, r->x0, r->y0, r->x1, r->y1, ROT_W, ROT_H, rot);
+        if (memcmp(ref, dst, px * sizeof(uint16_t)) != 0) {
+            ESP_LOGE(TAG, "rotate %u: mismatch for area %u,%u-%u,%u", (unsigned)rot,
+                     (unsigned)r->x0, (unsigned)r->y0, (unsigned)r->x1, (unsigned)r->y1);
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef void (*rotate_fn_t)(const uint16_t *, uint16_t *, uint16_t, uint16_t, uint16_t, uint16_t,
+                            uint16_t, uint16_t, uint16_t);
+
+static double rotate_mpix(rotate_fn_t fn, const uint16_t *src, uint16_t *dst, const rot_area_t *r, uint16_t rot)
+{
+    const uint64_t area = (uint64_t)(r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1);
+    const uint32_t reps = (uint32_t)(CAN_BENCH_ROT_PIXELS / area) + 1;
+
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < reps; i++) fn(src, dst, r->x0, r->y0, r->x1, r->y1, ROT_W, ROT_H, rot);
+    uint64_t ns = now_ns() - t0;
+    return ns ? (double)(area * reps) * 1e3 / ns : 0;
+}
+
+static bool bench_rotate(void)
+{
+    const size_t px = (size_t)ROT_W * ROT_H;
+    uint16_t *src = malloc(px * sizeof(uint16_t));
+    uint16_t *ref = malloc(px * sizeof(uint16_t));
+    uint16_t *dst = malloc(px * sizeof(uint16_t));
+    bool ok = src && ref && dst;
+    if (!ok) ESP_LOGE(TAG, "Out of memory");
+
+    for (size_t i = 0; ok && i < px; i++) src[i] = (uint16_t)rng_next();
+
+    static const uint16_t k_rot[] = { 90, 180, 270 };
+    static const struct {
+        const char *name;
+        rot_area_t  area;
+    } k_timed[] = {
+        { "screen", { 0, 0, ROT_W - 1, ROT_H - 1 } },
+        { "line",   { 0, 200, ROT_W - 1, 223 } },
+    };
+
+    if (ok) printf("\n%-8s %-8s %12s %12s\n", "angle", "area", "ref MPix/s", "tiled MPix/s");
+    for (size_t i = 0; ok && i < sizeof(k_rot) / sizeof(k_rot[0]); i++) {
+        ok = rotate_check(src, ref, dst, k_rot[i]);
+        for (size_t t = 0; ok && t < sizeof(k_timed) / sizeof(k_timed[0]); t++) {
+            double m_ref = rotate_mpix(rotate_ref, src, dst, &k_timed[t].area, k_rot[i]);
+            double m_new = rotate_mpix(lvgl_rotate_copy, src, dst, &k_timed[t].area, k_rot[i]);
+            printf("%-8u %-8s %12.1f %12.1f\n", (unsigned)k_rot[i], k_timed[t].name, m_ref, m_new);
+        }
+    }
+
+    free(src);
+    free(ref);
+    free(dst);
+    return ok;
+}
+
+/* ---------------- Frame buffer sync ---------------- */
+
+typedef struct {
+    const char        *name;
+    size_t             n;
+    lvgl_dirty_rect_t  a[LVGL_DIRTY_IN_MAX];
+} sync_case_t;
+
+static sync_case_t s_sync_cases[5];
+
+/* What ui_canmon invalidates: label old/new text bounds overlap, log rows
+ * and table cells sit edge to edge */
+static void sync_cases_build(void)
+{
+    sync_case_t *c = &s_sync_cases[0];
+    c->name = "log_line";     /* one new row, stats and load re-texted */
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 26, 420, 480, 443 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 26, 420, 512, 443 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 26, 60, 470, 79 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 26, 60, 478, 79 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 26, 84, 400, 103 };
+
+    c = &s_sync_cases[1];
+    c->name = "log_scroll";   /* every visible row re-texted */
+    for (int i = 0; i < 14; i++) {
+        int16_t y = (int16_t)(110 + i * 24);
+        c->a[c->n++] = (lvgl_dirty_rect_t){ 26, y, (int16_t)(380 + (i * 37) % 140), (int16_t)(y + 23) };
+    }
+
+    c = &s_sync_cases[2];
+    c->name = "table";        /* sys view: 5 columns x 6 rows of cells */
+    static const int16_t k_col_x[] = { 26, 186, 276, 366, 456, 546 };
+    for (int r = 0; r < 6; r++) {
+        for (int k = 0; k < 5; k++) {
+            int16_t y = (int16_t)(180 + r * 28);
+            c->a[c->n++] = (lvgl_dirty_rect_t){ k_col_x[k], y, (int16_t)(k_col_x[k + 1] - 1), (int16_t)(y + 27) };
+        }
+    }
+
+    c = &s_sync_cases[3];
+    c->name = "overlap";      /* log panel plus a wider bar across its bottom edge */
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 20, 100, 600, 460 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 20, 440, 700, 463 };
+    c->a[c->n++] = (lvgl_dirty_rect_t){ 590, 120, 599, 300 };
+
+    c = &s_sync_cases[4];
+    c->name = "scattered";    /* small and far apart */
+    for (int i = 0; i < 20; i++) {
+        int16_t x = (int16_t)(20 + (i % 5) * 150), y = (int16_t)(30 + (i / 5) * 110);
+        c->a[c->n++] = (lvgl_dirty_rect_t){ x, y, (int16_t)(x + 40), (int16_t)(y + 16) };
+    }
+}
+
+/* LVGL 8.3 lv_refr_join_area(): overlapping areas are joined when the
+ * union is smaller than the two; the survivors are copied one by one */
+static void sync_lvgl_join(const sync_case_t *c, lvgl_dirty_t *d)
+{
+    lvgl_dirty_reset(d);
+    for (size_t i = 0; i < c->n; i++) {
+        d->r[d->n++] = c->a[i];
+        d->n_in++;
+    }
+
+    bool again = true;
+    while (again) {
+        again = false;
+        for (uint16_t i = 0; i < d->n && !again; i++) {
+            for (uint16_t j = 0; j < d->n && !again; j++) {
+                const lvgl_dirty_rect_t *a = &d->r[i], *b = &d->r[j];
+                if (i == j || a->x1 > b->x2 || b->x1 > a->x2 || a->y1 > b->y2 || b->y1 > a->y2) continue;
+
+                lvgl_dirty_rect_t u = {
+                    a->x1 < b->x1 ? a->x1 : b->x1, a->y1 < b->y1 ? a->y1 : b->y1,
+                    a->x2 > b->x2 ? a->x2 : b->x2, a->y2 > b->y2 ? a->y2 : b->y2,
+                };
+                uint32_t su = (uint32_t)(u.x2 - u.x1 + 1) * (u.y2 - u.y1 + 1);
+                uint32_t sa = (uint32_t)(a->x2 - a->x1 + 1) * (a->y2 - a->y1 + 1);
+                uint32_t sb = (uint32_t)(b->x2 - b->x1 + 1) * (b->y2 - b->y1 + 1);
+                if (su >= sa + sb) continue;
+
+                d->r[i] = u;
+                d->r[j] = d->r[--d->n];
+                again = true;
+            }
+        }
+    }
+}
+
+/* Every invalidated pixel copied, nothing outside the merged rectangles touched */
+static bool sync_check(const sync_case_t *c, const lvgl_dirty_t *d, const uint16_t *src, uint16_t *dst)
+{
+    const size_t px = (size_t)ROT_W * ROT_H;
+    for (size_t i = 0; i < px; i++) dst[i] = (uint16_t)~src[i];
+    lvgl_dirty_copy(d, src, dst, ROT_W, ROT_H, 0);
+
+    for (size_t i = 0; i < c->n; i++) {
+        const lvgl_dirty_rect_t *a = &c->a[i];
+        for (int y = a->y1; y <= a->y2; y++) {
+            for (int x = a->x1; x <= a->x2; x++) {
+                if (dst[y * ROT_W + x] != src[y * ROT_W + x]) return false;
+            }
+        }
+    }
+    for (int y = 0; y < ROT_H; y++) {
+        for (int x = 0; x < ROT_W; x++) {
+            bool in = false;
+            for (uint16_t k = 0; k < d->n && !in; k++) {
+                in = x >= d->r[k].x1 && x <= d->r[k].x2 && y >= d->r[k].y1 && y <= d->r[k].y2;
+            }
+            const uint16_t bg = (uint16_t)~src[y * ROT_W + x];
+            if (!in && dst[y * ROT_W + x] != bg) return false;
+        }
+    }
+    return true;
+}
+
+static double sync_us(const lvgl_dirty_t *d, const uint16_t *src, uint16_t *dst)
+{
+    uint32_t reps = 2000;
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < reps; i++) lvgl_dirty_copy(d, src, dst, ROT_W, ROT_H, 90);
+    return (double)(now_ns() - t0) / reps / 1000.0;
+}
+
+static bool bench_sync(void)
+{
+    const size_t px = (size_t)ROT_W * ROT_H;
+    uint16_t *src = malloc(px * sizeof(uint16_t));
+    uint16_t *dst = malloc(px * sizeof(uint16_t));
+    bool ok = src && dst;
+    if (!ok) ESP_LOGE(TAG, "Out of memory");
+
+    for (size_t i = 0; ok && i < px; i++) src[i] = (uint16_t)rng_next();
+    sync_cases_build();
+
+    static lvgl_dirty_t join, merged;
+    if (ok) {
+        printf("\n%-11s %5s %6s %6s %10s %10s %9s %9s\n", "sync", "areas", "lvgl", "merged",
+               "lvgl B", "merged B", "lvgl us", "merged us");
+    }
+    for (size_t i = 0; ok && i < sizeof(s_sync_cases) / sizeof(s_sync_cases[0]); i++) {
+        const sync_case_t *c = &s_sync_cases[i];
+
+        sync_lvgl_join(c, &join);
+        lvgl_dirty_reset(&merged);
+        for (size_t k = 0; k < c->n; k++) lvgl_dirty_add(&merged, c->a[k].x1, c->a[k].y1, c->a[k].x2, c->a[k].y2);
+        lvgl_dirty_merge(&merged);
+
+        ok = sync_check(c, &merged, src, dst);
+        if (!ok) {
+            ESP_LOGE(TAG, "sync %s: merged rectangles miss an area or overrun", c->name);
+            break;
+        }
+        printf("%-11s %5u %6u %6u %10u %10u %9.1f %9.1f\n", c->name, (unsigned)c->n,
+               (unsigned)join.n, (unsigned)merged.n,
+               (unsigned)(lvgl_dirty_pixels(&join) * 2), (unsigned)(lvgl_dirty_pixels(&merged) * 2),
+               sync_us(&join, src, dst), sync_us(&merged, src, dst));
+
+        if (lvgl_dirty_pixels(&merged) > lvgl_dirty_pixels(&join)) {
+            ESP_LOGE(TAG, "sync %s: merged rectangles copy more than the LVGL join", c->name);
+            ok = false;
+        }
+    }
+
+    free(src);
+    free(dst);
+    return ok;
+}
+
+/* ---------------- UI tick ---------------- */
+
+/* The render side of ui_canmon: take_rows() into a ui_canlog history, then
+ * ui_canlog_refresh() with label updates reduced to the text copies */
+static struct {
+    char     hist[CAN_BENCH_UI_HIST][CAN_FMT_LINE_MAX];
+    uint32_t head;
+    char     row_txt[CAN_BENCH_UI_ROWS][CAN_FMT_LINE_MAX];
+    uint32_t row_idx[CAN_BENCH_UI_ROWS];
+    uint32_t pipe_drops;
+} s_ui;
+
+static void ui_hist_push(const char *txt)
+{
+    memcpy(s_ui.hist[s_ui.head % CAN_BENCH_UI_HIST], txt, CAN_FMT_LINE_MAX);
+    s_ui.head++;
+}
+
+static size_t ui_tick_model(void)
+{
+    uint32_t drops = can_pipe_get_drop_cnt();
+    uint32_t gap = drops - s_ui.pipe_drops;
+    s_ui.pipe_drops = drops;
+
+    size_t pending = can_pipe_pending();
+    const size_t taken = pending + gap;
+    if (pending + (gap > 0) > CAN_BENCH_UI_ROWS) {
+        can_pipe_release(pending - (CAN_BENCH_UI_ROWS - 1));
+        gap += (uint32_t)(pending - (CAN_BENCH_UI_ROWS - 1));
+        pending = CAN_BENCH_UI_ROWS - 1;
+    }
+    if (gap > 0) {
+        char line[CAN_FMT_LINE_MAX] = { 0 };
+        snprintf(line, sizeof(line), "... +%u frames ...", (unsigned)gap);
+        ui_hist_push(line);
+    }
+    const can_pipe_row_t *rows;
+    size_t n;
+    while (pending > 0 && (n = can_pipe_peek(&rows, pending)) > 0) {
+        for (size_t i = 0; i < n; i++) ui_hist_push(rows[i].txt);
+        can_pipe_release(n);
+        pending -= n;
+    }
+
+    const uint32_t top = s_ui.head > CAN_BENCH_UI_ROWS ? s_ui.head - CAN_BENCH_UI_ROWS : 0;
+    for (uint32_t idx = top; idx < s_ui.head; idx++) {
+        const uint32_t r = idx % CAN_BENCH_UI_ROWS;
+        if (s_ui.row_idx[r] == idx) continue;
+        memcpy(s_ui.row_txt[r], s_ui.hist[idx % CAN_BENCH_UI_HIST], CAN_FMT_LINE_MAX);
+        s_ui.row_idx[r] = idx;
+    }
+
+    /* ui_update_stats() */
+    static char stats[128];
+    snprintf(stats, sizeof(stats), "RX: %u  TX: %u  DROP: %u  LOST: %u  BATCH: %u.%u",
+             (unsigned)can_mon_get_rx_cnt(), (unsigned)can_mon_get_tx_cnt(),
+             (unsigned)can_mon_get_drop_cnt(), (unsigned)drops,
+             (unsigned)(can_mon_get_avg_batch_x10() / 10), (unsigned)(can_mon_get_avg_batch_x10() % 10));
+    return taken;
+}
+
+/* Standard 8-byte frames at a steady rate */
+static void gen_rate(bench_traffic_t *tr, uint32_t fps)
+{
+    for (size_t i = 0; i < tr->n; i++) {
+        twai_message_t *m = &tr->msgs[i];
+        memset(m, 0, sizeof(*m));
+        m->identifier = 0x100 + (rng_next() & 0x3FF);
+        m->data_length_code = 8;
+        fill_data(m);
+        tr->t_us[i] = (int64_t)i * 1000000 / fps;
+    }
+}
+
+static void bench_ui_tick(bench_traffic_t *tr, uint32_t *grp)
+{
+    static const uint32_t k_fps[] = { 1000, 5000, 10000 };
+    const size_t n_all = tr->n;
+
+    printf("\n%-8s %6s %10s %10s %10s %10s\n", "ui fps", "ticks", "rows/tick", "decode ms", "tick ms", "tick p99");
+    for (size_t f = 0; f < sizeof(k_fps) / sizeof(k_fps[0]); f++) {
+        tr->n = (size_t)k_fps[f] * CAN_BENCH_UI_SECONDS;
+        if (tr->n > n_all) tr->n = n_all;
+        s_rng = 0x2545F491u;
+        gen_rate(tr, k_fps[f]);
+        memset(&s_ui, 0, sizeof(s_ui));
+        memset(s_ui.row_idx, 0xFF, sizeof(s_ui.row_idx));
+        s_ui.pipe_drops = can_pipe_get_drop_cnt();
+
+        uint64_t decode_ns = 0, tick_ns = 0, rows = 0;
+        size_t ticks = 0, i = 0;
+        int64_t next_tick = CAN_BENCH_UI_PERIOD_MS * 1000;
+        for (int64_t ms = 1; i < tr->n; ms++) {
+            /* One RX wakeup and one decode pass per millisecond */
+            size_t k = 0;
+            while (i + k < tr->n && tr->t_us[i + k] < ms * 1000) k++;
+            if (k > 0) {
+                can_mon_push_rx_batch(&tr->msgs[i], k, s_t_offset + tr->t_us[i], s_t_offset + tr->t_us[i + k - 1]);
+                i += k;
+                uint64_t t0 = now_ns();
+                can_pipe_poll();
+                decode_ns += now_ns() - t0;
+            }
+
+            if (ms * 1000 >= next_tick) {
+                uint64_t t0 = now_ns();
+                rows += ui_tick_model();
+                uint64_t ns = now_ns() - t0;
+                tick_ns += ns;
+                grp[ticks++] = (uint32_t)ns;
+                next_tick += CAN_BENCH_UI_PERIOD_MS * 1000;
+            }
+        }
+        s_t_offset += tr->t_us[tr->n - 1] + 1;
+        drain_ring(SIZE_MAX);
+
+        if (ticks == 0) continue;
+        qsort(grp, ticks, sizeof(uint32_t), cmp_u32);
+        printf("%-8u %6u %10.1f %10.3f %10.4f %10.4f\n", (unsigned)k_fps[f], (unsigned)ticks,
+               (double)rows / ticks, decode_ns / 1e6 / ticks, tick_ns / 1e6 / ticks,
+               grp[ticks * 99 / 100] / 1e6);
+    }
+
+    tr->n = n_all;
+}
+
+/* ---------------- Driver ---------------- */
+
+void app_main(void)
+{
+    const char *csv_path = getenv("CAN_BENCH_CSV");
+    if (!csv_path) csv_path = "can_bench.csv";
+    FILE *csv = fopen(csv_path, "w");
+    if (csv) fprintf(csv, "profile,stage,frames,frames_per_s,ns_per_frame,p50_ns,p99_ns,p999_ns,drops\n");
+
+    ESP_ERROR_CHECK(can_mon_init(CAN_BENCH_RX_RING));
+    ESP_ERROR_CHECK(can_agg_init(256));
+    ESP_ERROR_CHECK(can_pipe_init(1024));
+    ESP_ERROR_CHECK(can_load_init(500000));
+    s_queue = xQueueCreate(CAN_BENCH_RX_RING, sizeof(can_evt_t));
+
+    static const size_t k_rules[] = { 1, 10, 100 };
+    can_filter_t *filters[3];
+    for (size_t i = 0; i < 3; i++) filters[i] = build_filter(k_rules[i]);
+
+    bench_traffic_t tr = {
+        .msgs = calloc(CAN_BENCH_FRAMES, sizeof(twai_message_t)),
+        .t_us = calloc(CAN_BENCH_FRAMES, sizeof(int64_t)),
+        .n    = CAN_BENCH_FRAMES,
+    };
+    bench_result_t r = {
+        .grp_ns = calloc(CAN_BENCH_FRAMES / CAN_BENCH_GROUP + 1, sizeof(uint32_t)),
+    };
+    if (!tr.msgs || !tr.t_us || !r.grp_ns || !s_queue) {
+        ESP_LOGE(TAG, "Out of memory");
+        return;
+    }
+
+    printf("%-14s %-12s %10s %8s %7s %7s %7s %7s\n",
+           "profile", "stage", "frames/s", "ns/frame", "p50", "p99", "p999", "drops");
+
+    /* Capture stays on once enabled, so every profile runs without it first */
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            esp_err_t err = can_mon_capture_init((size_t)CAN_BENCH_CAPTURE_MB << 20, CAN_MON_CAP_OVERWRITE_OLDEST);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Capture store: %s", esp_err_to_name(err));
+                break;
+            }
+        }
+
+        for (size_t p = 0; p < sizeof(k_profiles) / sizeof(k_profiles[0]); p++) {
+            s_rng = 0x2545F491u + (uint32_t)p;
+            k_profiles[p].gen(&tr);
+
+#define RUN(_stage, _call)                                       \
+            do {                                                 \
+                r.n_grp = 0; r.total_ns = 0; r.frames = 0; r.drops = 0; \
+                _call;                                           \
+                report(csv, k_profiles[p].name, _stage, &r);     \
+            } while (0)
+
+            if (pass == 1) {
+                RUN("capture", stage_push(&tr, CAN_BENCH_GROUP, &r));
+                continue;
+            }
+            RUN("queue", stage_queue(&tr, &r));
+            RUN("push", stage_push(&tr, CAN_BENCH_GROUP, &r));
+            RUN("push_1", stage_push(&tr, 1, &r));
+            RUN("format", stage_format(&tr, &r));
+            RUN("format_ref", stage_format_ref(&tr, &r));
+            RUN("decode", stage_decode(&tr, &r));
+            for (size_t i = 0; i < 3; i++) {
+                if (!filters[i]) continue;
+                char name[16];
+                snprintf(name, sizeof(name), "filter_%u", (unsigned)k_rules[i]);
+                RUN(name, stage_filter(&tr, filters[i], &r));
+            }
+            RUN("agg", stage_agg(&tr, &r));
+#undef RUN
+        }
+    }
+
+    if (csv) {
+        fclose(csv);
+        printf("CSV: %s\n", csv_path);
+    }
+    for (size_t i = 0; i < 3; i++) can_filter_free(filters[i]);
+
+    bool ok = s_format_ok;
+    ok = bench_rotate() && ok;
+    ok = bench_sync() && ok;
+    bench_ui_tick(&tr, r.grp_ns);
+
+    free(tr.msgs);
+    free(tr.t_us);
+    free(r.grp_ns);
+    exit(ok ? 0 : 1);
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "can_bus.h"
+#include "can_vbus.h"
+#include "can_mon.h"
+#include "can_agg.h"
+#include "can_pipe.h"
+#include "can_load.h"
+#include "can_tx.h"
+#include "can_sup.h"
+#include "can_lat.h"
+
+#define TAG "main_host"
+
+/*
+ * Host entry point (linux target): the CAN pipeline without display or TWAI.
+ * Node 0 of the virtual bus stands in for the controller; node 1 plays a
+ * busy ECU. The run is paced by the real-time bus clock, so the counters it
+ * prints are comparable with the board.
+ */
+
+/* -------- Configuration knobs -------- */
+#ifndef CAN_MON_RX_QUEUE_LEN
+#define CAN_MON_RX_QUEUE_LEN  1024
+#endif
+
+#ifndef CAN_AGG_MAX_IDS
+#define CAN_AGG_MAX_IDS       256
+#endif
+
+#ifndef CAN_RX_TASK_STACK
+#define CAN_RX_TASK_STACK     4096
+#endif
+
+#ifndef CAN_RX_TASK_PRIO
+#define CAN_RX_TASK_PRIO      10
+#endif
+
+#ifndef CAN_SUP_TASK_PRIO
+#define CAN_SUP_TASK_PRIO     11
+#endif
+
+#ifndef CAN_TX_TASK_PRIO
+#define CAN_TX_TASK_PRIO      9
+#endif
+
+#ifndef CAN_PIPE_TASK_PRIO
+#define CAN_PIPE_TASK_PRIO    4
+#endif
+
+#ifndef CAN_VBUS_CLOCK_PRIO
+#define CAN_VBUS_CLOCK_PRIO   12    /* the bus runs ahead of everyone on it */
+#endif
+
+#ifndef HOST_RUN_S
+#define HOST_RUN_S            10
+#endif
+
+#ifndef HOST_BURST
+#define HOST_BURST            8     /* ECU frames queued every 10 ms */
+#endif
+
+void app_main(void)
+{
+    ESP_ERROR_CHECK(can_vbus_init(NULL));
+    ESP_ERROR_CHECK(can_bus_init(&can_vbus_bus, NULL));
+
+    int ecu = can_vbus_add_node(can_bus_get_bitrate(), TWAI_MODE_NORMAL);
+    if (ecu < 0) {
+        ESP_LOGE(TAG, "No room for a virtual node");
+        return;
+    }
+
+    ESP_ERROR_CHECK(can_mon_init(CAN_MON_RX_QUEUE_LEN));
+    if (can_agg_init(CAN_AGG_MAX_IDS) != ESP_OK) {
+        ESP_LOGW(TAG, "ID table disabled");
+    }
+    ESP_ERROR_CHECK(can_load_init(can_bus_get_bitrate()));
+    ESP_ERROR_CHECK(can_pipe_init(CONFIG_CAN_PIPE_ROWS));
+    ESP_ERROR_CHECK(can_pipe_start(CAN_PIPE_TASK_PRIO, 0));
+
+    xTaskCreatePinnedToCore(can_mon_rx_task, "can_rx_task", CAN_RX_TASK_STACK,
+                            NULL, CAN_RX_TASK_PRIO, NULL, 0);
+    ESP_ERROR_CHECK(can_sup_start(CAN_SUP_TASK_PRIO, 0));
+    ESP_ERROR_CHECK(can_tx_init());
+    ESP_ERROR_CHECK(can_tx_start(CAN_TX_TASK_PRIO, 0));
+    ESP_ERROR_CHECK(can_vbus_clock_start(CAN_VBUS_CLOCK_PRIO, 0));
+
+    /* A mixed standard/extended pattern from the ECU; what its TX queue
+     * cannot take is retried next round */
+    uint32_t seq = 0;
+    for (int s = 0; s < HOST_RUN_S; s++) {
+        for (int i = 0; i < 100; i++) {
+            for (int k = 0; k < HOST_BURST; k++) {
+                twai_message_t m = {
+                    .identifier = 0x100 + (seq % 64),
+                    .data_length_code = 8,
+                };
+                if (seq & 1) {
+                    m.flags = TWAI_MSG_FLAG_EXTD;
+                    m.identifier = 0x18FEF100 | (seq & 0xFF);
+                }
+                for (int b = 0; b < 8; b++) m.data[b] = (uint8_t)(seq >> (8 * (b & 3)));
+                if (can_vbus_node_tx(ecu, &m) != ESP_OK) break;
+                seq++;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        /* Take the formatted rows like the UI would */
+        const can_pipe_row_t *rows;
+        size_t n;
+        while ((n = can_pipe_peek(&rows, 256)) > 0) can_pipe_release(n);
+
+        can_load_stats_t ls;
+        can_load_get(&ls, esp_timer_get_time());
+        printf("t=%ds rx=%u drop=%u rows dropped=%u ids=%u fps=%u load=%u.%u%% batch=%u.%u\n", s + 1,
+               (unsigned)can_mon_get_rx_cnt(), (unsigned)can_mon_get_drop_cnt(),
+               (unsigned)can_pipe_get_drop_cnt(), (unsigned)can_agg_count(),
+               (unsigned)ls.fps_1s, ls.load_1s_x10 / 10, ls.load_1s_x10 % 10,
+               (unsigned)(can_mon_get_avg_batch_x10() / 10), (unsigned)(can_mon_get_avg_batch_x10() % 10));
+    }
+
+    /* No UI here, so tick, flush and e2e stay empty */
+    static char lat[1024];
+    can_lat_format(lat, sizeof(lat));
+    fputs(lat, stdout);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+
+#include "can_rec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-ID aggregation ("fixed view").
+ *
+ * An open-addressing hash table keyed by identifier + EXTD (+ direction, so
+ * our own TX frames do not disturb the period of the same RX ID). Entries are
+ * numbered densely in first-seen order and never move, so a view can bind a
+ * row to an entry index once. Every update marks its entry dirty; readers take
+ * dirty entries, which makes render cost depend on the number of distinct IDs
+ * that changed, not on the bus frame rate.
+ *
+ * can_agg_update() may be called from several tasks; entries are guarded by a
+ * spinlock held for O(1) work.
+ */
+
+/* Key bits, same layout as can_rec_t.id_flags */
+#define CAN_AGG_KEY(id, extd, tx) \
+    (((id) & CAN_REC_ID_MASK) | ((extd) ? CAN_REC_F_EXTD : 0) | ((tx) ? CAN_REC_F_TX : 0))
+
+typedef struct {
+    uint32_t key;        /* identifier | CAN_REC_F_EXTD | CAN_REC_F_TX */
+    uint32_t count;      /* frames seen */
+    int64_t  last_us;    /* timestamp of the latest frame */
+    uint32_t period_us;  /* smoothed inter-arrival time, 0 until the second frame */
+    uint8_t  dlc;
+    bool     rtr;
+    uint8_t  chg_mask;   /* bit i: data[i] changed since the entry was last taken */
+    uint8_t  data[8];    /* latest payload */
+} can_agg_entry_t;
+
+/* Allocate room for max_ids distinct IDs (at most 65535) */
+esp_err_t can_agg_init(size_t max_ids);
+
+/* Forget all IDs; bumps can_agg_generation() so views rebind their rows */
+void can_agg_clear(void);
+
+/* Account one frame */
+void can_agg_update(bool is_tx, const twai_message_t *m, int64_t t_us);
+
+/* Number of entries (valid indices are 0 .. count-1) */
+size_t can_agg_count(void);
+
+/* Changes whenever entry indices are invalidated by can_agg_clear() */
+uint32_t can_agg_generation(void);
+
+/* Frames not aggregated because the table was full */
+uint32_t can_agg_get_overflow_cnt(void);
+
+/*
+ * Copy entry idx into *out if it changed since it was last taken (or always,
+ * when force is set) and clear its dirty bit and changed-byte mask.
+ * Returns false when nothing was copied.
+ */
+bool can_agg_take(size_t idx, can_agg_entry_t *out, bool force);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bit rate / mode switching and auto-baud.
+ *
+ * can_baud_set() reconfigures the controller at runtime; the RX, TX and
+ * supervisor tasks keep running across the reinstall and the bus load meter
+ * follows the new rate. can_baud_detect() listens at each candidate rate in
+ * listen-only mode, so nothing is ever driven onto an unknown bus, and locks
+ * on the first rate that receives frames without a single bus error. A wrong
+ * rate shows up as bus errors within a few frames, so most candidates are
+ * rejected long before their dwell time is up.
+ */
+
+#ifndef CAN_BAUD_DWELL_MS
+#define CAN_BAUD_DWELL_MS     250   /* per candidate; longer than the slowest expected frame period */
+#endif
+
+#ifndef CAN_BAUD_POLL_MS
+#define CAN_BAUD_POLL_MS      5     /* status poll; whole ticks, at least one */
+#endif
+
+#ifndef CAN_BAUD_MIN_FRAMES
+#define CAN_BAUD_MIN_FRAMES   2     /* error-free frames needed to lock */
+#endif
+
+typedef struct {
+    uint32_t bitrate;         /* locked rate, 0 if none matched */
+    uint32_t tried;           /* candidates listened to */
+    uint32_t frames;          /* frames seen at the locked rate */
+    uint32_t scan_ms;         /* whole scan, including the final switch */
+    uint32_t switch_max_us;   /* slowest driver reinstall during the scan */
+} can_baud_result_t;
+
+/* Reconfigure bit rate and mode (timing NULL: standard timing for bitrate) */
+esp_err_t can_baud_set(uint32_t bitrate, const twai_timing_config_t *timing, twai_mode_t mode);
+
+/*
+ * Scan rates[0..n) (NULL: 500k, 250k, 125k, 1M, 800k, 100k, 50k), dwell_ms
+ * each (0: CAN_BAUD_DWELL_MS), and switch to the first match in lock_mode.
+ * Without a match the previous rate and mode are restored and
+ * ESP_ERR_NOT_FOUND returned. Blocks for the whole scan: call it from a
+ * worker task, not from the LVGL task. out may be NULL.
+ */
+esp_err_t can_baud_detect(const uint32_t *rates, size_t n, uint32_t dwell_ms,
+                          twai_mode_t lock_mode, can_baud_result_t *out);
+
+#ifdef __cplusplus
+}
+#endif
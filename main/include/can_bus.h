@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CAN backend interface.
+ *
+ * The monitor pipeline (RX task, TX worker, supervisor, auto-baud, filters)
+ * talks to the bus only through can_bus_*(), which forward to the backend
+ * chosen at can_bus_init(): the TWAI controller on the board
+ * (waveshare_twai_bus) or the in-process virtual bus (can_vbus_bus) on the
+ * host. Frames, alerts and status keep the TWAI driver's types and meanings,
+ * so a backend behaves like the driver as seen through waveshare_twai_port.
+ *
+ * Bit rate and mode are tracked here; the RX frame count, reconfiguration
+ * time and reinstall count are measured here too, so they mean the same for
+ * every backend.
+ */
+
+typedef struct {
+    uint32_t             bitrate;   /* bit/s; what the load meter and auto-baud see */
+    twai_mode_t          mode;
+    bool                 custom;    /* use timing; otherwise the standard timing for bitrate */
+    twai_timing_config_t timing;
+} can_bus_cfg_t;
+
+/* Default: 500 kbit/s, no-ACK */
+#define CAN_BUS_CFG_DEFAULT()  ((can_bus_cfg_t){ .bitrate = 500000, .mode = TWAI_MODE_NO_ACK })
+
+/*
+ * Backend operations. Only rx() and alerts() may block, and only up to their
+ * timeout; everything else returns at once. tx() reports a full queue or a
+ * reconfiguration in progress as ESP_ERR_TIMEOUT.
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*start)(const can_bus_cfg_t *cfg);      /* bring the bus up */
+    esp_err_t (*stop)(void);
+    esp_err_t (*reconfigure)(const can_bus_cfg_t *cfg);
+    esp_err_t (*set_filter)(const twai_filter_config_t *f);
+    esp_err_t (*tx)(const twai_message_t *m);
+    esp_err_t (*rx)(twai_message_t *m, TickType_t timeout_ticks);
+    int       (*rx_batch)(twai_message_t *out, int max);
+    esp_err_t (*alerts)(uint32_t *alerts, TickType_t timeout_ticks);
+    esp_err_t (*status)(twai_status_info_t *out);
+    esp_err_t (*recover)(void);                        /* start bus-off recovery */
+    esp_err_t (*resume)(void);                         /* restart after recovery */
+    esp_err_t (*reset)(void);                          /* full reinit, same settings */
+} can_bus_ops_t;
+
+/* Select the backend and start it with cfg (NULL: CAN_BUS_CFG_DEFAULT()) */
+esp_err_t can_bus_init(const can_bus_ops_t *ops, const can_bus_cfg_t *cfg);
+esp_err_t can_bus_deinit(void);
+bool      can_bus_is_started(void);
+const char *can_bus_name(void);
+
+/* Standard timing for 50k/100k/125k/250k/500k/800k/1M; false otherwise */
+bool can_bus_timing_for(uint32_t bitrate, twai_timing_config_t *out);
+
+/* Change bit rate/mode while the pipeline keeps running */
+esp_err_t can_bus_reconfigure(const can_bus_cfg_t *cfg);
+void      can_bus_get_cfg(can_bus_cfg_t *out);
+uint32_t  can_bus_get_bitrate(void);
+
+/* Duration of the last reconfiguration in us; max_us gets the longest */
+uint32_t can_bus_get_switch_us(uint32_t *max_us);
+
+/*
+ * Bumped before and after every start, stop, reconfiguration, filter change
+ * and reset, so it is odd while one runs. Frames queued in the driver and its
+ * status counters may not survive a change of this value.
+ */
+uint32_t can_bus_get_reinstalls(void);
+
+esp_err_t can_bus_set_filter(const twai_filter_config_t *f);
+
+esp_err_t can_bus_tx(const twai_message_t *m);
+esp_err_t can_bus_rx(twai_message_t *m, TickType_t timeout_ticks);
+int       can_bus_rx_batch(twai_message_t *out, int max);
+
+/* Frames handed out by rx/rx_batch since boot (wraps) */
+uint32_t can_bus_get_rx_count(void);
+
+/* Wait for TWAI_ALERT_* bits; one reader at a time */
+esp_err_t can_bus_read_alerts(uint32_t *alerts, TickType_t timeout_ticks);
+esp_err_t can_bus_get_status(twai_status_info_t *out);
+
+esp_err_t can_bus_recover(void);
+esp_err_t can_bus_resume(void);
+esp_err_t can_bus_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Serial console (esp_console REPL on the default console port).
+ *
+ *   gen start [-r fps | -l pct] [-i id|lo-hi] [--rand] [-x] [-d dlc] [-t ms] [-s]
+ *   gen stop
+ *   gen stat
+ *   lat [reset]         latency histograms (can_lat)
+ *   sys                 task CPU/stack and heap (sys_diag)
+ *   cap                 capture store fill and drops
+ *   cap dump [n]        next n frames (default 100) from the capture store
+ *   cap rewind|clear
+ *   cap policy <overwrite|stop|drop>
+ *   hwf [std|ext] <id|lo-hi>...   acceptance filter for these IDs (can_hwf)
+ *   hwf off
+ *   filter "<rules>"    compile and install RX rules (can_filter)
+ *   filter off          remove them
+ *   filter              frames the rules dropped
+ *   sched               cyclic messages added here, with send stats (can_sched)
+ *   sched add <id> <ms> [hexdata]
+ *   sched rm <n>
+ *   sched period <n> <ms>
+ *   sup                 error state, counters, bus-off recoveries (can_sup)
+ *   sup series [n]      last n TEC/REC samples (default 40)
+ *   baud                bit rate, mode and reconfigure time
+ *   baud set <rate>[k] [normal|noack|listen]
+ *   baud detect [dwell_ms]   auto-baud over the standard rates (can_baud)
+ *
+ * -d takes one DLC ("8"), a uniform range ("0-8") or weights ("0:1,8:3").
+ * With -i lo-hi the IDs count up through the range, or are random with --rand.
+ * 'cap dump' keeps its cursor between calls and starts at the oldest record
+ * after rewind, clear or a policy change; with the drop policy each dump
+ * frees what it printed. hwf takes standard IDs until 'ext' switches to
+ * 29-bit ones (and 'std' back), and prints the pass-through it expects.
+ * A filter that does not compile prints the column and reason and leaves
+ * the old one.
+ * 'sched add' prints the row number rm and period take; IDs above 0x7FF go
+ * out extended, and the first send is staggered after the others.
+ * 'baud detect' blocks the console for the scan and keeps the current mode.
+ */
+
+/* Register the commands and start the REPL task */
+esp_err_t can_console_start(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compiled software filter / trigger rules, evaluated in the RX task before
+ * frames enter the monitor rings.
+ *
+ * A program is a list of rules separated by ';' or newlines:
+ *
+ *   [pass|trig] EXPR
+ *
+ *   EXPR  := TERM  { ("||" | "or")  TERM }
+ *   TERM  := UNARY { ("&&" | "and") UNARY }
+ *   UNARY := ("!" | "not") UNARY | "(" EXPR ")" | COND
+ *   COND  := "id" HEX                 exact ID; 'x' hex digits are wildcards (0x18FEA8xx)
+ *          | "id" NUM "/" MASK        (id & MASK) == NUM
+ *          | "id" NUM "-" NUM         inclusive range
+ *          | "id" CMP NUM
+ *          | "dlc" CMP NUM
+ *          | "d0".."d7" ["&" MASK] CMP NUM    payload byte (false if beyond DLC)
+ *          | "ext" | "std" | "rtr" | "data"
+ *   CMP   := "==" | "!=" | "<" | "<=" | ">" | ">="
+ *
+ * e.g.  "ext && id 0x18FEA8xx && d0 & 0x0F == 2; trig id 0x7DF"
+ *
+ * Numbers are 32-bit; NOTs and parentheses nest at most CAN_FILTER_MAX_DEPTH deep.
+ *
+ * A frame is kept if there are no pass rules or any pass rule matches.
+ * Every matching trig rule fires the trigger callback. Rules compile to a
+ * branch program (short-circuit AND/OR as jumps). Rules that pin the ID to a
+ * few values are indexed by ID - a 2048-bit bitmap for 11-bit IDs and a
+ * hashed set for 29-bit IDs - so a frame only runs the rules that can match.
+ */
+
+#ifndef CAN_FILTER_MAX_RULES
+#define CAN_FILTER_MAX_RULES  256
+#endif
+
+#ifndef CAN_FILTER_MAX_DEPTH
+#define CAN_FILTER_MAX_DEPTH  32     /* NOTs and parentheses open at once */
+#endif
+
+typedef struct can_filter can_filter_t;
+
+/* Called from the RX task for each matching trig rule (index in source order) */
+typedef void (*can_filter_trig_cb_t)(uint16_t rule, const twai_message_t *m, void *ctx);
+
+/*
+ * Compile src. On a syntax error returns ESP_ERR_INVALID_ARG and, if err is
+ * given, a message like "col 12: expected CMP".
+ */
+esp_err_t can_filter_compile(const char *src, can_filter_t **out, char *err, size_t err_sz);
+
+void   can_filter_free(can_filter_t *f);
+size_t can_filter_rule_count(const can_filter_t *f);
+
+/* True if f keeps m; fires triggers */
+bool can_filter_eval(const can_filter_t *f, const twai_message_t *m);
+
+/* can_filter_eval() over a batch; drops rejected frames in place, returns the count kept */
+size_t can_filter_batch(const can_filter_t *f, twai_message_t *msgs, size_t n);
+
+void can_filter_set_trigger_cb(can_filter_trig_cb_t cb, void *ctx);
+
+/*
+ * Hand a compiled program to the RX path (takes ownership; NULL removes the
+ * filter). The RX task switches to it at its next batch and frees the old one.
+ */
+void can_filter_set(can_filter_t *f);
+
+/* RX task side: apply the current program to a batch */
+size_t can_filter_rx(twai_message_t *msgs, size_t n);
+
+/* Frames dropped by can_filter_rx() */
+uint32_t can_filter_get_drop_cnt(void);
+
+#ifdef __cplusplus
+}
+#endif
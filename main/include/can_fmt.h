@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "can_rec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest line can_fmt_line() can produce, including the NUL:
+ * "TX ID=1FFFFFFF DLC=255 DATA=00 11 22 33 44 55 66 77 " + '\0' */
+#define CAN_FMT_LINE_MAX  64
+
+/*
+ * Format one event as
+ *   "RX ID=123 DLC=2 DATA=01 02" / "TX ID=18FEA831 DLC=0 RTR"
+ * into out (at least CAN_FMT_LINE_MAX bytes). NUL-terminates and returns the
+ * length. Output matches the former snprintf-based format_can_line().
+ * Bus events come out as "BUS ERR-PASSIVE TEC=128 REC=0".
+ */
+size_t can_fmt_line(char *out, const can_evt_t *e);
+
+/*
+ * Format events into one contiguous buffer, one line per event, each
+ * terminated by '\n'. Stops early when the next line might not fit.
+ * *n_done (optional) receives the number of events formatted.
+ * Returns bytes written, excluding the final NUL.
+ */
+size_t can_fmt_batch(char *out, size_t out_sz, const can_evt_t *evts, size_t n, size_t *n_done);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Synthetic traffic generator.
+ *
+ * A run pre-builds CAN_GEN_BATCH frames from the ID pattern and DLC weights
+ * and replays them in a loop straight into the driver's TX queue, around the
+ * can_tx worker: the worker waits for one completion per frame, which would
+ * leave gaps on the bus. The generator task tops the queue up whenever the
+ * supervisor forwards a TX completion, so at rate 0 frames go back-to-back.
+ * A target rate (or bus load) is paced against esp_timer time with at most
+ * one batch of catch-up.
+ *
+ * Achieved rate and error/arbitration counts come from the controller
+ * status, relative to the start of the run. Generated frames are not logged
+ * in the monitor rings. The driver queue belongs to the run: can_tx refuses
+ * submits and holds its queue while can_gen_is_running(), and a run starts
+ * filling the queue only once can_tx's frames in flight have completed.
+ */
+
+#ifndef CAN_GEN_BATCH
+#define CAN_GEN_BATCH          256    /* pre-built frames, replayed in a loop */
+#endif
+
+#ifndef CAN_GEN_STATS_MS
+#define CAN_GEN_STATS_MS       250    /* achieved-rate window */
+#endif
+
+typedef enum {
+    CAN_GEN_ID_FIXED = 0,    /* id_lo only */
+    CAN_GEN_ID_SEQ,          /* id_lo, id_lo + 1, ... id_hi, wrapping */
+    CAN_GEN_ID_RANDOM,       /* uniform in [id_lo, id_hi] */
+} can_gen_id_mode_t;
+
+typedef struct {
+    can_gen_id_mode_t id_mode;
+    uint32_t id_lo;
+    uint32_t id_hi;
+    bool     ext;            /* 29-bit identifiers */
+    uint8_t  dlc_weight[9];  /* relative weight of DLC 0..8; all zero means DLC 8 */
+    uint32_t rate_fps;       /* target frames/s; 0 uses load_pct */
+    uint8_t  load_pct;       /* target bus load when rate_fps is 0; 0 = back-to-back */
+    uint32_t duration_ms;    /* 0 runs until can_gen_stop() */
+    bool     seq_payload;    /* bytes 0..3 carry a running counter (DLC permitting) */
+    uint32_t seed;           /* payload/ID/DLC PRNG; 0 picks 1 */
+} can_gen_cfg_t;
+
+/* 8-byte frames from one standard ID, back-to-back */
+#define CAN_GEN_CFG_DEFAULT()                  \
+    (can_gen_cfg_t){                           \
+        .id_mode = CAN_GEN_ID_FIXED,           \
+        .id_lo   = 0x100,                      \
+        .id_hi   = 0x100,                      \
+    }
+
+typedef struct {
+    bool     running;
+    uint32_t target_fps;     /* 0 for back-to-back */
+    uint32_t achieved_fps;   /* last CAN_GEN_STATS_MS window */
+    uint32_t avg_fps;        /* whole run */
+    uint32_t load_x10;       /* bus load of the frames sent, last window */
+    uint32_t queued;         /* accepted by the driver */
+    uint32_t sent;           /* on the bus: queued minus pending minus failed */
+    uint32_t queue_full;     /* top-ups stopped by a full driver queue */
+    uint32_t arb_lost;       /* since the run started */
+    uint32_t bus_errors;
+    uint32_t tx_failed;
+    uint32_t elapsed_ms;
+    esp_err_t last_err;      /* why the run ended early, ESP_OK otherwise */
+} can_gen_stats_t;
+
+/* Create the generator task (idle until a run starts) */
+esp_err_t can_gen_init(UBaseType_t prio, BaseType_t core);
+
+/* Build the batch and start a run; ESP_ERR_INVALID_STATE if one is active */
+esp_err_t can_gen_start(const can_gen_cfg_t *cfg);
+void      can_gen_stop(void);
+bool      can_gen_is_running(void);
+
+void can_gen_get_stats(can_gen_stats_t *out);
+
+/* Supervisor side: hand over the TWAI_ALERT_* bits just read */
+void can_gen_on_alerts(uint32_t alerts);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * TWAI acceptance filter synthesis.
+ *
+ * Given the IDs and ID ranges we care about, pick the single- or dual-filter
+ * acceptance code/mask that lets all of them through with the fewest other
+ * IDs, and keep an exact second-stage set that removes what the hardware
+ * filter could not. Cost is measured as the fraction of each ID space
+ * (2^11 standard, 2^29 extended) passed that is not wanted.
+ */
+
+#ifndef CAN_HWF_MAX_RANGES
+#define CAN_HWF_MAX_RANGES  64
+#endif
+
+typedef struct {
+    uint32_t lo;     /* first ID */
+    uint32_t hi;     /* last ID, inclusive (lo for a single ID) */
+    bool     extd;   /* 29-bit IDs */
+} can_hwf_range_t;
+
+#define CAN_HWF_ID(_id, _ext)          ((can_hwf_range_t){ (_id), (_id), (_ext) })
+#define CAN_HWF_RANGE(_lo, _hi, _ext)  ((can_hwf_range_t){ (_lo), (_hi), (_ext) })
+
+typedef struct {
+    twai_filter_config_t hw;
+    uint32_t want_std;          /* distinct IDs asked for */
+    uint32_t want_ext;
+    uint32_t pass_std;          /* IDs the hardware lets through (expected, data frames) */
+    uint32_t pass_ext;
+    uint16_t std_ratio_x1000;   /* wanted share of what passes, 1000 = no false positives */
+    uint16_t ext_ratio_x1000;
+} can_hwf_result_t;
+
+/* Compute a filter for ids[0..n). n == 0 yields accept-all. */
+esp_err_t can_hwf_synth(const can_hwf_range_t *ids, size_t n, can_hwf_result_t *out);
+
+/* Model of the TWAI acceptance filter: true if f lets m through */
+bool can_hwf_hw_accepts(const twai_filter_config_t *f, const twai_message_t *m);
+
+/*
+ * Synthesize, install the second stage and reinstall the driver with the
+ * hardware filter. n == 0 goes back to accept-all. out may be NULL.
+ * Call from one task at a time.
+ */
+esp_err_t can_hwf_apply(const can_hwf_range_t *ids, size_t n, can_hwf_result_t *out);
+
+/* Second stage: true if m is wanted (or no filter is applied) */
+bool can_hwf_match(const twai_message_t *m);
+
+/* Second stage over a batch: drops unwanted frames in place, returns the count kept */
+size_t can_hwf_filter(twai_message_t *msgs, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
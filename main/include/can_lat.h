@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pipeline latency histograms.
+ *
+ * One log2 histogram per stage, bucket b counting samples in [2^b, 2^(b+1))
+ * ns (bucket 0 also takes 0). Recording is a count-leading-zeros and three
+ * increments under a spinlock; nothing is allocated. Stages, in frame order:
+ *
+ *   wake    supervisor sees RX_DATA -> RX task starts reading the driver
+ *   rx      RX task read -> batch filtered and in the ring (per batch)
+ *   queue   frame timestamp -> taken off the ring by the decode stage (per frame)
+ *   format  can_fmt_line() in the decode stage, mean per line of a batch
+ *   tick    one ui_tick_cb() run
+ *   flush   one LVGL flush callback
+ *   e2e     oldest row taken by a tick -> the next flush completes
+ *
+ * The first stamp is the alert, not the controller: time a frame spends in
+ * the driver queue before RX_DATA is read is not visible here.
+ */
+
+#ifndef CAN_LAT_BUCKETS
+#define CAN_LAT_BUCKETS  32    /* up to ~4.3 s */
+#endif
+
+typedef enum {
+    CAN_LAT_WAKE = 0,
+    CAN_LAT_RX,
+    CAN_LAT_QUEUE,
+    CAN_LAT_FORMAT,
+    CAN_LAT_TICK,
+    CAN_LAT_FLUSH,
+    CAN_LAT_E2E,
+    CAN_LAT_STAGE_COUNT,
+} can_lat_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_ns;
+    uint64_t sum_ns;
+    uint32_t bucket[CAN_LAT_BUCKETS];
+} can_lat_hist_t;
+
+void can_lat_record_ns(can_lat_stage_t stage, uint32_t ns);
+
+static inline void can_lat_record_us(can_lat_stage_t stage, int64_t us)
+{
+    if (us < 0) us = 0;
+    can_lat_record_ns(stage, us >= 4294967 ? UINT32_MAX : (uint32_t)us * 1000u);
+}
+
+void can_lat_get(can_lat_stage_t stage, can_lat_hist_t *out);
+void can_lat_reset(void);
+
+const char *can_lat_stage_name(can_lat_stage_t stage);
+
+/* Upper edge of the bucket holding the per_mille quantile, 0 if empty */
+uint32_t can_lat_pct_ns(const can_lat_hist_t *h, uint32_t per_mille);
+
+/*
+ * End-to-end: the UI tick marks the timestamp of the oldest frame it drained,
+ * the flush callback closes it once the last area of a refresh is out. Both
+ * run on the LVGL task.
+ */
+void can_lat_e2e_mark(int64_t frame_us);
+void can_lat_e2e_flushed(int64_t now_us);
+
+/* "123.4us" / "5.2ms" / "1.0s" */
+void can_lat_fmt_ns(char *out, size_t out_sz, uint32_t ns);
+
+/*
+ * Text table of all stages (count, mean, p50, p99, p99.9, max) with a 1 us -
+ * 1 s bucket strip per stage. Returns the length written.
+ */
+size_t can_lat_format(char *out, size_t out_sz);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bus load and frame-rate meter.
+ *
+ * Every frame is charged its on-wire length: SOF through CRC with stuff
+ * bits, CRC delimiter, ACK, EOF and the 3-bit intermission. Frames are
+ * binned into 100 ms buckets, from which rolling 100 ms, 1 s and 10 s
+ * windows are kept incrementally, with a peak-hold on the 100 ms window.
+ */
+
+/* Stuffing model used by can_load_update() */
+#ifndef CAN_LOAD_EXACT_STUFFING
+#define CAN_LOAD_EXACT_STUFFING  1   /* 0: assume worst-case stuffing */
+#endif
+
+typedef struct {
+    uint32_t fps_100ms;       /* frames per second over each window */
+    uint32_t fps_1s;
+    uint32_t fps_10s;
+    uint16_t load_100ms_x10;  /* bus load in 0.1 % steps */
+    uint16_t load_1s_x10;
+    uint16_t load_10s_x10;
+    uint16_t peak_load_x10;   /* highest 100 ms load since the last reset */
+    uint32_t peak_fps;        /* highest 100 ms frame rate since the last reset */
+    int64_t  peak_us;         /* end of the 100 ms bucket holding peak_load_x10 */
+} can_load_stats_t;
+
+/* Start metering at bitrate bit/s */
+esp_err_t can_load_init(uint32_t bitrate);
+
+/* Change the bit rate used for load %; windows restart */
+void can_load_set_bitrate(uint32_t bitrate);
+
+/*
+ * On-wire length of a classic CAN frame in bits, including the 3-bit
+ * intermission. exact_stuffing counts the stuff bits the frame really needs
+ * (which requires its CRC); otherwise the worst case for its length is used.
+ */
+uint32_t can_load_frame_bits(const twai_message_t *m, bool exact_stuffing);
+
+/* Account one frame seen on the bus at t_us (RX or our own TX) */
+void can_load_update(const twai_message_t *m, int64_t t_us);
+
+/* Snapshot of all windows as of now_us */
+void can_load_get(can_load_stats_t *out, int64_t now_us);
+
+void can_load_reset_peak(void);
+
+#ifdef __cplusplus
+}
+#endif
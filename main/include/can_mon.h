@@ -1,42 +1,97 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "driver/twai.h"
 
+#include "can_rec.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Event type delivered from CAN tasks to UI */
+/* Initialize event rings and counters. queue_len is rounded up to a power of two. */
+esp_err_t can_mon_init(size_t queue_len);
+
+/* Push an event (TX/RX) into the matching ring (non-blocking).
+ * RX events must come from the RX task; TX events may come from any task.
+ * Events are stored as 16-byte can_rec_t; SYNC records are inserted as needed. */
+void can_mon_push_evt(bool is_tx, const twai_message_t *m);
+
+/* ---- Producer batch API (RX task only) ----
+ * Push a burst of received frames with one commit per contiguous run.
+ * Timestamps are spread over [t_first_us, t_last_us] and stay monotonic.
+ * Frames that do not fit are counted as drops. */
+void can_mon_push_rx_batch(const twai_message_t *msgs, size_t n, int64_t t_first_us, int64_t t_last_us);
+
+/* ---- Consumer batch API (decode stage only, see can_pipe.h) ----
+ * Peek a contiguous run of up to max records in timestamp order, then release
+ * exactly the number consumed before the next peek. Returns 0 when empty.
+ * *base_us is the SYNC base for recs[0]; walk the run with can_rec_decode(). */
+size_t can_mon_peek(const can_rec_t **recs, int64_t *base_us, size_t max);
+void   can_mon_release(size_t n);
+
+/* ---- Capture store (PSRAM history) ----
+ * Every RX/TX frame is appended as a can_rec_t, independent of whether the UI
+ * keeps up with the rings. Appends are O(1), never allocate and never block.
+ * Readers iterate with their own cursor while the writer keeps going. */
+typedef enum {
+    CAN_MON_CAP_OVERWRITE_OLDEST = 0, /* flight recorder: keep the newest history */
+    CAN_MON_CAP_STOP_WHEN_FULL,       /* one-shot: freeze once full until cleared */
+    CAN_MON_CAP_DROP_NEWEST,          /* FIFO: drop new frames until a reader releases space */
+} can_mon_cap_policy_t;
+
 typedef struct {
-    int64_t        t_us;   /* esp_timer_get_time() timestamp */
-    bool           is_tx;  /* true: TX, false: RX */
-    twai_message_t msg;    /* raw TWAI message */
-} can_evt_t;
+    uint32_t pos;      /* next record index */
+    int64_t  base_us;  /* SYNC base, valid once synced */
+    bool     synced;
+    uint32_t lost;     /* records skipped because the writer overtook the cursor */
+} can_mon_cap_cursor_t;
 
-/* Initialize internal queue and counters */
-esp_err_t can_mon_init(size_t queue_len);
+/* Allocate `bytes` of PSRAM (rounded down to a power of two records) */
+esp_err_t can_mon_capture_init(size_t bytes, can_mon_cap_policy_t policy);
+/* Forget all history and re-arm a stopped capture */
+void      can_mon_capture_clear(void);
+/* Change overflow policy; also clears the store */
+void      can_mon_capture_set_policy(can_mon_cap_policy_t policy);
 
-/* Get queue handle for UI to drain events */
-QueueHandle_t can_mon_get_queue(void);
+size_t    can_mon_capture_capacity(void);   /* records */
+size_t    can_mon_capture_count(void);      /* records currently retained */
+uint32_t  can_mon_capture_get_drop_cnt(void);
+bool      can_mon_capture_is_stopped(void);
 
-/* Push an event (TX/RX) into queue (non-blocking). Safe to call from tasks. */
-void can_mon_push_evt(bool is_tx, const twai_message_t *m);
+/* Position a cursor at the oldest retained record */
+void      can_mon_capture_cursor_oldest(can_mon_cap_cursor_t *c);
+/* Decode up to max frames from the cursor; returns 0 once caught up */
+size_t    can_mon_capture_read(can_mon_cap_cursor_t *c, can_evt_t *out, size_t max);
+/* DROP_NEWEST only: free everything before the cursor for new frames */
+void      can_mon_capture_release(const can_mon_cap_cursor_t *c);
 
 /* Stats getters (atomic enough for UI reads) */
 uint32_t can_mon_get_rx_cnt(void);
 uint32_t can_mon_get_tx_cnt(void);
 uint32_t can_mon_get_drop_cnt(void);
 
+/* Average frames the RX task took from the driver per wakeup that found any,
+ * before the acceptance and software filters; times 10 (37 means 3.7) */
+uint32_t can_mon_get_avg_batch_x10(void);
+
+/* Bus event (error state change, frames lost below our rings) into the
+ * stream, timestamped now. Any task. */
+void can_mon_push_bus_evt(can_bus_evt_t code, uint32_t tec, uint32_t rec, uint32_t count);
+
 /* CAN RX task entry point */
 void can_mon_rx_task(void *arg);
 
-/* Convenience: transmit frame then push TX event if OK */
+/* Wake the RX task to drain the driver queue (supervisor, on RX_DATA) */
+void can_mon_rx_wake(void);
+
+/* Convenience: queue a frame on the TX worker (non-blocking). The TX event is
+ * pushed once the frame is on the bus. ESP_ERR_NO_MEM if the queue is full. */
 esp_err_t can_mon_send_frame(const twai_message_t *m);
 
 #ifdef __cplusplus
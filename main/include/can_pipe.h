@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "can_fmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Decode stage of the monitor pipeline.
+ *
+ *   capture (can_mon_rx_task)  driver -> filters -> capture store, load, event rings
+ *   decode  (this task)        event rings -> ID table, display rows
+ *   render  (LVGL task)        display rows -> labels
+ *
+ * The decode task is the only consumer of the can_mon rings. For every record
+ * it updates the per-ID table and formats a display row into a lock-free SPSC
+ * row ring, so the render stage only copies finished text while it holds the
+ * LVGL lock. The capture side wakes it with can_pipe_wake() after each batch;
+ * a timeout covers events that arrive without a wakeup.
+ *
+ * When the render stage falls behind, new rows are dropped and counted; the
+ * ID table and capture store still see every frame.
+ */
+
+#ifndef CAN_PIPE_BATCH
+#define CAN_PIPE_BATCH     64    /* records decoded per ring peek */
+#endif
+
+#ifndef CAN_PIPE_IDLE_MS
+#define CAN_PIPE_IDLE_MS   20    /* drain anyway if no wakeup came */
+#endif
+
+/* One pre-formatted display line */
+typedef struct {
+    int64_t t_us;                    /* frame timestamp */
+    char    txt[CAN_FMT_LINE_MAX];
+} can_pipe_row_t;
+
+/* Allocate the row ring; rows is rounded up to a power of two */
+esp_err_t can_pipe_init(size_t rows);
+
+/* Start the decode task */
+esp_err_t can_pipe_start(UBaseType_t prio, BaseType_t core);
+
+/* Wake the decode task (any task; no-op before can_pipe_start) */
+void can_pipe_wake(void);
+
+/* Called on the decode stage after it published new rows, at most once per
+ * drain. Keep it short and LVGL-free: meant to wake the render stage. */
+typedef void (*can_pipe_ready_cb_t)(void *ctx);
+void can_pipe_set_ready_cb(can_pipe_ready_cb_t cb, void *ctx);
+
+/* Run the decode stage once on the calling task instead of the decode task
+ * (host benchmarks). Returns the records consumed. */
+size_t can_pipe_poll(void);
+
+/* ---- Consumer API (render stage only) ----
+ * Peek a contiguous run of up to max rows, oldest first, then release what
+ * was consumed before the next peek. Returns 0 when empty. Releasing up to
+ * can_pipe_pending() rows without peeking them skips them unseen. */
+size_t can_pipe_peek(const can_pipe_row_t **rows, size_t max);
+void   can_pipe_release(size_t n);
+
+/* Rows waiting for the render stage (render stage only) */
+size_t can_pipe_pending(void);
+
+/* Rows dropped because the row ring was full */
+uint32_t can_pipe_get_drop_cnt(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driver/twai.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Controller state changes and losses reported by the supervisor */
+typedef enum {
+    CAN_BUS_EVT_ERR_WARN = 1,   /* an error counter crossed the warning limit */
+    CAN_BUS_EVT_ERR_PASSIVE,
+    CAN_BUS_EVT_ERR_ACTIVE,     /* back below the warning limit */
+    CAN_BUS_EVT_BUS_OFF,
+    CAN_BUS_EVT_RECOVERED,
+    CAN_BUS_EVT_RX_LOST,        /* frames lost below our rings (driver queue, HW FIFO) */
+    CAN_BUS_EVT_RX_RESUMED,     /* first frame after a bus-off; count = ms since bus-off */
+} can_bus_evt_t;
+
+typedef enum {
+    CAN_EVT_FRAME = 0,
+    CAN_EVT_BUS,
+} can_evt_kind_t;
+
+/*
+ * Decoded event handed to consumers (UI, formatters, filters).
+ * For CAN_EVT_BUS, msg.identifier holds the can_bus_evt_t, msg.data[0] and
+ * [1] the TX/RX error counters (saturated at 255) and msg.data[4..7] a
+ * little-endian count (frames for RX_LOST, ms for RX_RESUMED); see
+ * can_evt_bus_count().
+ */
+typedef struct {
+    int64_t        t_us;   /* esp_timer_get_time() timestamp */
+    bool           is_tx;  /* true: TX, false: RX */
+    uint8_t        kind;   /* can_evt_kind_t */
+    twai_message_t msg;    /* raw TWAI message */
+} can_evt_t;
+
+/*
+ * Compact 16-byte capture record used by the event rings, the capture store
+ * and any export path.
+ *
+ *   dt_kind  [27:0]  microseconds since the last SYNC record (~268 s range)
+ *            [31:28] DLC 0..8 for frames, or a CAN_REC_KIND_* marker
+ *   id_flags [28:0]  identifier
+ *            [29]    EXTD, [30] RTR, [31] TX
+ *   data[8]          payload; SYNC records carry the absolute int64 time here
+ *
+ * BUS records put the can_bus_evt_t in id_flags and TEC, REC and a count in
+ * data, laid out as in can_evt_t.
+ *
+ * A stream always starts with a SYNC record and writers re-sync at least every
+ * CAN_REC_SYNC_PERIOD_US, so a reader can start at any SYNC record.
+ */
+typedef struct {
+    uint32_t dt_kind;
+    uint32_t id_flags;
+    uint8_t  data[8];
+} can_rec_t;
+
+_Static_assert(sizeof(can_rec_t) == 16, "can_rec_t must stay 16 bytes");
+
+#define CAN_REC_DT_MASK        0x0FFFFFFFu
+#define CAN_REC_KIND_SHIFT     28
+#define CAN_REC_KIND_SYNC      0xFu        /* absolute timestamp record */
+#define CAN_REC_KIND_BUS       0xEu        /* controller state / loss event */
+
+#define CAN_REC_ID_MASK        0x1FFFFFFFu
+#define CAN_REC_F_EXTD         (1u << 29)
+#define CAN_REC_F_RTR          (1u << 30)
+#define CAN_REC_F_TX           (1u << 31)
+
+#ifndef CAN_REC_SYNC_PERIOD_US
+#define CAN_REC_SYNC_PERIOD_US 1000000     /* well inside the 28-bit delta range */
+#endif
+
+static inline uint32_t can_rec_kind(const can_rec_t *r)
+{
+    return r->dt_kind >> CAN_REC_KIND_SHIFT;
+}
+
+static inline bool can_rec_is_sync(const can_rec_t *r)
+{
+    return can_rec_kind(r) == CAN_REC_KIND_SYNC;
+}
+
+/* True when a writer whose last SYNC was at sync_us must emit a new one before t_us */
+static inline bool can_rec_needs_sync(int64_t sync_us, int64_t t_us)
+{
+    return (t_us < sync_us) || (t_us - sync_us >= CAN_REC_SYNC_PERIOD_US);
+}
+
+static inline void can_rec_encode_sync(can_rec_t *r, int64_t t_us)
+{
+    r->dt_kind  = CAN_REC_KIND_SYNC << CAN_REC_KIND_SHIFT;
+    r->id_flags = 0;
+    memcpy(r->data, &t_us, sizeof(t_us));
+}
+
+/* Encode a frame at t_us relative to the writer's last SYNC at sync_us */
+static inline void can_rec_encode(can_rec_t *r, int64_t sync_us, int64_t t_us,
+                                  bool is_tx, const twai_message_t *m)
+{
+    uint32_t dlc = m->data_length_code > 8 ? 8 : m->data_length_code;
+
+    r->dt_kind  = ((uint32_t)(t_us - sync_us) & CAN_REC_DT_MASK) | (dlc << CAN_REC_KIND_SHIFT);
+    r->id_flags = (m->identifier & CAN_REC_ID_MASK)
+                | ((m->flags & TWAI_MSG_FLAG_EXTD) ? CAN_REC_F_EXTD : 0)
+                | ((m->flags & TWAI_MSG_FLAG_RTR)  ? CAN_REC_F_RTR  : 0)
+                | (is_tx ? CAN_REC_F_TX : 0);
+    memcpy(r->data, m->data, 8);
+}
+
+/* Encode a bus event at t_us relative to the writer's last SYNC at sync_us */
+static inline void can_rec_encode_bus(can_rec_t *r, int64_t sync_us, int64_t t_us, can_bus_evt_t code,
+                                      uint32_t tec, uint32_t rec, uint32_t count)
+{
+    r->dt_kind  = ((uint32_t)(t_us - sync_us) & CAN_REC_DT_MASK) | (CAN_REC_KIND_BUS << CAN_REC_KIND_SHIFT);
+    r->id_flags = (uint32_t)code;
+    memset(r->data, 0, 8);
+    r->data[0] = (uint8_t)(tec > 255 ? 255 : tec);
+    r->data[1] = (uint8_t)(rec > 255 ? 255 : rec);
+    r->data[4] = (uint8_t)count;
+    r->data[5] = (uint8_t)(count >> 8);
+    r->data[6] = (uint8_t)(count >> 16);
+    r->data[7] = (uint8_t)(count >> 24);
+}
+
+static inline uint32_t can_evt_bus_count(const can_evt_t *e)
+{
+    const uint8_t *d = e->msg.data;
+    return (uint32_t)d[4] | ((uint32_t)d[5] << 8) | ((uint32_t)d[6] << 16) | ((uint32_t)d[7] << 24);
+}
+
+/* Absolute time of a record given the reader's current SYNC base */
+static inline int64_t can_rec_time(const can_rec_t *r, int64_t base_us)
+{
+    if (can_rec_is_sync(r)) {
+        int64_t t;
+        memcpy(&t, r->data, sizeof(t));
+        return t;
+    }
+    return base_us + (int64_t)(r->dt_kind & CAN_REC_DT_MASK);
+}
+
+/*
+ * Decode one record. SYNC records update *base_us and return false; frame
+ * and bus records fill *out and return true.
+ */
+static inline bool can_rec_decode(const can_rec_t *r, int64_t *base_us, can_evt_t *out)
+{
+    if (can_rec_is_sync(r)) {
+        *base_us = can_rec_time(r, *base_us);
+        return false;
+    }
+
+    out->t_us  = can_rec_time(r, *base_us);
+    out->is_tx = (r->id_flags & CAN_REC_F_TX) != 0;
+    memset(&out->msg, 0, sizeof(out->msg));
+
+    if (can_rec_kind(r) == CAN_REC_KIND_BUS) {
+        out->kind = CAN_EVT_BUS;
+        out->msg.identifier = r->id_flags;
+        memcpy(out->msg.data, r->data, 8);
+        return true;
+    }
+
+    out->kind = CAN_EVT_FRAME;
+    out->msg.identifier       = r->id_flags & CAN_REC_ID_MASK;
+    out->msg.data_length_code = (uint8_t)can_rec_kind(r);
+    if (r->id_flags & CAN_REC_F_EXTD) out->msg.flags |= TWAI_MSG_FLAG_EXTD;
+    if (r->id_flags & CAN_REC_F_RTR)  out->msg.flags |= TWAI_MSG_FLAG_RTR;
+    memcpy(out->msg.data, r->data, 8);
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cyclic TX scheduler.
+ *
+ * Messages sit in a two-level timer wheel with 1 ms ticks (256 x 1 ms, then
+ * 64 x 256 ms; longer periods re-cascade). Due messages move to a ready FIFO
+ * and are sent in bounded bursts, so a crowded tick delays cyclic traffic
+ * instead of starving the RX task. Deadlines advance by whole periods from
+ * the nominal start, so jitter never accumulates into drift; a message more
+ * than one period late skips the missed cycles.
+ *
+ * can_sched_run() holds all the logic and takes the time as an argument, so
+ * the scheduler can be driven without a timer (host builds, tests).
+ */
+
+#ifndef CAN_SCHED_TICK_US
+#define CAN_SCHED_TICK_US      1000
+#endif
+
+#ifndef CAN_SCHED_MAX_BURST
+#define CAN_SCHED_MAX_BURST    32     /* frames sent per wakeup */
+#endif
+
+#define CAN_SCHED_JIT_BUCKETS  12     /* [0,64) us, [64,128) us, ... , last >= 65.5 ms */
+#define CAN_SCHED_PHASE_AUTO   UINT32_MAX
+
+typedef uint32_t can_sched_handle_t;  /* 0 is never a valid handle */
+
+/* Transmit hook; must not block. ESP_OK means the frame was queued. */
+typedef esp_err_t (*can_sched_tx_fn_t)(const twai_message_t *m);
+
+typedef struct {
+    uint32_t sent;
+    uint32_t tx_fail;      /* tx hook refused the frame */
+    uint32_t missed;       /* cycles skipped because we were a full period late */
+    uint32_t jit_max_us;   /* worst send time after the nominal deadline */
+    uint32_t hist[CAN_SCHED_JIT_BUCKETS];
+} can_sched_stats_t;
+
+/* Allocate room for max_msgs cyclic messages. tx NULL queues on can_tx. */
+esp_err_t can_sched_init(size_t max_msgs, can_sched_tx_fn_t tx);
+
+/* Free the table so init can run again; ESP_ERR_INVALID_STATE once started
+ * or while messages are scheduled */
+esp_err_t can_sched_deinit(void);
+
+/* Start the scheduler task and its 1 ms esp_timer */
+esp_err_t can_sched_start(UBaseType_t prio, BaseType_t core);
+
+/*
+ * Add a cyclic message. The first send is phase_us from now; pass
+ * CAN_SCHED_PHASE_AUTO to stagger it one tick after the messages already added.
+ * Returns 0 when the table is full or the period is below one tick.
+ */
+can_sched_handle_t can_sched_add(const twai_message_t *m, uint32_t period_us, uint32_t phase_us);
+
+esp_err_t can_sched_remove(can_sched_handle_t h);
+
+/* Change the period; the next deadline is one new period after the last one */
+esp_err_t can_sched_set_period(can_sched_handle_t h, uint32_t period_us);
+
+/* Replace the payload in place; takes effect from the next send */
+esp_err_t can_sched_update_data(can_sched_handle_t h, const uint8_t *data, uint8_t dlc);
+
+esp_err_t can_sched_get_stats(can_sched_handle_t h, can_sched_stats_t *out);
+esp_err_t can_sched_reset_stats(can_sched_handle_t h);
+
+size_t can_sched_count(void);
+
+/* Advance the wheel to now_us and send up to CAN_SCHED_MAX_BURST ready frames.
+ * Returns the number of frames handed to the tx hook. */
+size_t can_sched_run(int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
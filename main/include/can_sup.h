@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CAN supervisor.
+ *
+ * The only reader of can_bus_read_alerts(). It wakes the RX task on RX_DATA,
+ * forwards TX completions to the TX worker and the traffic generator, counts
+ * frames the driver lost before we saw them (RX queue full, hardware FIFO
+ * overrun) and turns error state changes into CAN_REC_KIND_BUS events in the
+ * monitor stream.
+ *
+ * It also brings the controller back from bus-off: after a backoff it starts
+ * the recovery sequence, restarts the controller when it completes and falls
+ * back to a full driver reset if it does not. The backoff doubles when bus-off
+ * repeats within CAN_SUP_STABLE_MS, up to CAN_SUP_BACKOFF_MAX_MS, so a single
+ * attempt never keeps the monitor down for longer than
+ * CAN_SUP_BACKOFF_MAX_MS + CAN_SUP_RECOVERY_TIMEOUT_MS plus a reset. Each
+ * episode is timed from bus-off to the first frame received afterwards.
+ */
+
+#ifndef CAN_SUP_ALERT_WAIT_MS
+#define CAN_SUP_ALERT_WAIT_MS  100   /* also bounds how long a driver reinstall waits */
+#endif
+
+#ifndef CAN_SUP_POLL_MS
+#define CAN_SUP_POLL_MS        100   /* status/counter refresh while alerts keep coming */
+#endif
+
+#ifndef CAN_SUP_SAMPLE_MS
+#define CAN_SUP_SAMPLE_MS      250   /* error counter time series resolution */
+#endif
+
+#ifndef CAN_SUP_SERIES_LEN
+#define CAN_SUP_SERIES_LEN     240   /* 60 s at 250 ms */
+#endif
+
+#ifndef CAN_SUP_RECOVERY_LOG
+#define CAN_SUP_RECOVERY_LOG   8     /* recovery episodes kept */
+#endif
+
+#ifndef CAN_SUP_BACKOFF_MIN_MS
+#define CAN_SUP_BACKOFF_MIN_MS       50
+#endif
+
+#ifndef CAN_SUP_BACKOFF_MAX_MS
+#define CAN_SUP_BACKOFF_MAX_MS       2000
+#endif
+
+#ifndef CAN_SUP_RECOVERY_TIMEOUT_MS
+#define CAN_SUP_RECOVERY_TIMEOUT_MS  1000  /* recovery sequence, then a driver reset */
+#endif
+
+#ifndef CAN_SUP_RX_WAIT_MS
+#define CAN_SUP_RX_WAIT_MS           5000  /* how long to wait for traffic after a restart */
+#endif
+
+#ifndef CAN_SUP_STABLE_MS
+#define CAN_SUP_STABLE_MS            10000 /* bus-off after this long starts at the minimum backoff */
+#endif
+
+typedef struct {
+    twai_state_t state;
+    uint32_t tec;              /* TX error counter */
+    uint32_t rec;              /* RX error counter */
+    bool     err_warn;         /* above the warning limit */
+    bool     err_passive;
+    uint32_t rx_missed;        /* driver RX queue full: frames dropped below our rings */
+    uint32_t rx_overrun;       /* hardware RX FIFO overrun */
+    uint32_t bus_errors;
+    uint32_t arb_lost;
+    uint32_t tx_failed;
+    uint32_t err_passive_cnt;  /* transitions into error passive */
+    uint32_t bus_off_cnt;
+    uint32_t recoveries;       /* completed recovery episodes */
+    uint32_t resets;           /* driver reinstalls after a stuck recovery */
+    bool     recovering;       /* a recovery episode is in progress */
+} can_sup_stats_t;
+
+/* One point of the error counter time series */
+typedef struct {
+    uint32_t t_ms;             /* esp_timer time / 1000 */
+    uint8_t  tec;              /* saturated at 255 (bus-off reads 255) */
+    uint8_t  rec;
+    uint8_t  state;            /* twai_state_t */
+    uint8_t  reserved;
+    uint32_t bus_errors;       /* bus errors since the previous sample */
+} can_sup_sample_t;
+
+/* One bus-off episode */
+typedef struct {
+    int64_t  t_off_us;         /* bus-off seen */
+    uint32_t restart_ms;       /* bus-off to controller running again */
+    uint32_t rx_ms;            /* bus-off to the first frame received; 0 if none came */
+    uint8_t  attempts;         /* recovery sequences started */
+    bool     full_reset;       /* needed a driver reinstall */
+} can_sup_recovery_t;
+
+/* Start the supervisor task */
+esp_err_t can_sup_start(UBaseType_t prio, BaseType_t core);
+
+void can_sup_get_stats(can_sup_stats_t *out);
+
+/* Frames lost below our rings (driver queue + hardware FIFO) */
+uint32_t can_sup_get_lost_cnt(void);
+
+/* Copy up to max of the newest samples, oldest first; returns the count */
+size_t can_sup_get_series(can_sup_sample_t *out, size_t max);
+
+/* Copy up to max of the newest recovery episodes, oldest first */
+size_t can_sup_get_recoveries(can_sup_recovery_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous TX queue.
+ *
+ * Callers submit frames without blocking; a TX worker task owns the
+ * controller and sends them highest priority first, FIFO within a priority.
+ * Up to CAN_TX_INFLIGHT frames wait in the driver queue at once, so a burst
+ * goes out back-to-back and an urgent frame waits behind at most that many.
+ * The controller sends its queue in order, so completions are matched to
+ * requests by count from the controller status, read whenever a TX alert
+ * comes in through can_tx_on_alerts() from the supervisor (which owns
+ * can_bus_read_alerts()) and polled without one. Frames reach the monitor
+ * (TX ring, capture, stats) only once the controller reports them sent.
+ *
+ * A can_gen run fills the driver queue itself, so its completions can not
+ * be told apart from ours. While one is active submits are refused and
+ * anything already queued waits for the run to end.
+ */
+
+#ifndef CAN_TX_QUEUE_LEN
+#define CAN_TX_QUEUE_LEN       64
+#endif
+
+#ifndef CAN_TX_INFLIGHT
+#define CAN_TX_INFLIGHT        8     /* frames in the driver queue at once; at most its depth */
+#endif
+
+#ifndef CAN_TX_DONE_TIMEOUT_MS
+#define CAN_TX_DONE_TIMEOUT_MS 200   /* not sent by then: the frame counts as failed */
+#endif
+
+typedef enum {
+    CAN_TX_PRIO_HIGH = 0,    /* cyclic / time-critical */
+    CAN_TX_PRIO_NORMAL,      /* interactive */
+    CAN_TX_PRIO_LOW,         /* bulk, generators */
+    CAN_TX_PRIO_COUNT,
+} can_tx_prio_t;
+
+typedef uint32_t can_tx_handle_t;   /* 0 is never a valid handle */
+
+/*
+ * Completion callback, run on the TX worker. err is ESP_OK once the frame is
+ * on the bus, ESP_FAIL if the controller gave up, ESP_ERR_TIMEOUT if no
+ * completion arrived, or ESP_ERR_INVALID_STATE if the driver was stopped or
+ * reinstalled with the frame in its queue.
+ * Keep it short.
+ */
+typedef void (*can_tx_done_cb_t)(can_tx_handle_t h, const twai_message_t *m, esp_err_t err, void *ctx);
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;
+    uint32_t failed;       /* controller failure, timeout or driver stopped */
+    uint32_t rejected;     /* queue full or generator running at submit */
+    uint32_t queued;       /* waiting now, incl. the frames in flight */
+    uint32_t inflight;     /* in the driver queue now */
+} can_tx_stats_t;
+
+/* Allocate the request pool */
+esp_err_t can_tx_init(void);
+
+/* Start the TX worker task */
+esp_err_t can_tx_start(UBaseType_t prio, BaseType_t core);
+
+/*
+ * Queue a copy of m. Never blocks; safe from any task. Returns 0 if the queue
+ * is full, a can_gen run is active or can_tx_init() has not run (cb is not
+ * called then).
+ */
+can_tx_handle_t can_tx_submit(const twai_message_t *m, can_tx_prio_t prio,
+                              can_tx_done_cb_t cb, void *ctx);
+
+/* Drop a request that has not reached the controller yet; its callback is
+ * not called. ESP_ERR_NOT_FOUND once it is in flight or done. */
+esp_err_t can_tx_cancel(can_tx_handle_t h);
+
+void can_tx_get_stats(can_tx_stats_t *out);
+
+/* Supervisor side: hand over the TWAI_ALERT_* bits just read */
+void can_tx_on_alerts(uint32_t alerts);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+
+#include "can_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * In-process virtual CAN bus.
+ *
+ * A handful of nodes share one simulated bus. Node 0 is what the can_bus
+ * backend (can_vbus_bus) drives, the others are added with
+ * can_vbus_add_node() and fed by tests or generators. Time is virtual:
+ * nothing moves until can_vbus_advance() is called, so a run is fully
+ * deterministic; can_vbus_clock_start() drives it from real time instead.
+ *
+ * Each frame takes its on-wire length (can_load_frame_bits) at the sender's
+ * bit rate. Pending frames arbitrate by identifier (dominant bits win,
+ * standard before extended, data before remote) or in submission order.
+ * The model follows what the TWAI driver reports:
+ *  - a frame needs an ACK from a node at the same rate that is not
+ *    listen-only, unless the sender is in no-ACK mode;
+ *  - a node at another bit rate sees only bus errors, and if it is not
+ *    listen-only and still error active its error flags destroy the frame
+ *    for everyone;
+ *  - TEC/REC follow the fault confinement rules (+8 / +1, -1 on success,
+ *    warning at 96, passive at 128, bus-off above 255) with the matching
+ *    alerts; bus-off recovery takes 128 x 11 bit times of bus time;
+ *  - errors can be injected at a rate or one-shot.
+ * Frames and queues are not bit-accurate beyond that: an error costs the
+ * full frame time and there is no overload frame.
+ */
+
+#ifndef CAN_VBUS_MAX_NODES
+#define CAN_VBUS_MAX_NODES      8
+#endif
+
+#ifndef CAN_VBUS_TX_QUEUE_LEN
+#define CAN_VBUS_TX_QUEUE_LEN   32
+#endif
+
+#ifndef CAN_VBUS_RX_QUEUE_LEN
+#define CAN_VBUS_RX_QUEUE_LEN   64
+#endif
+
+typedef enum {
+    CAN_VBUS_ARB_ID = 0,     /* lowest arbitration field wins, like the real bus */
+    CAN_VBUS_ARB_FIFO,       /* oldest submission wins, whatever its ID */
+} can_vbus_arb_t;
+
+typedef struct {
+    can_vbus_arb_t arb;
+    uint32_t err_per_65536;  /* frames destroyed at random, per 65536 */
+    uint32_t seed;           /* PRNG seed for err_per_65536; 0 picks 1 */
+} can_vbus_cfg_t;
+
+/* (Re)create the bus with node 0 only, at virtual time 0. cfg may be NULL. */
+esp_err_t can_vbus_init(const can_vbus_cfg_t *cfg);
+
+/* Add a running node; returns its index (>= 1) or -1 if full */
+int       can_vbus_add_node(uint32_t bitrate, twai_mode_t mode);
+esp_err_t can_vbus_node_set(int node, uint32_t bitrate, twai_mode_t mode);
+esp_err_t can_vbus_node_set_filter(int node, const twai_filter_config_t *f);
+
+/* Queue a frame on a node; ESP_ERR_TIMEOUT if its TX queue is full */
+esp_err_t can_vbus_node_tx(int node, const twai_message_t *m);
+
+/* Take up to max received frames from a node */
+int       can_vbus_node_rx(int node, twai_message_t *out, int max);
+esp_err_t can_vbus_node_status(int node, twai_status_info_t *out);
+
+/* Destroy the next n frames on the bus */
+void      can_vbus_inject_errors(uint32_t n);
+void      can_vbus_set_err_rate(uint32_t per_65536);
+
+/* Run the bus for us of virtual time; returns frames completed */
+uint32_t  can_vbus_advance(int64_t us);
+int64_t   can_vbus_now_us(void);
+
+/* Advance the bus from esp_timer time in a task, once per tick */
+esp_err_t can_vbus_clock_start(UBaseType_t prio, BaseType_t core);
+
+/* Node 0 as a can_bus backend */
+extern const can_bus_ops_t can_vbus_bus;
+
+#ifdef __cplusplus
+}
+#endif
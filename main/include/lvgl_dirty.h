@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Dirty-rectangle set for the direct-mode frame buffer sync in lvgl_port.c.
+ *
+ * With two panel frame buffers, every area LVGL redrew has to be copied into
+ * the buffer that is not on screen. LVGL's own area list only joins areas
+ * whose union is smaller than their sum, so partly overlapping areas get
+ * copied twice, and each small area costs a call of its own.
+ *
+ * lvgl_dirty_merge() joins touching or overlapping rectangles whenever the
+ * union copies no more than the two apart. Overlapping pairs it does not join
+ * lose the overlap from one side when the rest is still a rectangle. Nothing
+ * is merged just to save a call: a row copy costs far less than the PSRAM
+ * traffic of the extra pixels; bench/ checks that none of the UI's
+ * invalidation patterns copies more than with LVGL's own join. Merged
+ * rectangles may cover pixels no area asked for; the source
+ * must hold the whole frame, so copying them does no harm.
+ */
+
+#ifndef LVGL_DIRTY_IN_MAX
+#define LVGL_DIRTY_IN_MAX     32    /* areas per frame; LV_INV_BUF_SIZE */
+#endif
+
+/* Inclusive bounds, like lv_area_t */
+typedef struct {
+    int16_t x1, y1, x2, y2;
+} lvgl_dirty_rect_t;
+
+typedef struct {
+    uint16_t          n;        /* rectangles in r */
+    uint16_t          n_in;     /* areas added since the reset */
+    lvgl_dirty_rect_t r[LVGL_DIRTY_IN_MAX];
+} lvgl_dirty_t;
+
+void lvgl_dirty_reset(lvgl_dirty_t *d);
+
+/* Add one area. A full set folds it into the rectangle that grows least. */
+void lvgl_dirty_add(lvgl_dirty_t *d, int16_t x1, int16_t y1, int16_t x2, int16_t y2);
+
+/* Reduce the set as described above */
+void lvgl_dirty_merge(lvgl_dirty_t *d);
+
+/* Pixels the set covers, overlaps counted twice (what a copy moves) */
+uint32_t lvgl_dirty_pixels(const lvgl_dirty_t *d);
+
+/*
+ * Copy every rectangle from a w x h RGB565 frame into another. Rotation 0
+ * copies row by row with memcpy; 90/180/270 go through lvgl_rotate_copy().
+ * Returns the bytes copied.
+ */
+size_t lvgl_dirty_copy(const lvgl_dirty_t *d, const uint16_t *from, uint16_t *to,
+                       uint16_t w, uint16_t h, uint16_t rotation);
+
+#ifdef __cplusplus
+}
+#endif
@@ -37,12 +37,15 @@ extern "C" {
  * LVGL timer handle task related parameters, can be adjusted by users
  *
  */
-#define LVGL_PORT_TASK_MAX_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MAX_DELAY_MS)    // The maximum delay of the LVGL timer task, in milliseconds
-#define LVGL_PORT_TASK_MIN_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MIN_DELAY_MS)    // The minimum delay of the LVGL timer task, in milliseconds
+#define LVGL_PORT_TASK_MAX_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MAX_DELAY_MS)    // The longest the LVGL task sleeps without a wakeup, in milliseconds
+#define LVGL_PORT_TASK_MIN_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MIN_DELAY_MS)    // The minimum frame interval: shortest time between two lv_timer_handler() passes
 #define LVGL_PORT_TASK_STACK_SIZE   (CONFIG_EXAMPLE_LVGL_PORT_TASK_STACK_SIZE_KB * 1024) // The stack size of the LVGL timer task, in bytes
 #define LVGL_PORT_TASK_PRIORITY     (CONFIG_EXAMPLE_LVGL_PORT_TASK_PRIORITY)        // The priority of the LVGL timer task
 #define LVGL_PORT_TASK_CORE         (CONFIG_EXAMPLE_LVGL_PORT_TASK_CORE)            // The core of the LVGL timer task,
 // `-1` means the don't specify the core
+#define LVGL_PORT_WAKE_INDEX        (1)     // Task notification slot for wakeups; slot 0 is the vsync handshake
+#define LVGL_PORT_WAKE_TIMERS       (4)     // Timers that can wait for lvgl_port_wake_timer() at once
+#define LVGL_PORT_TOUCH_IDLE_READS  (30)    // Released reads before touch polling stops (INT line only)
 /**
  *
  * LVGL buffer related parameters, can be adjusted by users:
@@ -123,6 +126,18 @@ extern "C" {
 #define LVGL_PORT_DIRECT_MODE           (0)
 #endif /* LVGL_PORT_AVOID_TEAR_ENABLE */
 
+/**
+ * Frame buffer sync cost (LCD double-buffer & LVGL direct-mode with rotation), all zero in other modes
+ *
+ */
+typedef struct {
+    uint32_t frames;        // Frames that synced
+    uint32_t bytes_last;    // Bytes copied between frame buffers for the last frame
+    uint32_t bytes_avg;     // Same, moving average over ~8 frames
+    uint16_t areas_last;    // Areas LVGL invalidated in the last frame
+    uint16_t rects_last;    // Rectangles actually copied after merging
+} lvgl_port_sync_stats_t;
+
 /**
  * @brief Initialize LVGL port
  *
@@ -162,6 +177,42 @@ void lvgl_port_unlock(void);
  */
 bool lvgl_port_notify_rgb_vsync(void);
 
+/**
+ * @brief Copy of the frame buffer sync statistics
+ *
+ * @note Call with the LVGL mutex held, e.g. from an LVGL timer or event callback.
+ */
+void lvgl_port_get_sync_stats(lvgl_port_sync_stats_t *out);
+
+/**
+ * @brief Wake the LVGL task now instead of at its next timer deadline
+ *
+ * The task still keeps the minimum frame interval between passes. Safe from any task, not from an ISR.
+ */
+void lvgl_port_wake(void);
+
+/**
+ * @brief Make an LVGL timer due and wake the LVGL task
+ *
+ * The timer is made ready under the LVGL mutex just before the next lv_timer_handler() pass, so the
+ * caller does not need the mutex. Use it to have a slow timer run as soon as it has work.
+ * Safe from any task, not from an ISR.
+ *
+ * @param[in] timer: LVGL timer, which must outlive the call
+ *
+ * @return
+ *      - true:  The timer will run on the next pass
+ *      - false: LVGL_PORT_WAKE_TIMERS other timers are already waiting; the task is woken anyway
+ */
+bool lvgl_port_wake_timer(lv_timer_t *timer);
+
+/**
+ * @brief Touch controller interrupt callback (`esp_lcd_touch_config_t.interrupt_callback`)
+ *
+ * Resumes touch reading and wakes the LVGL task. Without an INT line the touch is polled instead.
+ */
+void lvgl_port_touch_isr(esp_lcd_touch_handle_t tp);
+
 #ifdef __cplusplus
 }
 #endif
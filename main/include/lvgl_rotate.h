@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Rotated copy of an RGB565 area between full-screen frame buffers, for the
+ * avoid-tear flush paths in lvgl_port.c.
+ *
+ * The source is w x h pixels, row stride w. The destination is the panel
+ * frame buffer: stride h for 90/270 and w for 180. The area is inclusive,
+ * in source coordinates. Pixels outside it are not touched.
+ *
+ *   90, 270  walked in LVGL_ROTATE_TILE x LVGL_ROTATE_TILE tiles, writing
+ *            one destination row of the tile at a time. A tile reads and
+ *            writes LVGL_ROTATE_TILE lines each, instead of one destination
+ *            line per pixel when a source row is walked straight.
+ *   180      each row is copied reversed, two pixels per 32-bit move when
+ *            source and destination line up on 4 bytes.
+ *
+ * Any other rotation copies nothing. The result is identical to the former
+ * per-pixel rotate_copy_pixel().
+ */
+
+#ifndef LVGL_ROTATE_TILE
+#define LVGL_ROTATE_TILE   32    /* 32 RGB565 pixels = one 64 B cache line */
+#endif
+
+void lvgl_rotate_copy(const uint16_t *from, uint16_t *to,
+                      uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end,
+                      uint16_t w, uint16_t h, uint16_t rotation);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Task and heap diagnostics.
+ *
+ * A low-priority task samples uxTaskGetSystemState() every
+ * SYS_DIAG_PERIOD_MS and turns the run-time counter deltas into CPU% per
+ * task and per core (100 % minus that core's idle task), next to each
+ * task's stack high-water mark and the internal/PSRAM heap figures. Readers
+ * get a copy of the last sample.
+ *
+ * Needs CONFIG_SYS_DIAG, which turns on the FreeRTOS trace facility and
+ * run-time stats. Without it there is no task, no counters in the
+ * scheduler, and the calls below return ESP_ERR_NOT_SUPPORTED / nothing.
+ */
+
+#ifndef SYS_DIAG_PERIOD_MS
+#define SYS_DIAG_PERIOD_MS   1000
+#endif
+
+#ifndef SYS_DIAG_MAX_TASKS
+#define SYS_DIAG_MAX_TASKS   32
+#endif
+
+#define SYS_DIAG_CORES       2
+#define SYS_DIAG_NAME_LEN    16
+
+typedef struct {
+    char     name[SYS_DIAG_NAME_LEN];
+    int8_t   core;           /* -1: no affinity */
+    uint8_t  prio;
+    uint16_t cpu_x10;        /* share of one core over the last period */
+    uint32_t stack_free;     /* high-water mark: least free stack seen, bytes */
+} sys_diag_task_t;
+
+typedef struct {
+    size_t free;
+    size_t largest;          /* largest free block */
+    size_t min_free;         /* low-water mark since boot */
+} sys_diag_heap_t;
+
+typedef struct {
+    uint32_t        seq;     /* 0 until the first period has been measured */
+    uint32_t        period_ms;
+    uint16_t        core_load_x10[SYS_DIAG_CORES];
+    sys_diag_heap_t internal;
+    sys_diag_heap_t psram;
+    uint32_t        n_tasks; /* sorted by cpu_x10, highest first */
+    uint32_t        n_total; /* tasks in the system; more than n_tasks if the table was short */
+    sys_diag_task_t tasks[SYS_DIAG_MAX_TASKS];
+} sys_diag_t;
+
+/* Start the sampling task */
+esp_err_t sys_diag_start(UBaseType_t prio, BaseType_t core);
+
+/* Copy of the last sample; false if nothing has been measured yet */
+bool sys_diag_get(sys_diag_t *out);
+
+/* Text report: core loads, heaps, then one line per task. Returns the length. */
+size_t sys_diag_format(char *out, size_t out_sz);
+
+#ifdef __cplusplus
+}
+#endif
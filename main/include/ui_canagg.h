@@ -0,0 +1,26 @@
+#pragma once
+
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed (per-ID) CAN view.
+ *
+ * One row per distinct ID from can_agg, in first-seen order, with the latest
+ * payload, smoothed period and frame count. Bytes that changed since the row
+ * was last drawn are highlighted. Only rows whose entry changed are re-texted,
+ * so a refresh costs O(visible rows) no matter how busy the bus is.
+ */
+
+/* Create the view inside parent */
+lv_obj_t *ui_canagg_create(lv_obj_t *parent);
+
+/* Redraw changed rows. Call once per UI tick under the LVGL lock. */
+void ui_canagg_refresh(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Diagnostics view.
+ *
+ * A table of the can_lat stages (count, mean, p50, p99, p99.9, max) and a
+ * bar chart of one stage's log2 buckets from 1 us to 1 s. Tap a table row to
+ * chart that stage, long-press the table to reset the histograms. Refreshes
+ * at most every UI_CANDIAG_REFRESH_MS, and only while visible.
+ */
+
+/* Create the view inside parent */
+lv_obj_t *ui_candiag_create(lv_obj_t *parent);
+
+/* Call once per UI tick under the LVGL lock */
+void ui_candiag_refresh(void);
+
+#ifdef __cplusplus
+}
+#endif
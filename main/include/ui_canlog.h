@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "lvgl.h"
+
+#include "can_pipe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Virtualized CAN log view.
+ *
+ * Keeps a history ring of pre-formatted lines (from can_pipe) and a fixed set
+ * of pre-created row labels.
+ * Only the rows on screen exist as LVGL objects; scrolling and appending
+ * rebind rows to history slots instead of re-laying out a text buffer, so the
+ * cost per refresh is O(visible rows) regardless of history length.
+ */
+
+/* Create the log inside parent. history_len is rounded up to a power of two. */
+lv_obj_t *ui_canlog_create(lv_obj_t *parent, size_t history_len);
+
+/* Append formatted rows to history. No LVGL work; call ui_canlog_refresh() after a batch. */
+void ui_canlog_push(const can_pipe_row_t *rows, size_t n);
+
+/* Append a "+N frames" line standing for rows that were never shown */
+void ui_canlog_push_gap(uint32_t n);
+
+/* Rows on screen (the upper bound until the first refresh lays them out) */
+size_t ui_canlog_visible_rows(void);
+
+/* Rebind visible rows to history. Call once per UI tick under the LVGL lock. */
+void ui_canlog_refresh(void);
+
+/* Drop all history */
+void ui_canlog_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,8 +2,6 @@
 
 #include <stddef.h>
 #include "esp_err.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "lvgl.h"
 
 #ifdef __cplusplus
@@ -14,12 +12,18 @@ extern "C" {
 typedef struct {
     int  side_w_pct;      /* Right panel width percent */
     int  padding;         /* Screen padding */
-    int  drain_per_tick;  /* How many events to drain per LVGL tick */
-    int  tick_ms;         /* LVGL timer period */
+    int  fps;             /* Target render rate */
+    int  min_fps;         /* Floor the rate may adapt down to when ticks get expensive */
 } ui_canmon_cfg_t;
 
-/* Build UI and start LVGL timer that drains events from queue. */
-esp_err_t ui_canmon_start(const ui_canmon_cfg_t *cfg, QueueHandle_t evt_q);
+/*
+ * Build UI and start the LVGL timer that takes formatted rows from can_pipe.
+ * Each tick renders the newest screenful of what arrived since the last one
+ * and folds the rest into a "+N frames" line; capture never waits on it.
+ * The timer period stretches toward 1/min_fps while a tick costs more than
+ * UI_TICK_BUDGET_PCT of it, and returns to 1/fps when it gets cheap again.
+ */
+esp_err_t ui_canmon_start(const ui_canmon_cfg_t *cfg);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * System view.
+ *
+ * Per-core load and internal/PSRAM heap on top, then a table of tasks sorted
+ * by CPU share with their core, priority and stack high-water mark, all from
+ * sys_diag. Refreshes once per sys_diag sample, and only while visible.
+ */
+
+/* Create the view inside parent */
+lv_obj_t *ui_sysdiag_create(lv_obj_t *parent);
+
+/* Call once per UI tick under the LVGL lock */
+void ui_sysdiag_refresh(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,6 +5,8 @@
 #include "driver/twai.h"
 #include "freertos/FreeRTOS.h"
 
+#include "can_bus.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,6 +28,33 @@ extern "C" {
 #  endif
 #endif
 
+/* Driver-side RX buffer; bursts are drained from here in one go */
+#ifndef WAVESHARE_TWAI_RX_QUEUE_LEN
+#define WAVESHARE_TWAI_RX_QUEUE_LEN 64
+#endif
+
+/* Driver-side TX buffer; cyclic bursts queue here instead of blocking */
+#ifndef WAVESHARE_TWAI_TX_QUEUE_LEN
+#define WAVESHARE_TWAI_TX_QUEUE_LEN 32
+#endif
+
+/* Bit rate and mode at boot; waveshare_twai_reconfigure() changes them */
+#ifndef WAVESHARE_TWAI_BITRATE
+#define WAVESHARE_TWAI_BITRATE 500000
+#endif
+
+#ifndef WAVESHARE_TWAI_MODE
+#define WAVESHARE_TWAI_MODE TWAI_MODE_NO_ACK
+#endif
+
+/* twai_read_alerts() wait slice: upper bound on how long a reinstall waits
+ * for the alert reader. The driver has no way to wake that wait early, so
+ * this is whole ticks: 2 ms needs the 1 kHz tick from sdkconfig.defaults
+ * (at 100 Hz it rounds up to 10 ms). */
+#ifndef WAVESHARE_TWAI_ALERT_SLICE_MS
+#define WAVESHARE_TWAI_ALERT_SLICE_MS 2
+#endif
+
 #ifndef EXAMPLE_TAG
 #define EXAMPLE_TAG "TWAI Master"
 #endif
@@ -33,15 +62,50 @@ extern "C" {
 esp_err_t waveshare_twai_init(void);
 esp_err_t waveshare_twai_deinit(void);
 bool      waveshare_twai_is_started(void);
+uint32_t  waveshare_twai_get_bitrate(void);
+
+/* Replace the acceptance filter; reinstalls the driver if it is running */
+esp_err_t waveshare_twai_set_filter(const twai_filter_config_t *f);
+
+/*
+ * Switch bit rate and mode by reinstalling the driver; the filter is kept.
+ * timing NULL picks the standard timing for bitrate (ESP_ERR_NOT_SUPPORTED if
+ * there is none); otherwise bitrate is only what the rest of the system is
+ * told. Senders see ESP_ERR_TIMEOUT while it runs. Use can_bus_reconfigure()
+ * or can_baud_set() so the rest of the pipeline follows.
+ */
+esp_err_t waveshare_twai_reconfigure(uint32_t bitrate, const twai_timing_config_t *timing,
+                                     twai_mode_t mode);
 
 esp_err_t send_can_frame(twai_message_t frame);
 
+/* Queue a frame without waiting; ESP_ERR_TIMEOUT if the TX queue is full or busy */
+esp_err_t waveshare_twai_try_send(const twai_message_t *frame);
+
+/* Wait up to timeout_ticks for driver alerts (TWAI_ALERT_*); the driver can
+ * not be reinstalled meanwhile. One reader at a time. */
+esp_err_t waveshare_twai_read_alerts(uint32_t *alerts, TickType_t timeout_ticks);
+
+/* Controller state, error counters and driver loss counters (waits <= 10 ms) */
+esp_err_t waveshare_twai_get_status(twai_status_info_t *out);
+
+/* Bus-off handling: start the 128 x 11 recessive bit recovery sequence, then
+ * restart the controller once TWAI_ALERT_BUS_RECOVERED arrives. */
+esp_err_t waveshare_twai_recover(void);
+esp_err_t waveshare_twai_resume(void);
+
+/* Uninstall and reinstall the driver with the current settings */
+esp_err_t waveshare_twai_reset(void);
+
 /* Receive one CAN frame (blocking up to timeout_ticks) */
 esp_err_t waveshare_twai_receive(twai_message_t *out_frame, TickType_t timeout_ticks);
 
 /* Optional: drain RX queue quickly (non-blocking) */
 int waveshare_twai_drain(twai_message_t *out_frames, int max_frames);
 
+/* The TWAI controller as a can_bus backend */
+extern const can_bus_ops_t waveshare_twai_bus;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,203 @@
+#include "can_agg.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef TAG
+#define TAG "can_agg"
+#endif
+
+#define CAN_AGG_MAX_LIMIT  0xFFFFu   /* slot values are uint16_t index + 1 */
+
+/* ---------------- State ----------------
+ *
+ * slots[] is the open-addressing table (linear probing, load <= 1/2). It only
+ * stores index + 1 into entries[], 0 meaning empty; keys are never deleted
+ * one by one, so no tombstones are needed. dirty[] has one bit per entry and
+ * is read without the lock as a hint.
+ */
+
+typedef struct {
+    can_agg_entry_t *entries;
+    uint16_t        *slots;
+    atomic_uint     *dirty;
+    uint32_t         max_ids;
+    uint32_t         slot_mask;
+    uint32_t         hash_shift;
+    atomic_uint      count;
+    atomic_uint      generation;
+    uint32_t         overflow_cnt;
+    portMUX_TYPE     lock;
+} can_agg_t;
+
+static can_agg_t s_agg = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+esp_err_t can_agg_init(size_t max_ids)
+{
+    if (s_agg.entries) return ESP_OK;
+    if (max_ids == 0 || max_ids > CAN_AGG_MAX_LIMIT) return ESP_ERR_INVALID_SIZE;
+
+    /* At least twice as many slots as entries keeps probe chains short */
+    uint32_t slots = 2;
+    uint32_t bits = 1;
+    while (slots < 2 * max_ids) {
+        slots <<= 1;
+        bits++;
+    }
+
+    const uint32_t words = (uint32_t)((max_ids + 31) / 32);
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+
+    can_agg_entry_t *entries = heap_caps_calloc(max_ids, sizeof(can_agg_entry_t), caps);
+    uint16_t *slot_buf       = heap_caps_calloc(slots, sizeof(uint16_t), caps);
+    atomic_uint *dirty       = heap_caps_calloc(words, sizeof(atomic_uint), caps);
+    if (!entries || !slot_buf || !dirty) {
+        heap_caps_free(entries);
+        heap_caps_free(slot_buf);
+        heap_caps_free(dirty);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_agg.lock);
+    s_agg.slots = slot_buf;
+    s_agg.dirty = dirty;
+    s_agg.max_ids = (uint32_t)max_ids;
+    s_agg.slot_mask = slots - 1;
+    s_agg.hash_shift = 32 - bits;
+    s_agg.overflow_cnt = 0;
+    atomic_store_explicit(&s_agg.count, 0, memory_order_relaxed);
+    s_agg.entries = entries;
+    portEXIT_CRITICAL(&s_agg.lock);
+
+    ESP_LOGI(TAG, "ID table: %u IDs, %u slots (%u B)", (unsigned)max_ids, (unsigned)slots,
+             (unsigned)(max_ids * sizeof(can_agg_entry_t) + slots * sizeof(uint16_t)));
+    return ESP_OK;
+}
+
+void can_agg_clear(void)
+{
+    if (!s_agg.entries) return;
+
+    portENTER_CRITICAL(&s_agg.lock);
+    memset(s_agg.slots, 0, (s_agg.slot_mask + 1) * sizeof(uint16_t));
+    for (uint32_t w = 0; w < (s_agg.max_ids + 31) / 32; w++) {
+        atomic_store_explicit(&s_agg.dirty[w], 0, memory_order_relaxed);
+    }
+    s_agg.overflow_cnt = 0;
+    atomic_store_explicit(&s_agg.count, 0, memory_order_release);
+    atomic_fetch_add_explicit(&s_agg.generation, 1, memory_order_release);
+    portEXIT_CRITICAL(&s_agg.lock);
+}
+
+/* Fibonacci hashing: the top bits of key * 2^32/phi */
+static inline uint32_t agg_hash(uint32_t key)
+{
+    return (key * 2654435769u) >> s_agg.hash_shift;
+}
+
+/* Find or insert key under the lock; NULL when the table is full */
+static can_agg_entry_t *agg_lookup_locked(uint32_t key)
+{
+    uint32_t s = agg_hash(key);
+
+    while (1) {
+        uint16_t v = s_agg.slots[s];
+        if (v == 0) break;
+        if (s_agg.entries[v - 1].key == key) return &s_agg.entries[v - 1];
+        s = (s + 1) & s_agg.slot_mask;
+    }
+
+    uint32_t n = atomic_load_explicit(&s_agg.count, memory_order_relaxed);
+    if (n >= s_agg.max_ids) return NULL;
+
+    can_agg_entry_t *e = &s_agg.entries[n];
+    memset(e, 0, sizeof(*e));
+    e->key = key;
+    s_agg.slots[s] = (uint16_t)(n + 1);
+    atomic_store_explicit(&s_agg.count, n + 1, memory_order_release);
+    return e;
+}
+
+void can_agg_update(bool is_tx, const twai_message_t *m, int64_t t_us)
+{
+    if (!s_agg.entries || !m) return;
+
+    const uint32_t key = CAN_AGG_KEY(m->identifier, m->flags & TWAI_MSG_FLAG_EXTD, is_tx);
+    const uint8_t dlc = m->data_length_code > 8 ? 8 : m->data_length_code;
+    const bool rtr = (m->flags & TWAI_MSG_FLAG_RTR) != 0;
+
+    portENTER_CRITICAL(&s_agg.lock);
+
+    can_agg_entry_t *e = agg_lookup_locked(key);
+    if (!e) {
+        s_agg.overflow_cnt++;
+        portEXIT_CRITICAL(&s_agg.lock);
+        return;
+    }
+
+    if (e->count > 0) {
+        uint32_t dt = (t_us > e->last_us) ? (uint32_t)(t_us - e->last_us) : 0;
+        /* Exponential moving average, 1/8 weight; the first interval seeds it */
+        e->period_us = (e->count == 1) ? dt : e->period_us - (e->period_us >> 3) + (dt >> 3);
+    }
+
+    uint8_t chg = 0;
+    if (e->count == 0 || e->dlc != dlc || e->rtr != rtr) {
+        chg = 0xFF;
+    } else {
+        for (uint32_t i = 0; i < dlc; i++) {
+            if (e->data[i] != m->data[i]) chg |= (uint8_t)(1u << i);
+        }
+    }
+
+    e->count++;
+    e->last_us = t_us;
+    e->dlc = dlc;
+    e->rtr = rtr;
+    e->chg_mask |= chg;
+    memcpy(e->data, m->data, 8);
+
+    const uint32_t idx = (uint32_t)(e - s_agg.entries);
+    atomic_fetch_or_explicit(&s_agg.dirty[idx >> 5], 1u << (idx & 31), memory_order_release);
+
+    portEXIT_CRITICAL(&s_agg.lock);
+}
+
+size_t can_agg_count(void)
+{
+    return atomic_load_explicit(&s_agg.count, memory_order_acquire);
+}
+
+uint32_t can_agg_generation(void)
+{
+    return atomic_load_explicit(&s_agg.generation, memory_order_acquire);
+}
+
+uint32_t can_agg_get_overflow_cnt(void) { return s_agg.overflow_cnt; }
+
+bool can_agg_take(size_t idx, can_agg_entry_t *out, bool force)
+{
+    if (!s_agg.entries || !out || idx >= can_agg_count()) return false;
+
+    const uint32_t bit = 1u << (idx & 31);
+    atomic_uint *word = &s_agg.dirty[idx >> 5];
+
+    /* Cheap unlocked check first; most rows are clean on most ticks */
+    if (!force && !(atomic_load_explicit(word, memory_order_acquire) & bit)) return false;
+
+    portENTER_CRITICAL(&s_agg.lock);
+    bool ok = idx < atomic_load_explicit(&s_agg.count, memory_order_relaxed);
+    if (ok) {
+        atomic_fetch_and_explicit(word, ~bit, memory_order_relaxed);
+        *out = s_agg.entries[idx];
+        s_agg.entries[idx].chg_mask = 0;
+    }
+    portEXIT_CRITICAL(&s_agg.lock);
+    return ok;
+}
@@ -0,0 +1,121 @@
+#include "can_baud.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "can_bus.h"
+#include "can_load.h"
+
+#ifndef TAG
+#define TAG "can_baud"
+#endif
+
+static const uint32_t k_default_rates[] = {
+    500000, 250000, 125000, 1000000, 800000, 100000, 50000,
+};
+
+/* Reconfigure and keep the load meter in step */
+static esp_err_t baud_apply(const can_bus_cfg_t *cfg)
+{
+    esp_err_t err = can_bus_reconfigure(cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Switch to %u bit/s failed: %s", (unsigned)cfg->bitrate, esp_err_to_name(err));
+        return err;
+    }
+
+    can_load_set_bitrate(cfg->bitrate);
+    ESP_LOGI(TAG, "Bus at %u bit/s, mode %d (switch %u us)", (unsigned)cfg->bitrate, (int)cfg->mode,
+             (unsigned)can_bus_get_switch_us(NULL));
+    return ESP_OK;
+}
+
+esp_err_t can_baud_set(uint32_t bitrate, const twai_timing_config_t *timing, twai_mode_t mode)
+{
+    can_bus_cfg_t cfg = {
+        .bitrate = bitrate,
+        .mode    = mode,
+        .custom  = timing != NULL,
+    };
+    if (timing) cfg.timing = *timing;
+    return baud_apply(&cfg);
+}
+
+/* Listen at the current rate until it proves right or wrong; frames seen
+ * if it is right, 0 on a bus error or when nothing arrived */
+static uint32_t baud_listen(uint32_t dwell_ms)
+{
+    const int64_t deadline = esp_timer_get_time() + (int64_t)dwell_ms * 1000;
+    const uint32_t rx0 = can_bus_get_rx_count();
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CAN_BAUD_POLL_MS) ? pdMS_TO_TICKS(CAN_BAUD_POLL_MS) : 1);
+
+        /* The reinstall restarted the driver counters */
+        twai_status_info_t si;
+        if (can_bus_get_status(&si) == ESP_OK && si.bus_error_count > 0) return 0;
+
+        /* The RX task drains the driver; count what it was handed */
+        uint32_t frames = can_bus_get_rx_count() - rx0;
+        if (frames >= CAN_BAUD_MIN_FRAMES) return frames;
+        if (esp_timer_get_time() >= deadline) return 0;
+    }
+}
+
+esp_err_t can_baud_detect(const uint32_t *rates, size_t n, uint32_t dwell_ms,
+                          twai_mode_t lock_mode, can_baud_result_t *out)
+{
+    if (!rates) {
+        rates = k_default_rates;
+        n = sizeof(k_default_rates) / sizeof(k_default_rates[0]);
+    }
+    if (n == 0) return ESP_ERR_INVALID_ARG;
+    if (dwell_ms == 0) dwell_ms = CAN_BAUD_DWELL_MS;
+    if (!can_bus_is_started()) return ESP_ERR_INVALID_STATE;
+
+    const int64_t t0 = esp_timer_get_time();
+    can_bus_cfg_t prev;
+    can_bus_get_cfg(&prev);
+
+    can_baud_result_t r;
+    memset(&r, 0, sizeof(r));
+
+    for (size_t i = 0; i < n && r.bitrate == 0; i++) {
+        can_bus_cfg_t cfg = { .bitrate = rates[i], .mode = TWAI_MODE_LISTEN_ONLY };
+        if (can_bus_reconfigure(&cfg) != ESP_OK) continue;
+        r.tried++;
+
+        uint32_t us = can_bus_get_switch_us(NULL);
+        if (us > r.switch_max_us) r.switch_max_us = us;
+
+        uint32_t frames = baud_listen(dwell_ms);
+        ESP_LOGD(TAG, "%u bit/s: %u frames", (unsigned)rates[i], (unsigned)frames);
+        if (frames > 0) {
+            r.bitrate = rates[i];
+            r.frames = frames;
+        }
+    }
+
+    esp_err_t err;
+    if (r.bitrate) err = can_baud_set(r.bitrate, NULL, lock_mode);
+    else           err = baud_apply(&prev);
+
+    uint32_t us = can_bus_get_switch_us(NULL);
+    if (us > r.switch_max_us) r.switch_max_us = us;
+    r.scan_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+
+    if (r.bitrate) {
+        ESP_LOGI(TAG, "Auto-baud locked at %u bit/s after %u candidate(s), %u ms (switch max %u us)",
+                 (unsigned)r.bitrate, (unsigned)r.tried, (unsigned)r.scan_ms, (unsigned)r.switch_max_us);
+    } else {
+        ESP_LOGW(TAG, "Auto-baud found no rate in %u ms; back at %u bit/s",
+                 (unsigned)r.scan_ms, (unsigned)prev.bitrate);
+        if (err == ESP_OK) err = ESP_ERR_NOT_FOUND;
+    }
+
+    if (out) *out = r;
+    return err;
+}
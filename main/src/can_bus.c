@@ -0,0 +1,218 @@
+#include "can_bus.h"
+
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#ifndef TAG
+#define TAG "can_bus"
+#endif
+
+static const can_bus_ops_t *s_ops = NULL;
+static can_bus_cfg_t s_cfg;
+static bool s_started = false;
+
+static uint32_t s_switch_us = 0;
+static uint32_t s_switch_max_us = 0;
+static atomic_uint s_rx_cnt;
+static atomic_uint s_reinstalls;
+
+static inline void reinstall_mark(void)
+{
+    atomic_fetch_add_explicit(&s_reinstalls, 1, memory_order_acq_rel);
+}
+
+bool can_bus_timing_for(uint32_t bitrate, twai_timing_config_t *out)
+{
+    static const struct {
+        uint32_t bitrate;
+        twai_timing_config_t t;
+    } k_rates[] = {
+        {   50000, TWAI_TIMING_CONFIG_50KBITS()  },
+        {  100000, TWAI_TIMING_CONFIG_100KBITS() },
+        {  125000, TWAI_TIMING_CONFIG_125KBITS() },
+        {  250000, TWAI_TIMING_CONFIG_250KBITS() },
+        {  500000, TWAI_TIMING_CONFIG_500KBITS() },
+        {  800000, TWAI_TIMING_CONFIG_800KBITS() },
+        { 1000000, TWAI_TIMING_CONFIG_1MBITS()   },
+    };
+
+    for (size_t i = 0; i < sizeof(k_rates) / sizeof(k_rates[0]); i++) {
+        if (k_rates[i].bitrate == bitrate) {
+            if (out) *out = k_rates[i].t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Fill in the standard timing unless cfg brings its own */
+static esp_err_t cfg_resolve(const can_bus_cfg_t *in, can_bus_cfg_t *out)
+{
+    if (in->bitrate == 0) return ESP_ERR_INVALID_ARG;
+
+    *out = *in;
+    if (!out->custom && !can_bus_timing_for(out->bitrate, &out->timing)) return ESP_ERR_NOT_SUPPORTED;
+    out->custom = true;
+    return ESP_OK;
+}
+
+esp_err_t can_bus_init(const can_bus_ops_t *ops, const can_bus_cfg_t *cfg)
+{
+    if (!ops) return ESP_ERR_INVALID_ARG;
+    if (s_started) return ESP_ERR_INVALID_STATE;
+
+    can_bus_cfg_t c = CAN_BUS_CFG_DEFAULT();
+    esp_err_t err = cfg_resolve(cfg ? cfg : &c, &c);
+    if (err != ESP_OK) return err;
+
+    s_ops = ops;
+    s_cfg = c;
+    reinstall_mark();
+    err = ops->start(&c);
+    reinstall_mark();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s backend failed to start: %s", ops->name, esp_err_to_name(err));
+        return err;
+    }
+
+    s_started = true;
+    ESP_LOGI(TAG, "%s backend at %u bit/s", ops->name, (unsigned)c.bitrate);
+    return ESP_OK;
+}
+
+esp_err_t can_bus_deinit(void)
+{
+    if (!s_started) return ESP_OK;
+    s_started = false;
+    reinstall_mark();
+    esp_err_t err = s_ops->stop();
+    reinstall_mark();
+    return err;
+}
+
+bool can_bus_is_started(void)
+{
+    return s_started;
+}
+
+const char *can_bus_name(void)
+{
+    return s_ops ? s_ops->name : "none";
+}
+
+esp_err_t can_bus_reconfigure(const can_bus_cfg_t *cfg)
+{
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    if (!s_ops) return ESP_ERR_INVALID_STATE;
+
+    can_bus_cfg_t c;
+    esp_err_t err = cfg_resolve(cfg, &c);
+    if (err != ESP_OK) return err;
+
+    const int64_t t0 = esp_timer_get_time();
+    reinstall_mark();
+    err = s_ops->reconfigure(&c);
+    reinstall_mark();
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+
+    s_switch_us = us;
+    if (us > s_switch_max_us) s_switch_max_us = us;
+    if (err == ESP_OK) s_cfg = c;
+    return err;
+}
+
+void can_bus_get_cfg(can_bus_cfg_t *out)
+{
+    if (out) *out = s_cfg;
+}
+
+uint32_t can_bus_get_bitrate(void)
+{
+    return s_cfg.bitrate;
+}
+
+uint32_t can_bus_get_switch_us(uint32_t *max_us)
+{
+    if (max_us) *max_us = s_switch_max_us;
+    return s_switch_us;
+}
+
+uint32_t can_bus_get_reinstalls(void)
+{
+    return atomic_load_explicit(&s_reinstalls, memory_order_acquire);
+}
+
+esp_err_t can_bus_set_filter(const twai_filter_config_t *f)
+{
+    if (!s_ops) return ESP_ERR_INVALID_STATE;
+    reinstall_mark();
+    esp_err_t err = s_ops->set_filter(f);
+    reinstall_mark();
+    return err;
+}
+
+esp_err_t can_bus_tx(const twai_message_t *m)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    return s_ops->tx(m);
+}
+
+esp_err_t can_bus_rx(twai_message_t *m, TickType_t timeout_ticks)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = s_ops->rx(m, timeout_ticks);
+    if (err == ESP_OK) atomic_fetch_add_explicit(&s_rx_cnt, 1, memory_order_relaxed);
+    return err;
+}
+
+int can_bus_rx_batch(twai_message_t *out, int max)
+{
+    if (!s_started) return 0;
+
+    int n = s_ops->rx_batch(out, max);
+    if (n > 0) atomic_fetch_add_explicit(&s_rx_cnt, (unsigned)n, memory_order_relaxed);
+    return n;
+}
+
+uint32_t can_bus_get_rx_count(void)
+{
+    return atomic_load_explicit(&s_rx_cnt, memory_order_relaxed);
+}
+
+esp_err_t can_bus_read_alerts(uint32_t *alerts, TickType_t timeout_ticks)
+{
+    if (!alerts) return ESP_ERR_INVALID_ARG;
+    *alerts = 0;
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    return s_ops->alerts(alerts, timeout_ticks);
+}
+
+esp_err_t can_bus_get_status(twai_status_info_t *out)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    return s_ops->status(out);
+}
+
+esp_err_t can_bus_recover(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    return s_ops->recover();
+}
+
+esp_err_t can_bus_resume(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    return s_ops->resume();
+}
+
+esp_err_t can_bus_reset(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    reinstall_mark();
+    esp_err_t err = s_ops->reset();
+    reinstall_mark();
+    return err;
+}
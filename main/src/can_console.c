@@ -0,0 +1,833 @@
+#include "can_console.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "can_baud.h"
+#include "can_bus.h"
+#include "can_filter.h"
+#include "can_fmt.h"
+#include "can_gen.h"
+#include "can_hwf.h"
+#include "can_lat.h"
+#include "can_mon.h"
+#include "can_sched.h"
+#include "can_sup.h"
+#include "sys_diag.h"
+
+#ifndef TAG
+#define TAG "can_console"
+#endif
+
+#ifndef CAN_CONSOLE_PROMPT
+#define CAN_CONSOLE_PROMPT  "can> "
+#endif
+
+/* ---------------- gen ---------------- */
+
+static struct {
+    struct arg_str *action;
+    struct arg_int *rate;
+    struct arg_int *load;
+    struct arg_str *id;
+    struct arg_lit *rand;
+    struct arg_lit *ext;
+    struct arg_str *dlc;
+    struct arg_int *time;
+    struct arg_lit *seq;
+    struct arg_end *end;
+} s_gen_args;
+
+/* "0x123" or "0x100-0x1FF" */
+static bool parse_id(const char *s, uint32_t *lo, uint32_t *hi)
+{
+    char *end;
+    *lo = strtoul(s, &end, 0);
+    if (end == s) return false;
+    if (*end == '\0') {
+        *hi = *lo;
+        return true;
+    }
+    if (*end != '-') return false;
+    const char *p = end + 1;
+    *hi = strtoul(p, &end, 0);
+    return end != p && *end == '\0' && *hi >= *lo;
+}
+
+/* "8", "0-8" or "0:1,8:3" */
+static bool parse_dlc(const char *s, uint8_t w[9])
+{
+    memset(w, 0, 9);
+
+    char *end;
+    unsigned long a = strtoul(s, &end, 10);
+    if (end == s || a > 8) return false;
+
+    if (*end == '\0') {
+        w[a] = 1;
+        return true;
+    }
+    if (*end == '-') {
+        unsigned long b = strtoul(end + 1, &end, 10);
+        if (*end != '\0' || b > 8 || b < a) return false;
+        for (unsigned long d = a; d <= b; d++) w[d] = 1;
+        return true;
+    }
+
+    /* d:w[,d:w...] */
+    const char *p = s;
+    while (*p) {
+        unsigned long d = strtoul(p, &end, 10);
+        if (end == p || *end != ':' || d > 8) return false;
+        p = end + 1;
+        unsigned long wt = strtoul(p, &end, 10);
+        if (end == p || wt > 255) return false;
+        w[d] = (uint8_t)wt;
+        if (*end == ',') end++;
+        else if (*end != '\0') return false;
+        p = end;
+    }
+    return true;
+}
+
+static void print_stats(void)
+{
+    can_gen_stats_t st;
+    can_gen_get_stats(&st);
+
+    printf("%s  target %u fps  achieved %u fps (avg %u)  load %u.%u %%\n",
+           st.running ? "running" : "stopped",
+           (unsigned)st.target_fps, (unsigned)st.achieved_fps, (unsigned)st.avg_fps,
+           (unsigned)(st.load_x10 / 10), (unsigned)(st.load_x10 % 10));
+    printf("queued %u  sent %u  queue full %u  arb lost %u  bus errors %u  failed %u  %u ms\n",
+           (unsigned)st.queued, (unsigned)st.sent, (unsigned)st.queue_full,
+           (unsigned)st.arb_lost, (unsigned)st.bus_errors, (unsigned)st.tx_failed,
+           (unsigned)st.elapsed_ms);
+    if (st.last_err != ESP_OK) printf("last error: %s\n", esp_err_to_name(st.last_err));
+}
+
+static int cmd_gen(int argc, char **argv)
+{
+    if (arg_parse(argc, argv, (void **)&s_gen_args) != 0) {
+        arg_print_errors(stderr, s_gen_args.end, argv[0]);
+        return 1;
+    }
+
+    const char *action = s_gen_args.action->sval[0];
+
+    if (strcmp(action, "stop") == 0) {
+        can_gen_stop();
+        return 0;
+    }
+    if (strcmp(action, "stat") == 0) {
+        print_stats();
+        return 0;
+    }
+    if (strcmp(action, "start") != 0) {
+        printf("unknown action '%s'\n", action);
+        return 1;
+    }
+
+    can_gen_cfg_t cfg = CAN_GEN_CFG_DEFAULT();
+    cfg.ext = s_gen_args.ext->count > 0;
+    cfg.seq_payload = s_gen_args.seq->count > 0;
+    if (s_gen_args.rate->count) cfg.rate_fps = (uint32_t)s_gen_args.rate->ival[0];
+    if (s_gen_args.load->count) cfg.load_pct = (uint8_t)s_gen_args.load->ival[0];
+    if (s_gen_args.time->count) cfg.duration_ms = (uint32_t)s_gen_args.time->ival[0];
+
+    if (s_gen_args.id->count) {
+        if (!parse_id(s_gen_args.id->sval[0], &cfg.id_lo, &cfg.id_hi)) {
+            printf("bad id '%s'\n", s_gen_args.id->sval[0]);
+            return 1;
+        }
+        if (cfg.id_hi != cfg.id_lo) {
+            cfg.id_mode = s_gen_args.rand->count ? CAN_GEN_ID_RANDOM : CAN_GEN_ID_SEQ;
+        }
+    } else if (cfg.ext) {
+        cfg.id_lo = cfg.id_hi = 0x18FF0000;
+    }
+
+    if (s_gen_args.dlc->count && !parse_dlc(s_gen_args.dlc->sval[0], cfg.dlc_weight)) {
+        printf("bad dlc '%s'\n", s_gen_args.dlc->sval[0]);
+        return 1;
+    }
+
+    esp_err_t err = can_gen_start(&cfg);
+    if (err != ESP_OK) {
+        printf("start failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+static esp_err_t register_gen(void)
+{
+    s_gen_args.action = arg_str1(NULL, NULL, "<start|stop|stat>", "action");
+    s_gen_args.rate   = arg_int0("r", "rate", "<fps>", "target frames/s");
+    s_gen_args.load   = arg_int0("l", "load", "<pct>", "target bus load (without -r)");
+    s_gen_args.id     = arg_str0("i", "id", "<id|lo-hi>", "identifier or range");
+    s_gen_args.rand   = arg_lit0(NULL, "rand", "random IDs in the range");
+    s_gen_args.ext    = arg_lit0("x", "ext", "29-bit identifiers");
+    s_gen_args.dlc    = arg_str0("d", "dlc", "<n|a-b|n:w,..>", "DLC distribution");
+    s_gen_args.time   = arg_int0("t", "time", "<ms>", "run time (default: until stopped)");
+    s_gen_args.seq    = arg_lit0("s", "seq", "running counter in bytes 0..3");
+    s_gen_args.end    = arg_end(4);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "gen",
+        .help     = "Traffic generator; without -r/-l frames go back-to-back",
+        .hint     = NULL,
+        .func     = cmd_gen,
+        .argtable = &s_gen_args,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- lat ---------------- */
+
+static int cmd_lat(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        can_lat_reset();
+        return 0;
+    }
+    if (argc > 1) {
+        printf("usage: lat [reset]\n");
+        return 1;
+    }
+
+    static char buf[1024];
+    can_lat_format(buf, sizeof(buf));
+    fputs(buf, stdout);
+    return 0;
+}
+
+static esp_err_t register_lat(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "lat",
+        .help    = "Pipeline latency histograms; 'lat reset' clears them",
+        .hint    = "[reset]",
+        .func    = cmd_lat,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- sys ---------------- */
+
+static int cmd_sys(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    static char buf[2560];
+    sys_diag_format(buf, sizeof(buf));
+    fputs(buf, stdout);
+    return 0;
+}
+
+static esp_err_t register_sys(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "sys",
+        .help    = "Per-core and per-task CPU, stack high-water marks and heap",
+        .hint    = NULL,
+        .func    = cmd_sys,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- cap ---------------- */
+
+#ifndef CAN_CONSOLE_CAP_DUMP
+#define CAN_CONSOLE_CAP_DUMP  100   /* frames per 'cap dump' without a count */
+#endif
+
+/* The console's reader: each dump continues where the last one stopped */
+static can_mon_cap_cursor_t s_cap_cur;
+static bool s_cap_cur_valid = false;
+
+static const char *const k_cap_policy[] = { "overwrite", "stop", "drop" };
+
+static void print_cap_stats(void)
+{
+    printf("%u / %u records  dropped %u%s\n",
+           (unsigned)can_mon_capture_count(), (unsigned)can_mon_capture_capacity(),
+           (unsigned)can_mon_capture_get_drop_cnt(),
+           can_mon_capture_is_stopped() ? "  stopped (full)" : "");
+}
+
+static int cap_dump(size_t max)
+{
+    if (!s_cap_cur_valid) {
+        can_mon_capture_cursor_oldest(&s_cap_cur);
+        s_cap_cur_valid = true;
+    }
+
+    can_evt_t evts[16];
+    char line[CAN_FMT_LINE_MAX];
+    size_t done = 0, n;
+    const uint32_t lost0 = s_cap_cur.lost;
+
+    while (done < max) {
+        size_t want = max - done < 16 ? max - done : 16;
+        n = can_mon_capture_read(&s_cap_cur, evts, want);
+        if (n == 0) break;
+        for (size_t i = 0; i < n; i++) {
+            can_fmt_line(line, &evts[i]);
+            printf("%10lld.%06u  %s\n", (long long)(evts[i].t_us / 1000000),
+                   (unsigned)(evts[i].t_us % 1000000), line);
+        }
+        done += n;
+    }
+
+    /* In DROP_NEWEST the writer waits for us to make room */
+    can_mon_capture_release(&s_cap_cur);
+
+    printf("-- %u frames", (unsigned)done);
+    if (s_cap_cur.lost != lost0) {
+        printf(", %u records skipped (overwritten or before a SYNC)", (unsigned)(s_cap_cur.lost - lost0));
+    }
+    printf("\n");
+    return 0;
+}
+
+static int cmd_cap(int argc, char **argv)
+{
+    if (can_mon_capture_capacity() == 0) {
+        printf("capture store disabled (CAN_MON_CAPTURE_SIZE_MB)\n");
+        return 1;
+    }
+    if (argc == 1) {
+        print_cap_stats();
+        return 0;
+    }
+
+    if (strcmp(argv[1], "dump") == 0 && argc <= 3) {
+        size_t max = CAN_CONSOLE_CAP_DUMP;
+        if (argc == 3) {
+            char *end;
+            max = strtoul(argv[2], &end, 0);
+            if (end == argv[2] || *end != '\0') {
+                printf("bad count '%s'\n", argv[2]);
+                return 1;
+            }
+        }
+        return cap_dump(max);
+    }
+    if (strcmp(argv[1], "rewind") == 0 && argc == 2) {
+        s_cap_cur_valid = false;
+        return 0;
+    }
+    if (strcmp(argv[1], "clear") == 0 && argc == 2) {
+        can_mon_capture_clear();
+        s_cap_cur_valid = false;
+        return 0;
+    }
+    if (strcmp(argv[1], "policy") == 0 && argc == 3) {
+        for (size_t i = 0; i < sizeof(k_cap_policy) / sizeof(k_cap_policy[0]); i++) {
+            if (strcmp(argv[2], k_cap_policy[i]) == 0) {
+                can_mon_capture_set_policy((can_mon_cap_policy_t)i);
+                s_cap_cur_valid = false;
+                return 0;
+            }
+        }
+        printf("unknown policy '%s'\n", argv[2]);
+        return 1;
+    }
+
+    printf("usage: cap [dump [n] | rewind | clear | policy <overwrite|stop|drop>]\n");
+    return 1;
+}
+
+static esp_err_t register_cap(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "cap",
+        .help    = "Capture store: stats, dump the next n frames, rewind to the oldest, clear, policy",
+        .hint    = "[dump [n] | rewind | clear | policy <overwrite|stop|drop>]",
+        .func    = cmd_cap,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- hwf ---------------- */
+
+static int cmd_hwf(int argc, char **argv)
+{
+    static can_hwf_range_t ids[CAN_HWF_MAX_RANGES];
+    size_t n = 0;
+    bool ext = false;
+
+    if (argc < 2) {
+        printf("usage: hwf off | hwf [std|ext] <id|lo-hi>...\n");
+        return 1;
+    }
+
+    if (!(argc == 2 && strcmp(argv[1], "off") == 0)) {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "std") == 0 || strcmp(argv[i], "ext") == 0) {
+                ext = argv[i][0] == 'e';
+                continue;
+            }
+            uint32_t lo, hi;
+            if (!parse_id(argv[i], &lo, &hi) || hi > (ext ? 0x1FFFFFFFu : 0x7FFu)) {
+                printf("bad %s id '%s'\n", ext ? "ext" : "std", argv[i]);
+                return 1;
+            }
+            if (n == CAN_HWF_MAX_RANGES) {
+                printf("at most %u IDs/ranges\n", (unsigned)CAN_HWF_MAX_RANGES);
+                return 1;
+            }
+            ids[n++] = CAN_HWF_RANGE(lo, hi, ext);
+        }
+    }
+
+    can_hwf_result_t r;
+    esp_err_t err = can_hwf_apply(ids, n, &r);
+    if (err != ESP_OK) {
+        printf("apply failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s filter  code 0x%08" PRIX32 "  mask 0x%08" PRIX32 "\n",
+           r.hw.single_filter ? "single" : "dual", r.hw.acceptance_code, r.hw.acceptance_mask);
+    printf("std %u wanted / %u passed (%u.%u %%)  ext %u wanted / %u passed (%u.%u %%)\n",
+           (unsigned)r.want_std, (unsigned)r.pass_std,
+           (unsigned)(r.std_ratio_x1000 / 10), (unsigned)(r.std_ratio_x1000 % 10),
+           (unsigned)r.want_ext, (unsigned)r.pass_ext,
+           (unsigned)(r.ext_ratio_x1000 / 10), (unsigned)(r.ext_ratio_x1000 % 10));
+    return 0;
+}
+
+static esp_err_t register_hwf(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "hwf",
+        .help    = "Hardware acceptance filter for the given IDs and ranges (reinstalls the driver); 'hwf off' accepts all",
+        .hint    = "off | [std|ext] <id|lo-hi>...",
+        .func    = cmd_hwf,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- filter ---------------- */
+
+#ifndef CAN_CONSOLE_FILTER_SRC
+#define CAN_CONSOLE_FILTER_SRC  512   /* rule text, bytes */
+#endif
+
+static int cmd_filter(int argc, char **argv)
+{
+    static char src[CAN_CONSOLE_FILTER_SRC];
+
+    if (argc < 2) {
+        printf("dropped %" PRIu32 " frames\n", can_filter_get_drop_cnt());
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "off") == 0) {
+        can_filter_set(NULL);
+        printf("filter off\n");
+        return 0;
+    }
+
+    /* Unquoted rules arrive split on spaces; put them back together */
+    size_t len = 0;
+    for (int i = 1; i < argc; i++) {
+        int k = snprintf(src + len, sizeof(src) - len, "%s%s", i > 1 ? " " : "", argv[i]);
+        if (k < 0 || (size_t)k >= sizeof(src) - len) {
+            printf("rules longer than %u bytes\n", (unsigned)sizeof(src) - 1);
+            return 1;
+        }
+        len += (size_t)k;
+    }
+
+    can_filter_t *f;
+    char err[48];
+    esp_err_t e = can_filter_compile(src, &f, err, sizeof(err));
+    if (e == ESP_ERR_INVALID_ARG) {
+        printf("%s\n", err);
+        return 1;
+    }
+    if (e != ESP_OK) {
+        printf("compile failed: %s\n", esp_err_to_name(e));
+        return 1;
+    }
+    printf("%u rules\n", (unsigned)can_filter_rule_count(f));
+    can_filter_set(f);
+    return 0;
+}
+
+static esp_err_t register_filter(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "filter",
+        .help    = "Compile and install software filter/trigger rules (can_filter.h); 'filter off' removes them, no args prints the drop count",
+        .hint    = "\"<rules>\" | off",
+        .func    = cmd_filter,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- sched ---------------- */
+
+#ifndef CAN_CONSOLE_SCHED_MAX
+#define CAN_CONSOLE_SCHED_MAX  16   /* cyclic messages added from the console */
+#endif
+
+/* can_sched has no enumeration; the console lists what it added itself */
+static struct {
+    can_sched_handle_t h;           /* 0: free */
+    uint32_t           id;
+    uint32_t           period_us;
+} s_sched[CAN_CONSOLE_SCHED_MAX];
+
+/* Up to 16 hex digits, two per byte */
+static bool parse_data(const char *s, uint8_t d[8], uint8_t *dlc)
+{
+    size_t n = strlen(s);
+    if (n % 2 || n > 16) return false;
+    for (size_t i = 0; i < n; i += 2) {
+        char byte[3] = { s[i], s[i + 1], '\0' };
+        char *end;
+        d[i / 2] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0') return false;
+    }
+    *dlc = (uint8_t)(n / 2);
+    return true;
+}
+
+static bool parse_ms(const char *s, uint32_t *us)
+{
+    char *end;
+    unsigned long ms = strtoul(s, &end, 0);
+    if (end == s || *end != '\0' || ms == 0 || ms > UINT32_MAX / 1000) return false;
+    *us = (uint32_t)ms * 1000;
+    return true;
+}
+
+/* "sched rm/period <n>": n is the row 'sched' prints */
+static int sched_slot(const char *s)
+{
+    char *end;
+    unsigned long n = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || n == 0 || n > CAN_CONSOLE_SCHED_MAX || !s_sched[n - 1].h) {
+        printf("no message %s\n", s);
+        return -1;
+    }
+    return (int)n - 1;
+}
+
+static void print_sched(void)
+{
+    printf("%u cyclic messages\n", (unsigned)can_sched_count());
+    for (size_t i = 0; i < CAN_CONSOLE_SCHED_MAX; i++) {
+        can_sched_stats_t st;
+        if (!s_sched[i].h || can_sched_get_stats(s_sched[i].h, &st) != ESP_OK) continue;
+        printf("%2u  ID=%0*" PRIX32 "  %6" PRIu32 " ms  sent %" PRIu32 "  missed %" PRIu32
+               "  tx fail %" PRIu32 "  jitter max %" PRIu32 " us\n",
+               (unsigned)i + 1, s_sched[i].id > 0x7FF ? 8 : 3, s_sched[i].id,
+               s_sched[i].period_us / 1000, st.sent, st.missed, st.tx_fail, st.jit_max_us);
+    }
+}
+
+static int cmd_sched(int argc, char **argv)
+{
+    if (argc == 1) {
+        print_sched();
+        return 0;
+    }
+
+    if (strcmp(argv[1], "add") == 0 && (argc == 4 || argc == 5)) {
+        twai_message_t m = { 0 };
+        uint32_t hi, period_us;
+        if (!parse_id(argv[2], &m.identifier, &hi) || hi != m.identifier || hi > 0x1FFFFFFF) {
+            printf("bad id '%s'\n", argv[2]);
+            return 1;
+        }
+        if (!parse_ms(argv[3], &period_us)) {
+            printf("bad period '%s'\n", argv[3]);
+            return 1;
+        }
+        if (argc == 5 && !parse_data(argv[4], m.data, &m.data_length_code)) {
+            printf("bad data '%s'\n", argv[4]);
+            return 1;
+        }
+        if (m.identifier > 0x7FF) m.flags = TWAI_MSG_FLAG_EXTD;
+
+        size_t i = 0;
+        while (i < CAN_CONSOLE_SCHED_MAX && s_sched[i].h) i++;
+        if (i == CAN_CONSOLE_SCHED_MAX) {
+            printf("console holds at most %u messages\n", (unsigned)CAN_CONSOLE_SCHED_MAX);
+            return 1;
+        }
+        can_sched_handle_t h = can_sched_add(&m, period_us, CAN_SCHED_PHASE_AUTO);
+        if (!h) {
+            printf("scheduler full or not running\n");
+            return 1;
+        }
+        s_sched[i].h = h;
+        s_sched[i].id = m.identifier;
+        s_sched[i].period_us = period_us;
+        printf("%u\n", (unsigned)i + 1);
+        return 0;
+    }
+    if (strcmp(argv[1], "rm") == 0 && argc == 3) {
+        int i = sched_slot(argv[2]);
+        if (i < 0) return 1;
+        (void)can_sched_remove(s_sched[i].h);
+        s_sched[i].h = 0;
+        return 0;
+    }
+    if (strcmp(argv[1], "period") == 0 && argc == 4) {
+        int i = sched_slot(argv[2]);
+        uint32_t period_us;
+        if (i < 0) return 1;
+        if (!parse_ms(argv[3], &period_us)) {
+            printf("bad period '%s'\n", argv[3]);
+            return 1;
+        }
+        esp_err_t err = can_sched_set_period(s_sched[i].h, period_us);
+        if (err != ESP_OK) {
+            printf("set period failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+        s_sched[i].period_us = period_us;
+        return 0;
+    }
+
+    printf("usage: sched [add <id> <ms> [hexdata] | rm <n> | period <n> <ms>]\n");
+    return 1;
+}
+
+static esp_err_t register_sched(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "sched",
+        .help    = "Cyclic TX: list, add a message every <ms> (IDs above 0x7FF are extended), remove, change period",
+        .hint    = "[add <id> <ms> [hexdata] | rm <n> | period <n> <ms>]",
+        .func    = cmd_sched,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- sup ---------------- */
+
+#ifndef CAN_CONSOLE_SUP_SAMPLES
+#define CAN_CONSOLE_SUP_SAMPLES  40   /* samples per 'sup series' without a count */
+#endif
+
+static const char *const k_twai_state[] = { "stopped", "running", "bus-off", "recovering" };
+
+static const char *state_name(uint32_t st)
+{
+    return st < sizeof(k_twai_state) / sizeof(k_twai_state[0]) ? k_twai_state[st] : "?";
+}
+
+static void print_sup(void)
+{
+    can_sup_stats_t st;
+    can_sup_get_stats(&st);
+
+    printf("%s%s%s  TEC %u  REC %u\n", state_name(st.state),
+           st.err_passive ? "  error passive" : st.err_warn ? "  error warning" : "",
+           st.recovering ? "  (recovery in progress)" : "",
+           (unsigned)st.tec, (unsigned)st.rec);
+    printf("rx missed %u  rx overrun %u  bus errors %u  arb lost %u  tx failed %u\n",
+           (unsigned)st.rx_missed, (unsigned)st.rx_overrun, (unsigned)st.bus_errors,
+           (unsigned)st.arb_lost, (unsigned)st.tx_failed);
+    printf("error passive %u  bus-off %u  recoveries %u  driver resets %u\n",
+           (unsigned)st.err_passive_cnt, (unsigned)st.bus_off_cnt,
+           (unsigned)st.recoveries, (unsigned)st.resets);
+
+    can_sup_recovery_t rec[CAN_SUP_RECOVERY_LOG];
+    size_t n = can_sup_get_recoveries(rec, CAN_SUP_RECOVERY_LOG);
+    for (size_t i = 0; i < n; i++) {
+        printf("  bus-off at %lld.%03u s  running after %u ms  ", (long long)(rec[i].t_off_us / 1000000),
+               (unsigned)(rec[i].t_off_us / 1000 % 1000), (unsigned)rec[i].restart_ms);
+        if (rec[i].rx_ms) printf("first RX after %u ms", (unsigned)rec[i].rx_ms);
+        else              printf("no RX");
+        printf("  %u attempt%s%s\n", (unsigned)rec[i].attempts, rec[i].attempts == 1 ? "" : "s",
+               rec[i].full_reset ? ", driver reset" : "");
+    }
+}
+
+static void print_sup_series(size_t max)
+{
+    static can_sup_sample_t smp[CAN_SUP_SERIES_LEN];
+    if (max > CAN_SUP_SERIES_LEN) max = CAN_SUP_SERIES_LEN;
+
+    size_t n = can_sup_get_series(smp, max);
+    for (size_t i = 0; i < n; i++) {
+        printf("%8u.%03u  %-10s  TEC %3u  REC %3u  errors %u\n",
+               (unsigned)(smp[i].t_ms / 1000), (unsigned)(smp[i].t_ms % 1000), state_name(smp[i].state),
+               (unsigned)smp[i].tec, (unsigned)smp[i].rec, (unsigned)smp[i].bus_errors);
+    }
+    printf("-- %u samples, %u ms apart\n", (unsigned)n, (unsigned)CAN_SUP_SAMPLE_MS);
+}
+
+static int cmd_sup(int argc, char **argv)
+{
+    if (argc == 1) {
+        print_sup();
+        return 0;
+    }
+    if (strcmp(argv[1], "series") == 0 && argc <= 3) {
+        size_t max = CAN_CONSOLE_SUP_SAMPLES;
+        if (argc == 3) {
+            char *end;
+            max = strtoul(argv[2], &end, 0);
+            if (end == argv[2] || *end != '\0') {
+                printf("bad count '%s'\n", argv[2]);
+                return 1;
+            }
+        }
+        print_sup_series(max);
+        return 0;
+    }
+
+    printf("usage: sup [series [n]]\n");
+    return 1;
+}
+
+static esp_err_t register_sup(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "sup",
+        .help    = "Bus supervisor: error state, counters and the last bus-off recoveries; 'sup series' the TEC/REC history",
+        .hint    = "[series [n]]",
+        .func    = cmd_sup,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- baud ---------------- */
+
+static const char *const k_twai_mode[] = { "normal", "noack", "listen" };
+
+static int cmd_baud(int argc, char **argv)
+{
+    if (argc == 1) {
+        can_bus_cfg_t cfg;
+        uint32_t max_us;
+        can_bus_get_cfg(&cfg);
+        uint32_t us = can_bus_get_switch_us(&max_us);
+        printf("%" PRIu32 " bit/s  %s  (last switch %" PRIu32 " us, slowest %" PRIu32 " us)\n",
+               cfg.bitrate, cfg.mode < 3 ? k_twai_mode[cfg.mode] : "?", us, max_us);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "set") == 0 && (argc == 3 || argc == 4)) {
+        char *end;
+        unsigned long rate = strtoul(argv[2], &end, 0);
+        if (end == argv[2] || (*end != '\0' && strcmp(end, "k") != 0) || rate == 0) {
+            printf("bad rate '%s'\n", argv[2]);
+            return 1;
+        }
+        if (*end == 'k') rate *= 1000;
+
+        can_bus_cfg_t cfg;
+        can_bus_get_cfg(&cfg);
+        twai_mode_t mode = cfg.mode;
+        if (argc == 4) {
+            size_t i = 0;
+            while (i < 3 && strcmp(argv[3], k_twai_mode[i]) != 0) i++;
+            if (i == 3) {
+                printf("unknown mode '%s'\n", argv[3]);
+                return 1;
+            }
+            mode = (twai_mode_t)i;
+        }
+
+        esp_err_t err = can_baud_set((uint32_t)rate, NULL, mode);
+        if (err != ESP_OK) {
+            printf("set failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "detect") == 0 && argc <= 3) {
+        uint32_t dwell_ms = 0;
+        if (argc == 3) {
+            char *end;
+            dwell_ms = strtoul(argv[2], &end, 0);
+            if (end == argv[2] || *end != '\0') {
+                printf("bad dwell '%s'\n", argv[2]);
+                return 1;
+            }
+        }
+
+        /* Lock in the mode the bus is in now; the scan itself only listens */
+        can_bus_cfg_t cfg;
+        can_bus_get_cfg(&cfg);
+        can_baud_result_t r = { 0 };
+        esp_err_t err = can_baud_detect(NULL, 0, dwell_ms, cfg.mode, &r);
+        if (r.bitrate) {
+            printf("locked at %" PRIu32 " bit/s: %" PRIu32 " frames, %" PRIu32 " candidate(s) in %" PRIu32
+                   " ms, switch max %" PRIu32 " us\n",
+                   r.bitrate, r.frames, r.tried, r.scan_ms, r.switch_max_us);
+        } else if (err == ESP_ERR_NOT_FOUND) {
+            printf("no rate matched (%" PRIu32 " tried in %" PRIu32 " ms); back at %" PRIu32 " bit/s\n",
+                   r.tried, r.scan_ms, cfg.bitrate);
+        }
+        if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) printf("detect failed: %s\n", esp_err_to_name(err));
+        return err == ESP_OK ? 0 : 1;
+    }
+
+    printf("usage: baud [set <rate>[k] [normal|noack|listen] | detect [dwell_ms]]\n");
+    return 1;
+}
+
+static esp_err_t register_baud(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "baud",
+        .help    = "Bit rate: show, set (optionally with a mode), or detect by listening at each standard rate",
+        .hint    = "[set <rate>[k] [normal|noack|listen] | detect [dwell_ms]]",
+        .func    = cmd_baud,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+/* ---------------- REPL ---------------- */
+
+esp_err_t can_console_start(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_cfg = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_cfg.prompt = CAN_CONSOLE_PROMPT;
+
+    esp_err_t err;
+#if defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
+    esp_console_dev_usb_serial_jtag_config_t hw_cfg = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    err = esp_console_new_repl_usb_serial_jtag(&hw_cfg, &repl_cfg, &repl);
+#elif defined(CONFIG_ESP_CONSOLE_USB_CDC)
+    esp_console_dev_usb_cdc_config_t hw_cfg = ESP_CONSOLE_DEV_CDC_CONFIG_DEFAULT();
+    err = esp_console_new_repl_usb_cdc(&hw_cfg, &repl_cfg, &repl);
+#else
+    esp_console_dev_uart_config_t hw_cfg = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    err = esp_console_new_repl_uart(&hw_cfg, &repl_cfg, &repl);
+#endif
+    if (err != ESP_OK) return err;
+
+    esp_console_register_help_command();
+    err = register_gen();
+    if (err == ESP_OK) err = register_lat();
+    if (err == ESP_OK) err = register_sys();
+    if (err == ESP_OK) err = register_cap();
+    if (err == ESP_OK) err = register_hwf();
+    if (err == ESP_OK) err = register_filter();
+    if (err == ESP_OK) err = register_sched();
+    if (err == ESP_OK) err = register_sup();
+    if (err == ESP_OK) err = register_baud();
+    if (err != ESP_OK) return err;
+
+    ESP_LOGI(TAG, "Console ready ('help' lists commands)");
+    return esp_console_start_repl(repl);
+}
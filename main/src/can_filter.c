@@ -0,0 +1,768 @@
+#include "can_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+
+#ifndef TAG
+#define TAG "can_filter"
+#endif
+
+#ifndef CAN_FILTER_MAX_NODES
+#define CAN_FILTER_MAX_NODES  2048   /* AST nodes per program */
+#endif
+
+#ifndef CAN_FILTER_RULE_IDS
+#define CAN_FILTER_RULE_IDS   32     /* IDs a rule may pin to and still be indexed */
+#endif
+
+/* ---------------- Program ----------------
+ *
+ * Each condition is one instruction: load a field, mask it, compare, jump to
+ * on_true or on_false. Targets at or above PC_REJECT end the rule. The code is
+ * a DAG, so every path ends after at most one visit per instruction.
+ */
+
+enum { FLD_ID, FLD_DLC, FLD_BYTE, FLD_EXT, FLD_RTR };
+enum { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_RANGE };
+
+#define PC_REJECT  0xFFFEu
+#define PC_ACCEPT  0xFFFFu
+
+typedef struct {
+    uint8_t  field;
+    uint8_t  cmp;
+    uint8_t  idx;      /* payload byte for FLD_BYTE */
+    uint8_t  rsvd;
+    uint32_t mask;
+    uint32_t a;
+    uint32_t b;        /* upper bound for CMP_RANGE */
+    uint16_t on_true;
+    uint16_t on_false;
+} filt_insn_t;
+
+typedef struct {
+    uint16_t entry;
+    bool     trig;
+} filt_rule_t;
+
+struct can_filter {
+    filt_insn_t *code;
+    filt_rule_t *rules;
+    uint16_t     n_rules;
+    uint16_t     n_pass;
+    bool         has_trig;
+
+    uint16_t    *unidx;        /* rules run for every frame */
+    uint16_t     n_unidx;
+
+    /* ID index: per-ID chains of rule numbers */
+    uint16_t    *link_rule;
+    uint16_t    *link_next;    /* link index + 1, 0 ends the chain */
+    uint32_t     std_map[2048 / 32];
+    uint16_t    *std_head;     /* 2048 chain heads, NULL if no 11-bit rules */
+    uint32_t    *ext_keys;     /* open addressing, EXT_EMPTY marks a free slot */
+    uint16_t    *ext_head;
+    uint32_t     ext_mask;
+};
+
+#define EXT_EMPTY  0xFFFFFFFFu
+
+static can_filter_trig_cb_t s_trig_cb = NULL;
+static void *s_trig_ctx = NULL;
+
+static inline bool insn_test(const filt_insn_t *in, const twai_message_t *m)
+{
+    uint32_t v;
+
+    switch (in->field) {
+    case FLD_ID:   v = m->identifier; break;
+    case FLD_DLC:  v = m->data_length_code; break;
+    case FLD_BYTE:
+        if (in->idx >= m->data_length_code || (m->flags & TWAI_MSG_FLAG_RTR)) return false;
+        v = m->data[in->idx];
+        break;
+    case FLD_EXT:  return (m->flags & TWAI_MSG_FLAG_EXTD) != 0;
+    case FLD_RTR:  return (m->flags & TWAI_MSG_FLAG_RTR) != 0;
+    default:       return false;
+    }
+
+    v &= in->mask;
+    switch (in->cmp) {
+    case CMP_EQ:    return v == in->a;
+    case CMP_NE:    return v != in->a;
+    case CMP_LT:    return v <  in->a;
+    case CMP_LE:    return v <= in->a;
+    case CMP_GT:    return v >  in->a;
+    case CMP_GE:    return v >= in->a;
+    case CMP_RANGE: return v >= in->a && v <= in->b;
+    default:        return false;
+    }
+}
+
+static bool rule_run(const can_filter_t *f, uint16_t pc, const twai_message_t *m)
+{
+    while (pc < PC_REJECT) {
+        const filt_insn_t *in = &f->code[pc];
+        pc = insn_test(in, m) ? in->on_true : in->on_false;
+    }
+    return pc == PC_ACCEPT;
+}
+
+static inline uint32_t ext_hash(uint32_t id, uint32_t mask)
+{
+    return ((id * 2654435769u) >> 16) & mask;
+}
+
+/* Head of the rule chain indexed under m's ID, 0 if none */
+static uint16_t chain_head(const can_filter_t *f, const twai_message_t *m)
+{
+    if (!(m->flags & TWAI_MSG_FLAG_EXTD)) {
+        const uint32_t id = m->identifier & 0x7FF;
+        if (!f->std_head || !((f->std_map[id >> 5] >> (id & 31)) & 1)) return 0;
+        return f->std_head[id];
+    }
+
+    if (!f->ext_keys) return 0;
+    const uint32_t id = m->identifier & 0x1FFFFFFFu;
+    for (uint32_t s = ext_hash(id, f->ext_mask);; s = (s + 1) & f->ext_mask) {
+        if (f->ext_keys[s] == id) return f->ext_head[s];
+        if (f->ext_keys[s] == EXT_EMPTY) return 0;
+    }
+}
+
+/* Run rule r; returns true once the frame is kept and no triggers remain */
+static inline bool rule_visit(const can_filter_t *f, uint16_t r, const twai_message_t *m, bool *keep)
+{
+    const filt_rule_t *rule = &f->rules[r];
+
+    if (!rule->trig && *keep) return false;
+    if (!rule_run(f, rule->entry, m)) return false;
+
+    if (rule->trig) {
+        if (s_trig_cb) s_trig_cb(r, m, s_trig_ctx);
+        return false;
+    }
+    *keep = true;
+    return !f->has_trig;
+}
+
+bool can_filter_eval(const can_filter_t *f, const twai_message_t *m)
+{
+    if (!f || !m) return true;
+
+    bool keep = (f->n_pass == 0);
+    if (keep && !f->has_trig) return true;
+
+    for (uint16_t l = chain_head(f, m); l; l = f->link_next[l - 1]) {
+        if (rule_visit(f, f->link_rule[l - 1], m, &keep)) return true;
+    }
+    for (uint16_t i = 0; i < f->n_unidx; i++) {
+        if (rule_visit(f, f->unidx[i], m, &keep)) return true;
+    }
+    return keep;
+}
+
+size_t can_filter_batch(const can_filter_t *f, twai_message_t *msgs, size_t n)
+{
+    if (!f) return n;
+
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!can_filter_eval(f, &msgs[i])) continue;
+        if (k != i) msgs[k] = msgs[i];
+        k++;
+    }
+    return k;
+}
+
+size_t can_filter_rule_count(const can_filter_t *f)
+{
+    return f ? f->n_rules : 0;
+}
+
+void can_filter_free(can_filter_t *f)
+{
+    if (!f) return;
+    free(f->code);
+    free(f->rules);
+    free(f->unidx);
+    free(f->link_rule);
+    free(f->link_next);
+    free(f->std_head);
+    free(f->ext_keys);
+    free(f->ext_head);
+    free(f);
+}
+
+void can_filter_set_trigger_cb(can_filter_trig_cb_t cb, void *ctx)
+{
+    s_trig_ctx = ctx;
+    s_trig_cb = cb;
+}
+
+/* ---------------- Parser ---------------- */
+
+enum { N_COND, N_AND, N_OR, N_NOT };
+
+typedef struct {
+    uint8_t     kind;
+    uint16_t    l, r;
+    filt_insn_t cond;
+} filt_node_t;
+
+enum { T_END, T_SEP, T_LP, T_RP, T_AND, T_OR, T_NOT, T_CMP, T_AMP, T_SLASH, T_DASH, T_NUM, T_WORD, T_BAD };
+
+typedef struct {
+    const char  *src;
+    const char  *p;
+    int          tok;
+    const char  *tok_at;
+    uint32_t     num;
+    uint32_t     num_care;     /* bits of num that are not 'x' wildcards */
+    uint8_t      cmp;
+    char         word[8];
+
+    filt_node_t *nodes;
+    uint16_t     n_nodes;
+    uint16_t     depth;        /* open NOTs and parentheses */
+    const char  *err;
+    const char  *err_at;
+} filt_parser_t;
+
+static bool fail(filt_parser_t *ps, const char *msg)
+{
+    if (!ps->err) {
+        ps->err = msg;
+        ps->err_at = ps->tok_at;
+    }
+    return false;
+}
+
+static void lex(filt_parser_t *ps)
+{
+    const char *p = ps->p;
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    ps->tok_at = p;
+
+    char c = *p;
+    if (c == '\0')           { ps->tok = T_END; }
+    else if (c == ';' || c == '\n') { ps->tok = T_SEP; p++; }
+    else if (c == '(')       { ps->tok = T_LP; p++; }
+    else if (c == ')')       { ps->tok = T_RP; p++; }
+    else if (c == '/')       { ps->tok = T_SLASH; p++; }
+    else if (c == '-')       { ps->tok = T_DASH; p++; }
+    else if (c == '&' && p[1] == '&') { ps->tok = T_AND; p += 2; }
+    else if (c == '|' && p[1] == '|') { ps->tok = T_OR; p += 2; }
+    else if (c == '&')       { ps->tok = T_AMP; p++; }
+    else if (c == '=' && p[1] == '=') { ps->tok = T_CMP; ps->cmp = CMP_EQ; p += 2; }
+    else if (c == '!' && p[1] == '=') { ps->tok = T_CMP; ps->cmp = CMP_NE; p += 2; }
+    else if (c == '!')       { ps->tok = T_NOT; p++; }
+    else if (c == '<' || c == '>') {
+        bool eq = (p[1] == '=');
+        ps->tok = T_CMP;
+        ps->cmp = (c == '<') ? (eq ? CMP_LE : CMP_LT) : (eq ? CMP_GE : CMP_GT);
+        p += eq ? 2 : 1;
+    } else if (c >= '0' && c <= '9') {
+        uint32_t v = 0, wild = 0;
+        bool big = false;
+        if (c == '0' && (p[1] == 'x' || p[1] == 'X')) {
+            p += 2;
+            for (;; p++) {
+                int d;
+                if      (*p >= '0' && *p <= '9') d = *p - '0';
+                else if (*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+                else if (*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+                else if (*p == 'x' || *p == 'X') d = -1;
+                else break;
+                big |= ((v | wild) >> 28) != 0;
+                v = (v << 4) | (d < 0 ? 0 : (uint32_t)d);
+                wild = (wild << 4) | (d < 0 ? 0xF : 0);
+            }
+        } else {
+            for (; *p >= '0' && *p <= '9'; p++) {
+                uint32_t d = (uint32_t)(*p - '0');
+                big |= v > (UINT32_MAX - d) / 10;
+                v = v * 10 + d;
+            }
+        }
+        if (big) fail(ps, "number too large");
+        ps->tok = T_NUM;
+        ps->num = v;
+        ps->num_care = ~wild;
+    } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        size_t n = 0;
+        while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9')) {
+            if (n < sizeof(ps->word) - 1) ps->word[n++] = (char)(*p | 0x20);
+            p++;
+        }
+        ps->word[n] = '\0';
+        if      (!strcmp(ps->word, "and")) ps->tok = T_AND;
+        else if (!strcmp(ps->word, "or"))  ps->tok = T_OR;
+        else if (!strcmp(ps->word, "not")) ps->tok = T_NOT;
+        else                               ps->tok = T_WORD;
+    } else {
+        ps->tok = T_BAD;
+        p++;
+    }
+    ps->p = p;
+}
+
+static int node_new(filt_parser_t *ps, uint8_t kind, int l, int r)
+{
+    if (ps->n_nodes >= CAN_FILTER_MAX_NODES) {
+        fail(ps, "program too large");
+        return -1;
+    }
+    filt_node_t *n = &ps->nodes[ps->n_nodes];
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    n->l = (uint16_t)l;
+    n->r = (uint16_t)r;
+    return ps->n_nodes++;
+}
+
+static bool expect_num(filt_parser_t *ps, uint32_t *v)
+{
+    if (ps->tok != T_NUM) return fail(ps, "expected number");
+    *v = ps->num;
+    lex(ps);
+    return true;
+}
+
+static int parse_cond(filt_parser_t *ps)
+{
+    if (ps->tok != T_WORD) {
+        fail(ps, "expected condition");
+        return -1;
+    }
+
+    int id = node_new(ps, N_COND, 0, 0);
+    if (id < 0) return -1;
+    filt_insn_t *c = &ps->nodes[id].cond;
+    c->mask = 0xFFFFFFFFu;
+
+    const char *w = ps->word;
+
+    if (!strcmp(w, "ext") || !strcmp(w, "std") || !strcmp(w, "rtr") || !strcmp(w, "data")) {
+        c->field = (w[0] == 'r' || w[0] == 'd') ? FLD_RTR : FLD_EXT;
+        /* std / data are the negations; compile as a NOT node */
+        bool neg = (w[0] == 's' || w[0] == 'd');
+        lex(ps);
+        return neg ? node_new(ps, N_NOT, id, 0) : id;
+    }
+
+    if (!strcmp(w, "id")) {
+        c->field = FLD_ID;
+        c->mask = 0x1FFFFFFFu;
+        lex(ps);
+        if (ps->tok == T_CMP) {
+            c->cmp = ps->cmp;
+            lex(ps);
+            return expect_num(ps, &c->a) ? id : -1;
+        }
+        if (ps->tok != T_NUM) {
+            fail(ps, "expected ID");
+            return -1;
+        }
+        c->cmp = CMP_EQ;
+        c->a = ps->num;
+        c->mask &= ps->num_care;
+        lex(ps);
+        if (ps->tok == T_SLASH) {
+            lex(ps);
+            uint32_t m;
+            if (!expect_num(ps, &m)) return -1;
+            c->mask &= m;
+        } else if (ps->tok == T_DASH) {
+            lex(ps);
+            c->cmp = CMP_RANGE;
+            c->mask = 0x1FFFFFFFu;
+            if (!expect_num(ps, &c->b)) return -1;
+        }
+        c->a &= c->mask;
+        return id;
+    }
+
+    if (!strcmp(w, "dlc")) {
+        c->field = FLD_DLC;
+        lex(ps);
+        if (ps->tok != T_CMP) {
+            fail(ps, "expected CMP");
+            return -1;
+        }
+        c->cmp = ps->cmp;
+        lex(ps);
+        return expect_num(ps, &c->a) ? id : -1;
+    }
+
+    /* d0..d7 / b0..b7 / byte0..byte7 */
+    size_t wl = strlen(w);
+    if (wl >= 2 && (w[0] == 'd' || w[0] == 'b') && w[wl - 1] >= '0' && w[wl - 1] <= '7' &&
+        (wl == 2 || !strncmp(w, "byte", 4))) {
+        c->field = FLD_BYTE;
+        c->idx = (uint8_t)(w[wl - 1] - '0');
+        c->mask = 0xFF;
+        lex(ps);
+        if (ps->tok == T_AMP) {
+            lex(ps);
+            uint32_t m;
+            if (!expect_num(ps, &m)) return -1;
+            c->mask = m & 0xFF;
+        }
+        if (ps->tok != T_CMP) {
+            fail(ps, "expected CMP");
+            return -1;
+        }
+        c->cmp = ps->cmp;
+        lex(ps);
+        return expect_num(ps, &c->a) ? id : -1;
+    }
+
+    fail(ps, "unknown field");
+    return -1;
+}
+
+static int parse_expr(filt_parser_t *ps);
+
+static int parse_unary(filt_parser_t *ps)
+{
+    if (ps->tok != T_NOT && ps->tok != T_LP) return parse_cond(ps);
+
+    if (ps->depth >= CAN_FILTER_MAX_DEPTH) {
+        fail(ps, "too deeply nested");
+        return -1;
+    }
+    ps->depth++;
+
+    int x;
+    if (ps->tok == T_NOT) {
+        lex(ps);
+        x = parse_unary(ps);
+        if (x >= 0) x = node_new(ps, N_NOT, x, 0);
+    } else {
+        lex(ps);
+        x = parse_expr(ps);
+        if (x >= 0 && ps->tok != T_RP) {
+            fail(ps, "expected ')'");
+            x = -1;
+        } else if (x >= 0) {
+            lex(ps);
+        }
+    }
+    ps->depth--;
+    return x;
+}
+
+static int parse_term(filt_parser_t *ps)
+{
+    int l = parse_unary(ps);
+    while (l >= 0 && ps->tok == T_AND) {
+        lex(ps);
+        int r = parse_unary(ps);
+        l = (r < 0) ? -1 : node_new(ps, N_AND, l, r);
+    }
+    return l;
+}
+
+static int parse_expr(filt_parser_t *ps)
+{
+    int l = parse_term(ps);
+    while (l >= 0 && ps->tok == T_OR) {
+        lex(ps);
+        int r = parse_term(ps);
+        l = (r < 0) ? -1 : node_new(ps, N_OR, l, r);
+    }
+    return l;
+}
+
+/* ---------------- Code generation ----------------
+ *
+ * gen() emits a node given where to go on true and on false, and returns its
+ * entry point. Children are emitted right to left so every jump target is
+ * known when the jump is written. The left child and NOT's operand are taken
+ * in the loop, so a long AND/OR chain (a left spine) does not recurse and the
+ * depth stays within CAN_FILTER_MAX_DEPTH.
+ */
+
+typedef struct {
+    filt_insn_t *code;
+    uint16_t     n;
+} filt_gen_t;
+
+static int gen(filt_gen_t *g, const filt_node_t *nodes, int x, uint16_t t, uint16_t f)
+{
+    while (1) {
+        const filt_node_t *n = &nodes[x];
+
+        switch (n->kind) {
+        case N_COND: {
+            filt_insn_t *in = &g->code[g->n];
+            *in = n->cond;
+            in->on_true = t;
+            in->on_false = f;
+            return g->n++;
+        }
+        case N_AND:
+            t = (uint16_t)gen(g, nodes, n->r, t, f);
+            break;
+        case N_OR:
+            f = (uint16_t)gen(g, nodes, n->r, t, f);
+            break;
+        default: {
+            uint16_t tmp = t;
+            t = f;
+            f = tmp;
+            break;
+        }
+        }
+        x = n->l;
+    }
+}
+
+/* IDs a node can only match within, written to out[0..cap); -1 if
+ * unbounded, more than cap or deeper than is worth recursing for */
+static int id_set(const filt_node_t *nodes, int x, uint32_t *out, int cap, int depth)
+{
+    const filt_node_t *n = &nodes[x];
+    if (depth > CAN_FILTER_MAX_DEPTH) return -1;
+
+    if (n->kind == N_COND) {
+        const filt_insn_t *c = &n->cond;
+        if (c->field != FLD_ID) return -1;
+        if (c->cmp == CMP_EQ) {
+            uint32_t dc = ~c->mask & 0x1FFFFFFFu;
+            int bits = __builtin_popcount(dc);
+            if (bits > 16 || (1 << bits) > cap) return -1;
+            /* Enumerate the wildcard bits */
+            int k = 0;
+            uint32_t sub = 0;
+            do {
+                out[k++] = c->a | sub;
+                sub = (sub - dc) & dc;
+            } while (sub != 0);
+            return k;
+        }
+        if (c->cmp == CMP_RANGE && c->b >= c->a && c->b - c->a < (uint32_t)cap) {
+            int k = 0;
+            for (uint32_t id = c->a; id <= c->b; id++) out[k++] = id;
+            return k;
+        }
+        return -1;
+    }
+
+    if (n->kind == N_NOT) return -1;
+
+    int na = id_set(nodes, n->l, out, cap, depth + 1);
+
+    if (n->kind == N_AND) {
+        /* Either side bounds the conjunction; keep the tighter one */
+        if (na < 0) return id_set(nodes, n->r, out, cap, depth + 1);
+        int nb = id_set(nodes, n->r, out + na, cap - na, depth + 1);
+        if (nb >= 0 && nb < na) {
+            memmove(out, out + na, nb * sizeof(uint32_t));
+            return nb;
+        }
+        return na;
+    }
+
+    if (na < 0) return -1;
+    int nb = id_set(nodes, n->r, out + na, cap - na, depth + 1);
+    return nb < 0 ? -1 : na + nb;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    int      root;
+    bool     trig;
+    int      n_ids;                 /* -1: not indexed */
+    uint32_t ids[CAN_FILTER_RULE_IDS];
+} filt_src_rule_t;
+
+static esp_err_t index_build(can_filter_t *f, const filt_src_rule_t *rs, size_t n_links, size_t n_ext)
+{
+    f->link_rule = calloc(n_links ? n_links : 1, sizeof(uint16_t));
+    f->link_next = calloc(n_links ? n_links : 1, sizeof(uint16_t));
+    f->unidx = calloc(f->n_rules ? f->n_rules : 1, sizeof(uint16_t));
+    if (!f->link_rule || !f->link_next || !f->unidx) return ESP_ERR_NO_MEM;
+
+    if (n_ext > 0) {
+        uint32_t slots = 4;
+        while (slots < 2 * n_ext) slots <<= 1;
+        f->ext_keys = malloc(slots * sizeof(uint32_t));
+        f->ext_head = calloc(slots, sizeof(uint16_t));
+        if (!f->ext_keys || !f->ext_head) return ESP_ERR_NO_MEM;
+        memset(f->ext_keys, 0xFF, slots * sizeof(uint32_t));
+        f->ext_mask = slots - 1;
+    }
+
+    uint16_t nl = 0;
+    for (uint16_t r = 0; r < f->n_rules; r++) {
+        if (rs[r].n_ids < 0) {
+            f->unidx[f->n_unidx++] = r;
+            continue;
+        }
+        for (int i = 0; i < rs[r].n_ids; i++) {
+            const uint32_t id = rs[r].ids[i];
+
+            /* An 11-bit value can also be an extended ID; index both */
+            if (id <= 0x7FF) {
+                if (!f->std_head) {
+                    f->std_head = calloc(2048, sizeof(uint16_t));
+                    if (!f->std_head) return ESP_ERR_NO_MEM;
+                }
+                f->link_rule[nl] = r;
+                f->link_next[nl] = f->std_head[id];
+                f->std_head[id] = ++nl;
+                f->std_map[id >> 5] |= 1u << (id & 31);
+            }
+
+            uint32_t s = ext_hash(id, f->ext_mask);
+            while (f->ext_keys[s] != EXT_EMPTY && f->ext_keys[s] != id) s = (s + 1) & f->ext_mask;
+            f->ext_keys[s] = id;
+            f->link_rule[nl] = r;
+            f->link_next[nl] = f->ext_head[s];
+            f->ext_head[s] = ++nl;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t can_filter_compile(const char *src, can_filter_t **out, char *err, size_t err_sz)
+{
+    if (!src || !out) return ESP_ERR_INVALID_ARG;
+    *out = NULL;
+
+    filt_parser_t ps = { .src = src, .p = src };
+    ps.nodes = malloc(CAN_FILTER_MAX_NODES * sizeof(filt_node_t));
+    filt_src_rule_t *rs = malloc(CAN_FILTER_MAX_RULES * sizeof(filt_src_rule_t));
+    can_filter_t *f = calloc(1, sizeof(*f));
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (!ps.nodes || !rs || !f) goto done;
+
+    /* Parse all rules */
+    uint16_t n_rules = 0;
+    lex(&ps);
+    while (ps.tok != T_END && !ps.err) {
+        if (ps.tok == T_SEP) {
+            lex(&ps);
+            continue;
+        }
+        if (n_rules >= CAN_FILTER_MAX_RULES) {
+            fail(&ps, "too many rules");
+            break;
+        }
+
+        filt_src_rule_t *r = &rs[n_rules];
+        r->trig = false;
+        if (ps.tok == T_WORD && (!strcmp(ps.word, "pass") || !strcmp(ps.word, "trig"))) {
+            r->trig = (ps.word[0] == 't');
+            lex(&ps);
+        }
+
+        r->root = parse_expr(&ps);
+        if (r->root < 0) break;
+        if (ps.tok != T_SEP && ps.tok != T_END) {
+            fail(&ps, "expected ';'");
+            break;
+        }
+        n_rules++;
+    }
+
+    if (ps.err) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "col %d: %s", (int)(ps.err_at - src) + 1, ps.err);
+        }
+        ret = ESP_ERR_INVALID_ARG;
+        goto done;
+    }
+
+    /* Generate code; each condition node becomes at most one instruction */
+    f->code = malloc((ps.n_nodes ? ps.n_nodes : 1) * sizeof(filt_insn_t));
+    f->rules = calloc(n_rules ? n_rules : 1, sizeof(filt_rule_t));
+    if (!f->code || !f->rules) goto done;
+
+    filt_gen_t g = { .code = f->code, .n = 0 };
+    size_t n_links = 0, n_ext = 0;
+    for (uint16_t i = 0; i < n_rules; i++) {
+        f->rules[i].entry = (uint16_t)gen(&g, ps.nodes, rs[i].root, PC_ACCEPT, PC_REJECT);
+        f->rules[i].trig = rs[i].trig;
+        if (rs[i].trig) f->has_trig = true;
+        else            f->n_pass++;
+
+        rs[i].n_ids = id_set(ps.nodes, rs[i].root, rs[i].ids, CAN_FILTER_RULE_IDS, 0);
+        if (rs[i].n_ids > 0) {
+            /* Duplicates would run (and trigger) a rule twice */
+            qsort(rs[i].ids, rs[i].n_ids, sizeof(uint32_t), cmp_u32);
+            int k = 1;
+            for (int j = 1; j < rs[i].n_ids; j++) {
+                if (rs[i].ids[j] != rs[i].ids[k - 1]) rs[i].ids[k++] = rs[i].ids[j];
+            }
+            rs[i].n_ids = k;
+            for (int j = 0; j < k; j++) n_links += (rs[i].ids[j] <= 0x7FF) ? 2 : 1;
+            n_ext += k;
+        }
+    }
+    f->n_rules = n_rules;
+
+    ret = index_build(f, rs, n_links, n_ext);
+    if (ret != ESP_OK) goto done;
+
+    *out = f;
+    f = NULL;
+
+done:
+    can_filter_free(f);
+    free(ps.nodes);
+    free(rs);
+    return ret;
+}
+
+/* ---------------- RX path ----------------
+ *
+ * Only the RX task touches s_active. Other tasks hand over a new program
+ * through s_pending; the RX task adopts it between batches and frees the old
+ * one, so a program is never freed while it is being evaluated.
+ */
+
+static char s_none;                               /* "remove the filter" marker */
+#define FILTER_NONE  ((can_filter_t *)(void *)&s_none)
+
+static can_filter_t *_Atomic s_pending = NULL;
+static can_filter_t *s_active = NULL;
+static uint32_t s_drop_cnt = 0;
+
+void can_filter_set(can_filter_t *f)
+{
+    can_filter_t *old = atomic_exchange(&s_pending, f ? f : FILTER_NONE);
+    /* A program that was never picked up can go right away */
+    if (old && old != FILTER_NONE) can_filter_free(old);
+}
+
+size_t can_filter_rx(twai_message_t *msgs, size_t n)
+{
+    if (atomic_load_explicit(&s_pending, memory_order_relaxed)) {
+        can_filter_t *p = atomic_exchange(&s_pending, NULL);
+        if (p) {
+            can_filter_free(s_active);
+            s_active = (p == FILTER_NONE) ? NULL : p;
+            ESP_LOGI(TAG, "RX filter: %u rules", (unsigned)can_filter_rule_count(s_active));
+        }
+    }
+
+    if (!s_active) return n;
+
+    size_t kept = can_filter_batch(s_active, msgs, n);
+    s_drop_cnt += n - kept;
+    return kept;
+}
+
+uint32_t can_filter_get_drop_cnt(void) { return s_drop_cnt; }
@@ -0,0 +1,167 @@
+// main/src/can_fmt.c
+//
+// Table-driven CAN line formatter. Replaces up to a dozen snprintf() calls per
+// frame with lookups into a 256-entry hex-pair table and fixed column writes.
+
+#include "can_fmt.h"
+
+#include <string.h>
+
+/* "00" "01" ... "FF", two characters per byte value */
+static const char s_hex_pairs[512] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+static const char s_hex_digits[16] = "0123456789ABCDEF";
+
+static inline char *put_pair(char *p, uint8_t b)
+{
+    memcpy(p, &s_hex_pairs[b * 2], 2);
+    return p + 2;
+}
+
+/* Upper-case hex, zero padded to at least min_digits (like "%0*X") */
+static char *put_hex(char *p, uint32_t v, int min_digits)
+{
+    int digits = 1;
+    while (digits < 8 && (v >> (digits * 4)) != 0) digits++;
+    if (digits < min_digits) digits = min_digits;
+
+    for (int i = digits - 1; i >= 0; i--) {
+        *p++ = s_hex_digits[(v >> (i * 4)) & 0xF];
+    }
+    return p;
+}
+
+/* Unsigned decimal for 0..255 (like "%u" on a uint8_t) */
+static char *put_u8(char *p, unsigned v)
+{
+    if (v >= 100) *p++ = (char)('0' + v / 100);
+    if (v >= 10)  *p++ = (char)('0' + (v / 10) % 10);
+    *p++ = (char)('0' + v % 10);
+    return p;
+}
+
+/* Unsigned decimal (like "%u") */
+static char *put_u32(char *p, uint32_t v)
+{
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static const char *const s_bus_names[] = {
+    [CAN_BUS_EVT_ERR_WARN]    = "ERR-WARN",
+    [CAN_BUS_EVT_ERR_PASSIVE] = "ERR-PASSIVE",
+    [CAN_BUS_EVT_ERR_ACTIVE]  = "ERR-ACTIVE",
+    [CAN_BUS_EVT_BUS_OFF]     = "BUS-OFF",
+    [CAN_BUS_EVT_RECOVERED]   = "RECOVERED",
+    [CAN_BUS_EVT_RX_LOST]     = "RX-LOST",
+    [CAN_BUS_EVT_RX_RESUMED]  = "RX-RESUMED",
+};
+
+/* "BUS ERR-PASSIVE TEC=128 REC=0" / "BUS RX-LOST N=12 TEC=0 REC=0" /
+ * "BUS RX-RESUMED MS=180 TEC=0 REC=0" */
+static size_t fmt_bus(char *out, const can_evt_t *e)
+{
+    const uint32_t code = e->msg.identifier;
+    const char *name = (code < sizeof(s_bus_names) / sizeof(s_bus_names[0]) && s_bus_names[code])
+                     ? s_bus_names[code] : "?";
+    char *p = out;
+
+    memcpy(p, "BUS ", 4);
+    p += 4;
+    size_t len = strlen(name);
+    memcpy(p, name, len);
+    p += len;
+
+    if (code == CAN_BUS_EVT_RX_LOST) {
+        memcpy(p, " N=", 3);
+        p = put_u32(p + 3, can_evt_bus_count(e));
+    } else if (code == CAN_BUS_EVT_RX_RESUMED) {
+        memcpy(p, " MS=", 4);
+        p = put_u32(p + 4, can_evt_bus_count(e));
+    }
+    memcpy(p, " TEC=", 5);
+    p = put_u8(p + 5, e->msg.data[0]);
+    memcpy(p, " REC=", 5);
+    p = put_u8(p + 5, e->msg.data[1]);
+
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+size_t can_fmt_line(char *out, const can_evt_t *e)
+{
+    if (e->kind == CAN_EVT_BUS) return fmt_bus(out, e);
+
+    const twai_message_t *m = &e->msg;
+    char *p = out;
+
+    memcpy(p, e->is_tx ? "TX ID=" : "RX ID=", 6);
+    p += 6;
+
+    if (m->flags & TWAI_MSG_FLAG_EXTD) {
+        const uint32_t id = m->identifier;
+        p = put_pair(p, (uint8_t)(id >> 24));
+        p = put_pair(p, (uint8_t)(id >> 16));
+        p = put_pair(p, (uint8_t)(id >> 8));
+        p = put_pair(p, (uint8_t)id);
+    } else {
+        p = put_hex(p, m->identifier, 3);
+    }
+
+    memcpy(p, " DLC=", 5);
+    p += 5;
+    p = put_u8(p, m->data_length_code);
+
+    if (m->flags & TWAI_MSG_FLAG_RTR) {
+        memcpy(p, " RTR", 4);
+        p += 4;
+        *p = '\0';
+        return (size_t)(p - out);
+    }
+
+    memcpy(p, " DATA=", 6);
+    p += 6;
+
+    const unsigned dlc = m->data_length_code;
+    const unsigned n = dlc < 8 ? dlc : 8;
+    for (unsigned i = 0; i < n; i++) {
+        p = put_pair(p, m->data[i]);
+        /* Separator after every byte but the DLC-th, as the old format did */
+        if (i != dlc - 1) *p++ = ' ';
+    }
+
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+size_t can_fmt_batch(char *out, size_t out_sz, const can_evt_t *evts, size_t n, size_t *n_done)
+{
+    size_t len = 0;
+    size_t i = 0;
+
+    if (out && out_sz > 0) {
+        /* A line plus its '\n' always fits in CAN_FMT_LINE_MAX */
+        for (; i < n && out_sz - len >= CAN_FMT_LINE_MAX; i++) {
+            len += can_fmt_line(out + len, &evts[i]);
+            out[len++] = '\n';
+        }
+        out[len < out_sz ? len : out_sz - 1] = '\0';
+    }
+
+    if (n_done) *n_done = i;
+    return len;
+}
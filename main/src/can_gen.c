@@ -0,0 +1,382 @@
+#include "can_gen.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#include "can_bus.h"
+#include "can_load.h"
+#include "can_tx.h"
+
+#ifndef TAG
+#define TAG "can_gen"
+#endif
+
+#ifndef CAN_GEN_TASK_STACK
+#define CAN_GEN_TASK_STACK  3072
+#endif
+
+/* Task notification bits */
+#define GEN_START  (1u << 0)
+#define GEN_STOP   (1u << 1)
+#define GEN_TX     (1u << 2)   /* TX completion: room in the driver queue */
+
+/* ---------------- State ----------------
+ *
+ * The task owns the batch and the run counters; callers only post a config
+ * (under the lock) and notification bits. The published stats are a copy
+ * refreshed every CAN_GEN_STATS_MS and at the end of a run.
+ */
+
+typedef struct {
+    twai_message_t    *batch;
+    uint32_t           batch_bits;   /* on-wire bits of one pass over the batch */
+    size_t             idx;
+    uint32_t           seq;
+    uint32_t           rng;
+
+    can_gen_cfg_t      cfg;
+    can_gen_cfg_t      pending;
+    bool               start_pending;
+
+    int64_t            t0_us;
+    int64_t            end_us;       /* 0: no duration */
+    uint32_t           target_fps;
+    uint32_t           skipped;      /* frames the pacer gave up catching up on */
+    twai_status_info_t base;
+
+    int64_t            win_t0_us;
+    uint32_t           win_sent;
+    can_gen_stats_t    run;          /* task-local */
+    can_gen_stats_t    pub;          /* published copy */
+    portMUX_TYPE       lock;
+} can_gen_t;
+
+static can_gen_t s_gen = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static TaskHandle_t s_task = NULL;
+
+static inline uint32_t rng_next(void)
+{
+    uint32_t x = s_gen.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_gen.rng = x;
+    return x;
+}
+
+/* ---------------- Batch ---------------- */
+
+static uint8_t pick_dlc(const uint8_t w[9], uint32_t w_sum)
+{
+    if (w_sum == 0) return 8;
+    uint32_t r = rng_next() % w_sum;
+    for (uint8_t d = 0; d < 8; d++) {
+        if (r < w[d]) return d;
+        r -= w[d];
+    }
+    return 8;
+}
+
+static void batch_build(void)
+{
+    const can_gen_cfg_t *c = &s_gen.cfg;
+    const uint32_t span = c->id_hi - c->id_lo + 1;
+
+    uint32_t w_sum = 0;
+    for (int d = 0; d <= 8; d++) w_sum += c->dlc_weight[d];
+
+    s_gen.batch_bits = 0;
+    for (size_t i = 0; i < CAN_GEN_BATCH; i++) {
+        twai_message_t *m = &s_gen.batch[i];
+        memset(m, 0, sizeof(*m));
+
+        switch (c->id_mode) {
+        case CAN_GEN_ID_SEQ:    m->identifier = c->id_lo + (uint32_t)(i % span); break;
+        case CAN_GEN_ID_RANDOM: m->identifier = c->id_lo + rng_next() % span; break;
+        default:                m->identifier = c->id_lo; break;
+        }
+        if (c->ext) m->flags = TWAI_MSG_FLAG_EXTD;
+        m->data_length_code = pick_dlc(c->dlc_weight, w_sum);
+
+        uint32_t a = rng_next(), b = rng_next();
+        memcpy(&m->data[0], &a, 4);
+        memcpy(&m->data[4], &b, 4);
+
+        s_gen.batch_bits += can_load_frame_bits(m, true);
+    }
+}
+
+/* Frames/s for a bus load with the batch's mean frame length */
+static uint32_t load_to_fps(uint8_t pct)
+{
+    if (pct == 0 || s_gen.batch_bits == 0) return 0;
+    uint64_t bits_per_s = (uint64_t)can_bus_get_bitrate() * pct / 100;
+    uint64_t fps = bits_per_s * CAN_GEN_BATCH / s_gen.batch_bits;
+    return fps ? (uint32_t)fps : 1;
+}
+
+/* ---------------- Run ---------------- */
+
+static void stats_update(int64_t now, bool final)
+{
+    can_gen_stats_t *r = &s_gen.run;
+
+    twai_status_info_t st;
+    if (can_bus_get_status(&st) == ESP_OK) {
+        r->arb_lost   = st.arb_lost_count - s_gen.base.arb_lost_count;
+        r->bus_errors = st.bus_error_count - s_gen.base.bus_error_count;
+        r->tx_failed  = st.tx_failed_count - s_gen.base.tx_failed_count;
+
+        uint32_t gone = st.msgs_to_tx + r->tx_failed;
+        r->sent = r->queued > gone ? r->queued - gone : 0;
+    }
+
+    int64_t dt = now - s_gen.win_t0_us;
+    if (dt > 0) {
+        uint32_t d_sent = r->sent - s_gen.win_sent;
+        r->achieved_fps = (uint32_t)((uint64_t)d_sent * 1000000 / (uint64_t)dt);
+        uint32_t bitrate = can_bus_get_bitrate();
+        if (bitrate) {
+            uint64_t bits = (uint64_t)d_sent * s_gen.batch_bits / CAN_GEN_BATCH;
+            r->load_x10 = (uint32_t)(bits * 1000 * 1000000 / ((uint64_t)dt * bitrate));
+        }
+    }
+    s_gen.win_t0_us = now;
+    s_gen.win_sent = r->sent;
+
+    int64_t el = now - s_gen.t0_us;
+    r->elapsed_ms = (uint32_t)(el / 1000);
+    r->avg_fps = el > 0 ? (uint32_t)((uint64_t)r->sent * 1000000 / (uint64_t)el) : 0;
+    if (final) r->running = false;
+
+    portENTER_CRITICAL(&s_gen.lock);
+    s_gen.pub = *r;
+    portEXIT_CRITICAL(&s_gen.lock);
+}
+
+/* can_tx stops taking frames once a run is pending (can_gen_is_running());
+ * let the ones it already handed the controller complete first so every
+ * completion goes to its owner */
+static int64_t tx_drain(int64_t now)
+{
+    const int64_t deadline = now + (int64_t)CAN_TX_DONE_TIMEOUT_MS * 1000;
+    can_tx_stats_t tx;
+
+    for (can_tx_get_stats(&tx); tx.inflight > 0 && now < deadline; can_tx_get_stats(&tx)) {
+        vTaskDelay(1);
+        now = esp_timer_get_time();
+    }
+    return now;
+}
+
+static void run_begin(int64_t now)
+{
+    now = tx_drain(now);
+    batch_build();
+
+    can_gen_stats_t *r = &s_gen.run;
+    memset(r, 0, sizeof(*r));
+
+    esp_err_t err = can_bus_get_status(&s_gen.base);
+    if (err != ESP_OK) {
+        r->last_err = err;
+        portENTER_CRITICAL(&s_gen.lock);
+        s_gen.pub = *r;
+        portEXIT_CRITICAL(&s_gen.lock);
+        ESP_LOGW(TAG, "Not started: %s", esp_err_to_name(err));
+        return;
+    }
+
+    s_gen.target_fps = s_gen.cfg.rate_fps ? s_gen.cfg.rate_fps : load_to_fps(s_gen.cfg.load_pct);
+    s_gen.idx = 0;
+    s_gen.seq = 0;
+    s_gen.skipped = 0;
+    s_gen.t0_us = now;
+    s_gen.win_t0_us = now;
+    s_gen.win_sent = 0;
+    s_gen.end_us = s_gen.cfg.duration_ms ? now + (int64_t)s_gen.cfg.duration_ms * 1000 : 0;
+
+    r->running = true;
+    r->target_fps = s_gen.target_fps;
+    portENTER_CRITICAL(&s_gen.lock);
+    s_gen.pub = *r;
+    portEXIT_CRITICAL(&s_gen.lock);
+
+    ESP_LOGI(TAG, "Started: %u frames/s target (%s), mean %u bits/frame",
+             (unsigned)s_gen.target_fps, s_gen.target_fps ? "paced" : "back-to-back",
+             (unsigned)(s_gen.batch_bits / CAN_GEN_BATCH));
+}
+
+static void run_end(int64_t now)
+{
+    stats_update(now, true);
+    ESP_LOGI(TAG, "Stopped: %u sent in %u ms (%u frames/s), arb lost %u, bus errors %u, failed %u",
+             (unsigned)s_gen.run.sent, (unsigned)s_gen.run.elapsed_ms, (unsigned)s_gen.run.avg_fps,
+             (unsigned)s_gen.run.arb_lost, (unsigned)s_gen.run.bus_errors, (unsigned)s_gen.run.tx_failed);
+}
+
+/* Hand the driver as many frames as the pacer allows and its queue takes */
+static void run_pump(int64_t now)
+{
+    can_gen_stats_t *r = &s_gen.run;
+
+    uint32_t limit = UINT32_MAX;
+    if (s_gen.target_fps) {
+        uint64_t due = (uint64_t)(now - s_gen.t0_us) * s_gen.target_fps / 1000000 - s_gen.skipped;
+        /* Never more than one batch behind, so a stall is not followed by a burst */
+        if (due > (uint64_t)r->queued + CAN_GEN_BATCH) {
+            s_gen.skipped += (uint32_t)(due - r->queued - CAN_GEN_BATCH);
+            due = (uint64_t)r->queued + CAN_GEN_BATCH;
+        }
+        limit = (uint32_t)due;
+    }
+
+    while (r->queued < limit) {
+        twai_message_t *m = &s_gen.batch[s_gen.idx];
+        if (s_gen.cfg.seq_payload) {
+            uint32_t s = s_gen.seq;
+            memcpy(m->data, &s, m->data_length_code < 4 ? m->data_length_code : 4);
+        }
+
+        esp_err_t err = can_bus_tx(m);
+        if (err != ESP_OK) {
+            /* Queue full or reconfiguring: a completion or the next tick retries.
+             * Stopped / bus-off: the supervisor's recovery brings it back. */
+            if (err == ESP_ERR_TIMEOUT) r->queue_full++;
+            break;
+        }
+        r->queued++;
+        s_gen.seq++;
+        if (++s_gen.idx == CAN_GEN_BATCH) s_gen.idx = 0;
+    }
+}
+
+static void can_gen_task(void *arg)
+{
+    (void)arg;
+
+    int64_t next_stats = 0;
+
+    while (1) {
+        TickType_t wait = s_gen.run.running ? 1 : portMAX_DELAY;
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+
+        int64_t now = esp_timer_get_time();
+
+        if ((bits & GEN_STOP) && s_gen.run.running) run_end(now);
+
+        if (bits & GEN_START) {
+            portENTER_CRITICAL(&s_gen.lock);
+            s_gen.cfg = s_gen.pending;
+            s_gen.start_pending = false;
+            portEXIT_CRITICAL(&s_gen.lock);
+
+            if (s_gen.run.running) run_end(now);
+            run_begin(now);
+            next_stats = now + (int64_t)CAN_GEN_STATS_MS * 1000;
+        }
+
+        if (!s_gen.run.running) continue;
+
+        if (s_gen.end_us && now >= s_gen.end_us) {
+            run_end(now);
+            continue;
+        }
+
+        run_pump(now);
+
+        if (now >= next_stats) {
+            next_stats = now + (int64_t)CAN_GEN_STATS_MS * 1000;
+            stats_update(now, false);
+        }
+    }
+}
+
+/* ---------------- API ---------------- */
+
+esp_err_t can_gen_init(UBaseType_t prio, BaseType_t core)
+{
+    if (s_task) return ESP_OK;
+
+    s_gen.batch = heap_caps_calloc(CAN_GEN_BATCH, sizeof(twai_message_t),
+                                   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!s_gen.batch) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreatePinnedToCore(can_gen_task, "can_gen", CAN_GEN_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        heap_caps_free(s_gen.batch);
+        s_gen.batch = NULL;
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t can_gen_start(const can_gen_cfg_t *cfg)
+{
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    if (!s_task) return ESP_ERR_INVALID_STATE;
+
+    const uint32_t id_max = cfg->ext ? 0x1FFFFFFF : 0x7FF;
+    if (cfg->id_hi > id_max || cfg->id_lo > id_max) return ESP_ERR_INVALID_ARG;
+    if (cfg->id_mode != CAN_GEN_ID_FIXED && cfg->id_hi < cfg->id_lo) return ESP_ERR_INVALID_ARG;
+    if (cfg->load_pct > 100) return ESP_ERR_INVALID_ARG;
+
+    can_gen_cfg_t c = *cfg;
+    if (c.id_mode == CAN_GEN_ID_FIXED) c.id_hi = c.id_lo;
+    if (c.seed == 0) c.seed = 1;
+
+    portENTER_CRITICAL(&s_gen.lock);
+    bool busy = s_gen.pub.running || s_gen.start_pending;
+    if (!busy) {
+        s_gen.pending = c;
+        s_gen.start_pending = true;
+        s_gen.rng = c.seed;
+    }
+    portEXIT_CRITICAL(&s_gen.lock);
+    if (busy) return ESP_ERR_INVALID_STATE;
+
+    xTaskNotify(s_task, GEN_START, eSetBits);
+    return ESP_OK;
+}
+
+void can_gen_stop(void)
+{
+    TaskHandle_t t = s_task;
+    if (t) xTaskNotify(t, GEN_STOP, eSetBits);
+}
+
+bool can_gen_is_running(void)
+{
+    portENTER_CRITICAL(&s_gen.lock);
+    bool r = s_gen.pub.running || s_gen.start_pending;
+    portEXIT_CRITICAL(&s_gen.lock);
+    return r;
+}
+
+void can_gen_get_stats(can_gen_stats_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&s_gen.lock);
+    *out = s_gen.pub;
+    portEXIT_CRITICAL(&s_gen.lock);
+}
+
+void can_gen_on_alerts(uint32_t alerts)
+{
+    /* run.running is task-owned; a stale read costs one spurious wakeup or
+     * one tick of latency at the start of a run */
+    TaskHandle_t t = s_task;
+    if (t && s_gen.run.running &&
+        (alerts & (TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED | TWAI_ALERT_TX_IDLE))) {
+        xTaskNotify(t, GEN_TX, eSetBits);
+    }
+}
@@ -0,0 +1,460 @@
+#include "can_hwf.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include "can_bus.h"
+
+#ifndef TAG
+#define TAG "can_hwf"
+#endif
+
+#ifndef CAN_HWF_MAX_ITEMS
+#define CAN_HWF_MAX_ITEMS   128   /* aligned ID blocks considered by the search */
+#endif
+
+#define CAN_HWF_REFINE_PASSES  4
+
+#define STD_IDS   2048.0
+#define EXT_IDS   536870912.0     /* 2^29 */
+
+/* ---------------- Hardware model ----------------
+ *
+ * The 32-bit acceptance code/mask is read differently per frame type:
+ *
+ *   single, std:  [31:21] ID  [20] RTR  [15:8] data0  [7:0] data1
+ *   single, ext:  [31:3]  ID  [2]  RTR
+ *   dual,   std:  F1 [31:21] ID [20] RTR [19:16] data0 hi [3:0] data0 lo
+ *                 F2 [15:5]  ID [4]  RTR
+ *   dual,   ext:  F1 [31:16] ID[28:13]   F2 [15:0] ID[28:13]
+ *
+ * A mask bit of 1 means "don't care". frame_word() lays a frame out the same
+ * way; s_lanes says which bits each (mode, filter, type) compares and which of
+ * those carry payload.
+ */
+
+typedef struct {
+    uint32_t cmp;    /* bits compared */
+    uint32_t data;   /* of which payload bits */
+} hwf_lane_t;
+
+/* [dual][filter][extd] */
+static const hwf_lane_t s_lanes[2][2][2] = {
+    { { { 0xFFF0FFFFu, 0x0000FFFFu }, { 0xFFFFFFFCu, 0 } },
+      { { 0, 0 },                     { 0, 0 } } },
+    { { { 0xFFFF000Fu, 0x000F000Fu }, { 0xFFFF0000u, 0 } },
+      { { 0x0000FFF0u, 0 },           { 0x0000FFFFu, 0 } } },
+};
+
+static uint32_t frame_word(bool dual, int f, bool extd, uint32_t id, uint32_t rtr, uint32_t d0, uint32_t d1)
+{
+    if (!dual) {
+        return extd ? (id << 3) | (rtr << 2)
+                    : (id << 21) | (rtr << 20) | (d0 << 8) | d1;
+    }
+    if (extd) return f == 0 ? (id >> 13) << 16 : id >> 13;
+    return f == 0 ? (id << 21) | (rtr << 20) | ((d0 >> 4) << 16) | (d0 & 0xF)
+                  : (id << 5) | (rtr << 4);
+}
+
+static inline bool lane_match(const twai_filter_config_t *f, const hwf_lane_t *l, uint32_t w)
+{
+    return ((w ^ f->acceptance_code) & ~f->acceptance_mask & l->cmp) == 0;
+}
+
+bool can_hwf_hw_accepts(const twai_filter_config_t *f, const twai_message_t *m)
+{
+    const bool     extd = (m->flags & TWAI_MSG_FLAG_EXTD) != 0;
+    const uint32_t rtr  = (m->flags & TWAI_MSG_FLAG_RTR) ? 1 : 0;
+    const uint32_t id   = m->identifier & (extd ? 0x1FFFFFFFu : 0x7FFu);
+    const bool     dual = !f->single_filter;
+
+    for (int k = 0; k < (dual ? 2 : 1); k++) {
+        uint32_t w = frame_word(dual, k, extd, id, rtr, m->data[0], m->data[1]);
+        if (lane_match(f, &s_lanes[dual][k][extd], w)) return true;
+    }
+    return false;
+}
+
+/* ---------------- Synthesis ----------------
+ *
+ * Ranges are split into aligned power-of-two blocks ("items": fixed bits plus
+ * don't-care bits). A filter that must pass a group of items is their
+ * smallest enclosing cube in code/mask space: a bit is fixed only if every
+ * item presents the same fixed value there. Bits no wanted item looks at are
+ * fixed to 0, which costs nothing and narrows the other frame type.
+ *
+ * Single mode has exactly one such cover. For dual mode the items are split
+ * into two groups: by frame type, by each ID bit, then refined by moving
+ * single items while the cost drops.
+ */
+
+typedef struct {
+    uint32_t val;    /* ID bits that are fixed */
+    uint32_t var;    /* ID bits that vary inside the block */
+    bool     extd;
+} hwf_item_t;
+
+typedef struct {
+    uint32_t seen;   /* bits compared for some item */
+    uint32_t any;    /* bits that must be don't-care */
+    uint32_t val;
+} hwf_cover_t;
+
+static hwf_item_t s_items[CAN_HWF_MAX_ITEMS];
+static uint8_t    s_grp[CAN_HWF_MAX_ITEMS];
+static uint8_t    s_best_grp[CAN_HWF_MAX_ITEMS];
+
+/* Highest-bit mask covering lo ^ hi: the enclosing aligned block of a range */
+static uint32_t span_mask(uint32_t lo, uint32_t hi)
+{
+    uint32_t x = lo ^ hi;
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+    x |= x >> 8;
+    x |= x >> 16;
+    return x;
+}
+
+/* Split ranges into aligned blocks; falls back to one enclosing block per
+ * range when there are too many */
+static size_t items_build(const can_hwf_range_t *ids, size_t n)
+{
+    size_t k = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t lim = ids[i].extd ? 0x1FFFFFFFu : 0x7FFu;
+        uint64_t lo = ids[i].lo & lim, hi = ids[i].hi & lim;
+
+        while (lo <= hi) {
+            uint64_t size = lo ? (lo & -lo) : (uint64_t)lim + 1;
+            while (lo + size - 1 > hi) size >>= 1;
+            if (k == CAN_HWF_MAX_ITEMS) goto coarse;
+            s_items[k++] = (hwf_item_t){ (uint32_t)lo, (uint32_t)(size - 1), ids[i].extd };
+            lo += size;
+        }
+    }
+    return k;
+
+coarse:
+    for (size_t i = 0; i < n && i < CAN_HWF_MAX_ITEMS; i++) {
+        const uint32_t lim = ids[i].extd ? 0x1FFFFFFFu : 0x7FFu;
+        uint32_t m = span_mask(ids[i].lo & lim, ids[i].hi & lim);
+        s_items[i] = (hwf_item_t){ ids[i].lo & lim & ~m, m, ids[i].extd };
+    }
+    return n < CAN_HWF_MAX_ITEMS ? n : CAN_HWF_MAX_ITEMS;
+}
+
+static void cover_add(hwf_cover_t *c, bool dual, int f, const hwf_item_t *it)
+{
+    const hwf_lane_t *l = &s_lanes[dual][f][it->extd];
+    const uint32_t fixed = frame_word(dual, f, it->extd, it->val, 0, 0, 0) & l->cmp;
+    const uint32_t vary  = frame_word(dual, f, it->extd, it->var, 1, 0xFF, 0xFF) & l->cmp;
+    const uint32_t both  = c->seen & l->cmp;
+
+    c->any |= vary | (both & (c->val ^ fixed));
+    c->val  = (c->val & c->seen) | (fixed & ~c->seen);
+    c->seen |= l->cmp;
+}
+
+static twai_filter_config_t cover_filter(const hwf_cover_t *c, bool dual)
+{
+    return (twai_filter_config_t){
+        .acceptance_code = c->val & c->seen & ~c->any,
+        .acceptance_mask = c->any,
+        .single_filter   = !dual,
+    };
+}
+
+static inline double pow2(int k)
+{
+    return (double)((uint64_t)1 << k);
+}
+
+/* Expected standard IDs passed (data frames, uniform payload) */
+static double pass_std(const twai_filter_config_t *f)
+{
+    const bool dual = !f->single_filter;
+    double p_data[2];
+    for (int k = 0; k < 2; k++) {
+        p_data[k] = 1.0 / pow2(__builtin_popcount(s_lanes[dual][k][0].data & ~f->acceptance_mask));
+    }
+
+    double sum = 0;
+    for (uint32_t id = 0; id < 2048; id++) {
+        double p1 = 0, p2 = 0;
+        const hwf_lane_t *l0 = &s_lanes[dual][0][0];
+        if (((frame_word(dual, 0, false, id, 0, 0, 0) ^ f->acceptance_code) & ~f->acceptance_mask
+             & l0->cmp & ~l0->data) == 0) p1 = p_data[0];
+        if (dual) {
+            const hwf_lane_t *l1 = &s_lanes[1][1][0];
+            if (((frame_word(true, 1, false, id, 0, 0, 0) ^ f->acceptance_code) & ~f->acceptance_mask
+                 & l1->cmp) == 0) p2 = 1.0;
+        }
+        sum += p1 + p2 - p1 * p2;
+    }
+    return sum;
+}
+
+/* Extended IDs passed, counted per cube */
+static double pass_ext(const twai_filter_config_t *f)
+{
+    const uint32_t code = f->acceptance_code, mask = f->acceptance_mask;
+
+    if (f->single_filter) {
+        if ((code & ~mask) & (1u << 2)) return 0;   /* only RTR frames */
+        return pow2(__builtin_popcount(mask & 0xFFFFFFF8u));
+    }
+
+    const uint32_t c1 = code >> 16, m1 = mask >> 16;
+    const uint32_t c2 = code & 0xFFFF, m2 = mask & 0xFFFF;
+    double n = pow2(__builtin_popcount(m1)) + pow2(__builtin_popcount(m2));
+    if (((c1 ^ c2) & ~m1 & ~m2 & 0xFFFF) == 0) n -= pow2(__builtin_popcount(m1 & m2));
+    return n * 8192.0;
+}
+
+/* False-positive share of both ID spaces */
+static double filter_cost(const twai_filter_config_t *f, double want_std, double want_ext,
+                          double *p_std, double *p_ext)
+{
+    double ps = pass_std(f), pe = pass_ext(f);
+    if (p_std) *p_std = ps;
+    if (p_ext) *p_ext = pe;
+    return (ps - want_std) / STD_IDS + (pe - want_ext) / EXT_IDS;
+}
+
+static twai_filter_config_t dual_for(const uint8_t *grp, size_t n)
+{
+    hwf_cover_t c = {0};
+    for (size_t i = 0; i < n; i++) cover_add(&c, true, grp[i], &s_items[i]);
+    return cover_filter(&c, true);
+}
+
+/* ID bit b of an item in the shared 29-bit layout (std ID10:0 = ext ID28:18);
+ * don't-care bits count as 0 */
+static inline int item_bit(const hwf_item_t *it, int b)
+{
+    int sb = it->extd ? b : b - 18;
+    if (sb < 0) return 0;
+    return (it->val >> sb) & 1;
+}
+
+/* ---------------- Second stage ---------------- */
+
+typedef struct {
+    bool     active;
+    uint32_t std_map[2048 / 32];
+    size_t   n_ext;
+    uint32_t ext_lo[CAN_HWF_MAX_RANGES];   /* sorted, merged, inclusive */
+    uint32_t ext_hi[CAN_HWF_MAX_RANGES];
+} hwf_set_t;
+
+static hwf_set_t s_set;
+static hwf_set_t s_next;   /* built by can_hwf_synth(), published by can_hwf_apply() */
+static portMUX_TYPE s_set_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int cmp_range(const void *a, const void *b)
+{
+    const can_hwf_range_t *x = a, *y = b;
+    return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+/* Fill s_next from ids; returns wanted counts */
+static void set_build(const can_hwf_range_t *ids, size_t n, uint32_t *want_std, uint32_t *want_ext)
+{
+    static can_hwf_range_t ext[CAN_HWF_MAX_RANGES];
+    size_t n_ext = 0;
+
+    memset(&s_next, 0, sizeof(s_next));
+    s_next.active = true;
+
+    for (size_t i = 0; i < n; i++) {
+        if (ids[i].extd) {
+            ext[n_ext] = ids[i];
+            ext[n_ext].lo &= 0x1FFFFFFFu;
+            ext[n_ext].hi &= 0x1FFFFFFFu;
+            n_ext++;
+            continue;
+        }
+        for (uint32_t id = ids[i].lo & 0x7FF; id <= (ids[i].hi & 0x7FF); id++) {
+            s_next.std_map[id >> 5] |= 1u << (id & 31);
+        }
+    }
+
+    uint32_t ws = 0;
+    for (size_t w = 0; w < 2048 / 32; w++) ws += __builtin_popcount(s_next.std_map[w]);
+
+    qsort(ext, n_ext, sizeof(ext[0]), cmp_range);
+    uint32_t we = 0;
+    for (size_t i = 0; i < n_ext; i++) {
+        if (ext[i].hi < ext[i].lo) continue;
+        size_t k = s_next.n_ext;
+        if (k > 0 && ext[i].lo <= s_next.ext_hi[k - 1] + 1) {
+            if (ext[i].hi > s_next.ext_hi[k - 1]) s_next.ext_hi[k - 1] = ext[i].hi;
+        } else {
+            s_next.ext_lo[k] = ext[i].lo;
+            s_next.ext_hi[k] = ext[i].hi;
+            s_next.n_ext++;
+        }
+    }
+    for (size_t k = 0; k < s_next.n_ext; k++) we += s_next.ext_hi[k] - s_next.ext_lo[k] + 1;
+
+    *want_std = ws;
+    *want_ext = we;
+}
+
+static bool set_match(const hwf_set_t *s, const twai_message_t *m)
+{
+    if (!s->active) return true;
+
+    if (!(m->flags & TWAI_MSG_FLAG_EXTD)) {
+        uint32_t id = m->identifier & 0x7FF;
+        return (s->std_map[id >> 5] >> (id & 31)) & 1;
+    }
+
+    /* Last range starting at or below id */
+    const uint32_t id = m->identifier & 0x1FFFFFFFu;
+    size_t lo = 0, hi = s->n_ext;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s->ext_lo[mid] <= id) lo = mid + 1;
+        else                      hi = mid;
+    }
+    return lo > 0 && id <= s->ext_hi[lo - 1];
+}
+
+/* ---------------- Public API ---------------- */
+
+esp_err_t can_hwf_synth(const can_hwf_range_t *ids, size_t n, can_hwf_result_t *out)
+{
+    if (!out || (n > 0 && !ids)) return ESP_ERR_INVALID_ARG;
+    if (n > CAN_HWF_MAX_RANGES) return ESP_ERR_INVALID_SIZE;
+
+    memset(out, 0, sizeof(*out));
+
+    if (n == 0) {
+        out->hw = (twai_filter_config_t)TWAI_FILTER_CONFIG_ACCEPT_ALL();
+        out->want_std = out->pass_std = 2048;
+        out->want_ext = out->pass_ext = 1u << 29;
+        out->std_ratio_x1000 = out->ext_ratio_x1000 = 1000;
+        memset(&s_next, 0, sizeof(s_next));
+        return ESP_OK;
+    }
+
+    uint32_t want_std, want_ext;
+    set_build(ids, n, &want_std, &want_ext);
+    const size_t ni = items_build(ids, n);
+
+    /* Single filter: the one enclosing cube */
+    hwf_cover_t c = {0};
+    for (size_t i = 0; i < ni; i++) cover_add(&c, false, 0, &s_items[i]);
+    twai_filter_config_t best = cover_filter(&c, false);
+    double best_cost = filter_cost(&best, want_std, want_ext, NULL, NULL);
+
+    /* Dual filter: seed splits, keep the best assignment */
+    bool have_dual = false;
+    double dual_cost = 0;
+    const int n_seeds = 2 + 2 * 29;
+    for (int s = 0; s < n_seeds; s++) {
+        for (size_t i = 0; i < ni; i++) {
+            const hwf_item_t *it = &s_items[i];
+            if (s < 2)       s_grp[i] = (uint8_t)(it->extd ^ s);
+            else if (s < 31) s_grp[i] = (uint8_t)item_bit(it, s - 2);
+            else             s_grp[i] = (uint8_t)(item_bit(it, s - 31) ^ 1);
+        }
+        twai_filter_config_t f = dual_for(s_grp, ni);
+        double cost = filter_cost(&f, want_std, want_ext, NULL, NULL);
+        if (!have_dual || cost < dual_cost) {
+            have_dual = true;
+            dual_cost = cost;
+            memcpy(s_best_grp, s_grp, ni);
+        }
+    }
+
+    /* Move single items across while that helps */
+    for (int pass = 0; pass < CAN_HWF_REFINE_PASSES; pass++) {
+        bool improved = false;
+        for (size_t i = 0; i < ni; i++) {
+            s_best_grp[i] ^= 1;
+            twai_filter_config_t f = dual_for(s_best_grp, ni);
+            double cost = filter_cost(&f, want_std, want_ext, NULL, NULL);
+            if (cost < dual_cost) {
+                dual_cost = cost;
+                improved = true;
+            } else {
+                s_best_grp[i] ^= 1;
+            }
+        }
+        if (!improved) break;
+    }
+
+    if (dual_cost < best_cost) {
+        best = dual_for(s_best_grp, ni);
+        best_cost = dual_cost;
+    }
+
+    double ps, pe;
+    filter_cost(&best, want_std, want_ext, &ps, &pe);
+
+    out->hw = best;
+    out->want_std = want_std;
+    out->want_ext = want_ext;
+    out->pass_std = (uint32_t)(ps + 0.5);
+    out->pass_ext = (uint32_t)(pe + 0.5);
+    out->std_ratio_x1000 = (uint16_t)(ps > 0 ? want_std * 1000.0 / ps + 0.5 : 1000);
+    out->ext_ratio_x1000 = (uint16_t)(pe > 0 ? want_ext * 1000.0 / pe + 0.5 : 1000);
+    return ESP_OK;
+}
+
+esp_err_t can_hwf_apply(const can_hwf_range_t *ids, size_t n, can_hwf_result_t *out)
+{
+    can_hwf_result_t r;
+    esp_err_t err = can_hwf_synth(ids, n, &r);
+    if (err != ESP_OK) return err;
+
+    /* Second stage first: it is exact, so it is safe under either hardware filter */
+    portENTER_CRITICAL(&s_set_lock);
+    s_set = s_next;
+    portEXIT_CRITICAL(&s_set_lock);
+
+    err = can_bus_set_filter(&r.hw);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Driver reinstall failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "%s filter: std %u/%u wanted, ext %u/%u wanted",
+             r.hw.single_filter ? "Single" : "Dual",
+             (unsigned)r.want_std, (unsigned)r.pass_std,
+             (unsigned)r.want_ext, (unsigned)r.pass_ext);
+
+    if (out) *out = r;
+    return ESP_OK;
+}
+
+bool can_hwf_match(const twai_message_t *m)
+{
+    portENTER_CRITICAL(&s_set_lock);
+    bool ok = set_match(&s_set, m);
+    portEXIT_CRITICAL(&s_set_lock);
+    return ok;
+}
+
+size_t can_hwf_filter(twai_message_t *msgs, size_t n)
+{
+    if (!s_set.active) return n;
+
+    size_t k = 0;
+    portENTER_CRITICAL(&s_set_lock);
+    for (size_t i = 0; i < n; i++) {
+        if (!set_match(&s_set, &msgs[i])) continue;
+        if (k != i) msgs[k] = msgs[i];
+        k++;
+    }
+    portEXIT_CRITICAL(&s_set_lock);
+    return k;
+}
@@ -0,0 +1,151 @@
+#include "can_lat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+/* Strip columns: buckets 10 (~1 us) to 29 (~0.5-1 s) */
+#define STRIP_FIRST  10
+#define STRIP_LAST   29
+
+static can_lat_hist_t s_hist[CAN_LAT_STAGE_COUNT];
+static portMUX_TYPE   s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t s_e2e_oldest_us = 0;   /* LVGL task only; 0 = nothing pending */
+
+static const char *const k_names[CAN_LAT_STAGE_COUNT] = {
+    [CAN_LAT_WAKE]   = "wake",
+    [CAN_LAT_RX]     = "rx",
+    [CAN_LAT_QUEUE]  = "queue",
+    [CAN_LAT_FORMAT] = "format",
+    [CAN_LAT_TICK]   = "tick",
+    [CAN_LAT_FLUSH]  = "flush",
+    [CAN_LAT_E2E]    = "e2e",
+};
+
+static inline uint32_t bucket_of(uint32_t ns)
+{
+    uint32_t b = ns ? 31u - (uint32_t)__builtin_clz(ns) : 0;
+    return b < CAN_LAT_BUCKETS ? b : CAN_LAT_BUCKETS - 1;
+}
+
+void can_lat_record_ns(can_lat_stage_t stage, uint32_t ns)
+{
+    if ((unsigned)stage >= CAN_LAT_STAGE_COUNT) return;
+    can_lat_hist_t *h = &s_hist[stage];
+    const uint32_t b = bucket_of(ns);
+
+    portENTER_CRITICAL(&s_lock);
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->bucket[b]++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void can_lat_get(can_lat_stage_t stage, can_lat_hist_t *out)
+{
+    if (!out) return;
+    if ((unsigned)stage >= CAN_LAT_STAGE_COUNT) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *out = s_hist[stage];
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void can_lat_reset(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_hist, 0, sizeof(s_hist));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+const char *can_lat_stage_name(can_lat_stage_t stage)
+{
+    return ((unsigned)stage < CAN_LAT_STAGE_COUNT) ? k_names[stage] : "?";
+}
+
+uint32_t can_lat_pct_ns(const can_lat_hist_t *h, uint32_t per_mille)
+{
+    if (!h || h->count == 0) return 0;
+
+    /* Smallest bucket whose cumulative count reaches the quantile rank */
+    uint64_t rank = ((uint64_t)h->count * per_mille + 999) / 1000;
+    if (rank == 0) rank = 1;
+
+    uint64_t cum = 0;
+    for (uint32_t b = 0; b < CAN_LAT_BUCKETS; b++) {
+        cum += h->bucket[b];
+        if (cum >= rank) {
+            uint32_t edge = (b >= 31) ? UINT32_MAX : (2u << b) - 1;
+            return edge < h->max_ns ? edge : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/* ---------------- End-to-end ---------------- */
+
+void can_lat_e2e_mark(int64_t frame_us)
+{
+    if (s_e2e_oldest_us == 0 || frame_us < s_e2e_oldest_us) s_e2e_oldest_us = frame_us;
+}
+
+void can_lat_e2e_flushed(int64_t now_us)
+{
+    if (s_e2e_oldest_us == 0) return;
+    can_lat_record_us(CAN_LAT_E2E, now_us - s_e2e_oldest_us);
+    s_e2e_oldest_us = 0;
+}
+
+/* ---------------- Report ---------------- */
+
+/* One decimal in the largest unit that fits */
+void can_lat_fmt_ns(char *out, size_t sz, uint32_t ns)
+{
+    if (ns < 1000000)          snprintf(out, sz, "%u.%uus", (unsigned)(ns / 1000), (unsigned)(ns % 1000 / 100));
+    else if (ns < 1000000000)  snprintf(out, sz, "%u.%ums", (unsigned)(ns / 1000000), (unsigned)(ns % 1000000 / 100000));
+    else                       snprintf(out, sz, "%u.%us", (unsigned)(ns / 1000000000), (unsigned)(ns % 1000000000 / 100000000));
+}
+
+size_t can_lat_format(char *out, size_t out_sz)
+{
+    static const char k_levels[] = " .:-=+*#@";
+    if (!out || out_sz == 0) return 0;
+
+    size_t n = (size_t)snprintf(out, out_sz, "%-6s %9s %8s %8s %8s %8s %8s  1us%*s1s\n",
+                                "stage", "count", "mean", "p50", "p99", "p99.9", "max",
+                                STRIP_LAST - STRIP_FIRST - 2, "");
+
+    for (int s = 0; s < CAN_LAT_STAGE_COUNT && n < out_sz; s++) {
+        can_lat_hist_t h;
+        can_lat_get((can_lat_stage_t)s, &h);
+
+        char mean[12], p50[12], p99[12], p999[12], max[12];
+        can_lat_fmt_ns(mean, sizeof(mean), h.count ? (uint32_t)(h.sum_ns / h.count) : 0);
+        can_lat_fmt_ns(p50,  sizeof(p50),  can_lat_pct_ns(&h, 500));
+        can_lat_fmt_ns(p99,  sizeof(p99),  can_lat_pct_ns(&h, 990));
+        can_lat_fmt_ns(p999, sizeof(p999), can_lat_pct_ns(&h, 999));
+        can_lat_fmt_ns(max,  sizeof(max),  h.max_ns);
+
+        /* Bucket strip scaled to the fullest column */
+        char strip[STRIP_LAST - STRIP_FIRST + 2];
+        uint32_t peak = 0;
+        for (int b = STRIP_FIRST; b <= STRIP_LAST; b++) {
+            if (h.bucket[b] > peak) peak = h.bucket[b];
+        }
+        for (int b = STRIP_FIRST; b <= STRIP_LAST; b++) {
+            uint32_t c = h.bucket[b];
+            uint32_t lvl = c ? 1 + (uint32_t)(((uint64_t)c * (sizeof(k_levels) - 3)) / peak) : 0;
+            strip[b - STRIP_FIRST] = k_levels[lvl];
+        }
+        strip[STRIP_LAST - STRIP_FIRST + 1] = '\0';
+
+        n += (size_t)snprintf(out + n, out_sz - n, "%-6s %9u %8s %8s %8s %8s %8s  |%s|\n",
+                              k_names[s], (unsigned)h.count, mean, p50, p99, p999, max, strip);
+    }
+    return n < out_sz ? n : out_sz - 1;
+}
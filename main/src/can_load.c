@@ -0,0 +1,304 @@
+#include "can_load.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef TAG
+#define TAG "can_load"
+#endif
+
+#define CAN_LOAD_BUCKET_US   100000   /* 100 ms */
+#define CAN_LOAD_BUCKETS     128      /* power of two, > 10 s of buckets */
+#define CAN_LOAD_WIN_1S      10
+#define CAN_LOAD_WIN_10S     100
+
+/* Unstuffed trailer: CRC delimiter, ACK slot + delimiter, EOF, intermission */
+#define CAN_LOAD_TAIL_BITS   (1 + 2 + 7 + 3)
+
+/* ---------------- Frame length ----------------
+ *
+ * The stuffed part of a frame (SOF through CRC) is assembled MSB first into
+ * bytes, left-padded with zero bits so the data field stays byte aligned.
+ * Leading zeros do not change a CRC whose register starts at 0, so the CRC-15
+ * can run a byte at a time. Stuff bits are counted by a byte-wide state
+ * machine over the same bytes; only the padded first byte and the 15-bit CRC
+ * are walked bit by bit.
+ */
+
+#define CRC15_POLY  0x4599u
+
+/* Stuffing state: last bit * 6 + run length (0..5) */
+#define STUFF_STATES  12
+
+static uint16_t s_crc15_tab[256];
+static uint8_t  s_stuff_tab[STUFF_STATES][256];   /* stuff count << 4 | next state */
+static bool     s_tabs_ready = false;
+
+static inline uint32_t stuff_step(uint32_t st, uint32_t bit, uint32_t *stuffs)
+{
+    uint32_t last = st / 6, run = st % 6;
+
+    if (run > 0 && bit == last) run++;
+    else { last = bit; run = 1; }
+
+    if (run == 5) {
+        /* The complement is inserted and starts the next run */
+        (*stuffs)++;
+        last ^= 1;
+        run = 1;
+    }
+    return last * 6 + run;
+}
+
+static void tabs_build(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i << 7;
+        for (int b = 0; b < 8; b++) {
+            c = (c & 0x4000) ? (c << 1) ^ CRC15_POLY : c << 1;
+        }
+        s_crc15_tab[i] = (uint16_t)(c & 0x7FFF);
+    }
+
+    for (uint32_t st = 0; st < STUFF_STATES; st++) {
+        for (uint32_t v = 0; v < 256; v++) {
+            uint32_t stuffs = 0, s = st;
+            for (int b = 7; b >= 0; b--) s = stuff_step(s, (v >> b) & 1, &stuffs);
+            s_stuff_tab[st][v] = (uint8_t)((stuffs << 4) | s);
+        }
+    }
+    s_tabs_ready = true;
+}
+
+uint32_t can_load_frame_bits(const twai_message_t *m, bool exact_stuffing)
+{
+    const bool     extd = (m->flags & TWAI_MSG_FLAG_EXTD) != 0;
+    const bool     rtr  = (m->flags & TWAI_MSG_FLAG_RTR) != 0;
+    const uint32_t dlc  = m->data_length_code & 0xF;
+    const uint32_t nd   = rtr ? 0 : (dlc > 8 ? 8 : dlc);
+
+    /* Arbitration + control fields, SOF first */
+    uint64_t hdr;
+    uint32_t hdr_bits;
+    if (extd) {
+        const uint32_t id = m->identifier & 0x1FFFFFFF;
+        /* SOF, ID[28:18], SRR=1, IDE=1, ID[17:0], RTR, r1, r0, DLC */
+        hdr = ((uint64_t)(id >> 18) << 27) | (1ull << 26) | (1ull << 25)
+            | ((uint64_t)(id & 0x3FFFF) << 7) | ((uint64_t)rtr << 6) | dlc;
+        hdr_bits = 39;
+    } else {
+        /* SOF, ID[10:0], RTR, IDE=0, r0, DLC */
+        hdr = ((uint64_t)(m->identifier & 0x7FF) << 7) | ((uint64_t)rtr << 6) | dlc;
+        hdr_bits = 19;
+    }
+
+    const uint32_t stuffed_bits = hdr_bits + 8 * nd + 15;
+
+    if (!exact_stuffing) {
+        return stuffed_bits + (stuffed_bits - 1) / 4 + CAN_LOAD_TAIL_BITS;
+    }
+
+    if (!s_tabs_ready) tabs_build();
+
+    /* Header padded up to whole bytes: 19 -> 24 bits, 39 -> 40 bits */
+    const uint32_t hdr_bytes = (hdr_bits + 7) / 8;
+    const uint32_t pad = hdr_bytes * 8 - hdr_bits;
+
+    uint8_t buf[6 + 8];
+    for (uint32_t i = 0; i < hdr_bytes; i++) {
+        buf[i] = (uint8_t)(hdr >> (8 * (hdr_bytes - 1 - i)));
+    }
+    memcpy(&buf[hdr_bytes], m->data, nd);
+    const uint32_t len = hdr_bytes + nd;
+
+    uint32_t crc = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        crc = ((crc << 8) ^ s_crc15_tab[((crc >> 7) ^ buf[i]) & 0xFF]) & 0x7FFF;
+    }
+
+    /* First byte bit by bit, skipping the padding */
+    uint32_t stuffs = 0, st = 0;
+    for (int b = 7 - (int)pad; b >= 0; b--) st = stuff_step(st, (buf[0] >> b) & 1, &stuffs);
+
+    for (uint32_t i = 1; i < len; i++) {
+        uint8_t t = s_stuff_tab[st][buf[i]];
+        stuffs += t >> 4;
+        st = t & 0xF;
+    }
+
+    /* CRC: top 7 bits, then the low byte through the table */
+    for (int b = 14; b >= 8; b--) st = stuff_step(st, (crc >> b) & 1, &stuffs);
+    stuffs += s_stuff_tab[st][crc & 0xFF] >> 4;
+
+    return stuffed_bits + stuffs + CAN_LOAD_TAIL_BITS;
+}
+
+/* ---------------- Rolling windows ----------------
+ *
+ * A ring of 100 ms buckets. The bucket being filled is cur; sums over the last
+ * 10 and 100 completed buckets are updated as each bucket closes, so reading
+ * any window is O(1). The ring is longer than the 10 s window so the bucket
+ * leaving it is still intact when it is subtracted.
+ */
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bits;
+} load_bucket_t;
+
+typedef struct {
+    load_bucket_t b[CAN_LOAD_BUCKETS];
+    int64_t  cur;                 /* absolute index of the bucket being filled */
+    bool     started;
+    uint64_t bits_1s, bits_10s;
+    uint32_t frames_1s, frames_10s;
+    uint32_t bitrate;
+    uint16_t peak_load_x10;
+    uint32_t peak_fps;
+    int64_t  peak_us;
+    portMUX_TYPE lock;
+} can_load_t;
+
+static can_load_t s_load = {
+    .bitrate = 500000,
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static inline load_bucket_t *bucket_at(int64_t k)
+{
+    return &s_load.b[(uint64_t)k & (CAN_LOAD_BUCKETS - 1)];
+}
+
+/* Load of `bits` over `buckets` 100 ms buckets, in 0.1 % steps */
+static uint16_t load_x10(uint64_t bits, uint32_t buckets)
+{
+    uint64_t cap = (uint64_t)s_load.bitrate * buckets / 10;
+    if (cap == 0) return 0;
+    uint64_t v = bits * 1000 / cap;
+    return (uint16_t)(v > 1000 ? 1000 : v);
+}
+
+static void windows_reset_locked(int64_t k)
+{
+    memset(s_load.b, 0, sizeof(s_load.b));
+    s_load.bits_1s = s_load.bits_10s = 0;
+    s_load.frames_1s = s_load.frames_10s = 0;
+    s_load.cur = k;
+    s_load.started = true;
+}
+
+/* Close buckets up to (not including) bucket k */
+static void advance_locked(int64_t k)
+{
+    if (!s_load.started || k - s_load.cur >= CAN_LOAD_BUCKETS) {
+        windows_reset_locked(k);
+        return;
+    }
+
+    while (s_load.cur < k) {
+        const int64_t c = s_load.cur;
+        const load_bucket_t *done = bucket_at(c);
+        const load_bucket_t *old1 = bucket_at(c - CAN_LOAD_WIN_1S);
+        const load_bucket_t *old10 = bucket_at(c - CAN_LOAD_WIN_10S);
+
+        s_load.bits_1s    += done->bits;
+        s_load.frames_1s  += done->frames;
+        s_load.bits_10s   += done->bits;
+        s_load.frames_10s += done->frames;
+        s_load.bits_1s    -= old1->bits;
+        s_load.frames_1s  -= old1->frames;
+        s_load.bits_10s   -= old10->bits;
+        s_load.frames_10s -= old10->frames;
+
+        uint16_t l = load_x10(done->bits, 1);
+        if (l > s_load.peak_load_x10) {
+            s_load.peak_load_x10 = l;
+            s_load.peak_us = (c + 1) * CAN_LOAD_BUCKET_US;
+        }
+        if (done->frames * 10 > s_load.peak_fps) s_load.peak_fps = done->frames * 10;
+
+        /* Recycle the slot that just left the 10 s window (and the ring) */
+        s_load.cur = c + 1;
+        *bucket_at(s_load.cur) = (load_bucket_t){0};
+    }
+}
+
+esp_err_t can_load_init(uint32_t bitrate)
+{
+    if (bitrate == 0) return ESP_ERR_INVALID_ARG;
+
+    if (!s_tabs_ready) tabs_build();
+
+    portENTER_CRITICAL(&s_load.lock);
+    s_load.bitrate = bitrate;
+    s_load.started = false;
+    s_load.peak_load_x10 = 0;
+    s_load.peak_fps = 0;
+    s_load.peak_us = 0;
+    portEXIT_CRITICAL(&s_load.lock);
+
+    ESP_LOGI(TAG, "Bus load meter at %u bit/s (%s stuffing)", (unsigned)bitrate,
+             CAN_LOAD_EXACT_STUFFING ? "exact" : "worst-case");
+    return ESP_OK;
+}
+
+void can_load_set_bitrate(uint32_t bitrate)
+{
+    if (bitrate == 0) return;
+
+    portENTER_CRITICAL(&s_load.lock);
+    s_load.bitrate = bitrate;
+    s_load.started = false;
+    s_load.peak_load_x10 = 0;
+    s_load.peak_fps = 0;
+    portEXIT_CRITICAL(&s_load.lock);
+}
+
+void can_load_update(const twai_message_t *m, int64_t t_us)
+{
+    if (!m || t_us < 0) return;
+
+    const uint32_t bits = can_load_frame_bits(m, CAN_LOAD_EXACT_STUFFING);
+    const int64_t k = t_us / CAN_LOAD_BUCKET_US;
+
+    portENTER_CRITICAL(&s_load.lock);
+    /* Late stamps (TX vs a newer RX batch) land in the current bucket */
+    if (!s_load.started || k > s_load.cur) advance_locked(k);
+    load_bucket_t *b = bucket_at(s_load.cur);
+    b->frames++;
+    b->bits += bits;
+    portEXIT_CRITICAL(&s_load.lock);
+}
+
+void can_load_get(can_load_stats_t *out, int64_t now_us)
+{
+    if (!out) return;
+
+    const int64_t k = now_us / CAN_LOAD_BUCKET_US;
+
+    portENTER_CRITICAL(&s_load.lock);
+    if (!s_load.started || k > s_load.cur) advance_locked(k);
+
+    const load_bucket_t *last = bucket_at(s_load.cur - 1);
+    out->fps_100ms      = last->frames * 10;
+    out->fps_1s         = s_load.frames_1s;
+    out->fps_10s        = s_load.frames_10s / 10;
+    out->load_100ms_x10 = load_x10(last->bits, 1);
+    out->load_1s_x10    = load_x10(s_load.bits_1s, CAN_LOAD_WIN_1S);
+    out->load_10s_x10   = load_x10(s_load.bits_10s, CAN_LOAD_WIN_10S);
+    out->peak_load_x10  = s_load.peak_load_x10;
+    out->peak_fps       = s_load.peak_fps;
+    out->peak_us        = s_load.peak_us;
+    portEXIT_CRITICAL(&s_load.lock);
+}
+
+void can_load_reset_peak(void)
+{
+    portENTER_CRITICAL(&s_load.lock);
+    s_load.peak_load_x10 = 0;
+    s_load.peak_fps = 0;
+    s_load.peak_us = 0;
+    portEXIT_CRITICAL(&s_load.lock);
+}
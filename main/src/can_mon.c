@@ -1,101 +1,768 @@
 #include "can_mon.h"
 
 #include <string.h>
+#include <stdatomic.h>
 
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-#include "waveshare_twai_port.h"
+#include "can_bus.h"
+#include "can_load.h"
+#include "can_hwf.h"
+#include "can_filter.h"
+#include "can_tx.h"
+#include "can_lat.h"
+#include "can_pipe.h"
 
 #ifndef TAG
 #define TAG "can_mon"
 #endif
 
-static QueueHandle_t s_evt_q = NULL;
+#ifndef CAN_MON_CACHE_LINE
+#define CAN_MON_CACHE_LINE    64   /* CONFIG_ESP32S3_DATA_CACHE_LINE_64B */
+#endif
+
+#ifndef CAN_MON_TX_RING_LEN
+#define CAN_MON_TX_RING_LEN   256
+#endif
+
+#ifndef CAN_MON_RX_BATCH_MAX
+#define CAN_MON_RX_BATCH_MAX  32   /* frames drained from the driver per wakeup */
+#endif
+
+#ifndef CAN_MON_RX_IDLE_MS
+#define CAN_MON_RX_IDLE_MS    100  /* drain anyway if no RX_DATA wakeup came */
+#endif
+
+/* ---------------- SPSC ring ----------------
+ *
+ * Lock-free single-producer/single-consumer ring of 16-byte can_rec_t.
+ * Indices run freely and are masked on access, so capacity must be a power of
+ * two. Producer and consumer indices live on separate cache lines; each side
+ * also keeps a cached copy of the other side's index so it only touches the
+ * shared line when it runs out. Each side also tracks the SYNC base of its end
+ * of the record stream.
+ */
+
+#define CAN_MON_ALIGNED __attribute__((aligned(CAN_MON_CACHE_LINE)))
+
+typedef struct {
+    /* Producer-owned */
+    CAN_MON_ALIGNED atomic_uint head;
+    uint32_t tail_cache;
+    int64_t  prod_sync_us;     /* time of the last SYNC written */
+    bool     prod_synced;
+    /* Consumer-owned */
+    CAN_MON_ALIGNED atomic_uint tail;
+    uint32_t head_cache;
+    int64_t  cons_base_us;     /* time of the last SYNC released */
+    /* Read-only after init */
+    CAN_MON_ALIGNED can_rec_t *buf;
+    uint32_t mask;
+} can_ring_t;
+
+static uint32_t round_up_pow2(uint32_t v)
+{
+    if (v < 2) return 2;
+    v--;
+    v |= v >> 1;
+    v |= v >> 2;
+    v |= v >> 4;
+    v |= v >> 8;
+    v |= v >> 16;
+    return v + 1;
+}
+
+static esp_err_t ring_init(can_ring_t *r, size_t len)
+{
+    uint32_t cap = round_up_pow2((uint32_t)len);
+
+    r->buf = heap_caps_aligned_alloc(CAN_MON_CACHE_LINE, cap * sizeof(can_rec_t),
+                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!r->buf) return ESP_ERR_NO_MEM;
+
+    r->mask = cap - 1;
+    r->tail_cache = 0;
+    r->head_cache = 0;
+    r->prod_sync_us = 0;
+    r->prod_synced = false;
+    r->cons_base_us = 0;
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, 0, memory_order_relaxed);
+    return ESP_OK;
+}
+
+static size_t ring_reserve(can_ring_t *r, can_rec_t **slots, size_t n)
+{
+    const uint32_t cap  = r->mask + 1;
+    const uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    uint32_t free = cap - (head - r->tail_cache);
+    if (free < n) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        free = cap - (head - r->tail_cache);
+    }
+
+    const uint32_t idx = head & r->mask;
+    uint32_t cnt = cap - idx;             /* contiguous up to wrap point */
+    if (cnt > free) cnt = free;
+    if (cnt > n)    cnt = (uint32_t)n;
+
+    *slots = &r->buf[idx];
+    return cnt;
+}
+
+static inline void ring_commit(can_ring_t *r, size_t n)
+{
+    const uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + (uint32_t)n, memory_order_release);
+}
+
+static size_t ring_peek(can_ring_t *r, const can_rec_t **recs, size_t max)
+{
+    const uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    uint32_t avail = r->head_cache - tail;
+    if (avail < max) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        avail = r->head_cache - tail;
+    }
+
+    const uint32_t idx = tail & r->mask;
+    uint32_t cnt = (r->mask + 1) - idx;
+    if (cnt > avail) cnt = avail;
+    if (cnt > max)   cnt = (uint32_t)max;
+
+    *recs = &r->buf[idx];
+    return cnt;
+}
+
+static void ring_release(can_ring_t *r, size_t n)
+{
+    const uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    /* Carry the SYNC base forward past the released records */
+    for (uint32_t i = 0; i < n; i++) {
+        const can_rec_t *rec = &r->buf[(tail + i) & r->mask];
+        if (can_rec_is_sync(rec)) r->cons_base_us = can_rec_time(rec, 0);
+    }
+
+    atomic_store_explicit(&r->tail, tail + (uint32_t)n, memory_order_release);
+}
+
+/*
+ * Encode frames into the ring, inserting SYNC records as needed. time_of()
+ * yields the timestamp of frame i. Returns the number of frames written.
+ */
+static size_t ring_put_frames(can_ring_t *r, bool is_tx, const twai_message_t *msgs,
+                              size_t n, int64_t (*time_of)(size_t i, void *ctx), void *ctx)
+{
+    size_t done = 0;
+    bool have_t = false;
+    int64_t t = 0;
+
+    while (done < n) {
+        can_rec_t *slots;
+        /* One spare slot so a SYNC does not split the run needlessly */
+        size_t k = ring_reserve(r, &slots, n - done + 1);
+        if (k == 0) break;
+
+        size_t used = 0;
+        while (used < k && done < n) {
+            if (!have_t) {
+                t = time_of(done, ctx);
+                have_t = true;
+            }
+
+            if (!r->prod_synced || can_rec_needs_sync(r->prod_sync_us, t)) {
+                can_rec_encode_sync(&slots[used++], t);
+                r->prod_sync_us = t;
+                r->prod_synced = true;
+                continue;
+            }
+
+            can_rec_encode(&slots[used++], r->prod_sync_us, t, is_tx, &msgs[done]);
+            done++;
+            have_t = false;
+        }
+
+        ring_commit(r, used);
+    }
+
+    return done;
+}
+
+/* Write one bus event record, preceded by a SYNC if needed */
+static bool ring_put_bus(can_ring_t *r, int64_t t, can_bus_evt_t code,
+                         uint32_t tec, uint32_t rec, uint32_t count)
+{
+    while (1) {
+        can_rec_t *slots;
+        size_t k = ring_reserve(r, &slots, 2);
+        if (k == 0) return false;
+
+        size_t used = 0;
+        if (!r->prod_synced || can_rec_needs_sync(r->prod_sync_us, t)) {
+            can_rec_encode_sync(&slots[used++], t);
+            r->prod_sync_us = t;
+            r->prod_synced = true;
+            if (used == k) {
+                /* Wrap point: the event goes in the next run */
+                ring_commit(r, used);
+                continue;
+            }
+        }
+        can_rec_encode_bus(&slots[used++], r->prod_sync_us, t, code, tec, rec, count);
+        ring_commit(r, used);
+        return true;
+    }
+}
+
+/* ---------------- Capture store ----------------
+ *
+ * Large history of can_rec_t in PSRAM. Indices run freely like the rings;
+ * start/tail/head only move forward, so a stale reader cursor is detected by
+ * comparing it against the oldest retained index. Writers (RX task and the TX
+ * producer) serialize on a spinlock held for O(1) work per record; readers
+ * never take it. A writer bumps `claim` before overwriting a slot, which lets
+ * readers detect a record that was recycled under them while they copied it.
+ */
+
+typedef struct {
+    can_rec_t *buf;                 /* PSRAM, NULL when disabled */
+    uint32_t   mask;
+    portMUX_TYPE lock;
+    can_mon_cap_policy_t policy;
+    atomic_uint head;               /* records published */
+    atomic_uint claim;              /* records being/been written (head or head + 1) */
+    atomic_uint tail;               /* DROP_NEWEST: first record not yet released */
+    atomic_uint start;              /* first record since the last clear */
+    int64_t    sync_us;
+    bool       synced;
+    bool       stopped;
+    uint32_t   drop_cnt;
+} can_capture_t;
+
+static can_capture_t s_cap = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+esp_err_t can_mon_capture_init(size_t bytes, can_mon_cap_policy_t policy)
+{
+    if (s_cap.buf) return ESP_OK;
+    if (bytes < 2 * sizeof(can_rec_t)) return ESP_ERR_INVALID_SIZE;
+
+    /* Round down to a power of two number of records */
+    uint32_t cap = round_up_pow2((uint32_t)(bytes / sizeof(can_rec_t)));
+    if ((size_t)cap * sizeof(can_rec_t) > bytes) cap >>= 1;
+
+    can_rec_t *buf = heap_caps_malloc((size_t)cap * sizeof(can_rec_t), MALLOC_CAP_SPIRAM);
+    if (!buf) {
+        ESP_LOGE(TAG, "Capture store: no PSRAM for %u KB", (unsigned)((cap * sizeof(can_rec_t)) >> 10));
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_cap.lock);
+    s_cap.mask = cap - 1;
+    s_cap.policy = policy;
+    s_cap.synced = false;
+    s_cap.stopped = false;
+    s_cap.drop_cnt = 0;
+    atomic_store_explicit(&s_cap.head, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_cap.claim, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_cap.tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_cap.start, 0, memory_order_relaxed);
+    s_cap.buf = buf;
+    portEXIT_CRITICAL(&s_cap.lock);
+
+    ESP_LOGI(TAG, "Capture store: %u records (%u KB) in PSRAM, policy %d",
+             (unsigned)cap, (unsigned)((cap * sizeof(can_rec_t)) >> 10), (int)policy);
+    return ESP_OK;
+}
+
+void can_mon_capture_clear(void)
+{
+    if (!s_cap.buf) return;
+
+    portENTER_CRITICAL(&s_cap.lock);
+    uint32_t head = atomic_load_explicit(&s_cap.head, memory_order_relaxed);
+    atomic_store_explicit(&s_cap.start, head, memory_order_release);
+    atomic_store_explicit(&s_cap.tail, head, memory_order_release);
+    s_cap.synced = false;
+    s_cap.stopped = false;
+    s_cap.drop_cnt = 0;
+    portEXIT_CRITICAL(&s_cap.lock);
+}
+
+void can_mon_capture_set_policy(can_mon_cap_policy_t policy)
+{
+    portENTER_CRITICAL(&s_cap.lock);
+    s_cap.policy = policy;
+    portEXIT_CRITICAL(&s_cap.lock);
+    can_mon_capture_clear();
+}
+
+/* Oldest index a reader may still access, given the current claim index */
+static uint32_t capture_oldest(uint32_t claim)
+{
+    const uint32_t cap = s_cap.mask + 1;
+    uint32_t start = atomic_load_explicit(&s_cap.start, memory_order_acquire);
+
+    if (s_cap.policy == CAN_MON_CAP_DROP_NEWEST) {
+        return atomic_load_explicit(&s_cap.tail, memory_order_acquire);
+    }
+    if (s_cap.policy == CAN_MON_CAP_OVERWRITE_OLDEST && claim - start > cap) {
+        return claim - cap;
+    }
+    return start;
+}
+
+/* Store one record under s_cap.lock; false if the policy refused it */
+static bool capture_put_locked(const can_rec_t *r)
+{
+    const uint32_t cap  = s_cap.mask + 1;
+    const uint32_t head = atomic_load_explicit(&s_cap.head, memory_order_relaxed);
+
+    switch (s_cap.policy) {
+    case CAN_MON_CAP_STOP_WHEN_FULL:
+        if (head - atomic_load_explicit(&s_cap.start, memory_order_relaxed) >= cap) {
+            s_cap.stopped = true;
+            return false;
+        }
+        break;
+    case CAN_MON_CAP_DROP_NEWEST:
+        if (head - atomic_load_explicit(&s_cap.tail, memory_order_acquire) >= cap) {
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    atomic_store_explicit(&s_cap.claim, head + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s_cap.buf[head & s_cap.mask] = *r;
+    atomic_store_explicit(&s_cap.head, head + 1, memory_order_release);
+    return true;
+}
+
+/* Emit a SYNC first if the record at t needs one; false if it was refused */
+static bool capture_sync_locked(int64_t t)
+{
+    if (s_cap.synced && !can_rec_needs_sync(s_cap.sync_us, t)) return true;
+
+    can_rec_t rec;
+    can_rec_encode_sync(&rec, t);
+    if (!capture_put_locked(&rec)) {
+        s_cap.drop_cnt++;
+        return false;
+    }
+    s_cap.sync_us = t;
+    s_cap.synced = true;
+    return true;
+}
+
+static void capture_append(bool is_tx, const twai_message_t *msgs, size_t n,
+                           int64_t (*time_of)(size_t i, void *ctx), void *ctx)
+{
+    if (!s_cap.buf) return;
+
+    /* One record per critical section, so a batch never holds off the other
+     * writer (or interrupts on this core) for more than a record's work */
+    for (size_t i = 0; i < n; i++) {
+        int64_t t = time_of(i, ctx);
+
+        portENTER_CRITICAL(&s_cap.lock);
+        if (s_cap.stopped) {
+            s_cap.drop_cnt += n - i;
+            portEXIT_CRITICAL(&s_cap.lock);
+            break;
+        }
+        if (capture_sync_locked(t)) {
+            can_rec_t rec;
+            can_rec_encode(&rec, s_cap.sync_us, t, is_tx, &msgs[i]);
+            if (!capture_put_locked(&rec)) {
+                /* Re-sync after a gap so readers starting later find a base quickly */
+                s_cap.synced = false;
+                s_cap.drop_cnt++;
+            }
+        }
+        portEXIT_CRITICAL(&s_cap.lock);
+    }
+}
+
+static void capture_append_bus(int64_t t, can_bus_evt_t code, uint32_t tec, uint32_t rec_cnt, uint32_t count)
+{
+    if (!s_cap.buf) return;
+
+    portENTER_CRITICAL(&s_cap.lock);
+    if (s_cap.stopped) {
+        s_cap.drop_cnt++;
+    } else if (capture_sync_locked(t)) {
+        can_rec_t rec;
+        can_rec_encode_bus(&rec, s_cap.sync_us, t, code, tec, rec_cnt, count);
+        if (!capture_put_locked(&rec)) {
+            s_cap.synced = false;
+            s_cap.drop_cnt++;
+        }
+    }
+    portEXIT_CRITICAL(&s_cap.lock);
+}
+
+size_t can_mon_capture_capacity(void)
+{
+    return s_cap.buf ? (size_t)s_cap.mask + 1 : 0;
+}
+
+size_t can_mon_capture_count(void)
+{
+    if (!s_cap.buf) return 0;
+    uint32_t claim = atomic_load_explicit(&s_cap.claim, memory_order_acquire);
+    uint32_t head  = atomic_load_explicit(&s_cap.head, memory_order_acquire);
+    uint32_t oldest = capture_oldest(claim);
+    return (head - oldest <= s_cap.mask + 1) ? (size_t)(head - oldest) : 0;
+}
+
+uint32_t can_mon_capture_get_drop_cnt(void) { return s_cap.drop_cnt; }
+bool     can_mon_capture_is_stopped(void)   { return s_cap.stopped; }
+
+void can_mon_capture_cursor_oldest(can_mon_cap_cursor_t *c)
+{
+    if (!c) return;
+    uint32_t claim = atomic_load_explicit(&s_cap.claim, memory_order_acquire);
+    c->pos = s_cap.buf ? capture_oldest(claim) : 0;
+    c->base_us = 0;
+    c->synced = false;
+    c->lost = 0;
+}
+
+size_t can_mon_capture_read(can_mon_cap_cursor_t *c, can_evt_t *out, size_t max)
+{
+    if (!s_cap.buf || !c || !out) return 0;
+
+    const uint32_t cap = s_cap.mask + 1;
+    size_t n = 0;
+
+    while (n < max) {
+        uint32_t head   = atomic_load_explicit(&s_cap.head, memory_order_acquire);
+        uint32_t claim  = atomic_load_explicit(&s_cap.claim, memory_order_acquire);
+        uint32_t oldest = capture_oldest(claim);
+
+        /* The writer overtook us, or the store was cleared: jump to the oldest
+         * record still held and wait for the next SYNC to decode again. */
+        if ((int32_t)(c->pos - oldest) < 0) {
+            c->lost += oldest - c->pos;
+            c->pos = oldest;
+            c->synced = false;
+        }
+        if (c->pos == head) break;
+
+        can_rec_t r = s_cap.buf[c->pos & s_cap.mask];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s_cap.claim, memory_order_relaxed) - c->pos > cap) {
+            continue;  /* recycled while copying; the check above resyncs */
+        }
+        c->pos++;
+
+        if (!c->synced) {
+            if (!can_rec_is_sync(&r)) {
+                c->lost++;
+                continue;
+            }
+            c->synced = true;
+        }
+
+        if (can_rec_decode(&r, &c->base_us, &out[n])) n++;
+    }
+
+    return n;
+}
+
+void can_mon_capture_release(const can_mon_cap_cursor_t *c)
+{
+    if (!s_cap.buf || !c || s_cap.policy != CAN_MON_CAP_DROP_NEWEST) return;
+
+    uint32_t tail = atomic_load_explicit(&s_cap.tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&s_cap.head, memory_order_acquire);
+    if ((int32_t)(c->pos - tail) > 0 && (int32_t)(head - c->pos) >= 0) {
+        atomic_store_explicit(&s_cap.tail, c->pos, memory_order_release);
+    }
+}
+
+/* ---------------- Monitor state ---------------- */
+
+/* RX ring is fed by can_mon_rx_task() alone and stays lock-free. TX ring is
+ * fed by the TX worker and the supervisor's bus events, so its producer side
+ * serializes on s_tx_lock, which also keeps its timestamps in order; the
+ * consumer still never locks. */
+static can_ring_t s_rx_ring;
+static can_ring_t s_tx_ring;
+static portMUX_TYPE s_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t  s_tx_last_us = 0;       /* last TX ring timestamp, under s_tx_lock */
+static can_ring_t *s_peek_ring = NULL;
+static bool s_inited = false;
 
 static uint32_t s_rx_cnt = 0;
 static uint32_t s_tx_cnt = 0;
-static uint32_t s_drop_cnt = 0;
+static uint32_t s_rx_drop_cnt = 0;
+static uint32_t s_tx_drop_cnt = 0;
+static uint32_t s_rx_wake_cnt = 0;      /* RX task wakeups that found frames in the driver */
+static uint32_t s_rx_wake_frames = 0;   /* frames those wakeups took from the driver, before filtering */
+static int64_t  s_rx_last_us = 0;       /* last RX timestamp handed out */
 
 esp_err_t can_mon_init(size_t queue_len)
 {
-    if (s_evt_q) return ESP_OK;
+    if (s_inited) return ESP_OK;
 
-    s_evt_q = xQueueCreate(queue_len, sizeof(can_evt_t));
-    if (!s_evt_q) {
-        return ESP_ERR_NO_MEM;
+    esp_err_t err = ring_init(&s_rx_ring, queue_len);
+    if (err != ESP_OK) return err;
+
+    err = ring_init(&s_tx_ring, CAN_MON_TX_RING_LEN);
+    if (err != ESP_OK) {
+        heap_caps_free(s_rx_ring.buf);
+        s_rx_ring.buf = NULL;
+        return err;
     }
 
     s_rx_cnt = 0;
     s_tx_cnt = 0;
-    s_drop_cnt = 0;
+    s_rx_drop_cnt = 0;
+    s_tx_drop_cnt = 0;
+    s_rx_wake_cnt = 0;
+    s_rx_wake_frames = 0;
+    s_rx_last_us = 0;
+    s_tx_last_us = 0;
+    s_inited = true;
 
+    ESP_LOGI(TAG, "Event ring: %u RX slots, %u TX slots (%u B/record)",
+             (unsigned)(s_rx_ring.mask + 1), (unsigned)(s_tx_ring.mask + 1),
+             (unsigned)sizeof(can_rec_t));
     return ESP_OK;
 }
 
-QueueHandle_t can_mon_get_queue(void)
+static int64_t time_now(size_t i, void *ctx)
 {
-    return s_evt_q;
+    (void)i;
+    return *(const int64_t *)ctx;
 }
 
 void can_mon_push_evt(bool is_tx, const twai_message_t *m)
 {
-    if (!s_evt_q || !m) return;
+    if (!s_inited || !m) return;
 
-    can_evt_t e = {
-        .t_us  = esp_timer_get_time(),
-        .is_tx = is_tx,
-        .msg   = *m,
-    };
+    int64_t now = esp_timer_get_time();
 
-    if (xQueueSend(s_evt_q, &e, 0) != pdTRUE) {
-        s_drop_cnt++;
+    if (is_tx) {
+        portENTER_CRITICAL(&s_tx_lock);
+        if (now <= s_tx_last_us) now = s_tx_last_us + 1;
+        s_tx_last_us = now;
+        if (ring_put_frames(&s_tx_ring, true, m, 1, time_now, &now)) s_tx_cnt++;
+        else                                                         s_tx_drop_cnt++;
+        portEXIT_CRITICAL(&s_tx_lock);
+
+        capture_append(true, m, 1, time_now, &now);
+        can_load_update(m, now);
+        can_pipe_wake();
         return;
     }
 
-    if (is_tx) s_tx_cnt++;
-    else       s_rx_cnt++;
+    if (now <= s_rx_last_us) now = s_rx_last_us + 1;
+    s_rx_last_us = now;
+
+    capture_append(false, m, 1, time_now, &now);
+    can_load_update(m, now);
+    if (ring_put_frames(&s_rx_ring, false, m, 1, time_now, &now)) s_rx_cnt++;
+    else                                                          s_rx_drop_cnt++;
+    can_pipe_wake();
+}
+
+void can_mon_push_bus_evt(can_bus_evt_t code, uint32_t tec, uint32_t rec, uint32_t count)
+{
+    if (!s_inited) return;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_tx_lock);
+    if (now <= s_tx_last_us) now = s_tx_last_us + 1;
+    s_tx_last_us = now;
+    if (!ring_put_bus(&s_tx_ring, now, code, tec, rec, count)) s_tx_drop_cnt++;
+    portEXIT_CRITICAL(&s_tx_lock);
+
+    capture_append_bus(now, code, tec, rec, count);
+    can_pipe_wake();
+}
+
+typedef struct {
+    int64_t t_base_us;
+    int64_t span_us;
+    size_t  n;
+} rx_batch_clock_t;
+
+/* The driver only tells us when we woke up, not when each buffered frame
+ * arrived, so spread the batch evenly over [t_first, t_last]. The extra +i
+ * keeps the sequence strictly increasing even when the span is zero. */
+static int64_t time_spread(size_t i, void *ctx)
+{
+    const rx_batch_clock_t *c = ctx;
+    return c->t_base_us + c->span_us * (int64_t)i / (int64_t)c->n + (int64_t)i;
+}
+
+void can_mon_push_rx_batch(const twai_message_t *msgs, size_t n, int64_t t_first_us, int64_t t_last_us)
+{
+    if (!s_inited || !msgs || n == 0) return;
+
+    rx_batch_clock_t clk = {
+        .t_base_us = (t_first_us > s_rx_last_us) ? t_first_us : s_rx_last_us + 1,
+        .span_us   = (t_last_us > t_first_us) ? (t_last_us - t_first_us) : 0,
+        .n         = n,
+    };
+    s_rx_last_us = time_spread(n - 1, &clk);
+
+    /* Capture first: display lag must never cost history */
+    capture_append(false, msgs, n, time_spread, &clk);
+
+    /* The load meter sees every frame too, whatever the decode stage keeps up with */
+    for (size_t i = 0; i < n; i++) can_load_update(&msgs[i], time_spread(i, &clk));
+
+    size_t done = ring_put_frames(&s_rx_ring, false, msgs, n, time_spread, &clk);
+    s_rx_cnt      += done;
+    s_rx_drop_cnt += n - done;
+}
+
+/* Length of the leading run of recs[] not newer than limit_us (at least 1) */
+static size_t run_until(const can_rec_t *recs, size_t n, int64_t base_us, int64_t limit_us)
+{
+    if (can_rec_is_sync(&recs[0])) base_us = can_rec_time(&recs[0], base_us);
+
+    size_t i = 1;
+    while (i < n) {
+        int64_t t = can_rec_time(&recs[i], base_us);
+        if (t > limit_us) break;
+        if (can_rec_is_sync(&recs[i])) base_us = t;
+        i++;
+    }
+    return i;
+}
+
+size_t can_mon_peek(const can_rec_t **recs, int64_t *base_us, size_t max)
+{
+    if (!s_inited || !recs || !base_us || max == 0) return 0;
+
+    const can_rec_t *rx, *tx;
+    size_t n_rx = ring_peek(&s_rx_ring, &rx, max);
+    size_t n_tx = ring_peek(&s_tx_ring, &tx, max);
+
+    int64_t rx_base = s_rx_ring.cons_base_us;
+    int64_t tx_base = s_tx_ring.cons_base_us;
+
+    /* Hand out a run from whichever ring holds the oldest record, cut where the
+     * other ring's head would come next, so the merged stream stays ordered. */
+    if (n_tx == 0 || (n_rx > 0 && can_rec_time(&rx[0], rx_base) <= can_rec_time(&tx[0], tx_base))) {
+        if (n_tx > 0) n_rx = run_until(rx, n_rx, rx_base, can_rec_time(&tx[0], tx_base));
+        s_peek_ring = &s_rx_ring;
+        *recs = rx;
+        *base_us = rx_base;
+        return n_rx;
+    }
+
+    if (n_rx > 0) n_tx = run_until(tx, n_tx, tx_base, can_rec_time(&rx[0], rx_base));
+    s_peek_ring = &s_tx_ring;
+    *recs = tx;
+    *base_us = tx_base;
+    return n_tx;
+}
+
+void can_mon_release(size_t n)
+{
+    if (!s_peek_ring || n == 0) return;
+    ring_release(s_peek_ring, n);
+    s_peek_ring = NULL;
 }
 
 uint32_t can_mon_get_rx_cnt(void)   { return s_rx_cnt; }
 uint32_t can_mon_get_tx_cnt(void)   { return s_tx_cnt; }
-uint32_t can_mon_get_drop_cnt(void) { return s_drop_cnt; }
+uint32_t can_mon_get_drop_cnt(void) { return s_rx_drop_cnt + s_tx_drop_cnt; }
+
+uint32_t can_mon_get_avg_batch_x10(void)
+{
+    uint32_t wakeups = s_rx_wake_cnt;
+    if (wakeups == 0) return 0;
+    return (uint32_t)(((uint64_t)s_rx_wake_frames * 10u) / wakeups);
+}
 
 esp_err_t can_mon_send_frame(const twai_message_t *m)
 {
     if (!m) return ESP_ERR_INVALID_ARG;
-    if (!waveshare_twai_is_started()) return ESP_ERR_INVALID_STATE;
+    if (!can_bus_is_started()) return ESP_ERR_INVALID_STATE;
 
-    /* Copy because send_can_frame takes by value in your port */
-    twai_message_t tmp = *m;
+    /* The TX worker pushes the event once the controller reports it sent */
+    return can_tx_submit(m, CAN_TX_PRIO_NORMAL, NULL, NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
 
-    esp_err_t err = send_can_frame(tmp);
-    if (err == ESP_OK) {
-        can_mon_push_evt(true, &tmp);
-    }
-    return err;
+static TaskHandle_t s_rx_task = NULL;
+static atomic_uint  s_rx_wake_us = 0;   /* low 32 bits of the first unserved wakeup, 0 = none */
+
+void can_mon_rx_wake(void)
+{
+    TaskHandle_t t = s_rx_task;
+    if (!t) return;
+
+    unsigned none = 0;
+    unsigned now = (unsigned)esp_timer_get_time() | 1u;
+    atomic_compare_exchange_strong(&s_rx_wake_us, &none, now);
+    xTaskNotifyGive(t);
 }
 
 void can_mon_rx_task(void *arg)
 {
     (void)arg;
 
+    twai_message_t batch[CAN_MON_RX_BATCH_MAX];
+    s_rx_task = xTaskGetCurrentTaskHandle();
+
     while (1) {
-        twai_message_t msg;
-        esp_err_t err = waveshare_twai_receive(&msg, pdMS_TO_TICKS(1000));
+        /* Sleep until the supervisor sees RX_DATA, then empty the driver
+         * queue without sleeping again. The timeout only covers a missed
+         * wakeup or a supervisor that is not running. */
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAN_MON_RX_IDLE_MS));
+        unsigned woken = atomic_exchange(&s_rx_wake_us, 0);
 
-        if (err == ESP_OK) {
-            can_mon_push_evt(false, &msg);
-            continue;
-        }
+        int n;
+        uint32_t taken = 0;
+        bool pushed = false;
+        do {
+            int64_t t_first = esp_timer_get_time();
+            n = can_bus_rx_batch(batch, CAN_MON_RX_BATCH_MAX);
+            if (n <= 0) break;
+            taken += (uint32_t)n;
+
+            if (woken) {
+                /* 32-bit wrap-safe difference */
+                can_lat_record_us(CAN_LAT_WAKE, (int32_t)((unsigned)t_first - woken));
+                woken = 0;
+            }
+
+            /* Drop what the hardware acceptance filter could not, then run
+             * the software rules, before anything is queued */
+            size_t kept = can_hwf_filter(batch, (size_t)n);
+            kept = can_filter_rx(batch, kept);
+            int64_t t_last = esp_timer_get_time();
+            if (kept > 0) {
+                can_mon_push_rx_batch(batch, kept, t_first, t_last);
+                pushed = true;
+            }
+            can_lat_record_us(CAN_LAT_RX, esp_timer_get_time() - t_first);
+        } while (n == CAN_MON_RX_BATCH_MAX);
 
-        if (err == ESP_ERR_TIMEOUT) {
-            /* Normal idle case. */
-            continue;
+        if (taken > 0) {
+            s_rx_wake_cnt++;
+            s_rx_wake_frames += taken;
         }
 
-        ESP_LOGW(TAG, "CAN RX error: %s", esp_err_to_name(err));
-        vTaskDelay(pdMS_TO_TICKS(50));
+        /* One wakeup per drain; the decode stage takes whatever is there */
+        if (pushed) can_pipe_wake();
     }
 }
@@ -0,0 +1,218 @@
+#include "can_pipe.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#include "can_mon.h"
+#include "can_agg.h"
+#include "can_lat.h"
+
+#ifndef TAG
+#define TAG "can_pipe"
+#endif
+
+#ifndef CAN_PIPE_CACHE_LINE
+#define CAN_PIPE_CACHE_LINE   64
+#endif
+
+#ifndef CAN_PIPE_TASK_STACK
+#define CAN_PIPE_TASK_STACK   4096
+#endif
+
+/* ---------------- Row ring ----------------
+ *
+ * Same scheme as the can_mon rings: free-running indices masked on access,
+ * head and tail on separate cache lines, and a cached copy of the other side's
+ * index so each side only reads the shared line when it runs out.
+ */
+
+#define CAN_PIPE_ALIGNED __attribute__((aligned(CAN_PIPE_CACHE_LINE)))
+
+static struct {
+    /* Producer-owned (decode task) */
+    CAN_PIPE_ALIGNED atomic_uint head;
+    uint32_t tail_cache;
+    uint32_t drop_cnt;
+    /* Consumer-owned (render) */
+    CAN_PIPE_ALIGNED atomic_uint tail;
+    uint32_t head_cache;
+    /* Read-only after init */
+    CAN_PIPE_ALIGNED can_pipe_row_t *buf;
+    uint32_t mask;
+} s_rows;
+
+static TaskHandle_t s_task = NULL;
+static can_pipe_ready_cb_t s_ready_cb = NULL;
+static void *s_ready_ctx = NULL;
+
+esp_err_t can_pipe_init(size_t rows)
+{
+    if (s_rows.buf) return ESP_OK;
+
+    uint32_t cap = 2;
+    while (cap < rows && cap < (1u << 16)) cap <<= 1;
+
+    /* Both cores touch it; internal RAM first, PSRAM if that is short */
+    s_rows.buf = heap_caps_aligned_alloc(CAN_PIPE_CACHE_LINE, cap * sizeof(can_pipe_row_t),
+                                         MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!s_rows.buf) {
+        s_rows.buf = heap_caps_aligned_alloc(CAN_PIPE_CACHE_LINE, cap * sizeof(can_pipe_row_t),
+                                             MALLOC_CAP_SPIRAM);
+    }
+    if (!s_rows.buf) return ESP_ERR_NO_MEM;
+
+    s_rows.mask = cap - 1;
+    s_rows.tail_cache = 0;
+    s_rows.head_cache = 0;
+    s_rows.drop_cnt = 0;
+    atomic_store_explicit(&s_rows.head, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_rows.tail, 0, memory_order_relaxed);
+
+    ESP_LOGI(TAG, "Row ring: %u rows (%u B/row)", (unsigned)cap, (unsigned)sizeof(can_pipe_row_t));
+    return ESP_OK;
+}
+
+/* ---------------- Decode stage ---------------- */
+
+/* Decode one run of records; returns rows written */
+static uint32_t decode_run(const can_rec_t *recs, size_t n, int64_t base_us, uint32_t head, int64_t now)
+{
+    static can_evt_t evts[CAN_PIPE_BATCH];   /* decode task only */
+    size_t n_evt = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        can_evt_t *e = &evts[n_evt];
+        if (!can_rec_decode(&recs[i], &base_us, e)) continue;
+
+        can_lat_record_us(CAN_LAT_QUEUE, now - e->t_us);
+        if (e->kind == CAN_EVT_FRAME) can_agg_update(e->is_tx, &e->msg, e->t_us);
+        n_evt++;
+    }
+
+    /* Only as many rows as the ring takes; the rest are dropped, newest first */
+    const uint32_t cap = s_rows.mask + 1;
+    uint32_t room = cap - (head - s_rows.tail_cache);
+    if (room < n_evt) {
+        s_rows.tail_cache = atomic_load_explicit(&s_rows.tail, memory_order_acquire);
+        room = cap - (head - s_rows.tail_cache);
+    }
+    uint32_t done = (n_evt < room) ? (uint32_t)n_evt : room;
+    s_rows.drop_cnt += (uint32_t)n_evt - done;
+    if (done == 0) return 0;
+
+    int64_t f0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < done; i++) {
+        can_pipe_row_t *row = &s_rows.buf[(head + i) & s_rows.mask];
+        row->t_us = evts[i].t_us;
+        can_fmt_line(row->txt, &evts[i]);
+    }
+
+    /* Mean per line; a single call is below the timer's resolution */
+    can_lat_record_ns(CAN_LAT_FORMAT, (uint32_t)((esp_timer_get_time() - f0) * 1000 / done));
+    return done;
+}
+
+size_t can_pipe_poll(void)
+{
+    if (!s_rows.buf) return 0;
+
+    const can_rec_t *recs;
+    int64_t base_us;
+    size_t n, total = 0;
+    uint32_t rows = 0;
+
+    while ((n = can_mon_peek(&recs, &base_us, CAN_PIPE_BATCH)) > 0) {
+        const uint32_t head = atomic_load_explicit(&s_rows.head, memory_order_relaxed);
+        uint32_t done = decode_run(recs, n, base_us, head, esp_timer_get_time());
+        can_mon_release(n);
+        if (done > 0) atomic_store_explicit(&s_rows.head, head + done, memory_order_release);
+        rows += done;
+        total += n;
+    }
+
+    can_pipe_ready_cb_t cb = s_ready_cb;
+    if (rows > 0 && cb) cb(s_ready_ctx);
+    return total;
+}
+
+static void can_pipe_task(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAN_PIPE_IDLE_MS));
+        can_pipe_poll();
+    }
+}
+
+esp_err_t can_pipe_start(UBaseType_t prio, BaseType_t core)
+{
+    if (!s_rows.buf) return ESP_ERR_INVALID_STATE;
+    if (s_task) return ESP_OK;
+
+    if (xTaskCreatePinnedToCore(can_pipe_task, "can_decode", CAN_PIPE_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void can_pipe_wake(void)
+{
+    TaskHandle_t t = s_task;
+    if (t) xTaskNotifyGive(t);
+}
+
+void can_pipe_set_ready_cb(can_pipe_ready_cb_t cb, void *ctx)
+{
+    s_ready_ctx = ctx;
+    s_ready_cb = cb;
+}
+
+/* ---------------- Render side ---------------- */
+
+size_t can_pipe_peek(const can_pipe_row_t **rows, size_t max)
+{
+    if (!s_rows.buf || !rows || max == 0) return 0;
+
+    const uint32_t tail = atomic_load_explicit(&s_rows.tail, memory_order_relaxed);
+
+    uint32_t avail = s_rows.head_cache - tail;
+    if (avail < max) {
+        s_rows.head_cache = atomic_load_explicit(&s_rows.head, memory_order_acquire);
+        avail = s_rows.head_cache - tail;
+    }
+
+    const uint32_t idx = tail & s_rows.mask;
+    uint32_t cnt = (s_rows.mask + 1) - idx;
+    if (cnt > avail) cnt = avail;
+    if (cnt > max)   cnt = (uint32_t)max;
+
+    *rows = &s_rows.buf[idx];
+    return cnt;
+}
+
+void can_pipe_release(size_t n)
+{
+    if (n == 0) return;
+    const uint32_t tail = atomic_load_explicit(&s_rows.tail, memory_order_relaxed);
+    atomic_store_explicit(&s_rows.tail, tail + (uint32_t)n, memory_order_release);
+}
+
+size_t can_pipe_pending(void)
+{
+    if (!s_rows.buf) return 0;
+    s_rows.head_cache = atomic_load_explicit(&s_rows.head, memory_order_acquire);
+    return s_rows.head_cache - atomic_load_explicit(&s_rows.tail, memory_order_relaxed);
+}
+
+uint32_t can_pipe_get_drop_cnt(void)
+{
+    return s_rows.drop_cnt;
+}
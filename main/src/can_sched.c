@@ -0,0 +1,529 @@
+#include "can_sched.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#include "can_tx.h"
+
+#ifndef TAG
+#define TAG "can_sched"
+#endif
+
+#ifndef CAN_SCHED_TASK_STACK
+#define CAN_SCHED_TASK_STACK  3072
+#endif
+
+#define CAN_SCHED_MAX_LIMIT  0xFFFEu   /* indices are uint16_t, NIL excluded */
+
+/* ---------------- Wheel layout ----------------
+ *
+ * Ticks are absolute: esp_timer time / CAN_SCHED_TICK_US, kept in 32 bits
+ * and compared wrap-safe. L0 holds the current 256-tick round, one list per
+ * tick. L1 holds the next 63 rounds, one list per round; a round's list is
+ * cascaded into L0 when the round starts. Deadlines further out park in the
+ * last L1 slot and are re-inserted when it cascades. READY is the FIFO of
+ * messages whose tick has passed but which have not been sent yet.
+ *
+ * Lists are intrusive and doubly linked through uint16_t indices, so add,
+ * remove and re-arm are O(1) without allocation. n_l0 / n_l1 count what the
+ * two levels hold, so the advance can jump over empty stretches instead of
+ * walking them tick by tick.
+ */
+
+#define L0_BITS   8
+#define L0_SLOTS  (1u << L0_BITS)
+#define L1_SLOTS  64u
+#define LIST_L1   L0_SLOTS
+#define LIST_READY (L0_SLOTS + L1_SLOTS)
+#define LIST_CNT  (LIST_READY + 1)
+#define NIL       0xFFFFu
+
+typedef struct {
+    twai_message_t msg;
+    int64_t  next_us;      /* nominal deadline of the next send */
+    uint32_t period_us;
+    uint16_t prev;
+    uint16_t next;
+    uint16_t list;         /* NIL when free */
+    uint16_t gen;          /* bumped on free so stale handles miss */
+    can_sched_stats_t st;
+} sched_entry_t;
+
+typedef struct {
+    sched_entry_t *e;
+    uint16_t      *head;   /* LIST_CNT heads */
+    uint16_t      *tail;
+    uint16_t       free_head;
+    uint32_t       max;
+    uint32_t       cur;    /* next tick to process */
+    uint32_t       n_l0;   /* entries in L0 lists */
+    uint32_t       n_l1;   /* entries in L1 lists */
+    atomic_uint    count;
+    can_sched_tx_fn_t tx;
+    portMUX_TYPE   lock;
+} can_sched_t;
+
+static can_sched_t s_sch = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static TaskHandle_t s_task = NULL;
+static esp_timer_handle_t s_timer = NULL;
+
+/* ---------------- Lists ---------------- */
+
+static inline void level_count(uint16_t list, int32_t d)
+{
+    if (list < LIST_L1)         s_sch.n_l0 += (uint32_t)d;
+    else if (list < LIST_READY) s_sch.n_l1 += (uint32_t)d;
+}
+
+static void list_push(uint16_t list, uint16_t i)
+{
+    sched_entry_t *e = &s_sch.e[i];
+    level_count(list, 1);
+    e->list = list;
+    e->next = NIL;
+    e->prev = s_sch.tail[list];
+    if (e->prev == NIL) s_sch.head[list] = i;
+    else                s_sch.e[e->prev].next = i;
+    s_sch.tail[list] = i;
+}
+
+static void list_unlink(uint16_t i)
+{
+    sched_entry_t *e = &s_sch.e[i];
+    level_count(e->list, -1);
+    if (e->prev == NIL) s_sch.head[e->list] = e->next;
+    else                s_sch.e[e->prev].next = e->next;
+    if (e->next == NIL) s_sch.tail[e->list] = e->prev;
+    else                s_sch.e[e->next].prev = e->prev;
+}
+
+/* Move a whole list to the end of READY */
+static void list_splice_ready(uint16_t list)
+{
+    uint16_t i = s_sch.head[list];
+    if (i == NIL) return;
+
+    for (uint16_t j = i; j != NIL; j = s_sch.e[j].next) {
+        s_sch.e[j].list = LIST_READY;
+        level_count(list, -1);
+    }
+
+    uint16_t t = s_sch.tail[LIST_READY];
+    s_sch.e[i].prev = t;
+    if (t == NIL) s_sch.head[LIST_READY] = i;
+    else          s_sch.e[t].next = i;
+    s_sch.tail[LIST_READY] = s_sch.tail[list];
+    s_sch.head[list] = NIL;
+    s_sch.tail[list] = NIL;
+}
+
+/* ---------------- Wheel ---------------- */
+
+static inline uint32_t due_tick(int64_t t_us)
+{
+    /* Round up so a message is never sent before its deadline */
+    return (uint32_t)((t_us + CAN_SCHED_TICK_US - 1) / CAN_SCHED_TICK_US);
+}
+
+static void wheel_insert(uint16_t i)
+{
+    uint32_t t = due_tick(s_sch.e[i].next_us);
+
+    if ((int32_t)(t - s_sch.cur) < 0) {
+        list_push(LIST_READY, i);
+        return;
+    }
+
+    uint32_t round = t >> L0_BITS;
+    uint32_t cur_round = s_sch.cur >> L0_BITS;
+
+    if (round == cur_round) {
+        list_push(t & (L0_SLOTS - 1), i);
+    } else if (round - cur_round < L1_SLOTS) {
+        list_push(LIST_L1 + (round & (L1_SLOTS - 1)), i);
+    } else {
+        list_push(LIST_L1 + ((cur_round + L1_SLOTS - 1) & (L1_SLOTS - 1)), i);
+    }
+}
+
+static void wheel_cascade(void)
+{
+    uint16_t list = LIST_L1 + ((s_sch.cur >> L0_BITS) & (L1_SLOTS - 1));
+    uint16_t i = s_sch.head[list];
+
+    s_sch.head[list] = NIL;
+    s_sch.tail[list] = NIL;
+    while (i != NIL) {
+        uint16_t nx = s_sch.e[i].next;
+        s_sch.n_l1--;
+        wheel_insert(i);
+        i = nx;
+    }
+}
+
+/* Process ticks up to and including `target`; due lists go to READY.
+ * Runs under the spinlock, so a late call (the task starved, or a long gap
+ * between host-driven runs) must not cost a step per elapsed tick: an empty
+ * wheel jumps straight to target, an empty L0 to the next round start. */
+static void wheel_advance_locked(uint32_t target)
+{
+    while ((int32_t)(target - s_sch.cur) >= 0) {
+        if ((s_sch.cur & (L0_SLOTS - 1)) == 0) wheel_cascade();
+
+        if (s_sch.n_l0 == 0) {
+            if (s_sch.n_l1 == 0) {
+                s_sch.cur = target + 1;
+                break;
+            }
+            uint32_t next_round = (s_sch.cur | (L0_SLOTS - 1)) + 1;
+            s_sch.cur = ((int32_t)(target - next_round) < 0) ? target + 1 : next_round;
+            continue;
+        }
+
+        list_splice_ready(s_sch.cur & (L0_SLOTS - 1));
+        s_sch.cur++;
+    }
+}
+
+/* ---------------- Handles ---------------- */
+
+static inline can_sched_handle_t make_handle(uint16_t i)
+{
+    return ((uint32_t)s_sch.e[i].gen << 16) | i;
+}
+
+/* Entry for a live handle, NULL if stale */
+static sched_entry_t *lookup_locked(can_sched_handle_t h)
+{
+    uint32_t i = h & 0xFFFF;
+    if (!s_sch.e || i >= s_sch.max) return NULL;
+
+    sched_entry_t *e = &s_sch.e[i];
+    if (e->list == NIL || e->gen != (h >> 16)) return NULL;
+    return e;
+}
+
+/* Bucket 0 is [0,64) us, then one per power of two; the last is open ended */
+static inline uint32_t jit_bucket(uint32_t late_us)
+{
+    if (late_us < 64) return 0;
+    uint32_t b = 31 - (uint32_t)__builtin_clz(late_us) - 5;
+    return b < CAN_SCHED_JIT_BUCKETS ? b : CAN_SCHED_JIT_BUCKETS - 1;
+}
+
+/* ---------------- Default TX hook ---------------- */
+
+/* Cyclic frames jump the queue; the TX worker logs them once sent */
+static esp_err_t sched_twai_tx(const twai_message_t *m)
+{
+    return can_tx_submit(m, CAN_TX_PRIO_HIGH, NULL, NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* ---------------- API ---------------- */
+
+esp_err_t can_sched_init(size_t max_msgs, can_sched_tx_fn_t tx)
+{
+    if (s_sch.e) return ESP_OK;
+    if (max_msgs == 0 || max_msgs > CAN_SCHED_MAX_LIMIT) return ESP_ERR_INVALID_SIZE;
+
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    sched_entry_t *e = heap_caps_calloc(max_msgs, sizeof(sched_entry_t), caps);
+    uint16_t *heads  = heap_caps_malloc(2 * LIST_CNT * sizeof(uint16_t), caps);
+    if (!e || !heads) {
+        heap_caps_free(e);
+        heap_caps_free(heads);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(heads, 0xFF, 2 * LIST_CNT * sizeof(uint16_t));
+    for (size_t i = 0; i < max_msgs; i++) {
+        e[i].list = NIL;
+        e[i].gen = 1;
+        e[i].next = (i + 1 < max_msgs) ? (uint16_t)(i + 1) : NIL;
+    }
+
+    portENTER_CRITICAL(&s_sch.lock);
+    s_sch.head = heads;
+    s_sch.tail = heads + LIST_CNT;
+    s_sch.free_head = 0;
+    s_sch.max = (uint32_t)max_msgs;
+    s_sch.cur = (uint32_t)(esp_timer_get_time() / CAN_SCHED_TICK_US);
+    s_sch.n_l0 = 0;
+    s_sch.n_l1 = 0;
+    s_sch.tx = tx ? tx : sched_twai_tx;
+    atomic_store_explicit(&s_sch.count, 0, memory_order_relaxed);
+    s_sch.e = e;
+    portEXIT_CRITICAL(&s_sch.lock);
+
+    ESP_LOGI(TAG, "Cyclic TX: %u messages (%u B)", (unsigned)max_msgs,
+             (unsigned)(max_msgs * sizeof(sched_entry_t) + 2 * LIST_CNT * sizeof(uint16_t)));
+    return ESP_OK;
+}
+
+esp_err_t can_sched_deinit(void)
+{
+    if (!s_sch.e) return ESP_OK;
+    if (s_task || s_timer || atomic_load_explicit(&s_sch.count, memory_order_relaxed) > 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = s_sch.e;
+    uint16_t *heads = s_sch.head;
+    s_sch.e = NULL;
+    s_sch.head = NULL;
+    s_sch.tail = NULL;
+    s_sch.max = 0;
+    portEXIT_CRITICAL(&s_sch.lock);
+
+    heap_caps_free(e);
+    heap_caps_free(heads);
+    return ESP_OK;
+}
+
+/* Run the wheel only while something is scheduled */
+static void timer_update(void)
+{
+    if (!s_timer) return;
+
+    if (atomic_load_explicit(&s_sch.count, memory_order_relaxed) > 0) {
+        if (!esp_timer_is_active(s_timer)) (void)esp_timer_start_periodic(s_timer, CAN_SCHED_TICK_US);
+    } else {
+        if (esp_timer_is_active(s_timer)) (void)esp_timer_stop(s_timer);
+    }
+}
+
+can_sched_handle_t can_sched_add(const twai_message_t *m, uint32_t period_us, uint32_t phase_us)
+{
+    if (!s_sch.e || !m || period_us < CAN_SCHED_TICK_US) return 0;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_sch.lock);
+    uint16_t i = s_sch.free_head;
+    if (i == NIL) {
+        portEXIT_CRITICAL(&s_sch.lock);
+        return 0;
+    }
+    sched_entry_t *e = &s_sch.e[i];
+    s_sch.free_head = e->next;
+
+    /* An empty wheel is not advanced while idle; restart it at now rather
+     * than leave the next run the idle time to walk */
+    if (s_sch.n_l0 == 0 && s_sch.n_l1 == 0 && s_sch.head[LIST_READY] == NIL) {
+        s_sch.cur = (uint32_t)(now / CAN_SCHED_TICK_US);
+    }
+
+    if (phase_us == CAN_SCHED_PHASE_AUTO) {
+        /* One tick per message already scheduled keeps a batch of adds (and
+         * equal-rate traffic in particular) from landing in one burst */
+        uint32_t n = atomic_load_explicit(&s_sch.count, memory_order_relaxed);
+        phase_us = (uint32_t)(((uint64_t)n * CAN_SCHED_TICK_US) % period_us);
+    }
+
+    e->msg = *m;
+    if (e->msg.data_length_code > 8) e->msg.data_length_code = 8;
+    e->period_us = period_us;
+    e->next_us = now + phase_us;
+    memset(&e->st, 0, sizeof(e->st));
+    wheel_insert(i);
+    can_sched_handle_t h = make_handle(i);
+    portEXIT_CRITICAL(&s_sch.lock);
+
+    atomic_fetch_add_explicit(&s_sch.count, 1, memory_order_relaxed);
+    timer_update();
+    return h;
+}
+
+esp_err_t can_sched_remove(can_sched_handle_t h)
+{
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = lookup_locked(h);
+    if (!e) {
+        portEXIT_CRITICAL(&s_sch.lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint16_t i = (uint16_t)(h & 0xFFFF);
+    list_unlink(i);
+    e->list = NIL;
+    e->gen = (e->gen == 0xFFFF) ? 1 : e->gen + 1;
+    e->next = s_sch.free_head;
+    s_sch.free_head = i;
+    portEXIT_CRITICAL(&s_sch.lock);
+
+    atomic_fetch_sub_explicit(&s_sch.count, 1, memory_order_relaxed);
+    timer_update();
+    return ESP_OK;
+}
+
+esp_err_t can_sched_set_period(can_sched_handle_t h, uint32_t period_us)
+{
+    if (period_us < CAN_SCHED_TICK_US) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = lookup_locked(h);
+    if (!e) {
+        portEXIT_CRITICAL(&s_sch.lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint16_t i = (uint16_t)(h & 0xFFFF);
+    if (e->list != LIST_READY) {
+        /* Re-anchor on the last nominal send so the phase is kept */
+        list_unlink(i);
+        e->next_us += (int64_t)period_us - e->period_us;
+        wheel_insert(i);
+    }
+    e->period_us = period_us;
+    portEXIT_CRITICAL(&s_sch.lock);
+    return ESP_OK;
+}
+
+esp_err_t can_sched_update_data(can_sched_handle_t h, const uint8_t *data, uint8_t dlc)
+{
+    if (!data && dlc > 0) return ESP_ERR_INVALID_ARG;
+    if (dlc > 8) dlc = 8;
+
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = lookup_locked(h);
+    if (!e) {
+        portEXIT_CRITICAL(&s_sch.lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (dlc > 0) memcpy(e->msg.data, data, dlc);
+    e->msg.data_length_code = dlc;
+    portEXIT_CRITICAL(&s_sch.lock);
+    return ESP_OK;
+}
+
+esp_err_t can_sched_get_stats(can_sched_handle_t h, can_sched_stats_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = lookup_locked(h);
+    if (e) *out = e->st;
+    portEXIT_CRITICAL(&s_sch.lock);
+    return e ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t can_sched_reset_stats(can_sched_handle_t h)
+{
+    portENTER_CRITICAL(&s_sch.lock);
+    sched_entry_t *e = lookup_locked(h);
+    if (e) memset(&e->st, 0, sizeof(e->st));
+    portEXIT_CRITICAL(&s_sch.lock);
+    return e ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t can_sched_count(void)
+{
+    return atomic_load_explicit(&s_sch.count, memory_order_relaxed);
+}
+
+size_t can_sched_run(int64_t now_us)
+{
+    if (!s_sch.e) return 0;
+
+    size_t sent = 0;
+
+    portENTER_CRITICAL(&s_sch.lock);
+    wheel_advance_locked((uint32_t)(now_us / CAN_SCHED_TICK_US));
+    portEXIT_CRITICAL(&s_sch.lock);
+
+    /* Pop and re-arm one message at a time so the lock is never held
+     * across the TX hook */
+    while (sent < CAN_SCHED_MAX_BURST) {
+        portENTER_CRITICAL(&s_sch.lock);
+        uint16_t i = s_sch.head[LIST_READY];
+        if (i == NIL) {
+            portEXIT_CRITICAL(&s_sch.lock);
+            break;
+        }
+        sched_entry_t *e = &s_sch.e[i];
+        can_sched_handle_t h = make_handle(i);
+        twai_message_t msg = e->msg;
+
+        int64_t late = now_us - e->next_us;
+        if (late < 0) late = 0;
+        uint32_t late_us = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+        e->st.hist[jit_bucket(late_us)]++;
+        if (late_us > e->st.jit_max_us) e->st.jit_max_us = late_us;
+
+        e->next_us += e->period_us;
+        if (e->next_us <= now_us) {
+            /* A period or more behind: skip the lost cycles, keep the phase */
+            int64_t skip = (now_us - e->next_us) / e->period_us + 1;
+            e->st.missed += (uint32_t)skip;
+            e->next_us += skip * e->period_us;
+        }
+        list_unlink(i);
+        wheel_insert(i);
+        portEXIT_CRITICAL(&s_sch.lock);
+
+        esp_err_t err = s_sch.tx(&msg);
+
+        portENTER_CRITICAL(&s_sch.lock);
+        e = lookup_locked(h);
+        if (e) {
+            if (err == ESP_OK) e->st.sent++;
+            else               e->st.tx_fail++;
+        }
+        portEXIT_CRITICAL(&s_sch.lock);
+
+        /* TX queue full: leave the rest for the next tick */
+        if (err != ESP_OK) break;
+        sent++;
+    }
+    return sent;
+}
+
+/* ---------------- Task glue ---------------- */
+
+static void sched_timer_cb(void *arg)
+{
+    (void)arg;
+    xTaskNotifyGive(s_task);
+}
+
+static void can_sched_task(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        (void)can_sched_run(esp_timer_get_time());
+    }
+}
+
+esp_err_t can_sched_start(UBaseType_t prio, BaseType_t core)
+{
+    if (!s_sch.e) return ESP_ERR_INVALID_STATE;
+    if (s_task) return ESP_OK;
+
+    if (xTaskCreatePinnedToCore(can_sched_task, "can_sched", CAN_SCHED_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = sched_timer_cb,
+        .name = "can_sched",
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Timer create failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    timer_update();
+    return ESP_OK;
+}
@@ -0,0 +1,389 @@
+#include "can_sup.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "can_mon.h"
+#include "can_tx.h"
+#include "can_gen.h"
+#include "can_bus.h"
+
+#ifndef TAG
+#define TAG "can_sup"
+#endif
+
+#ifndef CAN_SUP_TASK_STACK
+#define CAN_SUP_TASK_STACK  3072
+#endif
+
+/* Alerts that carry no state change; anything else triggers a status read */
+#define SUP_ALERTS_ROUTINE  (TWAI_ALERT_RX_DATA | TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_IDLE)
+
+static can_sup_stats_t s_st;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task = NULL;
+
+/* Time series and recovery log: rings indexed by free-running counters,
+ * written by the supervisor and copied out under s_lock */
+static can_sup_sample_t   s_series[CAN_SUP_SERIES_LEN];
+static uint32_t           s_series_cnt = 0;
+static uint32_t           s_sample_bus_err = 0;   /* s_st.bus_errors at the last sample */
+static can_sup_recovery_t s_rcv_log[CAN_SUP_RECOVERY_LOG];
+static uint32_t           s_rcv_cnt = 0;
+
+/* Driver counters as last read. They restart from zero whenever the driver
+ * is reinstalled (filter change), which a smaller reading gives away. */
+static twai_status_info_t s_last;
+
+static inline uint32_t counter_delta(uint32_t now, uint32_t last)
+{
+    return now >= last ? now - last : now;
+}
+
+/* Fold a status read into the stats; returns frames lost since the last one */
+static uint32_t sup_poll_status(void)
+{
+    twai_status_info_t si;
+    if (can_bus_get_status(&si) != ESP_OK) return 0;
+
+    uint32_t missed  = counter_delta(si.rx_missed_count, s_last.rx_missed_count);
+    uint32_t overrun = counter_delta(si.rx_overrun_count, s_last.rx_overrun_count);
+
+    portENTER_CRITICAL(&s_lock);
+    s_st.state       = si.state;
+    s_st.tec         = si.tx_error_counter;
+    s_st.rec         = si.rx_error_counter;
+    s_st.rx_missed  += missed;
+    s_st.rx_overrun += overrun;
+    s_st.bus_errors += counter_delta(si.bus_error_count, s_last.bus_error_count);
+    s_st.arb_lost   += counter_delta(si.arb_lost_count, s_last.arb_lost_count);
+    s_st.tx_failed  += counter_delta(si.tx_failed_count, s_last.tx_failed_count);
+    portEXIT_CRITICAL(&s_lock);
+
+    s_last = si;
+    return missed + overrun;
+}
+
+/* Error state transitions, in the order the controller passes through them */
+static void sup_state_events(uint32_t alerts)
+{
+    uint32_t tec, rec;
+
+    portENTER_CRITICAL(&s_lock);
+    if (alerts & TWAI_ALERT_ABOVE_ERR_WARN) s_st.err_warn = true;
+    if (alerts & TWAI_ALERT_ERR_PASS) {
+        s_st.err_passive = true;
+        s_st.err_passive_cnt++;
+    }
+    if (alerts & TWAI_ALERT_BUS_OFF) s_st.bus_off_cnt++;
+    if (alerts & (TWAI_ALERT_ERR_ACTIVE | TWAI_ALERT_BUS_RECOVERED)) {
+        s_st.err_warn = false;
+        s_st.err_passive = false;
+    }
+    tec = s_st.tec;
+    rec = s_st.rec;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (alerts & TWAI_ALERT_ABOVE_ERR_WARN) can_mon_push_bus_evt(CAN_BUS_EVT_ERR_WARN, tec, rec, 0);
+    if (alerts & TWAI_ALERT_ERR_PASS)       can_mon_push_bus_evt(CAN_BUS_EVT_ERR_PASSIVE, tec, rec, 0);
+    if (alerts & TWAI_ALERT_BUS_OFF) {
+        can_mon_push_bus_evt(CAN_BUS_EVT_BUS_OFF, tec, rec, 0);
+        ESP_LOGW(TAG, "Bus off (TEC=%u REC=%u)", (unsigned)tec, (unsigned)rec);
+    }
+    if (alerts & TWAI_ALERT_BUS_RECOVERED)  can_mon_push_bus_evt(CAN_BUS_EVT_RECOVERED, tec, rec, 0);
+    if (alerts & TWAI_ALERT_ERR_ACTIVE)     can_mon_push_bus_evt(CAN_BUS_EVT_ERR_ACTIVE, tec, rec, 0);
+}
+
+static void series_sample(int64_t now)
+{
+    portENTER_CRITICAL(&s_lock);
+    can_sup_sample_t *p = &s_series[s_series_cnt % CAN_SUP_SERIES_LEN];
+    p->t_ms       = (uint32_t)(now / 1000);
+    p->tec        = (uint8_t)(s_st.tec > 255 ? 255 : s_st.tec);
+    p->rec        = (uint8_t)(s_st.rec > 255 ? 255 : s_st.rec);
+    p->state      = (uint8_t)s_st.state;
+    p->reserved   = 0;
+    p->bus_errors = s_st.bus_errors - s_sample_bus_err;
+    s_sample_bus_err = s_st.bus_errors;
+    s_series_cnt++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* ---------------- Bus-off recovery ----------------
+ *
+ *   IDLE --bus-off--> BACKOFF --delay--> RECOVERING --BUS_RECOVERED--> WAIT_RX --frame--> IDLE
+ *                        ^                   | timeout / error             |
+ *                        |                   v                             | no traffic: IDLE
+ *                        +---- reset failed -- driver reset --> WAIT_RX    | bus-off again: BACKOFF
+ *
+ * The driver leaves bus-off only through twai_initiate_recovery(), which
+ * needs 128 occurrences of 11 recessive bits; on a dead or shorted bus that
+ * never happens, hence the reset fallback.
+ */
+
+typedef enum {
+    RCV_IDLE = 0,
+    RCV_BACKOFF,
+    RCV_RECOVERING,
+    RCV_WAIT_RX,
+} rcv_state_t;
+
+static struct {
+    rcv_state_t st;
+    int64_t  t_off;        /* bus-off seen */
+    int64_t  t_restart;    /* controller running again */
+    int64_t  t_next;       /* deadline of the current state */
+    int64_t  t_done;       /* end of the last episode */
+    uint32_t backoff_ms;
+    uint8_t  attempts;
+    bool     full_reset;
+} s_rcv;
+
+static void rcv_set(rcv_state_t st)
+{
+    s_rcv.st = st;
+    portENTER_CRITICAL(&s_lock);
+    s_st.recovering = (st != RCV_IDLE);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void rcv_backoff(int64_t now)
+{
+    s_rcv.t_next = now + (int64_t)s_rcv.backoff_ms * 1000;
+    rcv_set(RCV_BACKOFF);
+}
+
+static void rcv_escalate(void)
+{
+    uint32_t b = s_rcv.backoff_ms * 2;
+    s_rcv.backoff_ms = b > CAN_SUP_BACKOFF_MAX_MS ? CAN_SUP_BACKOFF_MAX_MS : b;
+}
+
+/* Recovery stuck or refused: reinstall the driver */
+static void rcv_reset(int64_t now)
+{
+    s_rcv.full_reset = true;
+    esp_err_t err = can_bus_reset();
+
+    portENTER_CRITICAL(&s_lock);
+    s_st.resets++;
+    portEXIT_CRITICAL(&s_lock);
+    memset(&s_last, 0, sizeof(s_last));
+
+    if (err != ESP_OK) {
+        rcv_escalate();
+        rcv_backoff(now);
+        return;
+    }
+    s_rcv.t_restart = now;
+    s_rcv.t_next = now + (int64_t)CAN_SUP_RX_WAIT_MS * 1000;
+    rcv_set(RCV_WAIT_RX);
+}
+
+static void rcv_finish(int64_t now, bool rx_seen)
+{
+    can_sup_recovery_t r = {
+        .t_off_us   = s_rcv.t_off,
+        .restart_ms = (uint32_t)((s_rcv.t_restart - s_rcv.t_off) / 1000),
+        .rx_ms      = rx_seen ? (uint32_t)((now - s_rcv.t_off) / 1000) : 0,
+        .attempts   = s_rcv.attempts,
+        .full_reset = s_rcv.full_reset,
+    };
+
+    portENTER_CRITICAL(&s_lock);
+    s_rcv_log[s_rcv_cnt % CAN_SUP_RECOVERY_LOG] = r;
+    s_rcv_cnt++;
+    s_st.recoveries++;
+    uint32_t tec = s_st.tec, rec = s_st.rec;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (rx_seen) can_mon_push_bus_evt(CAN_BUS_EVT_RX_RESUMED, tec, rec, r.rx_ms);
+    ESP_LOGI(TAG, "Bus-off recovery: running after %u ms, RX after %u ms, %u attempt(s)%s",
+             (unsigned)r.restart_ms, (unsigned)r.rx_ms, (unsigned)r.attempts,
+             r.full_reset ? ", driver reset" : "");
+
+    s_rcv.t_done = now;
+    rcv_set(RCV_IDLE);
+}
+
+static void rcv_step(uint32_t alerts, bool bus_off, int64_t now)
+{
+    switch (s_rcv.st) {
+    case RCV_IDLE:
+        if (!bus_off) break;
+        /* Repeated bus-off soon after the last one backs off further */
+        if (s_rcv.t_done != 0 && now - s_rcv.t_done < (int64_t)CAN_SUP_STABLE_MS * 1000) rcv_escalate();
+        else s_rcv.backoff_ms = CAN_SUP_BACKOFF_MIN_MS;
+        s_rcv.t_off = now;
+        s_rcv.attempts = 0;
+        s_rcv.full_reset = false;
+        rcv_backoff(now);
+        break;
+
+    case RCV_BACKOFF:
+        if (now < s_rcv.t_next) break;
+        if (s_rcv.attempts < UINT8_MAX) s_rcv.attempts++;
+        if (can_bus_recover() == ESP_OK) {
+            s_rcv.t_next = now + (int64_t)CAN_SUP_RECOVERY_TIMEOUT_MS * 1000;
+            rcv_set(RCV_RECOVERING);
+        } else {
+            rcv_reset(now);
+        }
+        break;
+
+    case RCV_RECOVERING:
+        if (alerts & TWAI_ALERT_BUS_RECOVERED) {
+            /* Recovery leaves the controller stopped */
+            if (can_bus_resume() != ESP_OK) {
+                rcv_reset(now);
+                break;
+            }
+            s_rcv.t_restart = now;
+            s_rcv.t_next = now + (int64_t)CAN_SUP_RX_WAIT_MS * 1000;
+            rcv_set(RCV_WAIT_RX);
+        } else if (now >= s_rcv.t_next) {
+            ESP_LOGW(TAG, "Recovery sequence timed out; resetting driver");
+            rcv_reset(now);
+        }
+        break;
+
+    case RCV_WAIT_RX:
+        if (alerts & TWAI_ALERT_BUS_OFF) {
+            rcv_escalate();
+            rcv_backoff(now);
+        } else if (alerts & TWAI_ALERT_RX_DATA) {
+            rcv_finish(now, true);
+        } else if (now >= s_rcv.t_next) {
+            rcv_finish(now, false);
+        }
+        break;
+    }
+}
+
+/* Sleep no longer than the recovery state machine can wait */
+static TickType_t alert_wait_ticks(int64_t now)
+{
+    int64_t wait_us = (int64_t)CAN_SUP_ALERT_WAIT_MS * 1000;
+    if (s_rcv.st != RCV_IDLE && s_rcv.t_next - now < wait_us) wait_us = s_rcv.t_next - now;
+    if (wait_us <= 0) return 0;
+    return pdMS_TO_TICKS((uint32_t)(wait_us / 1000)) + 1;
+}
+
+static void can_sup_task(void *arg)
+{
+    (void)arg;
+
+    int64_t now = esp_timer_get_time();
+    int64_t next_poll = 0;
+    int64_t next_sample = now;
+
+    while (1) {
+        uint32_t alerts = 0;
+        esp_err_t err = can_bus_read_alerts(&alerts, alert_wait_ticks(now));
+        now = esp_timer_get_time();
+
+        if (err == ESP_ERR_INVALID_STATE) {
+            if (s_rcv.st == RCV_IDLE) {
+                /* Driver stopped on purpose; counters restart with it */
+                memset(&s_last, 0, sizeof(s_last));
+                vTaskDelay(pdMS_TO_TICKS(CAN_SUP_ALERT_WAIT_MS));
+                now = esp_timer_get_time();
+                continue;
+            }
+            /* Failed reset: no driver to wait on, sleep out the backoff */
+            TickType_t t = alert_wait_ticks(now);
+            vTaskDelay(t ? t : 1);
+            now = esp_timer_get_time();
+        }
+
+        /* Latency-sensitive consumers first */
+        if (alerts & TWAI_ALERT_RX_DATA) can_mon_rx_wake();
+        can_tx_on_alerts(alerts);
+        can_gen_on_alerts(alerts);
+
+        bool polled = false;
+        if ((alerts & ~SUP_ALERTS_ROUTINE) != 0 || now >= next_poll) {
+            next_poll = now + (int64_t)CAN_SUP_POLL_MS * 1000;
+            polled = true;
+
+            uint32_t lost = sup_poll_status();
+            if (lost > 0) {
+                can_sup_stats_t s;
+                can_sup_get_stats(&s);
+                can_mon_push_bus_evt(CAN_BUS_EVT_RX_LOST, s.tec, s.rec, lost);
+            }
+            if (alerts & ~SUP_ALERTS_ROUTINE) sup_state_events(alerts);
+        }
+
+        if (now >= next_sample) {
+            series_sample(now);
+            next_sample += (int64_t)CAN_SUP_SAMPLE_MS * 1000;
+            if (next_sample <= now) next_sample = now + (int64_t)CAN_SUP_SAMPLE_MS * 1000;
+        }
+
+        /* A bus-off alert can be folded into an earlier read; the polled
+         * state catches it then */
+        bool bus_off = (alerts & TWAI_ALERT_BUS_OFF) ||
+                       (polled && s_rcv.st == RCV_IDLE && s_st.state == TWAI_STATE_BUS_OFF);
+        rcv_step(alerts, bus_off, now);
+    }
+}
+
+esp_err_t can_sup_start(UBaseType_t prio, BaseType_t core)
+{
+    if (s_task) return ESP_OK;
+
+    if (xTaskCreatePinnedToCore(can_sup_task, "can_sup", CAN_SUP_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void can_sup_get_stats(can_sup_stats_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&s_lock);
+    *out = s_st;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+size_t can_sup_get_series(can_sup_sample_t *out, size_t max)
+{
+    if (!out) return 0;
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t n = s_series_cnt < CAN_SUP_SERIES_LEN ? s_series_cnt : CAN_SUP_SERIES_LEN;
+    if (n > max) n = (uint32_t)max;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = s_series[(s_series_cnt - n + i) % CAN_SUP_SERIES_LEN];
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+size_t can_sup_get_recoveries(can_sup_recovery_t *out, size_t max)
+{
+    if (!out) return 0;
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t n = s_rcv_cnt < CAN_SUP_RECOVERY_LOG ? s_rcv_cnt : CAN_SUP_RECOVERY_LOG;
+    if (n > max) n = (uint32_t)max;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = s_rcv_log[(s_rcv_cnt - n + i) % CAN_SUP_RECOVERY_LOG];
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+uint32_t can_sup_get_lost_cnt(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t n = s_st.rx_missed + s_st.rx_overrun;
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
@@ -0,0 +1,406 @@
+#include "can_tx.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#include "can_mon.h"
+#include "can_bus.h"
+#include "can_gen.h"
+
+#ifndef TAG
+#define TAG "can_tx"
+#endif
+
+#ifndef CAN_TX_TASK_STACK
+#define CAN_TX_TASK_STACK  3072
+#endif
+
+#ifndef CAN_TX_POLL_MS
+#define CAN_TX_POLL_MS      10   /* status read with frames in flight and no alert */
+#endif
+
+#ifndef CAN_TX_HOLD_POLL_MS
+#define CAN_TX_HOLD_POLL_MS 10   /* how often a held queue checks for the end of a can_gen run */
+#endif
+
+#define NIL  0xFFFFu
+
+/* Worker notification bits */
+#define TXN_QUEUE    (1u << 0)   /* a request was submitted */
+#define TXN_DONE_OK  (1u << 1)   /* TWAI_ALERT_TX_SUCCESS */
+#define TXN_DONE_ERR (1u << 2)   /* TWAI_ALERT_TX_FAILED / BUS_OFF */
+#define TXN_DONE     (TXN_DONE_OK | TXN_DONE_ERR)
+
+/* ---------------- State ----------------
+ *
+ * Requests live in a fixed pool and are chained into one FIFO per priority
+ * through uint16_t indices; free slots form a LIFO through the same link.
+ * Everything is guarded by a spinlock held for O(1) work (cancel walks one
+ * FIFO). The worker copies a request out before touching the driver.
+ */
+
+typedef enum {
+    REQ_FREE = 0,
+    REQ_QUEUED,
+    REQ_INFLIGHT,
+} req_state_t;
+
+typedef struct {
+    twai_message_t   msg;
+    can_tx_done_cb_t cb;
+    void            *ctx;
+    uint16_t         next;
+    uint16_t         gen;
+    uint8_t          state;
+    uint8_t          prio;
+} tx_req_t;
+
+typedef struct {
+    tx_req_t      *req;
+    uint16_t       head[CAN_TX_PRIO_COUNT];
+    uint16_t       tail[CAN_TX_PRIO_COUNT];
+    uint16_t       free_head;
+    can_tx_stats_t st;
+    portMUX_TYPE   lock;
+} can_tx_t;
+
+static can_tx_t s_tx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static TaskHandle_t s_task = NULL;
+
+esp_err_t can_tx_init(void)
+{
+    if (s_tx.req) return ESP_OK;
+
+    tx_req_t *req = heap_caps_calloc(CAN_TX_QUEUE_LEN, sizeof(tx_req_t),
+                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!req) return ESP_ERR_NO_MEM;
+
+    for (uint32_t i = 0; i < CAN_TX_QUEUE_LEN; i++) {
+        req[i].gen = 1;
+        req[i].next = (i + 1 < CAN_TX_QUEUE_LEN) ? (uint16_t)(i + 1) : NIL;
+    }
+
+    portENTER_CRITICAL(&s_tx.lock);
+    for (int p = 0; p < CAN_TX_PRIO_COUNT; p++) {
+        s_tx.head[p] = NIL;
+        s_tx.tail[p] = NIL;
+    }
+    s_tx.free_head = 0;
+    memset(&s_tx.st, 0, sizeof(s_tx.st));
+    s_tx.req = req;
+    portEXIT_CRITICAL(&s_tx.lock);
+    return ESP_OK;
+}
+
+static inline can_tx_handle_t make_handle(uint16_t i)
+{
+    return ((uint32_t)s_tx.req[i].gen << 16) | i;
+}
+
+static void req_free_locked(uint16_t i)
+{
+    tx_req_t *r = &s_tx.req[i];
+    r->state = REQ_FREE;
+    r->cb = NULL;
+    r->gen = (r->gen == 0xFFFF) ? 1 : r->gen + 1;
+    r->next = s_tx.free_head;
+    s_tx.free_head = i;
+    s_tx.st.queued--;
+}
+
+can_tx_handle_t can_tx_submit(const twai_message_t *m, can_tx_prio_t prio,
+                              can_tx_done_cb_t cb, void *ctx)
+{
+    if (!m || !s_tx.req) return 0;
+    if ((unsigned)prio >= CAN_TX_PRIO_COUNT) prio = CAN_TX_PRIO_LOW;
+    const bool gen = can_gen_is_running();
+
+    portENTER_CRITICAL(&s_tx.lock);
+    uint16_t i = s_tx.free_head;
+    if (i == NIL || gen) {
+        s_tx.st.rejected++;
+        portEXIT_CRITICAL(&s_tx.lock);
+        return 0;
+    }
+    tx_req_t *r = &s_tx.req[i];
+    s_tx.free_head = r->next;
+
+    r->msg = *m;
+    if (r->msg.data_length_code > 8) r->msg.data_length_code = 8;
+    r->cb = cb;
+    r->ctx = ctx;
+    r->prio = (uint8_t)prio;
+    r->state = REQ_QUEUED;
+    r->next = NIL;
+    if (s_tx.tail[prio] == NIL) s_tx.head[prio] = i;
+    else                        s_tx.req[s_tx.tail[prio]].next = i;
+    s_tx.tail[prio] = i;
+
+    s_tx.st.submitted++;
+    s_tx.st.queued++;
+    can_tx_handle_t h = make_handle(i);
+    portEXIT_CRITICAL(&s_tx.lock);
+
+    if (s_task) xTaskNotify(s_task, TXN_QUEUE, eSetBits);
+    return h;
+}
+
+esp_err_t can_tx_cancel(can_tx_handle_t h)
+{
+    uint16_t i = (uint16_t)(h & 0xFFFF);
+    if (!s_tx.req || i >= CAN_TX_QUEUE_LEN) return ESP_ERR_NOT_FOUND;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    portENTER_CRITICAL(&s_tx.lock);
+    tx_req_t *r = &s_tx.req[i];
+    if (r->state == REQ_QUEUED && r->gen == (h >> 16)) {
+        uint8_t p = r->prio;
+        uint16_t prev = NIL;
+        for (uint16_t j = s_tx.head[p]; j != i; j = s_tx.req[j].next) prev = j;
+
+        if (prev == NIL) s_tx.head[p] = r->next;
+        else             s_tx.req[prev].next = r->next;
+        if (s_tx.tail[p] == i) s_tx.tail[p] = prev;
+
+        req_free_locked(i);
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_tx.lock);
+    return err;
+}
+
+void can_tx_get_stats(can_tx_stats_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&s_tx.lock);
+    *out = s_tx.st;
+    portEXIT_CRITICAL(&s_tx.lock);
+}
+
+/* ---------------- Worker ----------------
+ *
+ * The frames in the driver queue are recorded oldest first in s_fl. After a
+ * TX alert, or every CAN_TX_POLL_MS without one, the worker reads the
+ * controller status: every frame of ours beyond msgs_to_tx has left, and the
+ * growth of tx_failed_count says how many of those failed. Failures are taken
+ * to be the latest of them, which is what a bus-off purge produces. Frames
+ * queued before a reinstall went with the old driver queue.
+ */
+
+typedef struct {
+    uint16_t idx;
+    uint32_t reinstalls;   /* can_bus_get_reinstalls() when it was queued */
+    int64_t  deadline;
+} tx_flight_t;
+
+/* Worker-owned */
+static struct {
+    tx_flight_t f[CAN_TX_INFLIGHT];
+    uint8_t     head;
+    uint8_t     n;
+    bool        stalled;     /* the driver refused the last frame */
+    uint32_t    failed0;     /* tx_failed_count at the last status read */
+} s_fl;
+
+static TickType_t ms_ticks(uint32_t ms)
+{
+    TickType_t t = pdMS_TO_TICKS(ms);
+    return t ? t : 1;
+}
+
+/* Take the oldest request of the highest non-empty priority */
+static bool req_pop(uint16_t *out, tx_req_t *copy)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_tx.lock);
+    for (int p = 0; p < CAN_TX_PRIO_COUNT; p++) {
+        uint16_t i = s_tx.head[p];
+        if (i == NIL) continue;
+
+        tx_req_t *r = &s_tx.req[i];
+        s_tx.head[p] = r->next;
+        if (s_tx.head[p] == NIL) s_tx.tail[p] = NIL;
+        r->state = REQ_INFLIGHT;
+        s_tx.st.inflight++;
+        *copy = *r;
+        *out = i;
+        found = true;
+        break;
+    }
+    portEXIT_CRITICAL(&s_tx.lock);
+    return found;
+}
+
+/* Put a request the driver did not take back at the front of its FIFO */
+static void req_unpop(uint16_t i)
+{
+    portENTER_CRITICAL(&s_tx.lock);
+    tx_req_t *r = &s_tx.req[i];
+    r->state = REQ_QUEUED;
+    r->next = s_tx.head[r->prio];
+    if (r->next == NIL) s_tx.tail[r->prio] = i;
+    s_tx.head[r->prio] = i;
+    s_tx.st.inflight--;
+    portEXIT_CRITICAL(&s_tx.lock);
+}
+
+/* Retire a request that left the worker's hands */
+static void req_done(uint16_t i, esp_err_t err)
+{
+    portENTER_CRITICAL(&s_tx.lock);
+    const tx_req_t r = s_tx.req[i];
+    if (err == ESP_OK) s_tx.st.sent++;
+    else               s_tx.st.failed++;
+    s_tx.st.inflight--;
+    req_free_locked(i);
+    portEXIT_CRITICAL(&s_tx.lock);
+
+    /* Log only what actually made it onto the bus */
+    if (err == ESP_OK) {
+        can_mon_push_evt(true, &r.msg);
+    } else {
+        ESP_LOGD(TAG, "TX id=0x%08X failed: %s", (unsigned)r.msg.identifier, esp_err_to_name(err));
+    }
+    if (r.cb) r.cb(((uint32_t)r.gen << 16) | i, &r.msg, err, r.ctx);
+}
+
+void can_tx_on_alerts(uint32_t alerts)
+{
+    uint32_t bits = 0;
+    if (alerts & TWAI_ALERT_TX_SUCCESS)                         bits |= TXN_DONE_OK;
+    if (alerts & (TWAI_ALERT_TX_FAILED | TWAI_ALERT_BUS_OFF))   bits |= TXN_DONE_ERR;
+
+    TaskHandle_t t = s_task;
+    if (bits && t) xTaskNotify(t, bits, eSetBits);
+}
+
+static void flight_pop(esp_err_t err)
+{
+    const uint16_t i = s_fl.f[s_fl.head].idx;
+    s_fl.head = (uint8_t)((s_fl.head + 1) % CAN_TX_INFLIGHT);
+    s_fl.n--;
+    req_done(i, err);
+}
+
+/* Hand the driver the next request; false if there is none or the driver
+ * can not take it now */
+static bool flight_issue(void)
+{
+    uint16_t i;
+    tx_req_t r;
+    if (!req_pop(&i, &r)) return false;
+
+    const uint32_t reinstalls = can_bus_get_reinstalls();
+    if (s_fl.n == 0) {
+        twai_status_info_t si;
+        if (can_bus_get_status(&si) == ESP_OK) s_fl.failed0 = si.tx_failed_count;
+    }
+
+    /* Queue full or a reinstall under way: retry it first, a tick later */
+    esp_err_t err = (reinstalls & 1) ? ESP_ERR_TIMEOUT : can_bus_tx(&r.msg);
+    if (err == ESP_ERR_TIMEOUT) {
+        req_unpop(i);
+        s_fl.stalled = true;
+        return false;
+    }
+    if (err != ESP_OK) {
+        req_done(i, err);
+        return true;
+    }
+
+    tx_flight_t *f = &s_fl.f[(s_fl.head + s_fl.n) % CAN_TX_INFLIGHT];
+    f->idx = i;
+    f->reinstalls = reinstalls;
+    f->deadline = esp_timer_get_time() + (int64_t)CAN_TX_DONE_TIMEOUT_MS * 1000;
+    s_fl.n++;
+    return true;
+}
+
+/* Retire what left the driver queue since the last status read */
+static void flight_settle(void)
+{
+    if (s_fl.n == 0) return;
+
+    const uint32_t reinstalls = can_bus_get_reinstalls();
+    twai_status_info_t si;
+    esp_err_t err = can_bus_get_status(&si);
+
+    /* Busy (ESP_ERR_TIMEOUT): read again next time. Stopped: all gone. */
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return;
+
+    bool lost = false;
+    while (s_fl.n > 0 && (err != ESP_OK || s_fl.f[s_fl.head].reinstalls != reinstalls)) {
+        flight_pop(ESP_ERR_INVALID_STATE);
+        lost = true;
+    }
+    if (err != ESP_OK) return;
+    if (lost) {
+        /* The counters restarted with the driver */
+        s_fl.failed0 = si.tx_failed_count;
+        return;
+    }
+
+    uint32_t failed = si.tx_failed_count - s_fl.failed0;
+    s_fl.failed0 = si.tx_failed_count;
+
+    /* Frames sent around the worker can only make ours look pending longer */
+    const uint32_t done = s_fl.n - (si.msgs_to_tx < s_fl.n ? si.msgs_to_tx : s_fl.n);
+    if (failed > done) failed = done;
+    for (uint32_t k = 0; k < done; k++) flight_pop(k >= done - failed ? ESP_FAIL : ESP_OK);
+}
+
+static void flight_expire(int64_t now)
+{
+    while (s_fl.n > 0 && now >= s_fl.f[s_fl.head].deadline) flight_pop(ESP_ERR_TIMEOUT);
+}
+
+static void can_tx_task(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        /* Leave the driver queue to a can_gen run; it waits for what we
+         * have in flight before it starts filling the queue */
+        const bool held = can_gen_is_running();
+
+        s_fl.stalled = false;
+        while (!held && s_fl.n < CAN_TX_INFLIGHT && flight_issue()) {}
+
+        TickType_t wait = portMAX_DELAY;
+        if (s_fl.n > 0) {
+            int64_t left_ms = (s_fl.f[s_fl.head].deadline - esp_timer_get_time()) / 1000;
+            wait = ms_ticks(left_ms < CAN_TX_POLL_MS ? (uint32_t)(left_ms > 0 ? left_ms : 0) : CAN_TX_POLL_MS);
+        } else if (held) {
+            wait = ms_ticks(CAN_TX_HOLD_POLL_MS);
+        }
+        if (s_fl.stalled) wait = 1;
+
+        uint32_t bits = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &bits, wait) != pdTRUE || (bits & TXN_DONE)) {
+            flight_settle();
+        }
+        flight_expire(esp_timer_get_time());
+    }
+}
+
+esp_err_t can_tx_start(UBaseType_t prio, BaseType_t core)
+{
+    if (!s_tx.req) return ESP_ERR_INVALID_STATE;
+    if (s_task) return ESP_OK;
+
+    if (xTaskCreatePinnedToCore(can_tx_task, "can_tx", CAN_TX_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
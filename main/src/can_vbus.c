@@ -0,0 +1,687 @@
+#include "can_vbus.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "can_hwf.h"
+#include "can_load.h"
+
+#ifndef TAG
+#define TAG "can_vbus"
+#endif
+
+#ifndef CAN_VBUS_CLOCK_STACK
+#define CAN_VBUS_CLOCK_STACK  3072
+#endif
+
+#define VBUS_ERR_WARN     96
+#define VBUS_ERR_PASSIVE  128
+#define VBUS_BUS_OFF      256
+#define VBUS_RECOVERY_BITS (128 * 11)
+
+/* ---------------- State ----------------
+ *
+ * Everything lives in one heap block allocated by can_vbus_init(), so a
+ * device build that never uses the virtual bus pays nothing for it. One
+ * spinlock covers the whole bus; it is held for one frame's worth of work,
+ * and can_vbus_advance() drops it between frames.
+ */
+
+typedef struct {
+    twai_message_t msg;
+    uint32_t       seq;      /* submission order, for CAN_VBUS_ARB_FIFO */
+} vbus_txe_t;
+
+typedef struct {
+    bool                 used;
+    uint32_t             bitrate;
+    twai_mode_t          mode;
+    twai_filter_config_t filter;
+    twai_state_t         state;
+    int64_t              recover_at_ns;
+    uint32_t             tec;
+    uint32_t             rec;
+    uint32_t             tx_failed;
+    uint32_t             rx_missed;
+    uint32_t             arb_lost;
+    uint32_t             bus_errors;
+    uint32_t             alerts;     /* triggered, not read yet */
+    vbus_txe_t           txq[CAN_VBUS_TX_QUEUE_LEN];
+    uint16_t             tx_head;
+    uint16_t             tx_cnt;
+    twai_message_t       rxq[CAN_VBUS_RX_QUEUE_LEN];
+    uint16_t             rx_head;
+    uint16_t             rx_cnt;
+} vbus_node_t;
+
+typedef struct {
+    vbus_node_t    node[CAN_VBUS_MAX_NODES];
+    can_vbus_arb_t arb;
+    uint32_t       err_rate;
+    uint32_t       err_oneshot;
+    uint32_t       rng;
+    uint32_t       seq;
+    int64_t        now_ns;
+    int            wire;         /* node whose frame is on the wire, -1 if idle */
+    uint32_t       wire_seq;     /* that frame */
+    int64_t        wire_start_ns;
+} vbus_t;
+
+static vbus_t *s_bus = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Node 0 wakeups for the blocking backend calls */
+static SemaphoreHandle_t s_rx_sem = NULL;
+static SemaphoreHandle_t s_alert_sem = NULL;
+static TaskHandle_t s_clock_task = NULL;
+
+static void node_clear(vbus_node_t *n)
+{
+    n->state = TWAI_STATE_RUNNING;
+    n->recover_at_ns = 0;
+    n->tec = n->rec = 0;
+    n->tx_failed = n->rx_missed = n->arb_lost = n->bus_errors = 0;
+    n->alerts = 0;
+    n->tx_head = n->tx_cnt = 0;
+    n->rx_head = n->rx_cnt = 0;
+}
+
+static void node_setup(vbus_node_t *n, uint32_t bitrate, twai_mode_t mode)
+{
+    const twai_filter_config_t all = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    n->used = true;
+    n->bitrate = bitrate;
+    n->mode = mode;
+    n->filter = all;
+    node_clear(n);
+}
+
+esp_err_t can_vbus_init(const can_vbus_cfg_t *cfg)
+{
+    if (!s_rx_sem) s_rx_sem = xSemaphoreCreateBinary();
+    if (!s_alert_sem) s_alert_sem = xSemaphoreCreateBinary();
+    if (!s_rx_sem || !s_alert_sem) return ESP_ERR_NO_MEM;
+
+    if (!s_bus) {
+        vbus_t *b = heap_caps_calloc(1, sizeof(vbus_t), MALLOC_CAP_DEFAULT);
+        if (!b) return ESP_ERR_NO_MEM;
+        s_bus = b;
+    }
+
+    /* Build the stuffing tables now rather than under the lock */
+    twai_message_t probe = { .identifier = 0, .data_length_code = 0 };
+    (void)can_load_frame_bits(&probe, true);
+
+    portENTER_CRITICAL(&s_lock);
+    memset(s_bus, 0, sizeof(*s_bus));
+    s_bus->arb = cfg ? cfg->arb : CAN_VBUS_ARB_ID;
+    s_bus->err_rate = cfg ? cfg->err_per_65536 : 0;
+    s_bus->rng = (cfg && cfg->seed) ? cfg->seed : 1;
+    s_bus->wire = -1;
+    node_setup(&s_bus->node[0], 500000, TWAI_MODE_NO_ACK);
+    s_bus->node[0].state = TWAI_STATE_STOPPED;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+static inline bool node_ok(int node)
+{
+    return s_bus && node >= 0 && node < CAN_VBUS_MAX_NODES && s_bus->node[node].used;
+}
+
+int can_vbus_add_node(uint32_t bitrate, twai_mode_t mode)
+{
+    if (!s_bus || bitrate == 0) return -1;
+
+    int idx = -1;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 1; i < CAN_VBUS_MAX_NODES; i++) {
+        if (!s_bus->node[i].used) {
+            node_setup(&s_bus->node[i], bitrate, mode);
+            idx = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return idx;
+}
+
+esp_err_t can_vbus_node_set(int node, uint32_t bitrate, twai_mode_t mode)
+{
+    if (!node_ok(node) || bitrate == 0) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[node];
+    twai_state_t st = n->state;
+    n->bitrate = bitrate;
+    n->mode = mode;
+    /* Like a driver reinstall: queues and counters start over */
+    node_clear(n);
+    if (node == 0) n->state = (st == TWAI_STATE_STOPPED) ? TWAI_STATE_STOPPED : TWAI_STATE_RUNNING;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t can_vbus_node_set_filter(int node, const twai_filter_config_t *f)
+{
+    if (!node_ok(node) || !f) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    s_bus->node[node].filter = *f;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t can_vbus_node_tx(int node, const twai_message_t *m)
+{
+    if (!node_ok(node) || !m) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[node];
+    if (n->state != TWAI_STATE_RUNNING) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (n->mode == TWAI_MODE_LISTEN_ONLY) {
+        err = ESP_ERR_NOT_SUPPORTED;
+    } else if (n->tx_cnt == CAN_VBUS_TX_QUEUE_LEN) {
+        err = ESP_ERR_TIMEOUT;
+    } else {
+        vbus_txe_t *e = &n->txq[(n->tx_head + n->tx_cnt) % CAN_VBUS_TX_QUEUE_LEN];
+        e->msg = *m;
+        if (e->msg.data_length_code > 8) e->msg.data_length_code = 8;
+        e->seq = s_bus->seq++;
+        n->tx_cnt++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+int can_vbus_node_rx(int node, twai_message_t *out, int max)
+{
+    if (!node_ok(node) || !out || max <= 0) return 0;
+
+    int k = 0;
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[node];
+    while (k < max && n->rx_cnt > 0) {
+        out[k++] = n->rxq[n->rx_head];
+        n->rx_head = (uint16_t)((n->rx_head + 1) % CAN_VBUS_RX_QUEUE_LEN);
+        n->rx_cnt--;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return k;
+}
+
+esp_err_t can_vbus_node_status(int node, twai_status_info_t *out)
+{
+    if (!node_ok(node) || !out) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    const vbus_node_t *n = &s_bus->node[node];
+    out->state            = n->state;
+    out->msgs_to_tx       = n->tx_cnt;
+    out->msgs_to_rx       = n->rx_cnt;
+    out->tx_error_counter = n->tec > 255 ? 255 : n->tec;
+    out->rx_error_counter = n->rec > 255 ? 255 : n->rec;
+    out->tx_failed_count  = n->tx_failed;
+    out->rx_missed_count  = n->rx_missed;
+    out->rx_overrun_count = 0;
+    out->arb_lost_count   = n->arb_lost;
+    out->bus_error_count  = n->bus_errors;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+void can_vbus_inject_errors(uint32_t n)
+{
+    if (!s_bus) return;
+    portENTER_CRITICAL(&s_lock);
+    s_bus->err_oneshot += n;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void can_vbus_set_err_rate(uint32_t per_65536)
+{
+    if (!s_bus) return;
+    portENTER_CRITICAL(&s_lock);
+    s_bus->err_rate = per_65536;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int64_t can_vbus_now_us(void)
+{
+    if (!s_bus) return 0;
+    portENTER_CRITICAL(&s_lock);
+    int64_t t = s_bus->now_ns / 1000;
+    portEXIT_CRITICAL(&s_lock);
+    return t;
+}
+
+/* ---------------- Bus model ---------------- */
+
+/* Arbitration field in transmit order; the lower value wins */
+static uint64_t arb_key(const twai_message_t *m)
+{
+    const uint64_t rtr = (m->flags & TWAI_MSG_FLAG_RTR) ? 1 : 0;
+    if (!(m->flags & TWAI_MSG_FLAG_EXTD)) {
+        /* ID[10:0], RTR, IDE=0 */
+        return ((uint64_t)(m->identifier & 0x7FF) << 21) | (rtr << 20);
+    }
+    /* ID[28:18], SRR=1, IDE=1, ID[17:0], RTR */
+    const uint32_t id = m->identifier & 0x1FFFFFFF;
+    return ((uint64_t)(id >> 18) << 21) | (1ull << 20) | (1ull << 19)
+         | ((uint64_t)(id & 0x3FFFF) << 1) | rtr;
+}
+
+static inline uint32_t rng_next(void)
+{
+    uint32_t x = s_bus->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_bus->rng = x;
+    return x;
+}
+
+static inline bool node_active(const vbus_node_t *n)
+{
+    return n->used && n->state == TWAI_STATE_RUNNING;
+}
+
+static inline int64_t bits_ns(uint32_t bits, uint32_t bitrate)
+{
+    return (int64_t)bits * 1000000000LL / bitrate;
+}
+
+/* Apply a TEC/REC change and raise the alerts the driver would */
+static void node_counters(vbus_node_t *n, int dtec, int drec)
+{
+    const uint32_t tec0 = n->tec, rec0 = n->rec;
+
+    if (dtec > 0) n->tec += (uint32_t)dtec;
+    else if (dtec < 0 && n->tec > 0) n->tec--;
+    if (drec > 0) { if (n->rec < 255) n->rec += (uint32_t)drec; }
+    else if (drec < 0 && n->rec > 0) n->rec--;
+
+    if (n->tec >= VBUS_BUS_OFF) {
+        /* Pending frames are dropped with the controller */
+        n->state = TWAI_STATE_BUS_OFF;
+        n->tx_failed += n->tx_cnt;
+        n->tx_cnt = 0;
+        n->tec = 255;
+        n->alerts |= TWAI_ALERT_BUS_OFF | TWAI_ALERT_TX_FAILED;
+        return;
+    }
+
+    const uint32_t max0 = tec0 > rec0 ? tec0 : rec0;
+    const uint32_t max1 = n->tec > n->rec ? n->tec : n->rec;
+    if (max0 < VBUS_ERR_WARN && max1 >= VBUS_ERR_WARN) n->alerts |= TWAI_ALERT_ABOVE_ERR_WARN;
+    if (max0 >= VBUS_ERR_WARN && max1 < VBUS_ERR_WARN) n->alerts |= TWAI_ALERT_BELOW_ERR_WARN;
+    if (max0 < VBUS_ERR_PASSIVE && max1 >= VBUS_ERR_PASSIVE) n->alerts |= TWAI_ALERT_ERR_PASS;
+    if (max0 >= VBUS_ERR_PASSIVE && max1 < VBUS_ERR_PASSIVE) n->alerts |= TWAI_ALERT_ERR_ACTIVE;
+}
+
+static void node_bus_error(vbus_node_t *n, int dtec, int drec)
+{
+    n->bus_errors++;
+    n->alerts |= TWAI_ALERT_BUS_ERROR;
+    /* Listen-only controllers keep their counters frozen */
+    if (n->mode == TWAI_MODE_LISTEN_ONLY) return;
+    node_counters(n, dtec, drec);
+}
+
+/* Bus-off recovery completes after 128 x 11 recessive bits */
+static void recovery_tick(void)
+{
+    for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+        vbus_node_t *n = &s_bus->node[i];
+        if (n->used && n->state == TWAI_STATE_RECOVERING && s_bus->now_ns >= n->recover_at_ns) {
+            n->state = TWAI_STATE_STOPPED;
+            n->tec = n->rec = 0;
+            n->alerts |= TWAI_ALERT_BUS_RECOVERED;
+        }
+    }
+}
+
+/* Pick the next sender; -1 if nobody has a frame */
+static int arbitrate(void)
+{
+    int win = -1;
+    uint64_t best = 0;
+
+    for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+        const vbus_node_t *n = &s_bus->node[i];
+        if (!node_active(n) || n->tx_cnt == 0) continue;
+
+        const vbus_txe_t *e = &n->txq[n->tx_head];
+        uint64_t key = (s_bus->arb == CAN_VBUS_ARB_FIFO) ? e->seq : arb_key(&e->msg);
+        if (win < 0 || key < best) {
+            win = i;
+            best = key;
+        }
+    }
+
+    /* Contenders at the winner's rate saw it take the bus */
+    if (win >= 0) {
+        for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+            vbus_node_t *n = &s_bus->node[i];
+            if (i == win || !node_active(n) || n->tx_cnt == 0) continue;
+            if (n->bitrate != s_bus->node[win].bitrate) continue;
+            n->arb_lost++;
+            n->alerts |= TWAI_ALERT_ARB_LOST;
+        }
+    }
+    return win;
+}
+
+/* Put the winner's head frame on the bus and settle every node */
+static void transmit(int w)
+{
+    vbus_node_t *tx = &s_bus->node[w];
+    const twai_message_t m = tx->txq[tx->tx_head].msg;
+
+    bool destroyed = false;
+    if (s_bus->err_oneshot > 0) {
+        s_bus->err_oneshot--;
+        destroyed = true;
+    } else if (s_bus->err_rate > 0 && (rng_next() & 0xFFFF) < s_bus->err_rate) {
+        destroyed = true;
+    }
+
+    bool acked = (tx->mode == TWAI_MODE_NO_ACK);
+    for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+        const vbus_node_t *n = &s_bus->node[i];
+        if (i == w || !node_active(n)) continue;
+        if (n->bitrate == tx->bitrate) {
+            if (n->mode != TWAI_MODE_LISTEN_ONLY) acked = true;
+        } else if (n->mode != TWAI_MODE_LISTEN_ONLY && n->tec < VBUS_ERR_PASSIVE && n->rec < VBUS_ERR_PASSIVE) {
+            /* Sees garbage and signals it with an active error flag */
+            destroyed = true;
+        }
+    }
+
+    /* Nodes at another rate only ever see errors */
+    for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+        vbus_node_t *n = &s_bus->node[i];
+        if (i != w && node_active(n) && n->bitrate != tx->bitrate) node_bus_error(n, 0, 1);
+    }
+
+    if (destroyed) {
+        node_bus_error(tx, 8, 0);
+        for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+            vbus_node_t *n = &s_bus->node[i];
+            if (i != w && node_active(n) && n->bitrate == tx->bitrate) node_bus_error(n, 0, 1);
+        }
+        tx->alerts |= TWAI_ALERT_TX_RETRIED;
+        return;   /* stays queued for the retransmission */
+    }
+
+    if (!acked) {
+        /* ACK error; an error passive sender does not count it */
+        node_bus_error(tx, tx->tec >= VBUS_ERR_PASSIVE ? 0 : 8, 0);
+        tx->alerts |= TWAI_ALERT_TX_RETRIED;
+        return;
+    }
+
+    tx->tx_head = (uint16_t)((tx->tx_head + 1) % CAN_VBUS_TX_QUEUE_LEN);
+    tx->tx_cnt--;
+    node_counters(tx, -1, 0);
+    tx->alerts |= TWAI_ALERT_TX_SUCCESS;
+    if (tx->tx_cnt == 0) tx->alerts |= TWAI_ALERT_TX_IDLE;
+
+    for (int i = 0; i < CAN_VBUS_MAX_NODES; i++) {
+        vbus_node_t *n = &s_bus->node[i];
+        if (i == w || !node_active(n) || n->bitrate != tx->bitrate) continue;
+
+        if (n->mode != TWAI_MODE_LISTEN_ONLY) node_counters(n, 0, -1);
+        if (!can_hwf_hw_accepts(&n->filter, &m)) continue;
+
+        if (n->rx_cnt == CAN_VBUS_RX_QUEUE_LEN) {
+            n->rx_missed++;
+            n->alerts |= TWAI_ALERT_RX_QUEUE_FULL;
+            continue;
+        }
+        n->rxq[(n->rx_head + n->rx_cnt) % CAN_VBUS_RX_QUEUE_LEN] = m;
+        n->rx_cnt++;
+        n->alerts |= TWAI_ALERT_RX_DATA;
+    }
+}
+
+/* The frame that won arbitration keeps the bus until it completes, across
+ * advance() calls, unless its node dropped it (stop, reset, bus-off) */
+static int wire_owner(void)
+{
+    const int w = s_bus->wire;
+    if (w < 0) return -1;
+    const vbus_node_t *n = &s_bus->node[w];
+    if (!node_active(n) || n->tx_cnt == 0 || n->txq[n->tx_head].seq != s_bus->wire_seq) return -1;
+    return w;
+}
+
+uint32_t can_vbus_advance(int64_t us)
+{
+    if (!s_bus || us < 0) return 0;
+
+    uint32_t frames = 0;
+    bool wake_rx = false, wake_alert = false;
+
+    portENTER_CRITICAL(&s_lock);
+    const int64_t end_ns = s_bus->now_ns + us * 1000;
+    while (1) {
+        recovery_tick();
+
+        int w = wire_owner();
+        if (w < 0) {
+            w = arbitrate();
+            if (w < 0) {
+                s_bus->wire = -1;
+                s_bus->now_ns = end_ns;
+                break;
+            }
+            s_bus->wire = w;
+            s_bus->wire_seq = s_bus->node[w].txq[s_bus->node[w].tx_head].seq;
+            s_bus->wire_start_ns = s_bus->now_ns;
+        }
+
+        vbus_node_t *tx = &s_bus->node[w];
+        int64_t t_end = s_bus->wire_start_ns
+                      + bits_ns(can_load_frame_bits(&tx->txq[tx->tx_head].msg, true), tx->bitrate);
+        /* Still on the wire at end_ns; it completes in a later call */
+        if (t_end > end_ns) {
+            s_bus->now_ns = end_ns;
+            break;
+        }
+
+        s_bus->now_ns = t_end;
+        s_bus->wire = -1;
+        uint32_t rx0 = s_bus->node[0].rx_cnt;
+        transmit(w);
+        frames++;
+        if (s_bus->node[0].rx_cnt != rx0) wake_rx = true;
+
+        /* Let the node tasks in between frames; another advance() may move
+         * the clock past end_ns meanwhile */
+        portEXIT_CRITICAL(&s_lock);
+        portENTER_CRITICAL(&s_lock);
+        if (s_bus->now_ns > end_ns) break;
+    }
+    recovery_tick();
+    if (s_bus->node[0].alerts) wake_alert = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (wake_rx) xSemaphoreGive(s_rx_sem);
+    if (wake_alert) xSemaphoreGive(s_alert_sem);
+    return frames;
+}
+
+static void can_vbus_clock_task(void *arg)
+{
+    (void)arg;
+
+    int64_t last = esp_timer_get_time();
+    while (1) {
+        vTaskDelay(1);
+        int64_t now = esp_timer_get_time();
+        can_vbus_advance(now - last);
+        last = now;
+    }
+}
+
+esp_err_t can_vbus_clock_start(UBaseType_t prio, BaseType_t core)
+{
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+    if (s_clock_task) return ESP_OK;
+
+    if (xTaskCreatePinnedToCore(can_vbus_clock_task, "can_vbus", CAN_VBUS_CLOCK_STACK,
+                                NULL, prio, &s_clock_task, core) != pdPASS) {
+        s_clock_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* ---------------- can_bus backend (node 0) ---------------- */
+
+static esp_err_t vbus_start(const can_bus_cfg_t *cfg)
+{
+    if (!s_bus) {
+        esp_err_t err = can_vbus_init(NULL);
+        if (err != ESP_OK) return err;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[0];
+    n->bitrate = cfg->bitrate;
+    n->mode = cfg->mode;
+    node_clear(n);
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+static esp_err_t vbus_stop(void)
+{
+    if (!s_bus) return ESP_OK;
+
+    portENTER_CRITICAL(&s_lock);
+    node_clear(&s_bus->node[0]);
+    s_bus->node[0].state = TWAI_STATE_STOPPED;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+static esp_err_t vbus_reconfigure(const can_bus_cfg_t *cfg)
+{
+    return can_vbus_node_set(0, cfg->bitrate, cfg->mode);
+}
+
+static esp_err_t vbus_set_filter(const twai_filter_config_t *f)
+{
+    return can_vbus_node_set_filter(0, f);
+}
+
+static esp_err_t vbus_tx(const twai_message_t *m)
+{
+    return can_vbus_node_tx(0, m);
+}
+
+static int vbus_rx_batch(twai_message_t *out, int max)
+{
+    return can_vbus_node_rx(0, out, max);
+}
+
+static esp_err_t vbus_rx(twai_message_t *m, TickType_t timeout_ticks)
+{
+    if (!m) return ESP_ERR_INVALID_ARG;
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+
+    if (can_vbus_node_rx(0, m, 1) == 1) return ESP_OK;
+    if (xSemaphoreTake(s_rx_sem, timeout_ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+    return can_vbus_node_rx(0, m, 1) == 1 ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static uint32_t take_alerts(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t a = s_bus->node[0].alerts;
+    s_bus->node[0].alerts = 0;
+    portEXIT_CRITICAL(&s_lock);
+    return a;
+}
+
+static esp_err_t vbus_alerts(uint32_t *alerts, TickType_t timeout_ticks)
+{
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+
+    *alerts = take_alerts();
+    if (*alerts) return ESP_OK;
+    if (xSemaphoreTake(s_alert_sem, timeout_ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+    *alerts = take_alerts();
+    return *alerts ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t vbus_status(twai_status_info_t *out)
+{
+    return can_vbus_node_status(0, out);
+}
+
+static esp_err_t vbus_recover(void)
+{
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[0];
+    if (n->state == TWAI_STATE_BUS_OFF) {
+        n->state = TWAI_STATE_RECOVERING;
+        n->recover_at_ns = s_bus->now_ns + bits_ns(VBUS_RECOVERY_BITS, n->bitrate);
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+static esp_err_t vbus_resume(void)
+{
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    portENTER_CRITICAL(&s_lock);
+    vbus_node_t *n = &s_bus->node[0];
+    if (n->state == TWAI_STATE_STOPPED) {
+        n->state = TWAI_STATE_RUNNING;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+static esp_err_t vbus_reset(void)
+{
+    if (!s_bus) return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL(&s_lock);
+    node_clear(&s_bus->node[0]);
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+const can_bus_ops_t can_vbus_bus = {
+    .name        = "vbus",
+    .start       = vbus_start,
+    .stop        = vbus_stop,
+    .reconfigure = vbus_reconfigure,
+    .set_filter  = vbus_set_filter,
+    .tx          = vbus_tx,
+    .rx          = vbus_rx,
+    .rx_batch    = vbus_rx_batch,
+    .alerts      = vbus_alerts,
+    .status      = vbus_status,
+    .recover     = vbus_recover,
+    .resume      = vbus_resume,
+    .reset       = vbus_reset,
+};
@@ -0,0 +1,149 @@
+#include "lvgl_dirty.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_attr.h"
+
+#include "lvgl_rotate.h"
+
+static inline uint32_t rect_px(const lvgl_dirty_rect_t *r)
+{
+    return (uint32_t)(r->x2 - r->x1 + 1) * (uint32_t)(r->y2 - r->y1 + 1);
+}
+
+static inline lvgl_dirty_rect_t rect_union(const lvgl_dirty_rect_t *a, const lvgl_dirty_rect_t *b)
+{
+    lvgl_dirty_rect_t u = {
+        .x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+        .x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+        .y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+    };
+    return u;
+}
+
+/* Overlapping, or sharing an edge */
+static inline bool rect_touch(const lvgl_dirty_rect_t *a, const lvgl_dirty_rect_t *b)
+{
+    return a->x1 <= b->x2 + 1 && b->x1 <= a->x2 + 1 &&
+           a->y1 <= b->y2 + 1 && b->y1 <= a->y2 + 1;
+}
+
+/* Extra pixels copied by merging a and b (negative: merging saves) */
+static inline int32_t merge_cost(const lvgl_dirty_rect_t *a, const lvgl_dirty_rect_t *b)
+{
+    lvgl_dirty_rect_t u = rect_union(a, b);
+    return (int32_t)rect_px(&u) - (int32_t)rect_px(a) - (int32_t)rect_px(b);
+}
+
+/* Overlapping, not just touching */
+static inline bool rect_overlap(const lvgl_dirty_rect_t *a, const lvgl_dirty_rect_t *b)
+{
+    return a->x1 <= b->x2 && b->x1 <= a->x2 && a->y1 <= b->y2 && b->y1 <= a->y2;
+}
+
+/* Cut keep's overlap out of cut when what is left is still one rectangle:
+ * keep spans all of cut's columns (or rows) and covers one end of it */
+static bool rect_trim(const lvgl_dirty_rect_t *keep, lvgl_dirty_rect_t *cut)
+{
+    if (keep->x1 <= cut->x1 && keep->x2 >= cut->x2) {
+        if (keep->y1 <= cut->y1) { cut->y1 = keep->y2 + 1; return true; }
+        if (keep->y2 >= cut->y2) { cut->y2 = keep->y1 - 1; return true; }
+    }
+    if (keep->y1 <= cut->y1 && keep->y2 >= cut->y2) {
+        if (keep->x1 <= cut->x1) { cut->x1 = keep->x2 + 1; return true; }
+        if (keep->x2 >= cut->x2) { cut->x2 = keep->x1 - 1; return true; }
+    }
+    return false;
+}
+
+static void merge_pair(lvgl_dirty_t *d, uint16_t i, uint16_t j)
+{
+    d->r[i] = rect_union(&d->r[i], &d->r[j]);
+    d->r[j] = d->r[--d->n];
+}
+
+void lvgl_dirty_reset(lvgl_dirty_t *d)
+{
+    d->n = 0;
+    d->n_in = 0;
+}
+
+void lvgl_dirty_add(lvgl_dirty_t *d, int16_t x1, int16_t y1, int16_t x2, int16_t y2)
+{
+    if (x2 < x1 || y2 < y1) return;
+
+    const lvgl_dirty_rect_t a = { x1, y1, x2, y2 };
+    d->n_in++;
+
+    if (d->n < LVGL_DIRTY_IN_MAX) {
+        d->r[d->n++] = a;
+        return;
+    }
+
+    uint16_t best = 0;
+    int32_t best_cost = INT32_MAX;
+    for (uint16_t i = 0; i < d->n; i++) {
+        int32_t c = merge_cost(&d->r[i], &a);
+        if (c < best_cost) {
+            best_cost = c;
+            best = i;
+        }
+    }
+    d->r[best] = rect_union(&d->r[best], &a);
+}
+
+void lvgl_dirty_merge(lvgl_dirty_t *d)
+{
+    /* Touching pairs that copy no more together are merged; overlapping
+     * pairs that are not lose the overlap from one side where that leaves a
+     * rectangle. Either can enable the next step, so repeat until stable. */
+    bool again = true;
+    while (again) {
+        again = false;
+        for (uint16_t i = 0; i < d->n; i++) {
+            for (uint16_t j = i + 1; j < d->n; j++) {
+                lvgl_dirty_rect_t *a = &d->r[i], *b = &d->r[j];
+                if (!rect_touch(a, b)) continue;
+
+                if (merge_cost(a, b) <= 0) {
+                    merge_pair(d, i, j);
+                } else if (rect_overlap(a, b) && (rect_trim(a, b) || rect_trim(b, a))) {
+                    if (b->x2 < b->x1 || b->y2 < b->y1)      d->r[j] = d->r[--d->n];
+                    else if (a->x2 < a->x1 || a->y2 < a->y1) d->r[i] = d->r[--d->n];
+                } else {
+                    continue;
+                }
+                again = true;
+                j = i;   /* r[i] changed: compare it with everything again */
+            }
+        }
+    }
+}
+
+uint32_t lvgl_dirty_pixels(const lvgl_dirty_t *d)
+{
+    uint32_t px = 0;
+    for (uint16_t i = 0; i < d->n; i++) px += rect_px(&d->r[i]);
+    return px;
+}
+
+IRAM_ATTR size_t lvgl_dirty_copy(const lvgl_dirty_t *d, const uint16_t *from, uint16_t *to,
+                                 uint16_t w, uint16_t h, uint16_t rotation)
+{
+    for (uint16_t i = 0; i < d->n; i++) {
+        const lvgl_dirty_rect_t *r = &d->r[i];
+        if (rotation != 0) {
+            lvgl_rotate_copy(from, to, r->x1, r->y1, r->x2, r->y2, w, h, rotation);
+            continue;
+        }
+
+        const size_t row = (size_t)(r->x2 - r->x1 + 1) * sizeof(uint16_t);
+        for (int y = r->y1; y <= r->y2; y++) {
+            const size_t off = (size_t)y * w + r->x1;
+            memcpy(to + off, from + off, row);
+        }
+    }
+    return (size_t)lvgl_dirty_pixels(d) * sizeof(uint16_t);
+}
@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -14,11 +16,28 @@
 #include "esp_log.h"
 #include "lvgl.h"
 #include "lvgl_port.h"
+#include "lvgl_rotate.h"
+#include "lvgl_dirty.h"
+#include "can_lat.h"
 
 static const char *TAG = "lv_port";                      // Tag for logging
 static SemaphoreHandle_t lvgl_mux;                       // LVGL mutex for synchronization
 static TaskHandle_t lvgl_task_handle = NULL;             // Handle for the LVGL task
 
+/* Wakeups use their own notification slot: slot 0 belongs to the vsync
+ * handshake in the avoid-tear flush callbacks, which the RGB ISR notifies
+ * every frame whether anybody waits or not. */
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= LVGL_PORT_WAKE_INDEX
+#error "LVGL task wakeups need CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES >= 2"
+#endif
+
+static lv_timer_t *wake_timers[LVGL_PORT_WAKE_TIMERS];   // Timers to make due before the next lv_timer_handler()
+static portMUX_TYPE wake_lock = portMUX_INITIALIZER_UNLOCKED; // Guards wake_timers
+static lv_timer_t *touch_timer = NULL;                   // Touch read timer, paused between touches when the controller has an INT line
+static volatile bool touch_irq = false;                  // Set by the touch ISR, consumed by the LVGL task
+static uint32_t touch_idle_reads = 0;                    // Released reads in a row
+static lvgl_port_sync_stats_t sync_stats;                // Frame buffer sync cost, direct mode with rotation only
+
 #if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
 // Function to get the next frame buffer for double buffering
 static void *get_next_frame_buffer(esp_lcd_panel_handle_t panel_handle)
@@ -34,68 +53,12 @@ static void *get_next_frame_buffer(esp_lcd_panel_handle_t panel_handle)
     }
     return next_fb;                                       // Return the next frame buffer
 }
-
-// Function to rotate and copy pixels from one buffer to another
-IRAM_ATTR static void rotate_copy_pixel(const uint16_t *from, uint16_t *to, uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end, uint16_t w, uint16_t h, uint16_t rotation)
-{
-    int from_index = 0;                                   // Index for source buffer
-    int to_index = 0;                                     // Index for destination buffer
-    int to_index_const = 0;                               // Constant index for destination buffer
-
-    switch (rotation) {
-    case 90:
-        to_index_const = (w - x_start - 1) * h;          // Calculate constant index for 90-degree rotation
-        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
-            from_index = from_y * w + x_start;           // Calculate index in the source buffer
-            to_index = to_index_const + from_y;          // Calculate index in the destination buffer
-            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
-                *(to + to_index) = *(from + from_index);  // Copy pixel
-                from_index += 1;                          // Move to the next pixel in the source
-                to_index -= h;                            // Move to the next pixel in the destination
-            }
-        }
-        break;
-    case 180:
-        to_index_const = h * w - x_start - 1;            // Calculate constant index for 180-degree rotation
-        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
-            from_index = from_y * w + x_start;           // Calculate index in the source buffer
-            to_index = to_index_const - from_y * w;      // Calculate index in the destination buffer
-            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
-                *(to + to_index) = *(from + from_index);  // Copy pixel
-                from_index += 1;                          // Move to the next pixel in the source
-                to_index -= 1;                            // Move to the next pixel in the destination
-            }
-        }
-        break;
-    case 270:
-        to_index_const = (x_start + 1) * h - 1;          // Calculate constant index for 270-degree rotation
-        for (int from_y = y_start; from_y < y_end + 1; from_y++) {
-            from_index = from_y * w + x_start;           // Calculate index in the source buffer
-            to_index = to_index_const - from_y;          // Calculate index in the destination buffer
-            for (int from_x = x_start; from_x < x_end + 1; from_x++) {
-                *(to + to_index) = *(from + from_index);  // Copy pixel
-                from_index += 1;                          // Move to the next pixel in the source
-                to_index += h;                            // Move to the next pixel in the destination
-            }
-        }
-        break;
-    default:
-        break;                                             // Do nothing for unsupported rotation angles
-    }
-}
 #endif /* EXAMPLE_LVGL_PORT_ROTATION_DEGREE */
 
 #if LVGL_PORT_AVOID_TEAR_ENABLE
 #if LVGL_PORT_DIRECT_MODE
 #if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
 
-// Structure to store information about dirty areas that need refreshing
-typedef struct {
-    uint16_t inv_p;                                   // Number of invalid areas
-    uint8_t inv_area_joined[LV_INV_BUF_SIZE];       // Array to track joined invalid areas
-    lv_area_t inv_areas[LV_INV_BUF_SIZE];            // Array of invalid areas
-} lv_port_dirty_area_t;
-
 // Enumeration for flush status
 typedef enum {
     FLUSH_STATUS_PART,                                // Partial flush
@@ -109,17 +72,21 @@ typedef enum {
     FLUSH_PROBE_FULL_COPY,                           // Probe result for full copy
 } lv_port_flush_probe_t;
 
-static lv_port_dirty_area_t dirty_area;             // Instance of dirty area structure
+static lvgl_dirty_t dirty_area;                     // Merged dirty rectangles of the last refresh
+static uint32_t sync_frame_bytes = 0;               // Bytes copied between frame buffers for the current frame
 
-// Function to save the current dirty area information
-static void flush_dirty_save(lv_port_dirty_area_t *dirty_area)
+// Function to save the current dirty area information, merged into as few rectangles as pay off
+static void flush_dirty_save(lvgl_dirty_t *dirty_area)
 {
     lv_disp_t *disp = _lv_refr_get_disp_refreshing(); // Get the currently refreshing display
-    dirty_area->inv_p = disp->inv_p;                  // Save the number of invalid areas
+    lvgl_dirty_reset(dirty_area);
     for (int i = 0; i < disp->inv_p; i++) {
-        dirty_area->inv_area_joined[i] = disp->inv_area_joined[i]; // Save joined areas status
-        dirty_area->inv_areas[i] = disp->inv_areas[i]; // Save invalid areas
+        if (disp->inv_area_joined[i] == 0) { // Areas LVGL joined are covered by another one
+            const lv_area_t *a = &disp->inv_areas[i];
+            lvgl_dirty_add(dirty_area, a->x1, a->y1, a->x2, a->y2);
+        }
     }
+    lvgl_dirty_merge(dirty_area);
 }
 
 /**
@@ -174,21 +141,22 @@ static inline void *flush_get_next_buf(void *panel_handle)
  * @note This function is used to avoid tearing effect, and only works with LVGL direct mode.
  *
  */
-static void flush_dirty_copy(void *dst, void *src, lv_port_dirty_area_t *dirty_area)
+static void flush_dirty_copy(void *dst, void *src, lvgl_dirty_t *dirty_area)
 {
-    lv_coord_t x_start, x_end, y_start, y_end; // Coordinates for the area to be copied
-    for (int i = 0; i < dirty_area->inv_p; i++) {
-        /* Refresh the unjoined areas */
-        if (dirty_area->inv_area_joined[i] == 0) {
-            x_start = dirty_area->inv_areas[i].x1; // Start X coordinate
-            x_end = dirty_area->inv_areas[i].x2;   // End X coordinate
-            y_start = dirty_area->inv_areas[i].y1; // Start Y coordinate
-            y_end = dirty_area->inv_areas[i].y2;   // End Y coordinate
-
-            // Rotate and copy pixel data from source to destination buffer
-            rotate_copy_pixel(src, dst, x_start, y_start, x_end, y_end, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
-        }
-    }
+    // Rotate and copy the merged rectangles from source to destination buffer
+    sync_frame_bytes += lvgl_dirty_copy(dirty_area, src, dst, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+}
+
+// Close the frame's sync accounting
+static void flush_sync_done(void)
+{
+    sync_stats.frames++;
+    sync_stats.bytes_last = sync_frame_bytes;
+    sync_stats.bytes_avg = sync_stats.frames == 1 ? sync_frame_bytes
+                           : sync_stats.bytes_avg - (sync_stats.bytes_avg >> 3) + (sync_frame_bytes >> 3);
+    sync_stats.areas_last = dirty_area.n_in;
+    sync_stats.rects_last = dirty_area.n;
+    sync_frame_bytes = 0;
 }
 
 
@@ -212,7 +180,7 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
 
             // Rotate and copy data from the whole screen LVGL's buffer to the next frame buffer
             next_fb = flush_get_next_buf(panel_handle);
-            rotate_copy_pixel((uint16_t *)color_map, next_fb, offsetx1, offsety1, offsetx2, offsety2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+            lvgl_rotate_copy((uint16_t *)color_map, next_fb, offsetx1, offsety1, offsetx2, offsety2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
 
             /* Switch the current RGB frame buffer to `next_fb` */
             esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, next_fb);
@@ -224,6 +192,9 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
             /* Synchronously update the dirty area for another frame buffer */
             flush_dirty_copy(flush_get_next_buf(panel_handle), color_map, &dirty_area);
             flush_get_next_buf(panel_handle);
+
+            sync_frame_bytes += (uint32_t)(offsetx2 + 1 - offsetx1) * (offsety2 + 1 - offsety1) * sizeof(uint16_t); // The full-screen rotate above
+            flush_sync_done();
         } else {
             /* Probe the copy method for the current dirty area */
             probe_result = flush_copy_probe(drv);
@@ -253,11 +224,11 @@ static void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
                 ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
                 if (probe_result == FLUSH_PROBE_PART_COPY) {
-                    /* Synchronously update the dirty area for another frame buffer */
-                    flush_dirty_save(&dirty_area);
+                    /* Synchronously update the dirty area for another frame buffer (same areas, already merged) */
                     flush_dirty_copy(flush_get_next_buf(panel_handle), color_map, &dirty_area);
                     flush_get_next_buf(panel_handle);
                 }
+                flush_sync_done();
             }
         }
     }
@@ -329,7 +300,7 @@ void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color
     void *next_fb = get_next_frame_buffer(panel_handle); // Get the next frame buffer
 
     /* Rotate and copy dirty area from the current LVGL's buffer to the next RGB frame buffer */
-    rotate_copy_pixel((uint16_t *)color_map, next_fb, offsetx1, offsety1, offsetx2, offsety2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+    lvgl_rotate_copy((uint16_t *)color_map, next_fb, offsetx1, offsety1, offsetx2, offsety2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
 
     /* Switch the current RGB frame buffer to `next_fb` */
     esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, next_fb);
@@ -366,6 +337,21 @@ void flush_callback(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color
 
 #endif /* LVGL_PORT_AVOID_TEAR_ENABLE */
 
+// Time every flush and close the end-to-end latency of the frames drawn in this refresh
+static void flush_callback_timed(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_map)
+{
+    const bool last = lv_disp_flush_is_last(drv); // Read before flush_callback() marks the flush ready
+    const int64_t t0 = esp_timer_get_time();
+
+    flush_callback(drv, area, color_map);
+
+    const int64_t t1 = esp_timer_get_time();
+    can_lat_record_us(CAN_LAT_FLUSH, t1 - t0);
+    if (last) {
+        can_lat_e2e_flushed(t1);
+    }
+}
+
 static lv_disp_t *display_init(esp_lcd_panel_handle_t panel_handle)
 {
     assert(panel_handle); // Ensure the panel handle is valid
@@ -415,7 +401,7 @@ static lv_disp_t *display_init(esp_lcd_panel_handle_t panel_handle)
     disp_drv.hor_res = LVGL_PORT_H_RES; // Set horizontal resolution
     disp_drv.ver_res = LVGL_PORT_V_RES; // Set vertical resolution
 #endif
-    disp_drv.flush_cb = flush_callback; // Set the flush callback
+    disp_drv.flush_cb = flush_callback_timed; // Set the flush callback
     disp_drv.draw_buf = &disp_buf; // Set the draw buffer
     disp_drv.user_data = panel_handle; // Set user data to panel handle
 #if LVGL_PORT_FULL_REFRESH
@@ -445,8 +431,14 @@ static void touchpad_read(lv_indev_drv_t *indev_drv, lv_indev_data_t *data)
         data->point.y = touchpad_y; // Set the Y coordinate
         data->state = LV_INDEV_STATE_PRESSED; // Set state to pressed
         ESP_LOGD(TAG, "Touch position: %d,%d", touchpad_x, touchpad_y); // Log touch position
+        touch_idle_reads = 0;
     } else {
         data->state = LV_INDEV_STATE_RELEASED; // Set state to released
+        // With an INT line there is nothing to poll once a release has settled (scroll throw
+        // and gestures finish on released reads); the touch ISR resumes the timer
+        if (tp->config.int_gpio_num != GPIO_NUM_NC && ++touch_idle_reads >= LVGL_PORT_TOUCH_IDLE_READS && !touch_irq) {
+            lv_timer_pause(indev_drv->read_timer);
+        }
     }
 }
 
@@ -462,7 +454,11 @@ static lv_indev_t *indev_init(esp_lcd_touch_handle_t tp)
     indev_drv_tp.read_cb = touchpad_read; // Set the read callback function
     indev_drv_tp.user_data = tp; // Set user data to the touch panel handle
 
-    return lv_indev_drv_register(&indev_drv_tp); // Register the input device driver
+    lv_indev_t *indev = lv_indev_drv_register(&indev_drv_tp); // Register the input device driver
+    if (indev) {
+        touch_timer = indev_drv_tp.read_timer; // Remember the read timer for touch wakeups
+    }
+    return indev;
 }
 
 static void tick_increment(void *arg)
@@ -483,23 +479,53 @@ static esp_err_t tick_init(void)
     return esp_timer_start_periodic(lvgl_tick_timer, LVGL_PORT_TICK_PERIOD_MS * 1000); // Start the timer
 }
 
+// Make the timers other tasks asked for due now; called with the LVGL mutex held
+static void wake_timers_ready(void)
+{
+    lv_timer_t *ready[LVGL_PORT_WAKE_TIMERS];
+
+    portENTER_CRITICAL(&wake_lock);
+    memcpy(ready, wake_timers, sizeof(ready));
+    memset(wake_timers, 0, sizeof(wake_timers));
+    portEXIT_CRITICAL(&wake_lock);
+
+    for (int i = 0; i < LVGL_PORT_WAKE_TIMERS && ready[i]; i++) {
+        lv_timer_ready(ready[i]);
+    }
+
+    if (touch_irq && touch_timer) {
+        touch_irq = false;
+        lv_timer_resume(touch_timer); // Read the controller on this pass
+        lv_timer_ready(touch_timer);
+    }
+}
+
 static void lvgl_port_task(void *arg)
 {
     ESP_LOGD(TAG, "Starting LVGL task"); // Log the task start
 
+    const int64_t min_frame_us = (int64_t)LVGL_PORT_TASK_MIN_DELAY_MS * 1000;
+    int64_t last_run_us = 0; // Start of the previous lv_timer_handler() pass
     uint32_t task_delay_ms = LVGL_PORT_TASK_MAX_DELAY_MS; // Set initial task delay
     while (1) {
+        // Never run passes closer together than the minimum frame interval, however often we are woken
+        int64_t wait_us = last_run_us + min_frame_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            vTaskDelay((TickType_t)((wait_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000)));
+        }
+        last_run_us = esp_timer_get_time();
+
         if (lvgl_port_lock(-1)) { // Try to lock the LVGL mutex
+            wake_timers_ready(); // Timers woken from other tasks run in this pass
             task_delay_ms = lv_timer_handler(); // Handle LVGL timer events
             lvgl_port_unlock(); // Unlock the mutex
         }
-        // Ensure the delay time is within limits
+        // Sleep until the next LVGL timer is due, or until a wakeup (new rows, touch)
         if (task_delay_ms > LVGL_PORT_TASK_MAX_DELAY_MS) {
             task_delay_ms = LVGL_PORT_TASK_MAX_DELAY_MS;
-        } else if (task_delay_ms < LVGL_PORT_TASK_MIN_DELAY_MS) {
-            task_delay_ms = LVGL_PORT_TASK_MIN_DELAY_MS;
         }
-        vTaskDelay(pdMS_TO_TICKS(task_delay_ms)); // Delay the task for the calculated time
+        ulTaskNotifyTakeIndexed(LVGL_PORT_WAKE_INDEX, pdTRUE,
+                                (task_delay_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS); // Round up: never wake before the deadline
     }
 }
 
@@ -571,3 +597,51 @@ bool lvgl_port_notify_rgb_vsync(void)
 #endif
     return (need_yield == pdTRUE); // Return whether a yield is needed
 }
+
+void lvgl_port_wake(void)
+{
+    TaskHandle_t t = lvgl_task_handle;
+    if (t) {
+        xTaskNotifyGiveIndexed(t, LVGL_PORT_WAKE_INDEX); // Cut the current sleep short
+    }
+}
+
+bool lvgl_port_wake_timer(lv_timer_t *timer)
+{
+    bool queued = false;
+
+    portENTER_CRITICAL(&wake_lock);
+    for (int i = 0; i < LVGL_PORT_WAKE_TIMERS; i++) {
+        if (wake_timers[i] == timer || wake_timers[i] == NULL) {
+            wake_timers[i] = timer; // Already pending or a free slot
+            queued = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&wake_lock);
+
+    lvgl_port_wake(); // Even when full: the task still runs the timers that are due
+    return queued;
+}
+
+IRAM_ATTR void lvgl_port_touch_isr(esp_lcd_touch_handle_t tp)
+{
+    (void)tp;
+    touch_irq = true;
+
+    TaskHandle_t t = lvgl_task_handle;
+    if (t) {
+        BaseType_t need_yield = pdFALSE;
+        vTaskNotifyGiveIndexedFromISR(t, LVGL_PORT_WAKE_INDEX, &need_yield); // Wake the LVGL task to read the touch
+        if (need_yield == pdTRUE) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+void lvgl_port_get_sync_stats(lvgl_port_sync_stats_t *out)
+{
+    if (out) {
+        *out = sync_stats;
+    }
+}
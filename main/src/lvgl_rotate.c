@@ -0,0 +1,83 @@
+#include "lvgl_rotate.h"
+
+#include <stddef.h>
+
+#include "esp_attr.h"
+
+/* 32-bit view of the 16-bit buffers for the 180 pair moves */
+typedef uint32_t __attribute__((may_alias)) px_pair_t;
+
+/* 90: source (x, y) -> destination row w-1-x, column y */
+static inline void tile_90(const uint16_t *from, uint16_t *to, int x0, int y0, int x1, int y1, int w, int h)
+{
+    for (int x = x0; x <= x1; x++) {
+        const uint16_t *s = from + (size_t)y0 * w + x;
+        uint16_t *d = to + (size_t)(w - 1 - x) * h + y0;
+        for (int y = y0; y <= y1; y++) {
+            *d++ = *s;
+            s += w;
+        }
+    }
+}
+
+/* 270: source (x, y) -> destination row x, column h-1-y; walk y down so the
+ * destination row is written forwards */
+static inline void tile_270(const uint16_t *from, uint16_t *to, int x0, int y0, int x1, int y1, int w, int h)
+{
+    for (int x = x0; x <= x1; x++) {
+        const uint16_t *s = from + (size_t)y1 * w + x;
+        uint16_t *d = to + (size_t)x * h + (h - 1 - y1);
+        for (int y = y1; y >= y0; y--) {
+            *d++ = *s;
+            s -= w;
+        }
+    }
+}
+
+/* 180: source row y -> destination row h-1-y, reversed */
+static inline void rows_180(const uint16_t *from, uint16_t *to, int x0, int y0, int x1, int y1, int w, int h)
+{
+    for (int y = y0; y <= y1; y++) {
+        const uint16_t *s = from + (size_t)y * w + x0;
+        uint16_t *d = to + (size_t)(h - 1 - y) * w + (w - 1 - x0);
+        int n = x1 - x0 + 1;
+
+        if (((uintptr_t)s & 3) && n > 0) {
+            *d-- = *s++;
+            n--;
+        }
+        /* Pixels s[0], s[1] land at d[0], d[-1]: one word, halves swapped */
+        if (((uintptr_t)(d - 1) & 3) == 0) {
+            for (; n >= 2; n -= 2) {
+                uint32_t v = *(const px_pair_t *)s;
+                *(px_pair_t *)(d - 1) = (v >> 16) | (v << 16);
+                s += 2;
+                d -= 2;
+            }
+        }
+        while (n-- > 0) *d-- = *s++;
+    }
+}
+
+IRAM_ATTR void lvgl_rotate_copy(const uint16_t *from, uint16_t *to,
+                                uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end,
+                                uint16_t w, uint16_t h, uint16_t rotation)
+{
+    if (x_end < x_start || y_end < y_start) return;
+
+    if (rotation == 180) {
+        rows_180(from, to, x_start, y_start, x_end, y_end, w, h);
+        return;
+    }
+    if (rotation != 90 && rotation != 270) return;
+
+    const int t = LVGL_ROTATE_TILE;
+    for (int ty = y_start; ty <= y_end; ty += t) {
+        const int ty1 = (ty + t - 1 < y_end) ? ty + t - 1 : y_end;
+        for (int tx = x_start; tx <= x_end; tx += t) {
+            const int tx1 = (tx + t - 1 < x_end) ? tx + t - 1 : x_end;
+            if (rotation == 90) tile_90(from, to, tx, ty, tx1, ty1, w, h);
+            else                tile_270(from, to, tx, ty, tx1, ty1, w, h);
+        }
+    }
+}
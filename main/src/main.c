@@ -10,22 +10,71 @@
 #include "waveshare_rgb_lcd_port.h"
 #include "waveshare_twai_port.h"
 
+#include "can_bus.h"
 #include "can_mon.h"
+#include "can_agg.h"
+#include "can_pipe.h"
+#include "can_load.h"
+#include "can_sched.h"
+#include "can_tx.h"
+#include "can_sup.h"
+#include "can_gen.h"
+#include "can_console.h"
+#include "sys_diag.h"
 #include "ui_canmon.h"
 
 #define TAG "main"
 
 /* -------- Configuration knobs -------- */
 #ifndef CAN_MON_RX_QUEUE_LEN
-#define CAN_MON_RX_QUEUE_LEN  64
+#define CAN_MON_RX_QUEUE_LEN  1024  /* power of two; rounded up otherwise */
+#endif
+
+#ifndef CAN_AGG_MAX_IDS
+#define CAN_AGG_MAX_IDS       256   /* distinct IDs in the fixed view */
+#endif
+
+#if CONFIG_CAN_MON_CAPTURE_STOP_WHEN_FULL
+#define CAN_MON_CAPTURE_POLICY  CAN_MON_CAP_STOP_WHEN_FULL
+#elif CONFIG_CAN_MON_CAPTURE_DROP_NEWEST
+#define CAN_MON_CAPTURE_POLICY  CAN_MON_CAP_DROP_NEWEST
+#else
+#define CAN_MON_CAPTURE_POLICY  CAN_MON_CAP_OVERWRITE_OLDEST
 #endif
 
 #ifndef CAN_RX_TASK_STACK
 #define CAN_RX_TASK_STACK     4096
 #endif
 
+/* Capture stage: the RX task and everything that talks to the controller */
+#define CAN_BUS_CORE          CONFIG_CAN_PIPE_CAPTURE_CORE
+
 #ifndef CAN_RX_TASK_PRIO
-#define CAN_RX_TASK_PRIO      10
+#define CAN_RX_TASK_PRIO      CONFIG_CAN_PIPE_CAPTURE_PRIO
+#endif
+
+#ifndef CAN_SUP_TASK_PRIO
+#define CAN_SUP_TASK_PRIO     (CAN_RX_TASK_PRIO + 1)   /* above RX: it is what wakes RX */
+#endif
+
+#ifndef CAN_TX_TASK_PRIO
+#define CAN_TX_TASK_PRIO      9     /* owns the controller; just below RX */
+#endif
+
+#ifndef CAN_SCHED_MAX_MSGS
+#define CAN_SCHED_MAX_MSGS    256   /* cyclic TX messages */
+#endif
+
+#ifndef CAN_SCHED_TASK_PRIO
+#define CAN_SCHED_TASK_PRIO   8     /* below RX so bursts never starve it */
+#endif
+
+#ifndef CAN_GEN_TASK_PRIO
+#define CAN_GEN_TASK_PRIO     7     /* below cyclic TX so its timing holds under load */
+#endif
+
+#ifndef SYS_DIAG_TASK_PRIO
+#define SYS_DIAG_TASK_PRIO    1     /* just above idle; a late sample only stretches one period */
 #endif
 
 void app_main(void)
@@ -41,8 +90,12 @@ void app_main(void)
     /* Initialize LCD + touch + LVGL port */
     ESP_ERROR_CHECK(waveshare_esp32_s3_rgb_lcd_init());
 
-    /* Initialize CAN (TWAI) */
-    err = waveshare_twai_init();
+    /* Initialize CAN (TWAI behind the can_bus interface) */
+    const can_bus_cfg_t bus_cfg = {
+        .bitrate = WAVESHARE_TWAI_BITRATE,
+        .mode    = WAVESHARE_TWAI_MODE,
+    };
+    err = can_bus_init(&waveshare_twai_bus, &bus_cfg);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "TWAI init failed: %s", esp_err_to_name(err));
         /* Continue booting UI anyway (you can show an error state later) */
@@ -50,24 +103,46 @@ void app_main(void)
         ESP_LOGI(TAG, "TWAI initialized");
     }
 
-    /* Initialize CAN monitor (queue + counters) */
+    /* Initialize CAN monitor (event rings + counters) */
     ESP_ERROR_CHECK(can_mon_init(CAN_MON_RX_QUEUE_LEN));
 
+    /* Per-ID table behind the fixed view */
+    err = can_agg_init(CAN_AGG_MAX_IDS);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "ID table disabled: %s", esp_err_to_name(err));
+    }
+    ESP_ERROR_CHECK(can_load_init(can_bus_get_bitrate()));
+
+#if CONFIG_CAN_MON_CAPTURE_SIZE_MB > 0
+    /* PSRAM history; the monitor works without it */
+    err = can_mon_capture_init((size_t)CONFIG_CAN_MON_CAPTURE_SIZE_MB << 20, CAN_MON_CAPTURE_POLICY);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Capture store disabled: %s", esp_err_to_name(err));
+    }
+#endif
+
+    /* Decode stage: ID table and display rows, off the LVGL lock */
+    err = can_pipe_init(CONFIG_CAN_PIPE_ROWS);
+    if (err == ESP_OK) err = can_pipe_start(CONFIG_CAN_PIPE_DECODE_PRIO, CONFIG_CAN_PIPE_DECODE_CORE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Decode stage not started: %s", esp_err_to_name(err));
+    }
+
     /* Build UI under LVGL lock (LVGL APIs are not thread-safe) */
     if (lvgl_port_lock(-1)) {
         ui_canmon_cfg_t ui_cfg = {
             .side_w_pct     = 33,
             .padding        = 12,
-            .drain_per_tick = 16,
-            .tick_ms        = 50,
+            .fps            = CONFIG_CAN_UI_FPS,
+            .min_fps        = CONFIG_CAN_UI_MIN_FPS,
         };
-        ESP_ERROR_CHECK(ui_canmon_start(&ui_cfg, can_mon_get_queue()));
+        ESP_ERROR_CHECK(ui_canmon_start(&ui_cfg));
         lvgl_port_unlock();
     } else {
         ESP_LOGE(TAG, "Failed to lock LVGL; UI not created");
     }
 
-    /* Start CAN RX task */
+    /* Start CAN RX task (capture stage) */
     xTaskCreatePinnedToCore(
         can_mon_rx_task,
         "can_rx_task",
@@ -75,9 +150,49 @@ void app_main(void)
         NULL,
         CAN_RX_TASK_PRIO,
         NULL,
-        0
+        CAN_BUS_CORE
     );
 
+    /* Alert supervisor; the RX task sleeps until it reports RX_DATA */
+    err = can_sup_start(CAN_SUP_TASK_PRIO, CAN_BUS_CORE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Supervisor not started: %s", esp_err_to_name(err));
+    }
+
+    /* TX worker; every transmitter queues on it */
+    err = can_tx_init();
+    if (err == ESP_OK) err = can_tx_start(CAN_TX_TASK_PRIO, CAN_BUS_CORE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "TX worker not started: %s", esp_err_to_name(err));
+    }
+
+    /* Cyclic TX scheduler; idle (timer stopped) until a message is added */
+    err = can_sched_init(CAN_SCHED_MAX_MSGS, NULL);
+    if (err == ESP_OK) err = can_sched_start(CAN_SCHED_TASK_PRIO, CAN_BUS_CORE);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cyclic TX disabled: %s", esp_err_to_name(err));
+    }
+
+    /* Traffic generator; idle until started from the UI or console */
+    err = can_gen_init(CAN_GEN_TASK_PRIO, CAN_BUS_CORE);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Traffic generator disabled: %s", esp_err_to_name(err));
+    }
+
+#if CONFIG_SYS_DIAG
+    err = sys_diag_start(SYS_DIAG_TASK_PRIO, 1);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Task diagnostics not started: %s", esp_err_to_name(err));
+    }
+#endif
+
+#if CONFIG_CAN_CONSOLE
+    err = can_console_start();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Console not started: %s", esp_err_to_name(err));
+    }
+#endif
+
     /* Keep app_main alive */
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -0,0 +1,243 @@
+#include "sys_diag.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#ifndef TAG
+#define TAG "sys_diag"
+#endif
+
+#ifndef SYS_DIAG_TASK_STACK
+#define SYS_DIAG_TASK_STACK  3072
+#endif
+
+#if CONFIG_SYS_DIAG
+
+/* ---------------- State ----------------
+ *
+ * The sampler owns the raw status table and the previous counters; readers
+ * only see s_pub, copied under the lock. Tasks are matched between samples
+ * by xTaskNumber, so a task created or deleted in between simply has no
+ * delta for that period.
+ */
+
+typedef struct {
+    UBaseType_t num;
+    uint32_t    runtime;
+} prev_t;
+
+static TaskStatus_t *s_raw = NULL;
+static prev_t       *s_prev = NULL;
+static UBaseType_t   s_cap = 0;
+static UBaseType_t   s_n_prev = 0;
+static uint32_t      s_total_prev = 0;
+
+static sys_diag_t    s_work;
+static sys_diag_t    s_pub;
+static portMUX_TYPE  s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t  s_task = NULL;
+
+/* Room for the current task count plus a few being created meanwhile */
+static bool ensure_cap(UBaseType_t n)
+{
+    if (n <= s_cap) return true;
+
+    UBaseType_t cap = n + 8;
+    TaskStatus_t *raw = heap_caps_realloc(s_raw, cap * sizeof(TaskStatus_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!raw) return false;
+    s_raw = raw;
+
+    prev_t *prev = heap_caps_realloc(s_prev, cap * sizeof(prev_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!prev) return false;
+    s_prev = prev;
+
+    s_cap = cap;
+    return true;
+}
+
+static bool prev_lookup(UBaseType_t num, uint32_t *runtime)
+{
+    for (UBaseType_t i = 0; i < s_n_prev; i++) {
+        if (s_prev[i].num == num) {
+            *runtime = s_prev[i].runtime;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void heap_sample(sys_diag_heap_t *h, uint32_t caps)
+{
+    h->free     = heap_caps_get_free_size(caps);
+    h->largest  = heap_caps_get_largest_free_block(caps);
+    h->min_free = heap_caps_get_minimum_free_size(caps);
+}
+
+static void sample(void)
+{
+    if (!ensure_cap(uxTaskGetNumberOfTasks())) return;
+
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(s_raw, s_cap, &total);
+    if (n == 0) {
+        /* Tasks were created since the count: grow and try next period */
+        ensure_cap(s_cap + 1);
+        return;
+    }
+
+    const uint32_t d_total = total - s_total_prev;
+    const bool have_prev = s_n_prev > 0 && d_total > 0;
+
+    TaskHandle_t idle[SYS_DIAG_CORES];
+    for (int c = 0; c < SYS_DIAG_CORES; c++) idle[c] = xTaskGetIdleTaskHandleForCore(c);
+
+    sys_diag_t *w = &s_work;
+    memset(w->core_load_x10, 0, sizeof(w->core_load_x10));
+    w->n_tasks = 0;
+    w->n_total = n;
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &s_raw[i];
+
+        uint32_t cpu_x10 = 0, before;
+        if (have_prev && prev_lookup(t->xTaskNumber, &before)) {
+            uint64_t d = (uint32_t)(t->ulRunTimeCounter - before);
+            cpu_x10 = (uint32_t)(d * 1000 / d_total);
+            if (cpu_x10 > 1000) cpu_x10 = 1000;
+        }
+
+        for (int c = 0; c < SYS_DIAG_CORES; c++) {
+            if (t->xHandle == idle[c]) w->core_load_x10[c] = (uint16_t)(1000 - cpu_x10);
+        }
+
+        if (w->n_tasks == SYS_DIAG_MAX_TASKS) continue;
+
+        /* Insertion by CPU share, highest first */
+        uint32_t k = w->n_tasks++;
+        while (k > 0 && w->tasks[k - 1].cpu_x10 < cpu_x10) {
+            w->tasks[k] = w->tasks[k - 1];
+            k--;
+        }
+        sys_diag_task_t *o = &w->tasks[k];
+        snprintf(o->name, sizeof(o->name), "%s", t->pcTaskName);
+        o->core       = (t->xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)t->xCoreID;
+        o->prio       = (uint8_t)t->uxCurrentPriority;
+        o->cpu_x10    = (uint16_t)cpu_x10;
+        o->stack_free = t->usStackHighWaterMark;   /* bytes: StackType_t is uint8_t here */
+    }
+
+    heap_sample(&w->internal, MALLOC_CAP_INTERNAL);
+    heap_sample(&w->psram, MALLOC_CAP_SPIRAM);
+    w->period_ms = SYS_DIAG_PERIOD_MS;
+
+    /* Remember counters for the next delta */
+    for (UBaseType_t i = 0; i < n; i++) {
+        s_prev[i].num = s_raw[i].xTaskNumber;
+        s_prev[i].runtime = s_raw[i].ulRunTimeCounter;
+    }
+    s_n_prev = n;
+    s_total_prev = total;
+
+    if (!have_prev) return;
+    w->seq++;
+
+    portENTER_CRITICAL(&s_lock);
+    s_pub = *w;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void sys_diag_task(void *arg)
+{
+    (void)arg;
+
+    TickType_t last = xTaskGetTickCount();
+    while (1) {
+        sample();
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(SYS_DIAG_PERIOD_MS));
+    }
+}
+
+esp_err_t sys_diag_start(UBaseType_t prio, BaseType_t core)
+{
+    if (s_task) return ESP_OK;
+
+    if (!ensure_cap(uxTaskGetNumberOfTasks())) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreatePinnedToCore(sys_diag_task, "sys_diag", SYS_DIAG_TASK_STACK,
+                                NULL, prio, &s_task, core) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool sys_diag_get(sys_diag_t *out)
+{
+    if (!out) return false;
+    portENTER_CRITICAL(&s_lock);
+    *out = s_pub;
+    portEXIT_CRITICAL(&s_lock);
+    return out->seq != 0;
+}
+
+#else /* !CONFIG_SYS_DIAG */
+
+esp_err_t sys_diag_start(UBaseType_t prio, BaseType_t core)
+{
+    (void)prio;
+    (void)core;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool sys_diag_get(sys_diag_t *out)
+{
+    if (out) memset(out, 0, sizeof(*out));
+    return false;
+}
+
+#endif /* CONFIG_SYS_DIAG */
+
+size_t sys_diag_format(char *out, size_t out_sz)
+{
+    if (!out || out_sz == 0) return 0;
+
+    static sys_diag_t d;   /* too big for a console task stack */
+    if (!sys_diag_get(&d)) {
+#if CONFIG_SYS_DIAG
+        return (size_t)snprintf(out, out_sz, "no sample yet\n");
+#else
+        return (size_t)snprintf(out, out_sz, "task diagnostics are off (CONFIG_SYS_DIAG)\n");
+#endif
+    }
+
+    size_t n = (size_t)snprintf(out, out_sz,
+                                "cpu0 %u.%u%%  cpu1 %u.%u%%  (%u ms)\n"
+                                "internal free %u largest %u min %u\n"
+                                "psram    free %u largest %u min %u\n"
+                                "%-16s %4s %4s %7s %7s\n",
+                                d.core_load_x10[0] / 10, d.core_load_x10[0] % 10,
+                                d.core_load_x10[1] / 10, d.core_load_x10[1] % 10,
+                                (unsigned)d.period_ms,
+                                (unsigned)d.internal.free, (unsigned)d.internal.largest, (unsigned)d.internal.min_free,
+                                (unsigned)d.psram.free, (unsigned)d.psram.largest, (unsigned)d.psram.min_free,
+                                "task", "core", "prio", "cpu%", "stack");
+
+    for (uint32_t i = 0; i < d.n_tasks && n < out_sz; i++) {
+        const sys_diag_task_t *t = &d.tasks[i];
+        char core[4];
+        if (t->core < 0) strcpy(core, "-");
+        else             snprintf(core, sizeof(core), "%d", t->core);
+
+        n += (size_t)snprintf(out + n, out_sz - n, "%-16s %4s %4u %5u.%u %7u\n",
+                              t->name, core, (unsigned)t->prio,
+                              t->cpu_x10 / 10, t->cpu_x10 % 10, (unsigned)t->stack_free);
+    }
+    if (d.n_total > d.n_tasks && n < out_sz) {
+        n += (size_t)snprintf(out + n, out_sz - n, "(%u more tasks)\n", (unsigned)(d.n_total - d.n_tasks));
+    }
+    return n < out_sz ? n : out_sz - 1;
+}
@@ -0,0 +1,201 @@
+// main/src/ui_canagg.c
+//
+// Fixed-row per-ID view for LVGL.
+//
+// Row r shows can_agg entry (top + r). Entries never move once created, so a
+// row is re-texted only when its entry was marked dirty by can_agg_update() or
+// when scrolling binds it to a different entry.
+
+#include "ui_canagg.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "can_agg.h"
+
+#ifndef UI_CANAGG_MAX_ROWS
+#define UI_CANAGG_MAX_ROWS   48
+#endif
+
+#ifndef UI_CANAGG_CHG_HEX
+#define UI_CANAGG_CHG_HEX    "F59E0B"   /* changed bytes */
+#endif
+
+/* "TX 18FEA831 [8] " + 8 highlighted bytes + "  65535.0 ms  4294967295" */
+#define UI_CANAGG_LINE_MAX   160
+
+#define ROW_UNBOUND  UINT32_MAX
+
+/* ---------------- State ---------------- */
+
+static lv_obj_t  *s_cont = NULL;
+static lv_obj_t  *s_placeholder = NULL;
+static lv_obj_t  *s_rows[UI_CANAGG_MAX_ROWS];
+static char       s_row_txt[UI_CANAGG_MAX_ROWS][UI_CANAGG_LINE_MAX];
+static uint32_t   s_row_idx[UI_CANAGG_MAX_ROWS];   /* entry shown, ROW_UNBOUND if hidden */
+static uint32_t   s_nrows = 0;
+static lv_coord_t s_line_h = 16;
+
+static uint32_t   s_top = 0;            /* first entry on screen */
+static lv_coord_t s_drag_px = 0;
+static uint32_t   s_generation = 0;
+
+/* ---------------- Formatting ---------------- */
+
+static void format_row(char *out, size_t out_sz, const can_agg_entry_t *e)
+{
+    const uint32_t id = e->key & CAN_REC_ID_MASK;
+    int n = snprintf(out, out_sz, (e->key & CAN_REC_F_EXTD) ? "%s %08" PRIX32 " [%u] " : "%s %03" PRIX32 " [%u] ",
+                     (e->key & CAN_REC_F_TX) ? "TX" : "RX", id, (unsigned)e->dlc);
+
+    if (e->rtr) {
+        n += snprintf(out + n, out_sz - n, "RTR");
+    } else {
+        for (uint32_t i = 0; i < e->dlc && n < (int)out_sz; i++) {
+            n += snprintf(out + n, out_sz - n, (e->chg_mask & (1u << i)) ? "#" UI_CANAGG_CHG_HEX " %02X# " : "%02X ",
+                          e->data[i]);
+        }
+    }
+
+    if (n >= (int)out_sz) return;
+
+    /* Period with one decimal in ms */
+    uint32_t p_x10 = e->period_us / 100;
+    snprintf(out + n, out_sz - n, " %" PRIu32 ".%" PRIu32 " ms  %" PRIu32,
+             p_x10 / 10, p_x10 % 10, e->count);
+}
+
+/* ---------------- Scrolling ---------------- */
+
+static uint32_t max_top(void)
+{
+    uint32_t n = (uint32_t)can_agg_count();
+    return (n > s_nrows) ? n - s_nrows : 0;
+}
+
+/* Drag with a finger: moving up reveals later IDs */
+static void view_drag_cb(lv_event_t *e)
+{
+    lv_event_code_t code = lv_event_get_code(e);
+
+    if (code == LV_EVENT_RELEASED) {
+        s_drag_px = 0;
+        return;
+    }
+
+    lv_indev_t *indev = lv_indev_get_act();
+    if (!indev) return;
+
+    lv_point_t v;
+    lv_indev_get_vect(indev, &v);
+    s_drag_px += v.y;
+
+    int lines = s_drag_px / s_line_h;
+    if (lines == 0) return;
+    s_drag_px -= (lv_coord_t)(lines * s_line_h);
+
+    int64_t top = (int64_t)s_top - lines;
+    if (top < 0) top = 0;
+    if (top > max_top()) top = max_top();
+    s_top = (uint32_t)top;
+}
+
+/* ---------------- Public API ---------------- */
+
+lv_obj_t *ui_canagg_create(lv_obj_t *parent)
+{
+    if (s_cont) return s_cont;
+
+    s_cont = lv_obj_create(parent);
+    lv_obj_clear_flag(s_cont, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_flag(s_cont, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(s_cont, view_drag_cb, LV_EVENT_PRESSING, NULL);
+    lv_obj_add_event_cb(s_cont, view_drag_cb, LV_EVENT_RELEASED, NULL);
+
+    s_placeholder = lv_label_create(s_cont);
+    lv_label_set_text(s_placeholder, "One row per CAN ID will appear here...");
+    lv_obj_set_style_text_opa(s_placeholder, LV_OPA_50, 0);
+
+    s_generation = can_agg_generation();
+    return s_cont;
+}
+
+/* Create the row labels once the container has its final size */
+static void rows_build(void)
+{
+    lv_obj_update_layout(s_cont);
+
+    const lv_font_t *font = lv_obj_get_style_text_font(s_cont, LV_PART_MAIN);
+    s_line_h = lv_font_get_line_height(font);
+    if (s_line_h <= 0) s_line_h = 16;
+
+    uint32_t n = (uint32_t)(lv_obj_get_content_height(s_cont) / s_line_h);
+    if (n < 1) n = 1;
+    if (n > UI_CANAGG_MAX_ROWS) n = UI_CANAGG_MAX_ROWS;
+
+    for (uint32_t i = 0; i < n; i++) {
+        lv_obj_t *row = lv_label_create(s_cont);
+        lv_label_set_long_mode(row, LV_LABEL_LONG_CLIP);
+        lv_label_set_recolor(row, true);
+        lv_obj_set_width(row, lv_pct(100));
+        lv_obj_set_height(row, s_line_h);
+        lv_obj_set_y(row, (lv_coord_t)(i * s_line_h));
+        lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+        s_row_txt[i][0] = '\0';
+        lv_label_set_text_static(row, s_row_txt[i]);
+
+        s_rows[i] = row;
+        s_row_idx[i] = ROW_UNBOUND;
+    }
+    s_nrows = n;
+}
+
+void ui_canagg_refresh(void)
+{
+    if (!s_cont || lv_obj_has_flag(s_cont, LV_OBJ_FLAG_HIDDEN)) return;
+
+    if (s_nrows == 0) rows_build();
+
+    /* Entry indices were reset: start over from the first ID */
+    uint32_t gen = can_agg_generation();
+    if (gen != s_generation) {
+        s_generation = gen;
+        s_top = 0;
+        for (uint32_t r = 0; r < s_nrows; r++) {
+            if (s_row_idx[r] != ROW_UNBOUND) {
+                lv_obj_add_flag(s_rows[r], LV_OBJ_FLAG_HIDDEN);
+                s_row_idx[r] = ROW_UNBOUND;
+            }
+        }
+    }
+
+    const uint32_t count = (uint32_t)can_agg_count();
+
+    if (count > 0 && s_placeholder) {
+        lv_obj_del(s_placeholder);
+        s_placeholder = NULL;
+    }
+
+    for (uint32_t r = 0; r < s_nrows; r++) {
+        const uint32_t idx = s_top + r;
+        lv_obj_t *row = s_rows[r];
+
+        if (idx >= count) {
+            if (s_row_idx[r] != ROW_UNBOUND) {
+                lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+                s_row_idx[r] = ROW_UNBOUND;
+            }
+            continue;
+        }
+
+        /* A rebound row needs the entry even if it is clean */
+        const bool rebind = (s_row_idx[r] != idx);
+        can_agg_entry_t e;
+        if (!can_agg_take(idx, &e, rebind)) continue;
+
+        if (s_row_idx[r] == ROW_UNBOUND) lv_obj_clear_flag(row, LV_OBJ_FLAG_HIDDEN);
+        format_row(s_row_txt[r], sizeof(s_row_txt[r]), &e);
+        lv_label_set_text_static(row, s_row_txt[r]);
+        s_row_idx[r] = idx;
+    }
+}
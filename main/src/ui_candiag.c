@@ -0,0 +1,151 @@
+// main/src/ui_candiag.c
+//
+// Latency diagnostics view for LVGL.
+//
+// The table is re-texted from can_lat snapshots; the chart shows the selected
+// stage's buckets 10..29 (~1 us .. ~1 s). Both are refreshed on a timer
+// rather than every UI tick, and never while hidden.
+
+#include "ui_candiag.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "can_lat.h"
+
+#ifndef UI_CANDIAG_REFRESH_MS
+#define UI_CANDIAG_REFRESH_MS  500
+#endif
+
+#ifndef UI_CANDIAG_BAR_HEX
+#define UI_CANDIAG_BAR_HEX     0x3B82F6
+#endif
+
+#define CHART_FIRST   10     /* bucket of the first bar */
+#define CHART_BARS    20
+
+#define COL_COUNT     7
+
+/* ---------------- State ---------------- */
+
+static lv_obj_t          *s_cont  = NULL;
+static lv_obj_t          *s_table = NULL;
+static lv_obj_t          *s_chart = NULL;
+static lv_obj_t          *s_lbl_chart = NULL;
+static lv_chart_series_t *s_ser   = NULL;
+
+static can_lat_stage_t s_sel = CAN_LAT_E2E;
+static int64_t         s_next_us = 0;
+
+/* ---------------- Events ---------------- */
+
+static void table_click_cb(lv_event_t *e)
+{
+    (void)e;
+    uint16_t row, col;
+    lv_table_get_selected_cell(s_table, &row, &col);
+    if (row == LV_TABLE_CELL_NONE || row == 0 || row > CAN_LAT_STAGE_COUNT) return;
+
+    s_sel = (can_lat_stage_t)(row - 1);
+    s_next_us = 0;
+}
+
+static void table_reset_cb(lv_event_t *e)
+{
+    (void)e;
+    can_lat_reset();
+    s_next_us = 0;
+}
+
+/* ---------------- Public API ---------------- */
+
+lv_obj_t *ui_candiag_create(lv_obj_t *parent)
+{
+    if (s_cont) return s_cont;
+
+    s_cont = lv_obj_create(parent);
+    lv_obj_set_flex_flow(s_cont, LV_FLEX_FLOW_COLUMN);
+    lv_obj_set_style_pad_row(s_cont, 8, 0);
+
+    static const char *const k_hdr[COL_COUNT] = { "stage", "count", "mean", "p50", "p99", "p99.9", "max" };
+
+    s_table = lv_table_create(s_cont);
+    lv_table_set_col_cnt(s_table, COL_COUNT);
+    lv_table_set_row_cnt(s_table, CAN_LAT_STAGE_COUNT + 1);
+    lv_obj_set_width(s_table, lv_pct(100));
+    lv_obj_set_style_bg_opa(s_table, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_bg_opa(s_table, LV_OPA_TRANSP, LV_PART_ITEMS);
+    lv_obj_set_style_border_width(s_table, 0, 0);
+    lv_obj_set_style_pad_ver(s_table, 2, LV_PART_ITEMS);
+    for (uint16_t c = 0; c < COL_COUNT; c++) {
+        lv_table_set_col_width(s_table, c, c == 0 ? 90 : 78);
+        lv_table_set_cell_value(s_table, 0, c, k_hdr[c]);
+    }
+    for (uint16_t s = 0; s < CAN_LAT_STAGE_COUNT; s++) {
+        lv_table_set_cell_value(s_table, s + 1, 0, can_lat_stage_name((can_lat_stage_t)s));
+    }
+    lv_obj_add_event_cb(s_table, table_click_cb, LV_EVENT_VALUE_CHANGED, NULL);
+    lv_obj_add_event_cb(s_table, table_reset_cb, LV_EVENT_LONG_PRESSED, NULL);
+
+    s_lbl_chart = lv_label_create(s_cont);
+    lv_obj_set_style_text_opa(s_lbl_chart, LV_OPA_70, 0);
+
+    s_chart = lv_chart_create(s_cont);
+    lv_chart_set_type(s_chart, LV_CHART_TYPE_BAR);
+    lv_chart_set_point_count(s_chart, CHART_BARS);
+    lv_chart_set_div_line_count(s_chart, 0, 0);
+    lv_chart_set_range(s_chart, LV_CHART_AXIS_PRIMARY_Y, 0, 1000);
+    lv_obj_set_width(s_chart, lv_pct(100));
+    lv_obj_set_flex_grow(s_chart, 1);
+    lv_obj_set_style_bg_opa(s_chart, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_border_width(s_chart, 0, 0);
+    lv_obj_set_style_pad_column(s_chart, 2, 0);
+    s_ser = lv_chart_add_series(s_chart, lv_color_hex(UI_CANDIAG_BAR_HEX), LV_CHART_AXIS_PRIMARY_Y);
+
+    return s_cont;
+}
+
+void ui_candiag_refresh(void)
+{
+    if (!s_cont || lv_obj_has_flag(s_cont, LV_OBJ_FLAG_HIDDEN)) return;
+
+    int64_t now = esp_timer_get_time();
+    if (now < s_next_us) return;
+    s_next_us = now + (int64_t)UI_CANDIAG_REFRESH_MS * 1000;
+
+    char buf[16];
+    can_lat_hist_t sel = { 0 };
+
+    for (uint16_t s = 0; s < CAN_LAT_STAGE_COUNT; s++) {
+        can_lat_hist_t h;
+        can_lat_get((can_lat_stage_t)s, &h);
+        if (s == s_sel) sel = h;
+
+        const uint16_t row = s + 1;
+        snprintf(buf, sizeof(buf), "%u", (unsigned)h.count);
+        lv_table_set_cell_value(s_table, row, 1, buf);
+        can_lat_fmt_ns(buf, sizeof(buf), h.count ? (uint32_t)(h.sum_ns / h.count) : 0);
+        lv_table_set_cell_value(s_table, row, 2, buf);
+        can_lat_fmt_ns(buf, sizeof(buf), can_lat_pct_ns(&h, 500));
+        lv_table_set_cell_value(s_table, row, 3, buf);
+        can_lat_fmt_ns(buf, sizeof(buf), can_lat_pct_ns(&h, 990));
+        lv_table_set_cell_value(s_table, row, 4, buf);
+        can_lat_fmt_ns(buf, sizeof(buf), can_lat_pct_ns(&h, 999));
+        lv_table_set_cell_value(s_table, row, 5, buf);
+        can_lat_fmt_ns(buf, sizeof(buf), h.max_ns);
+        lv_table_set_cell_value(s_table, row, 6, buf);
+    }
+
+    /* Bars in per mille of the selected stage's samples */
+    for (uint32_t i = 0; i < CHART_BARS; i++) {
+        uint32_t c = sel.bucket[CHART_FIRST + i];
+        lv_coord_t v = sel.count ? (lv_coord_t)((uint64_t)c * 1000 / sel.count) : 0;
+        lv_chart_set_value_by_id(s_chart, s_ser, i, v);
+    }
+    lv_chart_refresh(s_chart);
+
+    lv_label_set_text_fmt(s_lbl_chart, "%s: 1 us .. 1 s, log2 buckets (tap a row to switch, hold to reset)",
+                          can_lat_stage_name(s_sel));
+}
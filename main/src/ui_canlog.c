@@ -0,0 +1,243 @@
+// main/src/ui_canlog.c
+//
+// Virtualized, fixed-row CAN log for LVGL.
+//
+// A history ring holds the last N lines, already formatted by the decode
+// stage (can_pipe). The view owns only as many label objects as fit on
+// screen; row objects are bound to history slots by (index % rows), so
+// appending k lines re-texts at most k rows and just moves the rest. Dragging
+// scrolls through history by rebinding the same rows.
+
+#include "ui_canlog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#ifndef TAG
+#define TAG "ui_canlog"
+#endif
+
+#ifndef UI_CANLOG_MAX_ROWS
+#define UI_CANLOG_MAX_ROWS   48
+#endif
+
+#define ROW_UNBOUND  UINT32_MAX
+
+/* ---------------- State ---------------- */
+
+static lv_obj_t  *s_cont = NULL;
+static lv_obj_t  *s_placeholder = NULL;
+static lv_obj_t  *s_rows[UI_CANLOG_MAX_ROWS];
+static char       s_row_txt[UI_CANLOG_MAX_ROWS][CAN_FMT_LINE_MAX];
+static uint32_t   s_row_idx[UI_CANLOG_MAX_ROWS];   /* history index shown, ROW_UNBOUND if hidden */
+static lv_coord_t s_row_y[UI_CANLOG_MAX_ROWS];
+static uint32_t   s_nrows = 0;
+static lv_coord_t s_line_h = 16;
+
+typedef char line_t[CAN_FMT_LINE_MAX];
+
+static line_t    *s_hist = NULL;
+static uint32_t   s_hist_mask = 0;
+static uint32_t   s_hist_head = 0;      /* events pushed so far (free-running) */
+static uint32_t   s_scroll_back = 0;    /* lines above the newest; 0 = follow tail */
+static lv_coord_t s_drag_px = 0;
+static bool       s_dirty = false;
+
+/* ---------------- Scrolling ---------------- */
+
+static uint32_t hist_retained(void)
+{
+    return (s_hist_head > s_hist_mask + 1) ? s_hist_mask + 1 : s_hist_head;
+}
+
+static uint32_t max_scroll_back(void)
+{
+    uint32_t kept = hist_retained();
+    return (kept > s_nrows) ? kept - s_nrows : 0;
+}
+
+/* Drag with a finger: moving down reveals older lines */
+static void log_drag_cb(lv_event_t *e)
+{
+    lv_event_code_t code = lv_event_get_code(e);
+
+    if (code == LV_EVENT_RELEASED) {
+        s_drag_px = 0;
+        return;
+    }
+
+    lv_indev_t *indev = lv_indev_get_act();
+    if (!indev) return;
+
+    lv_point_t v;
+    lv_indev_get_vect(indev, &v);
+    s_drag_px += v.y;
+
+    int lines = s_drag_px / s_line_h;
+    if (lines == 0) return;
+    s_drag_px -= (lv_coord_t)(lines * s_line_h);
+
+    int64_t sb = (int64_t)s_scroll_back + lines;
+    if (sb < 0) sb = 0;
+    if (sb > max_scroll_back()) sb = max_scroll_back();
+    s_scroll_back = (uint32_t)sb;
+    s_dirty = true;
+}
+
+/* ---------------- Public API ---------------- */
+
+lv_obj_t *ui_canlog_create(lv_obj_t *parent, size_t history_len)
+{
+    if (s_cont) return s_cont;
+
+    uint32_t cap = 2;
+    while (cap < history_len && cap < (1u << 20)) cap <<= 1;
+
+    s_hist = heap_caps_malloc(cap * sizeof(line_t), MALLOC_CAP_SPIRAM);
+    if (!s_hist) s_hist = heap_caps_malloc(cap * sizeof(line_t), MALLOC_CAP_DEFAULT);
+    if (!s_hist) {
+        ESP_LOGE(TAG, "No memory for %u history lines", (unsigned)cap);
+        return NULL;
+    }
+    s_hist_mask = cap - 1;
+    s_hist_head = 0;
+    s_scroll_back = 0;
+
+    s_cont = lv_obj_create(parent);
+    lv_obj_clear_flag(s_cont, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_flag(s_cont, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(s_cont, log_drag_cb, LV_EVENT_PRESSING, NULL);
+    lv_obj_add_event_cb(s_cont, log_drag_cb, LV_EVENT_RELEASED, NULL);
+
+    s_placeholder = lv_label_create(s_cont);
+    lv_label_set_text(s_placeholder, "CAN frames will appear here...");
+    lv_obj_set_style_text_opa(s_placeholder, LV_OPA_50, 0);
+
+    return s_cont;
+}
+
+/* Create the row labels once the container has its final size */
+static void rows_build(void)
+{
+    lv_obj_update_layout(s_cont);
+
+    const lv_font_t *font = lv_obj_get_style_text_font(s_cont, LV_PART_MAIN);
+    s_line_h = lv_font_get_line_height(font);
+    if (s_line_h <= 0) s_line_h = 16;
+
+    uint32_t n = (uint32_t)(lv_obj_get_content_height(s_cont) / s_line_h);
+    if (n < 1) n = 1;
+    if (n > UI_CANLOG_MAX_ROWS) n = UI_CANLOG_MAX_ROWS;
+
+    for (uint32_t i = 0; i < n; i++) {
+        lv_obj_t *row = lv_label_create(s_cont);
+        lv_label_set_long_mode(row, LV_LABEL_LONG_CLIP);
+        lv_obj_set_width(row, lv_pct(100));
+        lv_obj_set_height(row, s_line_h);
+        lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+        s_row_txt[i][0] = '\0';
+        lv_label_set_text_static(row, s_row_txt[i]);
+
+        s_rows[i] = row;
+        s_row_idx[i] = ROW_UNBOUND;
+        s_row_y[i] = -1;
+    }
+    s_nrows = n;
+}
+
+void ui_canlog_push(const can_pipe_row_t *rows, size_t n)
+{
+    if (!s_hist || !rows || n == 0) return;
+
+    /* Lines older than the whole history would be overwritten in this call */
+    if (n > s_hist_mask + 1) {
+        s_hist_head += (uint32_t)(n - (s_hist_mask + 1));
+        rows += n - (s_hist_mask + 1);
+        n = s_hist_mask + 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        memcpy(s_hist[s_hist_head & s_hist_mask], rows[i].txt, CAN_FMT_LINE_MAX);
+        s_hist_head++;
+    }
+
+    /* Keep a scrolled-back view anchored on the same lines */
+    if (s_scroll_back > 0) {
+        uint32_t sb = s_scroll_back + (uint32_t)n;
+        s_scroll_back = (sb < max_scroll_back()) ? sb : max_scroll_back();
+    }
+    s_dirty = true;
+}
+
+void ui_canlog_push_gap(uint32_t n)
+{
+    if (!s_hist || n == 0) return;
+
+    can_pipe_row_t row = { 0 };
+    snprintf(row.txt, sizeof(row.txt), "... +%u frames ...", (unsigned)n);
+    ui_canlog_push(&row, 1);
+}
+
+size_t ui_canlog_visible_rows(void)
+{
+    return s_nrows ? s_nrows : UI_CANLOG_MAX_ROWS;
+}
+
+void ui_canlog_refresh(void)
+{
+    if (!s_cont || !s_dirty) return;
+    s_dirty = false;
+
+    if (s_nrows == 0) rows_build();
+
+    if (s_hist_head > 0 && s_placeholder) {
+        lv_obj_del(s_placeholder);
+        s_placeholder = NULL;
+    }
+
+    const uint32_t kept   = hist_retained();
+    const uint32_t oldest = s_hist_head - kept;
+    const uint32_t bottom = s_hist_head - s_scroll_back;
+    const uint32_t top    = (bottom - oldest > s_nrows) ? bottom - s_nrows : oldest;
+
+    for (uint32_t idx = top; idx < top + s_nrows; idx++) {
+        const uint32_t r = idx % s_nrows;
+        lv_obj_t *row = s_rows[r];
+
+        if (idx >= bottom) {
+            if (s_row_idx[r] != ROW_UNBOUND) {
+                lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+                s_row_idx[r] = ROW_UNBOUND;
+            }
+            continue;
+        }
+
+        if (s_row_idx[r] != idx) {
+            if (s_row_idx[r] == ROW_UNBOUND) lv_obj_clear_flag(row, LV_OBJ_FLAG_HIDDEN);
+            memcpy(s_row_txt[r], s_hist[idx & s_hist_mask], CAN_FMT_LINE_MAX);
+            lv_label_set_text_static(row, s_row_txt[r]);
+            s_row_idx[r] = idx;
+        }
+
+        lv_coord_t y = (lv_coord_t)((idx - top) * s_line_h);
+        if (s_row_y[r] != y) {
+            lv_obj_set_y(row, y);
+            s_row_y[r] = y;
+        }
+    }
+}
+
+void ui_canlog_clear(void)
+{
+    s_hist_head = 0;
+    s_scroll_back = 0;
+    for (uint32_t i = 0; i < s_nrows; i++) {
+        if (s_row_idx[i] != ROW_UNBOUND) {
+            lv_obj_add_flag(s_rows[i], LV_OBJ_FLAG_HIDDEN);
+            s_row_idx[i] = ROW_UNBOUND;
+        }
+    }
+    s_dirty = true;
+}
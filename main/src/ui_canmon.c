@@ -1,21 +1,40 @@
 // main/src/ui_canmon.c
 //
 // Dark theme CAN monitor UI for LVGL:
-// - Left: title + counters + scrolling log
-// - Right: quick TX buttons (configurable table)
+// - Left: title + counters + virtualized log (ui_canlog), per-ID view (ui_canagg)
+//   latency diagnostics (ui_candiag) or tasks/heap (ui_sysdiag)
+// - Right: quick TX buttons (configurable table) and the traffic generator
 //
-// This module does not start/stop CAN. It only renders events from a queue and
-// calls can_mon_send_frame() when a button is pressed.
+// This module does not start/stop CAN. It only renders rows the decode stage
+// (can_pipe) has already formatted, and queues a frame on can_tx when a
+// button is pressed. Nothing is decoded or formatted under the LVGL lock.
+//
+// With no traffic the tick parks at UI_IDLE_PERIOD_MS; the decode stage wakes
+// it through lvgl_port_wake_timer() as soon as rows are ready.
 
 #include "ui_canmon.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/twai.h"
 
 #include "can_mon.h"
+#include "can_pipe.h"
+#include "can_tx.h"
+#include "can_sup.h"
+#include "can_load.h"
+#include "can_gen.h"
+#include "can_lat.h"
+#include "lvgl_port.h"
+#include "ui_canlog.h"
+#include "ui_canagg.h"
+#include "ui_candiag.h"
+#include "ui_sysdiag.h"
 
 #ifndef TAG
 #define TAG "ui_canmon"
@@ -45,6 +64,18 @@
 #define UI_BTN_PR_HEX    0x374151  /* button pressed background */
 #endif
 
+#ifndef UI_LOG_HISTORY
+#define UI_LOG_HISTORY   1024      /* lines kept for scrollback */
+#endif
+
+#ifndef UI_TICK_BUDGET_PCT
+#define UI_TICK_BUDGET_PCT  25     /* share of the frame interval a tick may use */
+#endif
+
+#ifndef UI_IDLE_PERIOD_MS
+#define UI_IDLE_PERIOD_MS   250    /* tick period with no rows; keeps the counters moving */
+#endif
+
 #ifndef UI_RADIUS
 #define UI_RADIUS        14
 #endif
@@ -94,13 +125,24 @@ static const size_t s_button_count = sizeof(s_buttons) / sizeof(s_buttons[0]);
 
 /* ---------------- UI state ---------------- */
 
-static QueueHandle_t s_evt_q = NULL;
-
 static lv_obj_t *s_lbl_title = NULL;
 static lv_obj_t *s_lbl_stats = NULL;
-static lv_obj_t *s_ta_log    = NULL;
-
-static int s_drain_per_tick = 16;
+static lv_obj_t *s_lbl_load  = NULL;
+static lv_obj_t *s_log       = NULL;
+static lv_obj_t *s_fixed     = NULL;   /* per-ID view, shares the log's place */
+static lv_obj_t *s_diag      = NULL;   /* latency view, same place */
+static lv_obj_t *s_sys       = NULL;   /* tasks/heap view, same place */
+static lv_obj_t *s_lbl_view  = NULL;
+static lv_obj_t *s_lbl_gen   = NULL;
+
+static lv_timer_t *s_timer = NULL;
+static uint32_t s_period_ms = 33;      /* current tick period */
+static uint32_t s_period_min_ms = 33;  /* 1 / target fps */
+static uint32_t s_period_max_ms = 200; /* 1 / min fps */
+static uint32_t s_tick_us_avg = 0;     /* ui_tick_cb() cost, EMA in microseconds */
+static uint32_t s_pipe_drops = 0;      /* can_pipe drops already folded into a gap line */
+static bool     s_parked = false;      /* tick is at UI_IDLE_PERIOD_MS (LVGL side) */
+static atomic_bool s_idle;             /* parked and waiting for a decode-stage wakeup */
 
 /* A couple of reusable styles */
 static lv_style_t s_st_scr;
@@ -164,87 +206,255 @@ static void init_styles_once(void)
     lv_style_set_bg_opa(&s_st_btn_pr, LV_OPA_COVER);
 }
 
-/* ---------------- Formatting helpers ---------------- */
+/* ---------------- Rendering ---------------- */
 
-/* Format one CAN event into a single short line suitable for a log view */
-static void format_can_line(char *out, size_t out_sz, const can_evt_t *e)
+/* Refresh the stats labels; each is skipped when unchanged to avoid a relayout */
+static void ui_update_stats(void)
 {
-    const twai_message_t *m = &e->msg;
+    static char last[128];
+    char stats[128];
 
-    int p = 0;
-    p += snprintf(out + p, out_sz - p, "%s ", e->is_tx ? "TX" : "RX");
+    uint32_t batch_x10 = can_mon_get_avg_batch_x10();
+    uint32_t tick_x10  = s_tick_us_avg / 100;
+    snprintf(stats, sizeof(stats),
+             "RX: %" PRIu32 "  TX: %" PRIu32 "  DROP: %" PRIu32 "  LOST: %" PRIu32
+             "  BATCH: %" PRIu32 ".%" PRIu32 "  TICK: %" PRIu32 ".%" PRIu32 " ms  UI: %" PRIu32 " fps",
+             can_mon_get_rx_cnt(),
+             can_mon_get_tx_cnt(),
+             can_mon_get_drop_cnt(),
+             can_sup_get_lost_cnt(),
+             batch_x10 / 10, batch_x10 % 10,
+             tick_x10 / 10, tick_x10 % 10,
+             1000 / (s_parked ? UI_IDLE_PERIOD_MS : s_period_ms));
+
+    if (strcmp(stats, last) != 0) {
+        strcpy(last, stats);
+        lv_label_set_text(s_lbl_stats, stats);
+    }
 
-    if (m->flags & TWAI_MSG_FLAG_EXTD) {
-        p += snprintf(out + p, out_sz - p, "ID=%08" PRIX32 " ", (uint32_t)m->identifier);
-    } else {
-        p += snprintf(out + p, out_sz - p, "ID=%03" PRIX32 " ", (uint32_t)m->identifier);
+    static char last_load[128];
+    can_load_stats_t ls;
+    can_load_get(&ls, esp_timer_get_time());
+    snprintf(stats, sizeof(stats),
+             "LOAD: %u.%u / %u.%u / %u.%u %%  PEAK: %u.%u %%  FPS: %" PRIu32,
+             ls.load_100ms_x10 / 10, ls.load_100ms_x10 % 10,
+             ls.load_1s_x10 / 10, ls.load_1s_x10 % 10,
+             ls.load_10s_x10 / 10, ls.load_10s_x10 % 10,
+             ls.peak_load_x10 / 10, ls.peak_load_x10 % 10,
+             ls.fps_1s);
+
+    can_gen_stats_t gs;
+    can_gen_get_stats(&gs);
+    if (gs.running) {
+        size_t len = strlen(stats);
+        snprintf(stats + len, sizeof(stats) - len, "  GEN: %" PRIu32 "/%" PRIu32,
+                 gs.achieved_fps, gs.target_fps);
+    }
+    if (s_lbl_gen) {
+        const char *txt = gs.running ? "Stop" : "Gen";
+        if (strcmp(lv_label_get_text(s_lbl_gen), txt) != 0) lv_label_set_text(s_lbl_gen, txt);
     }
 
-    p += snprintf(out + p, out_sz - p, "DLC=%u ", (unsigned)m->data_length_code);
+    if (strcmp(stats, last_load) == 0) return;
+    strcpy(last_load, stats);
+    lv_label_set_text(s_lbl_load, stats);
+}
 
-    if (m->flags & TWAI_MSG_FLAG_RTR) {
-        p += snprintf(out + p, out_sz - p, "RTR");
-        return;
+/* Take everything the decode stage has ready: the newest screenful goes to
+ * the log, anything older (and rows can_pipe had to drop) becomes one gap line.
+ * Returns the rows accounted for, shown or not. */
+static size_t take_rows(void)
+{
+    uint32_t drops = can_pipe_get_drop_cnt();
+    uint32_t gap = drops - s_pipe_drops;
+    s_pipe_drops = drops;
+
+    size_t pending = can_pipe_pending();
+    const size_t taken = pending + gap;
+    const can_pipe_row_t *rows;
+
+    /* Latency counts from the oldest arrival, shown or not */
+    if (pending > 0 && can_pipe_peek(&rows, 1) > 0) can_lat_e2e_mark(rows[0].t_us);
+
+    /* Keep the gap line itself on screen, above the rows it precedes */
+    const size_t vis = ui_canlog_visible_rows();
+    if (pending + (gap > 0) > vis) {
+        size_t keep = vis > 1 ? vis - 1 : 1;
+        can_pipe_release(pending - keep);
+        gap += (uint32_t)(pending - keep);
+        pending = keep;
+    }
+    ui_canlog_push_gap(gap);
+
+    while (pending > 0) {
+        size_t n = can_pipe_peek(&rows, pending);
+        if (n == 0) break;
+        ui_canlog_push(rows, n);
+        can_pipe_release(n);
+        pending -= n;
     }
+    return taken;
+}
 
-    p += snprintf(out + p, out_sz - p, "DATA=");
-    for (int i = 0; i < m->data_length_code && i < 8; i++) {
-        p += snprintf(out + p, out_sz - p, "%02X%s",
-                      (unsigned)m->data[i], (i == m->data_length_code - 1) ? "" : " ");
+/* Stretch the period while ticks are expensive, snap back when they are not.
+ * Moves only on a 10 % change so the rate does not flutter. */
+static void adapt_rate(void)
+{
+    uint32_t want = s_tick_us_avg / (10 * UI_TICK_BUDGET_PCT);   /* us * 100 / pct / 1000 */
+    if (want < s_period_min_ms) want = s_period_min_ms;
+    if (want > s_period_max_ms) want = s_period_max_ms;
+
+    if (want * 10 > s_period_ms * 11 || want * 11 < s_period_ms * 10 ||
+        (want == s_period_min_ms && s_period_ms != want)) {
+        s_period_ms = want;
+        lv_timer_set_period(s_timer, want);
     }
 }
 
-/* Push line into LVGL text area and update the stats label */
-static void ui_push_event(const can_evt_t *e)
+/* Nothing arrived this tick: slow the tick down until the decode stage wakes it */
+static void park(void)
 {
-    if (!s_ta_log || !s_lbl_stats) return;
+    if (s_parked) return;
 
-    char line[180];
-    format_can_line(line, sizeof(line), e);
+    atomic_store(&s_idle, true);
+    /* Rows published before the flag was up raised no wakeup */
+    if (can_pipe_pending() > 0) {
+        atomic_store(&s_idle, false);
+        return;
+    }
+    s_parked = true;
+    lv_timer_set_period(s_timer, UI_IDLE_PERIOD_MS);
+}
 
-    lv_textarea_add_text(s_ta_log, line);
-    lv_textarea_add_text(s_ta_log, "\n");
-    lv_textarea_set_cursor_pos(s_ta_log, LV_TEXTAREA_CURSOR_LAST);
+static void unpark(void)
+{
+    if (!s_parked) return;
 
-    char stats[96];
-    snprintf(stats, sizeof(stats),
-             "RX: %" PRIu32 "   TX: %" PRIu32 "   DROP: %" PRIu32,
-             can_mon_get_rx_cnt(),
-             can_mon_get_tx_cnt(),
-             can_mon_get_drop_cnt());
+    s_parked = false;
+    atomic_store(&s_idle, false);
+    lv_timer_set_period(s_timer, s_period_ms);
+}
 
-    lv_label_set_text(s_lbl_stats, stats);
+/* Decode stage, after publishing rows: no LVGL calls here */
+static void rows_ready_cb(void *ctx)
+{
+    (void)ctx;
+    if (atomic_exchange(&s_idle, false)) lvgl_port_wake_timer(s_timer);
 }
 
-/* LVGL timer callback: drain events from queue and render them */
+/* LVGL timer callback: render what the decode stage formatted since last time */
 static void ui_tick_cb(lv_timer_t *t)
 {
     (void)t;
 
-    if (!s_evt_q) return;
+    if (!s_log || !s_lbl_stats || !s_lbl_load) return;
+
+    int64_t t0 = esp_timer_get_time();
+
+    const size_t taken = take_rows();
+
+    /* Only the visible view pays for redrawing */
+    if (s_fixed && !lv_obj_has_flag(s_fixed, LV_OBJ_FLAG_HIDDEN))     ui_canagg_refresh();
+    else if (s_diag && !lv_obj_has_flag(s_diag, LV_OBJ_FLAG_HIDDEN))  ui_candiag_refresh();
+    else if (s_sys && !lv_obj_has_flag(s_sys, LV_OBJ_FLAG_HIDDEN))    ui_sysdiag_refresh();
+    else                                                              ui_canlog_refresh();
+    ui_update_stats();
+
+    /* Exponential moving average of tick cost, 1/8 weight */
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+    can_lat_record_us(CAN_LAT_TICK, dt);
+    s_tick_us_avg = s_tick_us_avg - (s_tick_us_avg >> 3) + (dt >> 3);
 
-    for (int i = 0; i < s_drain_per_tick; i++) {
-        can_evt_t e;
-        if (xQueueReceive(s_evt_q, &e, 0) != pdTRUE) break;
-        ui_push_event(&e);
+    if (taken == 0) {
+        park();
+        return;
     }
+    unpark();
+    adapt_rate();
+
+    /* Draw what this tick changed now rather than on the refresh timer's own phase */
+    lv_timer_t *refr = _lv_disp_get_refr_timer(NULL);
+    if (refr) lv_timer_ready(refr);
 }
 
 /* ---------------- Button callback ---------------- */
 
-/* Send the configured frame, and log it through can_mon */
+/* Runs on the TX worker: no LVGL calls here */
+static void btn_tx_done_cb(can_tx_handle_t h, const twai_message_t *m, esp_err_t err, void *ctx)
+{
+    (void)h;
+    (void)m;
+    const can_btn_cfg_t *cfg = (const can_btn_cfg_t *)ctx;
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Button TX failed (%s): %s", cfg->label, esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "Button TX OK: %s", cfg->label);
+}
+
+/* Queue the configured frame; can_tx logs it through can_mon once sent */
 static void btn_send_cb(lv_event_t *e)
 {
     const can_btn_cfg_t *cfg = (const can_btn_cfg_t *)lv_event_get_user_data(e);
     if (!cfg) return;
 
-    esp_err_t err = can_mon_send_frame(&cfg->frame);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Button TX failed (%s): %s", cfg->label, esp_err_to_name(err));
+    /* Never blocks the LVGL task; the result arrives on the TX worker */
+    if (!can_tx_submit(&cfg->frame, CAN_TX_PRIO_NORMAL, btn_tx_done_cb, (void *)cfg)) {
+        ESP_LOGW(TAG, "Button TX dropped (%s): queue full", cfg->label);
+    }
+}
+
+/* Start/stop the generator with the Kconfig preset; the label follows the
+ * run state in ui_update_stats() */
+static void btn_gen_cb(lv_event_t *e)
+{
+    (void)e;
+    if (can_gen_is_running()) {
+        can_gen_stop();
         return;
     }
 
-    ESP_LOGI(TAG, "Button TX OK: %s", cfg->label);
+    can_gen_cfg_t cfg = CAN_GEN_CFG_DEFAULT();
+    cfg.id_mode  = CAN_GEN_ID_SEQ;
+    cfg.id_lo    = 0x100;
+    cfg.id_hi    = 0x1FF;
+    cfg.load_pct = CONFIG_CAN_GEN_UI_LOAD_PCT;
+
+    esp_err_t err = can_gen_start(&cfg);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Generator not started: %s", esp_err_to_name(err));
+}
+
+/* Tap the load line to clear the peak-hold */
+static void lbl_load_cb(lv_event_t *e)
+{
+    (void)e;
+    can_load_reset_peak();
+}
+
+/* Cycle trace -> per-ID -> latency -> system; the button names the next view */
+static void btn_view_cb(lv_event_t *e)
+{
+    (void)e;
+    if (!s_log || !s_fixed || !s_diag || !s_sys) return;
+
+    if (!lv_obj_has_flag(s_log, LV_OBJ_FLAG_HIDDEN)) {
+        lv_obj_add_flag(s_log, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(s_fixed, LV_OBJ_FLAG_HIDDEN);
+        lv_label_set_text(s_lbl_view, "Diag");
+    } else if (!lv_obj_has_flag(s_fixed, LV_OBJ_FLAG_HIDDEN)) {
+        lv_obj_add_flag(s_fixed, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(s_diag, LV_OBJ_FLAG_HIDDEN);
+        lv_label_set_text(s_lbl_view, "Sys");
+    } else if (!lv_obj_has_flag(s_diag, LV_OBJ_FLAG_HIDDEN)) {
+        lv_obj_add_flag(s_diag, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(s_sys, LV_OBJ_FLAG_HIDDEN);
+        lv_label_set_text(s_lbl_view, "Trace");
+    } else {
+        lv_obj_add_flag(s_sys, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(s_log, LV_OBJ_FLAG_HIDDEN);
+        lv_label_set_text(s_lbl_view, "Fixed");
+    }
 }
 
 /* ---------------- UI build ---------------- */
@@ -284,19 +494,56 @@ static void ui_build_split(const ui_canmon_cfg_t *cfg)
 
     s_lbl_stats = lv_label_create(left);
     lv_obj_add_style(s_lbl_stats, &s_st_muted, 0);
-    lv_label_set_text(s_lbl_stats, "RX: 0   TX: 0   DROP: 0");
+
+    /* Bus load over 100 ms / 1 s / 10 s */
+    s_lbl_load = lv_label_create(left);
+    lv_obj_add_style(s_lbl_load, &s_st_muted, 0);
+
+    /* First text from the same formatter the tick uses, so no field pops in later */
+    ui_update_stats();
     lv_obj_align_to(s_lbl_stats, s_lbl_title, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 8);
+    lv_obj_align_to(s_lbl_load, s_lbl_stats, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 4);
+    lv_obj_add_flag(s_lbl_load, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(s_lbl_load, lbl_load_cb, LV_EVENT_CLICKED, NULL);
+
+    s_log = ui_canlog_create(left, UI_LOG_HISTORY);
+    if (s_log) {
+        lv_obj_add_style(s_log, &s_st_log, 0);
+        lv_obj_set_width(s_log, lv_pct(100));
+        lv_obj_set_height(s_log, lv_pct(78));
+        lv_obj_align(s_log, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+    }
 
-    s_ta_log = lv_textarea_create(left);
-    lv_obj_add_style(s_ta_log, &s_st_log, 0);
-    lv_obj_set_width(s_ta_log, lv_pct(100));
-    lv_obj_set_height(s_ta_log, lv_pct(82));
-    lv_obj_align(s_ta_log, LV_ALIGN_BOTTOM_LEFT, 0, 0);
-    lv_textarea_set_text(s_ta_log, "");
-    lv_textarea_set_placeholder_text(s_ta_log, "CAN frames will appear here...");
-    lv_textarea_set_cursor_click_pos(s_ta_log, false);
-    lv_textarea_set_one_line(s_ta_log, false);
-    lv_textarea_set_max_length(s_ta_log, 8192);
+    s_fixed = ui_canagg_create(left);
+    lv_obj_add_style(s_fixed, &s_st_log, 0);
+    lv_obj_set_width(s_fixed, lv_pct(100));
+    lv_obj_set_height(s_fixed, lv_pct(78));
+    lv_obj_align(s_fixed, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+    lv_obj_add_flag(s_fixed, LV_OBJ_FLAG_HIDDEN);
+
+    s_diag = ui_candiag_create(left);
+    lv_obj_add_style(s_diag, &s_st_log, 0);
+    lv_obj_set_width(s_diag, lv_pct(100));
+    lv_obj_set_height(s_diag, lv_pct(78));
+    lv_obj_align(s_diag, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+    lv_obj_add_flag(s_diag, LV_OBJ_FLAG_HIDDEN);
+
+    s_sys = ui_sysdiag_create(left);
+    lv_obj_add_style(s_sys, &s_st_log, 0);
+    lv_obj_set_width(s_sys, lv_pct(100));
+    lv_obj_set_height(s_sys, lv_pct(78));
+    lv_obj_align(s_sys, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+    lv_obj_add_flag(s_sys, LV_OBJ_FLAG_HIDDEN);
+
+    lv_obj_t *vb = lv_btn_create(left);
+    lv_obj_add_style(vb, &s_st_btn, 0);
+    lv_obj_add_style(vb, &s_st_btn_pr, LV_STATE_PRESSED);
+    lv_obj_align(vb, LV_ALIGN_TOP_RIGHT, 0, 0);
+    lv_obj_add_event_cb(vb, btn_view_cb, LV_EVENT_CLICKED, NULL);
+
+    s_lbl_view = lv_label_create(vb);
+    lv_label_set_text(s_lbl_view, "Fixed");
+    lv_obj_center(s_lbl_view);
 
     /* Right (buttons) panel */
     lv_obj_t *right = panel_create(row);
@@ -307,10 +554,20 @@ static void ui_build_split(const ui_canmon_cfg_t *cfg)
     lv_label_set_text(rt, "Quick TX");
     lv_obj_align(rt, LV_ALIGN_TOP_LEFT, 0, 0);
 
+    lv_obj_t *gb = lv_btn_create(right);
+    lv_obj_add_style(gb, &s_st_btn, 0);
+    lv_obj_add_style(gb, &s_st_btn_pr, LV_STATE_PRESSED);
+    lv_obj_align(gb, LV_ALIGN_TOP_RIGHT, 0, 0);
+    lv_obj_add_event_cb(gb, btn_gen_cb, LV_EVENT_CLICKED, NULL);
+
+    s_lbl_gen = lv_label_create(gb);
+    lv_label_set_text(s_lbl_gen, "Gen");
+    lv_obj_center(s_lbl_gen);
+
     /* Buttons container inside right panel */
     lv_obj_t *grid = lv_obj_create(right);
     lv_obj_set_width(grid, lv_pct(100));
-    lv_obj_set_height(grid, lv_pct(92));
+    lv_obj_set_height(grid, lv_pct(84));
     lv_obj_align(grid, LV_ALIGN_BOTTOM_LEFT, 0, 0);
 
     lv_obj_set_style_bg_opa(grid, LV_OPA_TRANSP, 0);
@@ -338,26 +595,28 @@ static void ui_build_split(const ui_canmon_cfg_t *cfg)
     }
 }
 
-esp_err_t ui_canmon_start(const ui_canmon_cfg_t *cfg_in, QueueHandle_t evt_q)
+esp_err_t ui_canmon_start(const ui_canmon_cfg_t *cfg_in)
 {
-    if (!evt_q) return ESP_ERR_INVALID_ARG;
-
     ui_canmon_cfg_t cfg = {
         .side_w_pct     = 33,
         .padding        = 12,
-        .drain_per_tick = 16,
-        .tick_ms        = 50,
+        .fps            = 30,
+        .min_fps        = 5,
     };
 
     if (cfg_in) cfg = *cfg_in;
 
-    s_evt_q = evt_q;
-    s_drain_per_tick = cfg.drain_per_tick;
+    if (cfg.fps <= 0 || cfg.min_fps <= 0 || cfg.min_fps > cfg.fps) return ESP_ERR_INVALID_ARG;
+
+    s_period_min_ms = 1000u / (uint32_t)cfg.fps;
+    s_period_max_ms = 1000u / (uint32_t)cfg.min_fps;
+    s_period_ms     = s_period_min_ms;
 
     ui_build_split(&cfg);
 
-    /* Timer that pulls CAN events and paints them */
-    lv_timer_create(ui_tick_cb, cfg.tick_ms, NULL);
+    /* Timer that takes formatted rows and paints them */
+    s_timer = lv_timer_create(ui_tick_cb, s_period_ms, NULL);
+    can_pipe_set_ready_cb(rows_ready_cb, NULL);
 
     return ESP_OK;
 }
@@ -0,0 +1,108 @@
+// main/src/ui_sysdiag.c
+//
+// System (tasks/heap) view for LVGL.
+//
+// Only re-texted when sys_diag publishes a new sample, so between samples a
+// visible view costs one sequence-number compare per tick. The frame buffer
+// sync cost from lvgl_port rides along with each sample.
+
+#include "ui_sysdiag.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sys_diag.h"
+#include "lvgl_port.h"
+
+#define COL_COUNT     5
+
+/* ---------------- State ---------------- */
+
+static lv_obj_t  *s_cont  = NULL;
+static lv_obj_t  *s_lbl   = NULL;
+static lv_obj_t  *s_table = NULL;
+
+static sys_diag_t s_snap;       /* ~900 bytes; kept off the LVGL task stack */
+
+/* ---------------- Public API ---------------- */
+
+lv_obj_t *ui_sysdiag_create(lv_obj_t *parent)
+{
+    if (s_cont) return s_cont;
+
+    s_cont = lv_obj_create(parent);
+    lv_obj_set_flex_flow(s_cont, LV_FLEX_FLOW_COLUMN);
+    lv_obj_set_style_pad_row(s_cont, 8, 0);
+
+    s_lbl = lv_label_create(s_cont);
+#if CONFIG_SYS_DIAG
+    lv_label_set_text(s_lbl, "Waiting for the first sample...");
+#else
+    lv_label_set_text(s_lbl, "Task diagnostics are off (CONFIG_SYS_DIAG)");
+#endif
+
+    static const char *const k_hdr[COL_COUNT] = { "task", "core", "prio", "cpu %", "stack free" };
+
+    s_table = lv_table_create(s_cont);
+    lv_table_set_col_cnt(s_table, COL_COUNT);
+    lv_table_set_row_cnt(s_table, 1);
+    lv_obj_set_width(s_table, lv_pct(100));
+    lv_obj_set_flex_grow(s_table, 1);
+    lv_obj_set_style_bg_opa(s_table, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_bg_opa(s_table, LV_OPA_TRANSP, LV_PART_ITEMS);
+    lv_obj_set_style_border_width(s_table, 0, 0);
+    lv_obj_set_style_pad_ver(s_table, 2, LV_PART_ITEMS);
+    for (uint16_t c = 0; c < COL_COUNT; c++) {
+        lv_table_set_col_width(s_table, c, c == 0 ? 160 : 90);
+        lv_table_set_cell_value(s_table, 0, c, k_hdr[c]);
+    }
+
+    return s_cont;
+}
+
+void ui_sysdiag_refresh(void)
+{
+    if (!s_cont || lv_obj_has_flag(s_cont, LV_OBJ_FLAG_HIDDEN)) return;
+
+    uint32_t seen = s_snap.seq;
+    if (!sys_diag_get(&s_snap) || s_snap.seq == seen) return;
+
+    const sys_diag_t *d = &s_snap;
+    char sync[80] = "";
+    lvgl_port_sync_stats_t ss;
+    lvgl_port_get_sync_stats(&ss);
+    if (ss.frames > 0) {
+        snprintf(sync, sizeof(sync), "\nFB sync: %u B/frame (avg %u), %u areas -> %u rects",
+                 (unsigned)ss.bytes_last, (unsigned)ss.bytes_avg, ss.areas_last, ss.rects_last);
+    }
+
+    lv_label_set_text_fmt(s_lbl,
+                          "CPU0 %u.%u %%  CPU1 %u.%u %%\n"
+                          "Internal: %u KiB free, %u KiB largest, %u KiB min\n"
+                          "PSRAM: %u KiB free, %u KiB largest, %u KiB min%s",
+                          d->core_load_x10[0] / 10, d->core_load_x10[0] % 10,
+                          d->core_load_x10[1] / 10, d->core_load_x10[1] % 10,
+                          (unsigned)(d->internal.free / 1024), (unsigned)(d->internal.largest / 1024),
+                          (unsigned)(d->internal.min_free / 1024),
+                          (unsigned)(d->psram.free / 1024), (unsigned)(d->psram.largest / 1024),
+                          (unsigned)(d->psram.min_free / 1024), sync);
+
+    lv_table_set_row_cnt(s_table, (uint16_t)(d->n_tasks + 1));
+
+    char buf[16];
+    for (uint32_t i = 0; i < d->n_tasks; i++) {
+        const sys_diag_task_t *t = &d->tasks[i];
+        const uint16_t row = (uint16_t)(i + 1);
+
+        lv_table_set_cell_value(s_table, row, 0, t->name);
+        if (t->core < 0) strcpy(buf, "-");
+        else             snprintf(buf, sizeof(buf), "%d", t->core);
+        lv_table_set_cell_value(s_table, row, 1, buf);
+        snprintf(buf, sizeof(buf), "%u", (unsigned)t->prio);
+        lv_table_set_cell_value(s_table, row, 2, buf);
+        snprintf(buf, sizeof(buf), "%u.%u", t->cpu_x10 / 10, t->cpu_x10 % 10);
+        lv_table_set_cell_value(s_table, row, 3, buf);
+        snprintf(buf, sizeof(buf), "%u", (unsigned)t->stack_free);
+        lv_table_set_cell_value(s_table, row, 4, buf);
+    }
+}
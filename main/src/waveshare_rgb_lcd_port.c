@@ -170,6 +170,7 @@ esp_err_t waveshare_esp32_s3_rgb_lcd_init()
             .mirror_x = 0, // No mirroring of X
             .mirror_y = 0, // No mirroring of Y
         },
+        .interrupt_callback = lvgl_port_touch_isr, // Wake LVGL on touch (only used with an INT pin)
     };
     ESP_ERROR_CHECK(esp_lcd_touch_new_i2c_gt911(tp_io_handle, &tp_cfg, &tp_handle)); // Create new I2C GT911 touch controller
 #endif                                                                               // CONFIG_EXAMPLE_LCD_TOUCH_CONTROLLER_GT911
@@ -2,23 +2,35 @@
 
 #include "esp_log.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 
-/* 500 kbit/s timing */
-static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
-/* Accept all frames */
-static const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
-/* No-ACK mode; change to TWAI_MODE_NORMAL if you want ACK on the bus */
+/* Timing for s_bitrate; replaced by waveshare_twai_reconfigure() */
+static twai_timing_config_t s_t_config = TWAI_TIMING_CONFIG_500KBITS();
+static uint32_t s_bitrate = WAVESHARE_TWAI_BITRATE;
+/* No-ACK by default; TWAI_MODE_NORMAL to ACK on the bus */
+static twai_mode_t s_mode = WAVESHARE_TWAI_MODE;
+/* Accept all frames until waveshare_twai_set_filter() says otherwise */
+static twai_filter_config_t s_f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
 static const twai_general_config_t g_config =
     TWAI_GENERAL_CONFIG_DEFAULT(TX_GPIO_NUM, RX_GPIO_NUM, TWAI_MODE_NO_ACK);
 
 static bool s_started = false;
 static SemaphoreHandle_t s_tx_mtx = NULL;
+static SemaphoreHandle_t s_rx_mtx = NULL;   /* held across twai_receive() so the driver can be swapped */
+static SemaphoreHandle_t s_alert_mtx = NULL; /* same for twai_read_alerts() */
 
-esp_err_t waveshare_twai_init(void)
+/* A reinstall is waiting for the alert reader to let go */
+static volatile bool s_reconfig = false;
+
+/* Install + start the driver with the current settings and enable alerts */
+static esp_err_t driver_up(void)
 {
-    if (s_started) return ESP_OK;
+    twai_general_config_t g = g_config;
+    g.mode = s_mode;
+    g.rx_queue_len = WAVESHARE_TWAI_RX_QUEUE_LEN;
+    g.tx_queue_len = WAVESHARE_TWAI_TX_QUEUE_LEN;
 
-    esp_err_t err = twai_driver_install(&g_config, &t_config, &f_config);
+    esp_err_t err = twai_driver_install(&g, &s_t_config, &s_f_config);
     if (err != ESP_OK) {
         ESP_LOGE(EXAMPLE_TAG, "Driver install failed: %s", esp_err_to_name(err));
         return err;
@@ -31,28 +43,40 @@ esp_err_t waveshare_twai_init(void)
         return err;
     }
 
-    /* Enable TX/RX + error alerts */
+    /* Enable TX/RX + error state alerts */
     uint32_t alerts =
         TWAI_ALERT_TX_IDLE |
         TWAI_ALERT_TX_SUCCESS |
         TWAI_ALERT_TX_FAILED |
         TWAI_ALERT_RX_DATA |
         TWAI_ALERT_RX_QUEUE_FULL |
+        TWAI_ALERT_RX_FIFO_OVERRUN |
+        TWAI_ALERT_ABOVE_ERR_WARN |
         TWAI_ALERT_ERR_PASS |
+        TWAI_ALERT_ERR_ACTIVE |
         TWAI_ALERT_BUS_ERROR |
-        TWAI_ALERT_BUS_OFF;
+        TWAI_ALERT_BUS_OFF |
+        TWAI_ALERT_BUS_RECOVERED;
 
     (void)twai_reconfigure_alerts(alerts, NULL);
+    return ESP_OK;
+}
 
-    s_tx_mtx = xSemaphoreCreateMutex();
-    if (!s_tx_mtx) {
-        (void)twai_stop();
-        (void)twai_driver_uninstall();
-        return ESP_ERR_NO_MEM;
-    }
+esp_err_t waveshare_twai_init(void)
+{
+    if (s_started) return ESP_OK;
+
+    if (!s_tx_mtx) s_tx_mtx = xSemaphoreCreateMutex();
+    if (!s_rx_mtx) s_rx_mtx = xSemaphoreCreateMutex();
+    if (!s_alert_mtx) s_alert_mtx = xSemaphoreCreateMutex();
+    if (!s_tx_mtx || !s_rx_mtx || !s_alert_mtx) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = driver_up();
+    if (err != ESP_OK) return err;
 
     s_started = true;
-    ESP_LOGI(EXAMPLE_TAG, "TWAI started (TX=%d, RX=%d, 500k)", TX_GPIO_NUM, RX_GPIO_NUM);
+    ESP_LOGI(EXAMPLE_TAG, "TWAI started (TX=%d, RX=%d, %u bit/s)", TX_GPIO_NUM, RX_GPIO_NUM,
+             (unsigned)s_bitrate);
     return ESP_OK;
 }
 
@@ -60,15 +84,19 @@ esp_err_t waveshare_twai_deinit(void)
 {
     if (!s_started) return ESP_OK;
 
-    if (s_tx_mtx) {
-        vSemaphoreDelete(s_tx_mtx);
-        s_tx_mtx = NULL;
-    }
-
+    xSemaphoreTake(s_tx_mtx, portMAX_DELAY);
     (void)twai_stop();
-    (void)twai_driver_uninstall();
     s_started = false;
 
+    /* Wait for a receiver blocked in twai_receive() or twai_read_alerts()
+     * to time out */
+    xSemaphoreTake(s_rx_mtx, portMAX_DELAY);
+    xSemaphoreTake(s_alert_mtx, portMAX_DELAY);
+    (void)twai_driver_uninstall();
+    xSemaphoreGive(s_alert_mtx);
+    xSemaphoreGive(s_rx_mtx);
+    xSemaphoreGive(s_tx_mtx);
+
     ESP_LOGI(EXAMPLE_TAG, "TWAI stopped");
     return ESP_OK;
 }
@@ -78,6 +106,118 @@ bool waveshare_twai_is_started(void)
     return s_started;
 }
 
+uint32_t waveshare_twai_get_bitrate(void)
+{
+    return s_bitrate;
+}
+
+/*
+ * Tear the driver down and bring it back up; NULL arguments keep the current
+ * setting. Receivers never block inside the driver for long (the RX task only
+ * drains, the alert reader waits in slices and backs off on s_reconfig), so
+ * the time here is mostly the install itself.
+ */
+static esp_err_t driver_reinstall(const twai_timing_config_t *t, uint32_t bitrate,
+                                  const twai_mode_t *mode, const twai_filter_config_t *f)
+{
+    /* Stop TX first, then wait for the receiver and the alert reader to
+     * leave the driver before tearing down the queues they block on. */
+    xSemaphoreTake(s_tx_mtx, portMAX_DELAY);
+    s_reconfig = true;
+    (void)twai_stop();
+    xSemaphoreTake(s_rx_mtx, portMAX_DELAY);
+    xSemaphoreTake(s_alert_mtx, portMAX_DELAY);
+    (void)twai_driver_uninstall();
+
+    if (t) {
+        s_t_config = *t;
+        s_bitrate = bitrate;
+    }
+    if (mode) s_mode = *mode;
+    if (f) s_f_config = *f;
+    esp_err_t err = driver_up();
+    s_started = (err == ESP_OK);
+    s_reconfig = false;
+
+    xSemaphoreGive(s_alert_mtx);
+    xSemaphoreGive(s_rx_mtx);
+    xSemaphoreGive(s_tx_mtx);
+    return err;
+}
+
+esp_err_t waveshare_twai_reconfigure(uint32_t bitrate, const twai_timing_config_t *timing,
+                                     twai_mode_t mode)
+{
+    if (bitrate == 0) return ESP_ERR_INVALID_ARG;
+
+    twai_timing_config_t t;
+    if (timing) t = *timing;
+    else if (!can_bus_timing_for(bitrate, &t)) return ESP_ERR_NOT_SUPPORTED;
+
+    if (!s_started) {
+        /* Used by the next waveshare_twai_init() */
+        s_t_config = t;
+        s_bitrate = bitrate;
+        s_mode = mode;
+        return ESP_OK;
+    }
+
+    esp_err_t err = driver_reinstall(&t, bitrate, &mode, NULL);
+    ESP_LOGD(EXAMPLE_TAG, "Reconfigured to %u bit/s mode %d: %s",
+             (unsigned)bitrate, (int)mode, esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t waveshare_twai_reset(void)
+{
+    if (!s_tx_mtx) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = driver_reinstall(NULL, 0, NULL, NULL);
+    ESP_LOGI(EXAMPLE_TAG, "Driver reset: %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t waveshare_twai_recover(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    if (xSemaphoreTake(s_tx_mtx, pdMS_TO_TICKS(10)) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_started ? twai_initiate_recovery() : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_tx_mtx);
+    return err;
+}
+
+esp_err_t waveshare_twai_resume(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    if (xSemaphoreTake(s_tx_mtx, pdMS_TO_TICKS(10)) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_started ? twai_start() : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_tx_mtx);
+    return err;
+}
+
+esp_err_t waveshare_twai_set_filter(const twai_filter_config_t *f)
+{
+    if (!f) return ESP_ERR_INVALID_ARG;
+
+    if (!s_started) {
+        /* Used by the next waveshare_twai_init() */
+        s_f_config = *f;
+        return ESP_OK;
+    }
+
+    /* The filter can only change with the driver uninstalled */
+    esp_err_t err = driver_reinstall(NULL, 0, NULL, f);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(EXAMPLE_TAG, "Filter set: code=0x%08X mask=0x%08X %s",
+                 (unsigned)f->acceptance_code, (unsigned)f->acceptance_mask,
+                 f->single_filter ? "single" : "dual");
+    }
+    return err;
+}
+
 esp_err_t send_can_frame(twai_message_t frame)
 {
     if (!s_started) return ESP_ERR_INVALID_STATE;
@@ -90,9 +230,9 @@ esp_err_t send_can_frame(twai_message_t frame)
      */
 
     esp_err_t err;
-    if (s_tx_mtx) xSemaphoreTake(s_tx_mtx, portMAX_DELAY);
-    err = twai_transmit(&frame, pdMS_TO_TICKS(100));
-    if (s_tx_mtx) xSemaphoreGive(s_tx_mtx);
+    xSemaphoreTake(s_tx_mtx, portMAX_DELAY);
+    err = s_started ? twai_transmit(&frame, pdMS_TO_TICKS(100)) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_tx_mtx);
 
     if (err != ESP_OK) {
         ESP_LOGW(EXAMPLE_TAG, "TX fail id=0x%08X ext=%d dlc=%u err=%s",
@@ -105,12 +245,73 @@ esp_err_t send_can_frame(twai_message_t frame)
     return err;
 }
 
+esp_err_t waveshare_twai_try_send(const twai_message_t *frame)
+{
+    if (!frame) return ESP_ERR_INVALID_ARG;
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    /* Never wait: a reconfiguration holding the mutex or a full queue is
+     * reported to the caller, which retries on its own schedule */
+    if (xSemaphoreTake(s_tx_mtx, 0) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_started ? twai_transmit(frame, 0) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_tx_mtx);
+    return err;
+}
+
+esp_err_t waveshare_twai_read_alerts(uint32_t *alerts, TickType_t timeout_ticks)
+{
+    if (!alerts) return ESP_ERR_INVALID_ARG;
+    *alerts = 0;
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    if (s_reconfig) {
+        /* Sit out the reinstall on the mutex it holds throughout instead of
+         * racing it back to s_alert_mtx */
+        if (xSemaphoreTake(s_tx_mtx, timeout_ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+        xSemaphoreGive(s_tx_mtx);
+        if (!s_started) return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Held like s_rx_mtx around twai_receive(): the alert semaphore goes
+     * away with the driver. Nothing can wake twai_read_alerts() early, so
+     * wait in slices and let a pending reinstall in between them. */
+    if (xSemaphoreTake(s_alert_mtx, timeout_ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+
+    TickType_t slice = pdMS_TO_TICKS(WAVESHARE_TWAI_ALERT_SLICE_MS);
+    if (slice == 0) slice = 1;
+    const TickType_t t0 = xTaskGetTickCount();
+    esp_err_t err;
+    while (1) {
+        TickType_t spent = xTaskGetTickCount() - t0;
+        TickType_t left = spent < timeout_ticks ? timeout_ticks - spent : 0;
+        err = s_started ? twai_read_alerts(alerts, left < slice ? left : slice) : ESP_ERR_INVALID_STATE;
+        if (err != ESP_ERR_TIMEOUT || left <= slice || s_reconfig) break;
+    }
+    xSemaphoreGive(s_alert_mtx);
+    return err;
+}
+
+esp_err_t waveshare_twai_get_status(twai_status_info_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+
+    /* Only needs the driver to stay installed. Senders hold s_tx_mtx just
+     * around a non-blocking twai_transmit(), so a short wait is enough. */
+    if (xSemaphoreTake(s_tx_mtx, pdMS_TO_TICKS(10)) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_started ? twai_get_status_info(out) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_tx_mtx);
+    return err;
+}
+
 esp_err_t waveshare_twai_receive(twai_message_t *out_frame, TickType_t timeout_ticks)
 {
     if (!out_frame) return ESP_ERR_INVALID_ARG;
     if (!s_started) return ESP_ERR_INVALID_STATE;
 
-    esp_err_t err = twai_receive(out_frame, timeout_ticks);
+    if (xSemaphoreTake(s_rx_mtx, timeout_ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_started ? twai_receive(out_frame, timeout_ticks) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_rx_mtx);
     if (err == ESP_OK) {
         /* out_frame now contains the received CAN frame */
         return ESP_OK;
@@ -128,11 +329,45 @@ int waveshare_twai_drain(twai_message_t *out_frames, int max_frames)
     if (!out_frames || max_frames <= 0) return 0;
     if (!s_started) return 0;
 
+    if (xSemaphoreTake(s_rx_mtx, 0) != pdTRUE) return 0;
+
     int n = 0;
-    while (n < max_frames) {
+    while (s_started && n < max_frames) {
         twai_message_t m;
         if (twai_receive(&m, 0) != ESP_OK) break;
         out_frames[n++] = m;
     }
+    xSemaphoreGive(s_rx_mtx);
     return n;
 }
+
+/* ---------------- can_bus backend ---------------- */
+
+static esp_err_t bus_start(const can_bus_cfg_t *cfg)
+{
+    /* Stored for the install when not running yet */
+    esp_err_t err = waveshare_twai_reconfigure(cfg->bitrate, cfg->custom ? &cfg->timing : NULL, cfg->mode);
+    if (err != ESP_OK) return err;
+    return waveshare_twai_init();
+}
+
+static esp_err_t bus_reconfigure(const can_bus_cfg_t *cfg)
+{
+    return waveshare_twai_reconfigure(cfg->bitrate, cfg->custom ? &cfg->timing : NULL, cfg->mode);
+}
+
+const can_bus_ops_t waveshare_twai_bus = {
+    .name        = "twai",
+    .start       = bus_start,
+    .stop        = waveshare_twai_deinit,
+    .reconfigure = bus_reconfigure,
+    .set_filter  = waveshare_twai_set_filter,
+    .tx          = waveshare_twai_try_send,
+    .rx          = waveshare_twai_receive,
+    .rx_batch    = waveshare_twai_drain,
+    .alerts      = waveshare_twai_read_alerts,
+    .status      = waveshare_twai_get_status,
+    .recover     = waveshare_twai_recover,
+    .resume      = waveshare_twai_resume,
+    .reset       = waveshare_twai_reset,
+};
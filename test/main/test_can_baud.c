@@ -0,0 +1,158 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "can_baud.h"
+#include "can_bus.h"
+#include "can_vbus.h"
+
+#include "test_main.h"
+
+#define TEST_BAUD_DWELL_MS  200
+#define TEST_BAUD_SWITCH_US 3000    /* one alert-reader slice plus the reinstall */
+
+/*
+ * can_baud_detect() blocks and polls can_bus from the calling task, so the
+ * bus runs in a second one: it keeps a node at the bus rate transmitting,
+ * advances virtual time and drains node 0 like the RX task would. A second
+ * node at the same rate ACKs. Node 0 (the monitor) is what detect retunes.
+ */
+static struct {
+    volatile bool stop;
+    volatile bool quiet;        /* sender stops queueing */
+    int           tx;
+    int           ack;
+} s_bus;
+
+static void bus_pump(void *arg)
+{
+    SemaphoreHandle_t done = arg;
+    twai_message_t m = { .identifier = 0x18FEF100, .flags = TWAI_MSG_FLAG_EXTD, .data_length_code = 8 };
+    twai_message_t rx[16];
+
+    while (!s_bus.stop) {
+        if (!s_bus.quiet) {
+            m.data[0]++;
+            (void)can_vbus_node_tx(s_bus.tx, &m);
+        }
+        can_vbus_advance(1000);
+        while (can_bus_rx_batch(rx, 16) > 0) {}
+        while (can_vbus_node_rx(s_bus.ack, rx, 16) > 0) {}
+        vTaskDelay(1);
+    }
+    xSemaphoreGive(done);
+    vTaskDelete(NULL);
+}
+
+/* The monitor at 500 kbit/s listen-only, the traffic at 250 kbit/s */
+static SemaphoreHandle_t bus_start(void)
+{
+    const can_bus_cfg_t cfg = { .bitrate = 500000, .mode = TWAI_MODE_LISTEN_ONLY };
+    ESP_ERROR_CHECK(can_vbus_init(NULL));
+    ESP_ERROR_CHECK(can_bus_deinit());
+    ESP_ERROR_CHECK(can_bus_init(&can_vbus_bus, &cfg));
+
+    s_bus.stop = false;
+    s_bus.quiet = false;
+    s_bus.tx = can_vbus_add_node(250000, TWAI_MODE_NORMAL);
+    s_bus.ack = can_vbus_add_node(250000, TWAI_MODE_NORMAL);
+    TEST_ASSERT_GREATER_THAN(0, s_bus.tx);
+    TEST_ASSERT_GREATER_THAN(0, s_bus.ack);
+
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(bus_pump, "bus_pump", 4096, done,
+                                          uxTaskPriorityGet(NULL), NULL));
+    return done;
+}
+
+static void bus_stop(SemaphoreHandle_t done)
+{
+    s_bus.stop = true;
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(done, portMAX_DELAY));
+    vSemaphoreDelete(done);
+}
+
+/* Wrong rates see error frames within a few frames and are dropped long
+ * before their dwell; the right one locks. Listening never disturbs the bus. */
+static void test_baud_detect_locks(void)
+{
+    SemaphoreHandle_t done = bus_start();
+
+    static const uint32_t k_rates[] = { 500000, 1000000, 125000, 250000, 100000 };
+    can_baud_result_t r;
+    TEST_ASSERT_EQUAL(ESP_OK, can_baud_detect(k_rates, 5, TEST_BAUD_DWELL_MS, TWAI_MODE_NORMAL, &r));
+    TEST_ASSERT_EQUAL_UINT32(250000, r.bitrate);
+    TEST_ASSERT_EQUAL_UINT32(4, r.tried);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(CAN_BAUD_MIN_FRAMES, r.frames);
+    TEST_ASSERT_LESS_THAN(TEST_BAUD_DWELL_MS, r.scan_ms);
+
+    /* Five switches, none of them a noticeable gap on the bus */
+    TEST_ASSERT_LESS_THAN_UINT32(TEST_BAUD_SWITCH_US, r.switch_max_us);
+    TEST_ASSERT_LESS_THAN_UINT32(TEST_BAUD_SWITCH_US, can_bus_get_switch_us(NULL));
+
+    can_bus_cfg_t cfg;
+    can_bus_get_cfg(&cfg);
+    TEST_ASSERT_EQUAL_UINT32(250000, cfg.bitrate);
+    TEST_ASSERT_EQUAL(TWAI_MODE_NORMAL, cfg.mode);
+
+    /* Locked in normal mode the monitor ACKs and receives */
+    const uint32_t rx0 = can_bus_get_rx_count();
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ASSERT_GREATER_THAN(rx0, can_bus_get_rx_count());
+
+    bus_stop(done);
+
+    twai_status_info_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_status(s_bus.tx, &st));
+    TEST_ASSERT_EQUAL_UINT32(0, st.tx_error_counter);
+    TEST_ASSERT_EQUAL_UINT32(0, st.bus_error_count);
+}
+
+/* Every candidate wrong: errors reject each, the previous setting comes back */
+static void test_baud_detect_wrong_rates(void)
+{
+    SemaphoreHandle_t done = bus_start();
+    TEST_ASSERT_EQUAL(ESP_OK, can_baud_set(125000, NULL, TWAI_MODE_LISTEN_ONLY));
+
+    static const uint32_t k_rates[] = { 500000, 1000000, 800000 };
+    can_baud_result_t r;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, can_baud_detect(k_rates, 3, TEST_BAUD_DWELL_MS, TWAI_MODE_NORMAL, &r));
+    TEST_ASSERT_EQUAL_UINT32(0, r.bitrate);
+    TEST_ASSERT_EQUAL_UINT32(3, r.tried);
+    TEST_ASSERT_LESS_THAN(TEST_BAUD_DWELL_MS, r.scan_ms);
+
+    can_bus_cfg_t cfg;
+    can_bus_get_cfg(&cfg);
+    TEST_ASSERT_EQUAL_UINT32(125000, cfg.bitrate);
+    TEST_ASSERT_EQUAL(TWAI_MODE_LISTEN_ONLY, cfg.mode);
+
+    bus_stop(done);
+}
+
+/* A silent bus proves nothing: each candidate listens out its dwell */
+static void test_baud_detect_silent(void)
+{
+    SemaphoreHandle_t done = bus_start();
+    s_bus.quiet = true;
+
+    static const uint32_t k_rates[] = { 250000, 500000 };
+    can_baud_result_t r;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, can_baud_detect(k_rates, 2, 50, TWAI_MODE_NORMAL, &r));
+    TEST_ASSERT_EQUAL_UINT32(2, r.tried);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2 * 50, r.scan_ms);
+    TEST_ASSERT_EQUAL_UINT32(500000, can_bus_get_bitrate());
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, can_baud_detect(k_rates, 0, 0, TWAI_MODE_NORMAL, NULL));
+    bus_stop(done);
+}
+
+void test_can_baud_run(void)
+{
+    RUN_TEST(test_baud_detect_locks);
+    RUN_TEST(test_baud_detect_wrong_rates);
+    RUN_TEST(test_baud_detect_silent);
+}
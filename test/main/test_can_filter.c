@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "can_filter.h"
+
+#include "test_main.h"
+
+static twai_message_t frame(uint32_t id, bool ext, uint8_t dlc, uint8_t d0)
+{
+    twai_message_t m = {
+        .identifier = id,
+        .flags = ext ? TWAI_MSG_FLAG_EXTD : 0,
+        .data_length_code = dlc,
+    };
+    m.data[0] = d0;
+    for (int i = 1; i < 8; i++) m.data[i] = (uint8_t)(d0 + i);
+    return m;
+}
+
+static can_filter_t *compile(const char *src)
+{
+    can_filter_t *f = NULL;
+    char err[48] = "";
+    if (can_filter_compile(src, &f, err, sizeof(err)) != ESP_OK) TEST_FAIL_MESSAGE(err);
+    return f;
+}
+
+/* Trigger callback: count per rule */
+static uint32_t s_trig[CAN_FILTER_MAX_RULES];
+
+static void trig_count(uint16_t rule, const twai_message_t *m, void *ctx)
+{
+    (void)m;
+    (void)ctx;
+    s_trig[rule]++;
+}
+
+/* ---------------- Parser ---------------- */
+
+static void check_error(const char *src, const char *want)
+{
+    can_filter_t *f = (can_filter_t *)&f;
+    char err[48] = "";
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, can_filter_compile(src, &f, err, sizeof(err)), src);
+    TEST_ASSERT_NULL(f);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(want, err, src);
+}
+
+static void test_filter_syntax_errors(void)
+{
+    check_error("id", "col 3: expected ID");
+    check_error("dlc 5", "col 5: expected CMP");
+    check_error("d0 & == 1", "col 6: expected number");
+    check_error("foo == 1", "col 1: unknown field");
+    check_error("(id 0x1", "col 8: expected ')'");
+    check_error("id 1 id 2", "col 6: expected ';'");
+    check_error("ext &&", "col 7: expected condition");
+    check_error("pass ext; trig id 0x7DF @", "col 25: expected ';'");
+
+    /* One rule past the limit */
+    static char src[CAN_FILTER_MAX_RULES * 4 + 8];
+    size_t len = 0;
+    for (int i = 0; i <= CAN_FILTER_MAX_RULES; i++) len += (size_t)sprintf(src + len, "rtr;");
+    char want[32];
+    snprintf(want, sizeof(want), "col %d: too many rules", CAN_FILTER_MAX_RULES * 4 + 1);
+    check_error(src, want);
+
+    /* NULL error buffer is fine; empty programs compile to no rules */
+    can_filter_t *f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, can_filter_compile("id ==", &f, NULL, 0));
+    f = compile(" ;\n; ");
+    TEST_ASSERT_EQUAL(0, can_filter_rule_count(f));
+    can_filter_free(f);
+}
+
+static void test_filter_limits(void)
+{
+    /* Literals past 32 bits, wildcards included */
+    check_error("id 0x118FEA8xx", "col 4: number too large");
+    check_error("dlc == 4294967296", "col 8: number too large");
+    check_error("d0 & 99999999999 == 1", "col 6: number too large");
+    can_filter_free(compile("id 0xFFFFFFFF; dlc == 4294967295; id 0x00000000123"));
+
+    /* The limit compiles; one more NOT or '(' fails where it opens */
+    static char src[8192];
+    char want[32];
+    for (int d = CAN_FILTER_MAX_DEPTH; d <= CAN_FILTER_MAX_DEPTH + 8; d += 8) {
+        size_t len = 0;
+        for (int i = 0; i < d; i++) len += (size_t)sprintf(src + len, "(");
+        len += (size_t)sprintf(src + len, "rtr");
+        for (int i = 0; i < d; i++) len += (size_t)sprintf(src + len, ")");
+        if (d == CAN_FILTER_MAX_DEPTH) {
+            can_filter_free(compile(src));
+        } else {
+            snprintf(want, sizeof(want), "col %d: too deeply nested", CAN_FILTER_MAX_DEPTH + 1);
+            check_error(src, want);
+        }
+
+        len = 0;
+        for (int i = 0; i < d; i++) len += (size_t)sprintf(src + len, "not ");
+        sprintf(src + len, "rtr");
+        if (d == CAN_FILTER_MAX_DEPTH) {
+            can_filter_free(compile(src));
+        } else {
+            snprintf(want, sizeof(want), "col %d: too deeply nested", CAN_FILTER_MAX_DEPTH * 4 + 1);
+            check_error(src, want);
+        }
+    }
+
+    /* A long chain is not nesting */
+    size_t len = 0;
+    for (int i = 1; i <= 500; i++) len += (size_t)sprintf(src + len, "%sid %d", i > 1 ? " || " : "", i);
+    can_filter_t *f = compile(src);
+    const twai_message_t first = frame(1, false, 8, 0), last = frame(500, false, 8, 0);
+    const twai_message_t miss = frame(501, false, 8, 0);
+    TEST_ASSERT_TRUE(can_filter_eval(f, &first));
+    TEST_ASSERT_TRUE(can_filter_eval(f, &last));
+    TEST_ASSERT_FALSE(can_filter_eval(f, &miss));
+    can_filter_free(f);
+}
+
+/* ---------------- Evaluation ---------------- */
+
+typedef struct {
+    const char     *src;
+    twai_message_t  m;
+    bool            keep;
+} eval_case_t;
+
+static void test_filter_eval(void)
+{
+    const twai_message_t rtr = { .identifier = 0x7DF, .flags = TWAI_MSG_FLAG_RTR, .data_length_code = 8 };
+    const eval_case_t k_cases[] = {
+        { "id 0x123",               frame(0x123, false, 8, 0), true  },
+        { "id 0x123",               frame(0x124, false, 8, 0), false },
+        { "id 0x123",               frame(0x123, true, 8, 0),  true  },   /* ID only, either format */
+        { "std && id 0x123",        frame(0x123, true, 8, 0),  false },
+        { "id 0x18FEA8xx",          frame(0x18FEA8F1, true, 8, 0), true },
+        { "id 0x18FEA8xx",          frame(0x18FEA9F1, true, 8, 0), false },
+        { "id 0x100/0x700",         frame(0x1AB, false, 8, 0), true  },
+        { "id 0x100/0x700",         frame(0x2AB, false, 8, 0), false },
+        { "id 0x100-0x10F",         frame(0x10F, false, 8, 0), true  },
+        { "id 0x100-0x10F",         frame(0x110, false, 8, 0), false },
+        { "id >= 0x700",            frame(0x7E8, false, 8, 0), true  },
+        { "dlc < 8",                frame(0x100, false, 8, 0), false },
+        { "dlc != 8",               frame(0x100, false, 2, 0), true  },
+        { "d0 & 0x0F == 2",         frame(0x100, false, 8, 0xA2), true },
+        { "d0 & 0x0F == 2",         frame(0x100, false, 8, 0xA3), false },
+        { "byte1 > 0xA0",           frame(0x100, false, 8, 0xA2), true },
+        { "b7 == 0",                frame(0x100, false, 7, 0xF9), false },   /* beyond DLC */
+        { "d0 == 0",                rtr,                       false },       /* no payload */
+        { "rtr && id 0x7DF",        rtr,                       true  },
+        { "data",                   rtr,                       false },
+        { "not ext",                frame(0x100, false, 8, 0), true  },
+        { "!(std || rtr)",          frame(0x100, true, 8, 0),  true  },
+        { "ext or std and id 1",    frame(0x100, false, 8, 0), false },   /* and binds tighter */
+        { "(ext or std) and id 1",  frame(0x001, false, 8, 0), true  },
+        { "ID 0x7DF || DLC == 0",   frame(0x7DF, false, 8, 0), true  },
+        /* Any pass rule keeps the frame; trig rules do not */
+        { "id 1; id 2; id 0x100",   frame(0x100, false, 8, 0), true  },
+        { "trig id 0x100",          frame(0x200, false, 8, 0), true  },
+        { "pass id 1; trig id 0x100", frame(0x100, false, 8, 0), false },
+    };
+
+    for (size_t i = 0; i < sizeof(k_cases) / sizeof(k_cases[0]); i++) {
+        can_filter_t *f = compile(k_cases[i].src);
+        TEST_ASSERT_EQUAL_MESSAGE(k_cases[i].keep, can_filter_eval(f, &k_cases[i].m), k_cases[i].src);
+        can_filter_free(f);
+    }
+
+    /* No program keeps everything */
+    TEST_ASSERT_TRUE(can_filter_eval(NULL, &rtr));
+}
+
+/* Short-circuit jumps: equivalent rewrites of an expression agree on every frame */
+static void test_filter_codegen(void)
+{
+    static const char *const k_forms[][2] = {
+        { "id 0x100-0x10F && (d0 == 1 || !ext)",
+          "(id 0x100-0x10F && d0 == 1) || (id >= 0x100 && id <= 0x10F && std)" },
+        { "!(ext && (dlc > 4 || rtr))",         "std || (dlc <= 4 && data)" },
+        { "not (id 0x7DF or id 0x7E8) and d1 & 0x80 != 0",
+          "d1 >= 0x80 and id != 0x7DF and id != 0x7E8" },
+        { "((((ext))))",                        "!!ext" },
+    };
+
+    uint32_t x = 0x9E3779B9u;
+    for (size_t k = 0; k < sizeof(k_forms) / sizeof(k_forms[0]); k++) {
+        can_filter_t *a = compile(k_forms[k][0]);
+        can_filter_t *b = compile(k_forms[k][1]);
+        for (int i = 0; i < 20000; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            const bool ext = x & 1;
+            /* Bias towards the IDs the forms name */
+            uint32_t id = (x & 2) ? 0x100 + ((x >> 4) & 0x1F) : (x & 4) ? 0x7DF + ((x >> 4) & 0x0F) : x >> 3;
+            twai_message_t m = frame(ext ? id & 0x1FFFFFFF : id & 0x7FF, ext, (x >> 8) % 9, (uint8_t)(x >> 16));
+            m.data[1] = (uint8_t)(x >> 24);
+            if ((x & 0x300) == 0x300) m.flags |= TWAI_MSG_FLAG_RTR;
+            TEST_ASSERT_EQUAL_MESSAGE(can_filter_eval(b, &m), can_filter_eval(a, &m), k_forms[k][0]);
+        }
+        can_filter_free(a);
+        can_filter_free(b);
+    }
+}
+
+/* ---------------- ID index ---------------- */
+
+/* Every 11-bit ID: pinned rules are reached through the bitmap, the rest
+ * through the unindexed list, and each matching trig rule fires once */
+static void test_filter_index_std(void)
+{
+    can_filter_t *f = compile(
+        "pass id 0x123;"
+        "pass id 0x7DF || id 0x7E8-0x7EF;"
+        "pass id 0x10x && d0 == 5;"               /* 16 IDs, indexed */
+        "trig id 0x7E8 || id 0x7E8;"               /* same ID twice */
+        "trig id 0x7E0/0x7F0;"
+        "trig dlc == 8 && id 0x5FF;"
+        "trig id > 0x7FC");                        /* not pinned */
+    TEST_ASSERT_EQUAL(7, can_filter_rule_count(f));
+
+    memset(s_trig, 0, sizeof(s_trig));
+    can_filter_set_trigger_cb(trig_count, NULL);
+    for (uint32_t id = 0; id < 2048; id++) {
+        for (int d0 = 4; d0 <= 5; d0++) {
+            twai_message_t m = frame(id, false, 8, (uint8_t)d0);
+            bool want = id == 0x123 || id == 0x7DF || (id >= 0x7E8 && id <= 0x7EF) ||
+                        ((id & 0x7F0) == 0x100 && d0 == 5);
+            TEST_ASSERT_EQUAL(want, can_filter_eval(f, &m));
+        }
+    }
+    can_filter_set_trigger_cb(NULL, NULL);
+
+    TEST_ASSERT_EQUAL_UINT32(2, s_trig[3]);
+    TEST_ASSERT_EQUAL_UINT32(2 * 16, s_trig[4]);
+    TEST_ASSERT_EQUAL_UINT32(2, s_trig[5]);
+    TEST_ASSERT_EQUAL_UINT32(2 * 3, s_trig[6]);
+    TEST_ASSERT_EQUAL_UINT32(0, s_trig[0]);
+    can_filter_free(f);
+}
+
+/* 29-bit IDs go through the hashed set; 11-bit values are in both */
+static void test_filter_index_ext(void)
+{
+    static char src[4096];
+    size_t len = 0;
+    static uint32_t ids[200];
+    for (uint32_t i = 0; i < 200; i++) {
+        ids[i] = (0x18DA0000u + i * 0x10101u) & 0x1FFFFFFFu;
+        len += (size_t)snprintf(src + len, sizeof(src) - len, "id 0x%08X;", (unsigned)ids[i]);
+    }
+    snprintf(src + len, sizeof(src) - len,
+             "id 0x18FEF1x0; id 0x7DF; trig id 0x18FEF100-0x18FEF10F; trig ext && d0 == 0xEE");
+    can_filter_t *f = compile(src);
+    TEST_ASSERT_EQUAL(204, can_filter_rule_count(f));
+
+    for (uint32_t i = 0; i < 200; i++) {
+        twai_message_t m = frame(ids[i], true, 8, 0);
+        TEST_ASSERT_TRUE(can_filter_eval(f, &m));
+        m.identifier ^= 1u << (i % 29);
+        TEST_ASSERT_FALSE(can_filter_eval(f, &m));
+    }
+
+    memset(s_trig, 0, sizeof(s_trig));
+    can_filter_set_trigger_cb(trig_count, NULL);
+    for (uint32_t id = 0x18FEF000; id < 0x18FEF200; id++) {
+        twai_message_t m = frame(id, true, 8, (id & 1) ? 0xEE : 0);
+        TEST_ASSERT_EQUAL((id & 0xFFFFFF0F) == 0x18FEF100, can_filter_eval(f, &m));
+    }
+    can_filter_set_trigger_cb(NULL, NULL);
+    TEST_ASSERT_EQUAL_UINT32(16, s_trig[202]);
+    TEST_ASSERT_EQUAL_UINT32(256, s_trig[203]);
+
+    twai_message_t m = frame(0x7DF, true, 8, 0);
+    TEST_ASSERT_TRUE(can_filter_eval(f, &m));
+    m.flags = 0;
+    TEST_ASSERT_TRUE(can_filter_eval(f, &m));
+    m.identifier = 0x7DE;
+    TEST_ASSERT_FALSE(can_filter_eval(f, &m));
+    can_filter_free(f);
+}
+
+/* ---------------- RX path ---------------- */
+
+static void test_filter_rx(void)
+{
+    twai_message_t b[4] = {
+        frame(0x100, false, 8, 0), frame(0x200, false, 8, 0),
+        frame(0x101, false, 8, 0), frame(0x300, true, 8, 0),
+    };
+    const uint32_t drops = can_filter_get_drop_cnt();
+
+    /* Batch keeps order and compacts in place */
+    can_filter_set(compile("id 0x100-0x1FF || ext"));
+    TEST_ASSERT_EQUAL(3, can_filter_rx(b, 4));
+    TEST_ASSERT_EQUAL_HEX32(0x100, b[0].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x101, b[1].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x300, b[2].identifier);
+    TEST_ASSERT_EQUAL_UINT32(drops + 1, can_filter_get_drop_cnt());
+
+    /* A program replaced before the RX path picked it up is freed unused */
+    can_filter_set(compile("id 0x7DF"));
+    can_filter_set(compile("std"));
+    TEST_ASSERT_EQUAL(2, can_filter_rx(b, 3));
+
+    can_filter_set(NULL);
+    TEST_ASSERT_EQUAL(2, can_filter_rx(b, 2));
+    TEST_ASSERT_EQUAL_UINT32(drops + 2, can_filter_get_drop_cnt());
+}
+
+void test_can_filter_run(void)
+{
+    RUN_TEST(test_filter_syntax_errors);
+    RUN_TEST(test_filter_limits);
+    RUN_TEST(test_filter_eval);
+    RUN_TEST(test_filter_codegen);
+    RUN_TEST(test_filter_index_std);
+    RUN_TEST(test_filter_index_ext);
+    RUN_TEST(test_filter_rx);
+}
@@ -0,0 +1,173 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "can_fmt.h"
+
+#include "test_main.h"
+
+/* The snprintf formatter can_fmt_line() replaced; its output is the spec */
+static void format_ref(char *out, size_t out_sz, const can_evt_t *e)
+{
+    const twai_message_t *m = &e->msg;
+
+    int p = 0;
+    p += snprintf(out + p, out_sz - p, "%s ", e->is_tx ? "TX" : "RX");
+
+    if (m->flags & TWAI_MSG_FLAG_EXTD) {
+        p += snprintf(out + p, out_sz - p, "ID=%08" PRIX32 " ", (uint32_t)m->identifier);
+    } else {
+        p += snprintf(out + p, out_sz - p, "ID=%03" PRIX32 " ", (uint32_t)m->identifier);
+    }
+
+    p += snprintf(out + p, out_sz - p, "DLC=%u ", (unsigned)m->data_length_code);
+
+    if (m->flags & TWAI_MSG_FLAG_RTR) {
+        p += snprintf(out + p, out_sz - p, "RTR");
+        return;
+    }
+
+    p += snprintf(out + p, out_sz - p, "DATA=");
+    for (int i = 0; i < m->data_length_code && i < 8; i++) {
+        p += snprintf(out + p, out_sz - p, "%02X%s",
+                      (unsigned)m->data[i], (i == m->data_length_code - 1) ? "" : " ");
+    }
+}
+
+static can_evt_t evt(bool tx, uint32_t id, uint32_t flags, uint8_t dlc)
+{
+    can_evt_t e = {
+        .is_tx = tx,
+        .kind  = CAN_EVT_FRAME,
+        .msg   = { .identifier = id, .flags = flags, .data_length_code = dlc },
+    };
+    for (int i = 0; i < 8; i++) e.msg.data[i] = (uint8_t)(0x11 * i);
+    return e;
+}
+
+static void check_line(const can_evt_t *e, const char *want)
+{
+    char line[CAN_FMT_LINE_MAX], ref[CAN_FMT_LINE_MAX];
+    memset(line, 0x5A, sizeof(line));
+    size_t len = can_fmt_line(line, e);
+    TEST_ASSERT_EQUAL_STRING(want, line);
+    TEST_ASSERT_EQUAL(strlen(want), len);
+
+    format_ref(ref, sizeof(ref), e);
+    TEST_ASSERT_EQUAL_STRING(ref, line);
+}
+
+/* The corners the table version has to reproduce */
+static void test_fmt_cases(void)
+{
+    can_evt_t e = evt(false, 0x7, 0, 0);
+    check_line(&e, "RX ID=007 DLC=0 DATA=");
+
+    e = evt(true, 0x123, 0, 2);
+    check_line(&e, "TX ID=123 DLC=2 DATA=00 11");
+
+    e = evt(false, 0x18FEA831, TWAI_MSG_FLAG_EXTD, 8);
+    check_line(&e, "RX ID=18FEA831 DLC=8 DATA=00 11 22 33 44 55 66 77");
+
+    e = evt(false, 0x5, TWAI_MSG_FLAG_EXTD, 1);
+    check_line(&e, "RX ID=00000005 DLC=1 DATA=00");
+
+    /* Not flagged extended but wider than 11 bits: grows past 3 digits */
+    e = evt(false, 0x1ABCD, 0, 1);
+    check_line(&e, "RX ID=1ABCD DLC=1 DATA=00");
+
+    e = evt(true, 0x7DF, TWAI_MSG_FLAG_RTR, 8);
+    check_line(&e, "TX ID=7DF DLC=8 RTR");
+
+    /* DLC above 8: eight bytes, and the separator after the last one stays */
+    e = evt(false, 0x100, 0, 15);
+    check_line(&e, "RX ID=100 DLC=15 DATA=00 11 22 33 44 55 66 77 ");
+
+    /* The longest line fits */
+    e = evt(true, 0x1FFFFFFF, TWAI_MSG_FLAG_EXTD, 255);
+    char line[CAN_FMT_LINE_MAX];
+    TEST_ASSERT_LESS_THAN(CAN_FMT_LINE_MAX, can_fmt_line(line, &e));
+}
+
+/* Random frames: byte for byte the snprintf output */
+static void test_fmt_matches_snprintf(void)
+{
+    uint32_t x = 0x2545F491u;
+    char line[CAN_FMT_LINE_MAX], ref[CAN_FMT_LINE_MAX];
+
+    for (int i = 0; i < 200000; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        const bool ext = x & 1;
+        uint32_t flags = (ext ? TWAI_MSG_FLAG_EXTD : 0) | ((x & 0x30) == 0x30 ? TWAI_MSG_FLAG_RTR : 0);
+        can_evt_t e = evt(x & 2, ext ? (x >> 3) & 0x1FFFFFFF : (x >> 8) & 0x7FF, flags, (x >> 12) % 16);
+        memcpy(e.msg.data, &x, 4);
+        memcpy(&e.msg.data[4], &i, 4);
+
+        can_fmt_line(line, &e);
+        format_ref(ref, sizeof(ref), &e);
+        TEST_ASSERT_EQUAL_STRING(ref, line);
+    }
+}
+
+static void test_fmt_bus(void)
+{
+    can_rec_t r;
+    can_evt_t e;
+    int64_t base = 0;
+    char line[CAN_FMT_LINE_MAX];
+
+    can_rec_encode_bus(&r, 0, 10, CAN_BUS_EVT_ERR_PASSIVE, 128, 0, 0);
+    TEST_ASSERT_TRUE(can_rec_decode(&r, &base, &e));
+    can_fmt_line(line, &e);
+    TEST_ASSERT_EQUAL_STRING("BUS ERR-PASSIVE TEC=128 REC=0", line);
+
+    can_rec_encode_bus(&r, 0, 10, CAN_BUS_EVT_RX_LOST, 0, 300, 12);
+    TEST_ASSERT_TRUE(can_rec_decode(&r, &base, &e));
+    can_fmt_line(line, &e);
+    TEST_ASSERT_EQUAL_STRING("BUS RX-LOST N=12 TEC=0 REC=255", line);
+
+    can_rec_encode_bus(&r, 0, 10, CAN_BUS_EVT_RX_RESUMED, 0, 0, 180);
+    TEST_ASSERT_TRUE(can_rec_decode(&r, &base, &e));
+    can_fmt_line(line, &e);
+    TEST_ASSERT_EQUAL_STRING("BUS RX-RESUMED MS=180 TEC=0 REC=0", line);
+}
+
+/* One line per event, '\n' after each, and no line that might not fit */
+static void test_fmt_batch(void)
+{
+    can_evt_t e[3] = {
+        evt(false, 0x100, 0, 1),
+        evt(true, 0x18FEA831, TWAI_MSG_FLAG_EXTD, 0),
+        evt(false, 0x7DF, TWAI_MSG_FLAG_RTR, 8),
+    };
+    char buf[4 * CAN_FMT_LINE_MAX];
+    size_t done;
+
+    size_t len = can_fmt_batch(buf, sizeof(buf), e, 3, &done);
+    TEST_ASSERT_EQUAL(3, done);
+    const char *want = "RX ID=100 DLC=1 DATA=00\nTX ID=18FEA831 DLC=0 DATA=\nRX ID=7DF DLC=8 RTR\n";
+    TEST_ASSERT_EQUAL_STRING(want, buf);
+    TEST_ASSERT_EQUAL(strlen(want), len);
+
+    /* Stops once a worst-case line might not fit, even before a short one */
+    len = can_fmt_batch(buf, CAN_FMT_LINE_MAX + 20, e, 3, &done);
+    TEST_ASSERT_EQUAL(1, done);
+    TEST_ASSERT_EQUAL_STRING("RX ID=100 DLC=1 DATA=00\n", buf);
+    TEST_ASSERT_EQUAL(strlen(buf), len);
+
+    TEST_ASSERT_EQUAL(0, can_fmt_batch(buf, CAN_FMT_LINE_MAX - 1, e, 3, &done));
+    TEST_ASSERT_EQUAL(0, done);
+    TEST_ASSERT_EQUAL_STRING("", buf);
+}
+
+void test_can_fmt_run(void)
+{
+    RUN_TEST(test_fmt_cases);
+    RUN_TEST(test_fmt_matches_snprintf);
+    RUN_TEST(test_fmt_bus);
+    RUN_TEST(test_fmt_batch);
+}
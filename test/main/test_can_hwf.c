@@ -0,0 +1,250 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "esp_err.h"
+
+#include "can_bus.h"
+#include "can_hwf.h"
+#include "can_vbus.h"
+
+#include "test_main.h"
+
+#define STD_IDS  2048u
+#define EXT_IDS  (1u << 29)
+
+typedef struct {
+    const char      *name;
+    size_t           n;
+    can_hwf_range_t  ids[CAN_HWF_MAX_RANGES];
+} hwf_case_t;
+
+static twai_message_t msg(uint32_t id, bool ext, bool rtr, uint8_t d0, uint8_t d1)
+{
+    twai_message_t m = {
+        .identifier = id,
+        .flags = (ext ? TWAI_MSG_FLAG_EXTD : 0) | (rtr ? TWAI_MSG_FLAG_RTR : 0),
+        .data_length_code = 8,
+    };
+    m.data[0] = d0;
+    m.data[1] = d1;
+    return m;
+}
+
+static bool wanted(const hwf_case_t *c, uint32_t id, bool ext)
+{
+    for (size_t i = 0; i < c->n; i++) {
+        if (c->ids[i].extd == ext && id >= c->ids[i].lo && id <= c->ids[i].hi) return true;
+    }
+    return false;
+}
+
+/* Every wanted ID gets through the hardware filter, data or remote frame,
+ * whatever the first two payload bytes */
+static void check_no_false_negative(const twai_filter_config_t *f, uint32_t id, bool ext)
+{
+    static const uint8_t k_pay[][2] = { { 0x00, 0x00 }, { 0xFF, 0xFF }, { 0x5A, 0xA5 }, { 0x0F, 0xF0 } };
+    for (size_t p = 0; p < sizeof(k_pay) / sizeof(k_pay[0]); p++) {
+        for (int rtr = 0; rtr < 2; rtr++) {
+            twai_message_t m = msg(id, ext, rtr, k_pay[p][0], k_pay[p][1]);
+            if (!can_hwf_hw_accepts(f, &m)) {
+                TEST_FAIL_MESSAGE("hardware filter drops a wanted ID");
+            }
+        }
+    }
+}
+
+/* Hardware then second stage: exactly the wanted IDs */
+static void check_exact(const hwf_case_t *c, uint32_t id, bool ext)
+{
+    twai_message_t m = msg(id, ext, false, 0, 0);
+    TEST_ASSERT_EQUAL_MESSAGE(wanted(c, id, ext), can_hwf_match(&m), c->name);
+}
+
+/* Extended IDs the hardware passes, over the whole 29-bit space. A dual
+ * filter compares ID[28:13] only, so one ID stands for each 8192-ID block.
+ * A single filter compares every ID bit on its own; a block can only hold
+ * accepted IDs if its member with the code's low 13 bits is accepted, and
+ * only those blocks are walked ID by ID. */
+static uint32_t ext_pass_count(const twai_filter_config_t *f)
+{
+    uint32_t pass = 0;
+    const uint32_t low = (f->acceptance_code >> 3) & 0x1FFF;
+
+    for (uint32_t blk = 0; blk < EXT_IDS; blk += 0x2000) {
+        twai_message_t m = msg(blk | (f->single_filter ? low : 0), true, false, 0, 0);
+        if (!can_hwf_hw_accepts(f, &m)) continue;
+        if (!f->single_filter) {
+            pass += 0x2000;
+            continue;
+        }
+        for (uint32_t id = blk; id < blk + 0x2000; id++) {
+            m.identifier = id;
+            pass += can_hwf_hw_accepts(f, &m);
+        }
+    }
+    return pass;
+}
+
+/* ---------------- 11-bit ---------------- */
+
+static hwf_case_t s_std_cases[5];
+
+static void std_cases_build(void)
+{
+    hwf_case_t *c = &s_std_cases[0];
+    c->name = "obd";
+    c->ids[c->n++] = CAN_HWF_ID(0x7DF, false);
+    c->ids[c->n++] = CAN_HWF_ID(0x7E8, false);
+
+    c = &s_std_cases[1];
+    c->name = "block";
+    c->ids[c->n++] = CAN_HWF_RANGE(0x100, 0x1FF, false);
+
+    c = &s_std_cases[2];
+    c->name = "scattered";
+    static const uint32_t k_ids[] = { 0x0A0, 0x123, 0x1F4, 0x244, 0x300, 0x3E9, 0x456,
+                                      0x501, 0x5FF, 0x60A, 0x700, 0x7FF };
+    for (size_t i = 0; i < sizeof(k_ids) / sizeof(k_ids[0]); i++) c->ids[c->n++] = CAN_HWF_ID(k_ids[i], false);
+
+    c = &s_std_cases[3];
+    c->name = "unaligned";
+    c->ids[c->n++] = CAN_HWF_RANGE(0x0F3, 0x10C, false);
+    c->ids[c->n++] = CAN_HWF_RANGE(0x6FF, 0x701, false);
+
+    /* 64 ranges of 4 aligned blocks each: more than the search takes, so
+     * every range falls back to its enclosing block */
+    c = &s_std_cases[4];
+    c->name = "coarse";
+    for (uint32_t i = 0; i < CAN_HWF_MAX_RANGES; i++) c->ids[c->n++] = CAN_HWF_RANGE(i * 24 + 1, i * 24 + 6, false);
+}
+
+static void test_hwf_std_space(void)
+{
+    std_cases_build();
+
+    for (size_t k = 0; k < sizeof(s_std_cases) / sizeof(s_std_cases[0]); k++) {
+        const hwf_case_t *c = &s_std_cases[k];
+        can_hwf_result_t r;
+        TEST_ASSERT_EQUAL(ESP_OK, can_hwf_apply(c->ids, c->n, &r));
+
+        /* Standard IDs only: payload bits are don't-care, so what the
+         * hardware passes can be counted directly */
+        uint32_t want = 0, pass = 0;
+        for (uint32_t id = 0; id < STD_IDS; id++) {
+            if (wanted(c, id, false)) {
+                want++;
+                check_no_false_negative(&r.hw, id, false);
+            }
+            twai_message_t m = msg(id, false, false, 0, 0);
+            pass += can_hwf_hw_accepts(&r.hw, &m);
+            check_exact(c, id, false);
+        }
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(want, r.want_std, c->name);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(pass, r.pass_std, c->name);
+        TEST_ASSERT_UINT32_WITHIN(1, want * 1000 / pass, r.std_ratio_x1000);
+
+        /* No extended ID was asked for; none reaches the application */
+        for (uint32_t id = 0; id < EXT_IDS; id += 0x10001) check_exact(c, id, true);
+    }
+
+    /* One aligned block fits a single cube exactly. Extended frames that
+     * share its bits still pass (payload bits of a standard frame are ID
+     * bits of an extended one) and are left to the second stage. */
+    can_hwf_result_t r;
+    TEST_ASSERT_EQUAL(ESP_OK, can_hwf_synth(s_std_cases[1].ids, s_std_cases[1].n, &r));
+    TEST_ASSERT_EQUAL_UINT32(256, r.pass_std);
+    TEST_ASSERT_EQUAL_UINT32(1000, r.std_ratio_x1000);
+    TEST_ASSERT_EQUAL_UINT32(ext_pass_count(&r.hw), r.pass_ext);
+}
+
+/* ---------------- 29-bit ---------------- */
+
+static hwf_case_t s_ext_cases[4];
+
+static void ext_cases_build(void)
+{
+    hwf_case_t *c = &s_ext_cases[0];
+    c->name = "j1939";
+    c->ids[c->n++] = CAN_HWF_RANGE(0x18FEF100, 0x18FEF1FF, true);
+    c->ids[c->n++] = CAN_HWF_ID(0x0CF00400, true);
+
+    c = &s_ext_cases[1];
+    c->name = "corners";
+    c->ids[c->n++] = CAN_HWF_ID(0x00000000, true);
+    c->ids[c->n++] = CAN_HWF_ID(0x1FFFFFFF, true);
+
+    c = &s_ext_cases[2];
+    c->name = "wide";
+    c->ids[c->n++] = CAN_HWF_RANGE(0x00010000, 0x0003FFFF, true);
+    c->ids[c->n++] = CAN_HWF_RANGE(0x1FFF0000, 0x1FFF7FFF, true);
+
+    c = &s_ext_cases[3];
+    c->name = "mixed";
+    c->ids[c->n++] = CAN_HWF_ID(0x7DF, false);
+    c->ids[c->n++] = CAN_HWF_RANGE(0x7E8, 0x7EF, false);
+    c->ids[c->n++] = CAN_HWF_RANGE(0x18DAF100, 0x18DAF1FF, true);
+    c->ids[c->n++] = CAN_HWF_ID(0x18FECA00, true);
+}
+
+static void test_hwf_ext_space(void)
+{
+    ext_cases_build();
+
+    for (size_t k = 0; k < sizeof(s_ext_cases) / sizeof(s_ext_cases[0]); k++) {
+        const hwf_case_t *c = &s_ext_cases[k];
+        can_hwf_result_t r;
+        TEST_ASSERT_EQUAL(ESP_OK, can_hwf_apply(c->ids, c->n, &r));
+
+        uint32_t want = 0;
+        for (size_t i = 0; i < c->n; i++) {
+            const can_hwf_range_t *g = &c->ids[i];
+            if (!g->extd) {
+                for (uint32_t id = g->lo; id <= g->hi; id++) check_no_false_negative(&r.hw, id, false);
+                continue;
+            }
+            want += g->hi - g->lo + 1;
+
+            /* Every wanted ID, and the second stage's edges on both sides */
+            for (uint32_t id = g->lo; id <= g->hi; id++) check_no_false_negative(&r.hw, id, true);
+            check_exact(c, g->lo, true);
+            check_exact(c, g->hi, true);
+            if (g->lo > 0) check_exact(c, g->lo - 1, true);
+            if (g->hi < EXT_IDS - 1) check_exact(c, g->hi + 1, true);
+        }
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(want, r.want_ext, c->name);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(ext_pass_count(&r.hw), r.pass_ext, c->name);
+
+        /* Second stage across the space */
+        for (uint32_t id = 0; id < EXT_IDS; id += 0x1003) check_exact(c, id, true);
+        for (uint32_t id = 0; id < STD_IDS; id++) check_exact(c, id, false);
+    }
+}
+
+/* Nothing asked for: accept-all, second stage off */
+static void test_hwf_accept_all(void)
+{
+    can_hwf_result_t r;
+    TEST_ASSERT_EQUAL(ESP_OK, can_hwf_apply(NULL, 0, &r));
+    TEST_ASSERT_EQUAL_UINT32(1000, r.std_ratio_x1000);
+    TEST_ASSERT_EQUAL_UINT32(EXT_IDS, r.pass_ext);
+
+    twai_message_t m[3] = { msg(0x123, false, false, 0, 0), msg(0x1ABCDEF, true, false, 0, 0),
+                            msg(0x7FF, false, true, 0, 0) };
+    TEST_ASSERT_EQUAL(3, can_hwf_filter(m, 3));
+    for (size_t i = 0; i < 3; i++) TEST_ASSERT_TRUE(can_hwf_hw_accepts(&r.hw, &m[i]));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, can_hwf_synth(s_std_cases[4].ids, CAN_HWF_MAX_RANGES + 1, &r));
+}
+
+void test_can_hwf_run(void)
+{
+    /* can_hwf_apply() reinstalls the filter through can_bus */
+    ESP_ERROR_CHECK(can_vbus_init(NULL));
+    ESP_ERROR_CHECK(can_bus_deinit());
+    ESP_ERROR_CHECK(can_bus_init(&can_vbus_bus, NULL));
+
+    RUN_TEST(test_hwf_std_space);
+    RUN_TEST(test_hwf_ext_space);
+    RUN_TEST(test_hwf_accept_all);
+}
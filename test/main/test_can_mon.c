@@ -0,0 +1,380 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "can_mon.h"
+
+#include "test_main.h"
+
+#define TEST_RX_RING   16
+#define TEST_CAP_RECS  64
+#define TEST_CAP_STEP  (CAN_REC_SYNC_PERIOD_US / 10)   /* a SYNC every 10 frames */
+
+static int64_t s_t = 1000;    /* RX time, kept ahead of everything pushed so far */
+
+static twai_message_t frame(uint32_t seq)
+{
+    twai_message_t m = {
+        .identifier = 0x100 + (seq & 0x3FF),
+        .data_length_code = 8,
+    };
+    memcpy(&m.data[0], &seq, 4);
+    uint32_t inv = ~seq;
+    memcpy(&m.data[4], &inv, 4);
+    return m;
+}
+
+static uint32_t frame_seq(const twai_message_t *m)
+{
+    uint32_t seq, inv;
+    memcpy(&seq, &m->data[0], 4);
+    memcpy(&inv, &m->data[4], 4);
+    TEST_ASSERT_EQUAL_HEX32(~seq, inv);
+    return seq;
+}
+
+static void push_rx(uint32_t seq0, size_t n, int64_t step_us)
+{
+    twai_message_t msgs[64];
+    TEST_ASSERT_LESS_OR_EQUAL(64, n);
+    for (size_t i = 0; i < n; i++) msgs[i] = frame(seq0 + (uint32_t)i);
+    can_mon_push_rx_batch(msgs, n, s_t, s_t + step_us * (int64_t)(n - 1));
+    s_t += step_us * (int64_t)n;
+}
+
+/* Take everything the rings hold, in the merged order, like the decode stage */
+static size_t drain(can_evt_t *out, size_t max, size_t peek_max)
+{
+    size_t n = 0;
+    const can_rec_t *recs;
+    int64_t base;
+    size_t k;
+    while ((k = can_mon_peek(&recs, &base, peek_max)) > 0) {
+        for (size_t i = 0; i < k; i++) {
+            can_evt_t e;
+            if (can_rec_decode(&recs[i], &base, &e)) {
+                TEST_ASSERT_TRUE(n < max);
+                out[n++] = e;
+            }
+        }
+        can_mon_release(k);
+    }
+    return n;
+}
+
+/* Empty the rings without looking; the capture tests only fill them */
+static void discard(void)
+{
+    const can_rec_t *recs;
+    int64_t base;
+    size_t k;
+    while ((k = can_mon_peek(&recs, &base, SIZE_MAX)) > 0) can_mon_release(k);
+}
+
+/* One frame per call, TEST_CAP_STEP apart: the capture store then holds a
+ * SYNC and 10 frames per period, 11 records for every 10 frames */
+static void push_cap(uint32_t seq0, size_t n)
+{
+    for (size_t i = 0; i < n; i++) push_rx(seq0 + (uint32_t)i, 1, TEST_CAP_STEP);
+    discard();
+}
+
+/* Read up to max frames; checks each against the next expected sequence */
+static size_t cap_read(can_mon_cap_cursor_t *c, uint32_t seq0, size_t max)
+{
+    can_evt_t e[8];
+    size_t n = 0, k;
+    while (n < max && (k = can_mon_capture_read(c, e, max - n < 8 ? max - n : 8)) > 0) {
+        for (size_t i = 0; i < k; i++) TEST_ASSERT_EQUAL_UINT32(seq0 + n + i, frame_seq(&e[i].msg));
+        n += k;
+    }
+    return n;
+}
+
+/* ---------------- Rings ---------------- */
+
+/* Batches of 5 through a 16-slot ring: runs split at the wrap point and
+ * every frame comes out once, in order, with increasing timestamps */
+static void test_ring_wrap(void)
+{
+    can_evt_t out[8];
+    uint32_t seq = 0;
+    int64_t last_t = 0;
+
+    for (int round = 0; round < 40; round++) {
+        push_rx(seq, 5, 10);
+
+        const can_rec_t *recs;
+        int64_t base;
+        size_t got = 0, k;
+        while ((k = can_mon_peek(&recs, &base, SIZE_MAX)) > 0) {
+            TEST_ASSERT_LESS_OR_EQUAL(TEST_RX_RING, k);
+            for (size_t i = 0; i < k; i++) {
+                can_evt_t e;
+                if (!can_rec_decode(&recs[i], &base, &e)) continue;
+                TEST_ASSERT_EQUAL_UINT32(seq + got, frame_seq(&e.msg));
+                TEST_ASSERT_GREATER_THAN(last_t, e.t_us);
+                last_t = e.t_us;
+                got++;
+            }
+            can_mon_release(k);
+        }
+        TEST_ASSERT_EQUAL(5, got);
+        seq += 5;
+    }
+    TEST_ASSERT_EQUAL(0, drain(out, 8, SIZE_MAX));
+}
+
+/* A full ring keeps the oldest and counts the rest as drops */
+static void test_ring_full(void)
+{
+    const uint32_t rx0 = can_mon_get_rx_cnt(), drop0 = can_mon_get_drop_cnt();
+
+    /* Far from the last SYNC: the batch opens with a new one */
+    s_t += 2 * CAN_REC_SYNC_PERIOD_US;
+    push_rx(1000, 20, 10);
+
+    const uint32_t kept = can_mon_get_rx_cnt() - rx0;
+    TEST_ASSERT_EQUAL_UINT32(TEST_RX_RING - 1, kept);
+    TEST_ASSERT_EQUAL_UINT32(20 - kept, can_mon_get_drop_cnt() - drop0);
+
+    can_evt_t out[TEST_RX_RING];
+    TEST_ASSERT_EQUAL(kept, drain(out, TEST_RX_RING, SIZE_MAX));
+    for (uint32_t i = 0; i < kept; i++) TEST_ASSERT_EQUAL_UINT32(1000 + i, frame_seq(&out[i].msg));
+}
+
+/* Releasing part of a peek leaves the rest, and the SYNC base, for the next */
+static void test_ring_partial_release(void)
+{
+    s_t += 2 * CAN_REC_SYNC_PERIOD_US;
+    const int64_t t0 = s_t;
+    push_rx(2000, 6, 100);
+
+    const can_rec_t *recs;
+    int64_t base;
+    TEST_ASSERT_EQUAL(3, can_mon_peek(&recs, &base, 3));
+    TEST_ASSERT_TRUE(can_rec_is_sync(&recs[0]));
+    can_mon_release(2);   /* SYNC and the first frame */
+
+    TEST_ASSERT_EQUAL(2, can_mon_peek(&recs, &base, 2));
+    TEST_ASSERT_EQUAL_INT64(t0, base);
+    can_evt_t e;
+    TEST_ASSERT_TRUE(can_rec_decode(&recs[0], &base, &e));
+    TEST_ASSERT_EQUAL_UINT32(2001, frame_seq(&e.msg));
+    TEST_ASSERT_GREATER_THAN(t0, e.t_us);
+    can_mon_release(1);
+
+    can_evt_t out[8];
+    TEST_ASSERT_EQUAL(4, drain(out, 8, SIZE_MAX));
+    TEST_ASSERT_EQUAL_UINT32(2002, frame_seq(&out[0].msg));
+    TEST_ASSERT_GREATER_THAN(e.t_us, out[0].t_us);
+    TEST_ASSERT_LESS_OR_EQUAL(t0 + 500, out[3].t_us);
+}
+
+/* RX and TX come out merged by time whatever the peek size. The TX side
+ * stamps with esp_timer time, so the RX frames are placed around it: the
+ * first batch in the past, the second just ahead. */
+static void test_ring_merge_rx_tx(void)
+{
+    for (size_t peek_max = 1; peek_max <= 8; peek_max *= 2) {
+        while (esp_timer_get_time() <= s_t + 1000) {
+        }
+        push_rx(3000, 4, 10);                       /* before the TX frames */
+
+        twai_message_t tx = frame(4000);
+        can_mon_push_evt(true, &tx);
+        tx = frame(4001);
+        can_mon_push_evt(true, &tx);
+
+        s_t = esp_timer_get_time() + 100;
+        push_rx(3004, 4, 10);                       /* after them */
+
+        can_evt_t out[16];
+        TEST_ASSERT_EQUAL(10, drain(out, 16, peek_max));
+        static const uint32_t k_order[] = { 3000, 3001, 3002, 3003, 4000, 4001, 3004, 3005, 3006, 3007 };
+        for (size_t i = 0; i < 10; i++) {
+            TEST_ASSERT_EQUAL_UINT32(k_order[i], frame_seq(&out[i].msg));
+            TEST_ASSERT_EQUAL(k_order[i] >= 4000, out[i].is_tx);
+            if (i > 0) TEST_ASSERT_GREATER_OR_EQUAL(out[i - 1].t_us, out[i].t_us);
+        }
+    }
+}
+
+/* ---------------- Capture store ---------------- */
+
+/* The flight recorder keeps the newest records. A cursor starting at the
+ * oldest one skips to the first SYNC, and one the writer overtook jumps
+ * ahead; both count what they skipped as lost. */
+static void test_cap_overwrite(void)
+{
+    can_mon_capture_set_policy(CAN_MON_CAP_OVERWRITE_OLDEST);
+    const int64_t t0 = s_t;
+    push_cap(0, 200);   /* 220 records, 156..219 kept */
+
+    TEST_ASSERT_EQUAL(TEST_CAP_RECS, can_mon_capture_count());
+    TEST_ASSERT_EQUAL_UINT32(0, can_mon_capture_get_drop_cnt());
+    TEST_ASSERT_FALSE(can_mon_capture_is_stopped());
+
+    /* Record 156 is frame 141; the next SYNC is the one before frame 150 */
+    can_mon_cap_cursor_t c;
+    can_mon_capture_cursor_oldest(&c);
+    can_evt_t e;
+    TEST_ASSERT_EQUAL(1, can_mon_capture_read(&c, &e, 1));
+    TEST_ASSERT_EQUAL_UINT32(150, frame_seq(&e.msg));
+    TEST_ASSERT_EQUAL_INT64(t0 + 150 * TEST_CAP_STEP, e.t_us);
+    TEST_ASSERT_EQUAL_UINT32(9, c.lost);
+    TEST_ASSERT_EQUAL(4, cap_read(&c, 151, 4));
+
+    /* Overtaken: the cursor is at record 171, the oldest is now 266 (frame
+     * 241), and decoding restarts at frame 250 */
+    push_cap(200, 100);
+    TEST_ASSERT_EQUAL(50, cap_read(&c, 250, SIZE_MAX));
+    TEST_ASSERT_EQUAL_UINT32(9 + (266 - 171) + 9, c.lost);
+    TEST_ASSERT_EQUAL(0, can_mon_capture_read(&c, &e, 1));
+
+    /* Clearing drops everything before the cursor; new frames read on */
+    can_mon_capture_clear();
+    TEST_ASSERT_EQUAL(0, can_mon_capture_count());
+    push_cap(300, 5);
+    TEST_ASSERT_EQUAL(5, cap_read(&c, 300, SIZE_MAX));
+}
+
+/* One-shot: the first 64 records stay, the rest is dropped until a clear */
+static void test_cap_stop_when_full(void)
+{
+    can_mon_capture_set_policy(CAN_MON_CAP_STOP_WHEN_FULL);
+    push_cap(0, 100);   /* frames 0..57 and 6 SYNCs fill it */
+
+    TEST_ASSERT_TRUE(can_mon_capture_is_stopped());
+    TEST_ASSERT_EQUAL(TEST_CAP_RECS, can_mon_capture_count());
+    TEST_ASSERT_EQUAL_UINT32(100 - 58, can_mon_capture_get_drop_cnt());
+
+    can_mon_cap_cursor_t c;
+    can_mon_capture_cursor_oldest(&c);
+    TEST_ASSERT_EQUAL(58, cap_read(&c, 0, SIZE_MAX));
+    TEST_ASSERT_EQUAL_UINT32(0, c.lost);
+
+    /* Reading does not re-arm it; clearing does */
+    push_cap(100, 1);
+    TEST_ASSERT_EQUAL_UINT32(100 - 58 + 1, can_mon_capture_get_drop_cnt());
+    can_mon_capture_clear();
+    TEST_ASSERT_FALSE(can_mon_capture_is_stopped());
+    TEST_ASSERT_EQUAL_UINT32(0, can_mon_capture_get_drop_cnt());
+    push_cap(200, 5);
+    can_mon_capture_cursor_oldest(&c);
+    TEST_ASSERT_EQUAL(5, cap_read(&c, 200, SIZE_MAX));
+}
+
+/* FIFO: new frames are dropped until the reader releases what it read, and
+ * the reader loses nothing it was given */
+static void test_cap_drop_newest(void)
+{
+    can_mon_capture_set_policy(CAN_MON_CAP_DROP_NEWEST);
+    push_cap(0, 100);   /* 0..57 kept */
+
+    TEST_ASSERT_FALSE(can_mon_capture_is_stopped());
+    TEST_ASSERT_EQUAL_UINT32(100 - 58, can_mon_capture_get_drop_cnt());
+
+    can_mon_cap_cursor_t c;
+    can_mon_capture_cursor_oldest(&c);
+    TEST_ASSERT_EQUAL(20, cap_read(&c, 0, 20));
+    push_cap(100, 1);                            /* not released yet */
+    TEST_ASSERT_EQUAL_UINT32(100 - 58 + 1, can_mon_capture_get_drop_cnt());
+
+    /* 22 records freed: a SYNC and 10 frames, twice */
+    can_mon_capture_release(&c);
+    TEST_ASSERT_EQUAL(TEST_CAP_RECS - 22, can_mon_capture_count());
+    push_cap(200, 25);
+    TEST_ASSERT_EQUAL_UINT32(100 - 58 + 1 + 5, can_mon_capture_get_drop_cnt());
+
+    TEST_ASSERT_EQUAL(38, cap_read(&c, 20, 38));   /* then straight to 200 */
+    TEST_ASSERT_EQUAL(20, cap_read(&c, 200, SIZE_MAX));
+    TEST_ASSERT_EQUAL_UINT32(0, c.lost);
+    can_mon_capture_release(&c);
+    TEST_ASSERT_EQUAL(0, can_mon_capture_count());
+}
+
+static volatile bool s_cap_stop;
+static volatile uint32_t s_cap_written;
+
+/* Stands in for the RX task: bursts of frames, as fast as it can */
+static void cap_writer(void *arg)
+{
+    SemaphoreHandle_t done = arg;
+    twai_message_t msgs[16];
+    uint32_t seq = 0;
+
+    while (!s_cap_stop) {
+        for (size_t i = 0; i < 16; i++) msgs[i] = frame(seq + (uint32_t)i);
+        can_mon_push_rx_batch(msgs, 16, s_t, s_t + 15 * TEST_CAP_STEP);
+        seq += 16;
+        s_t += 16 * TEST_CAP_STEP;
+        s_cap_written = seq;
+        taskYIELD();
+    }
+    xSemaphoreGive(done);
+    vTaskDelete(NULL);
+}
+
+/* A reader racing the writer never returns a torn record (the payload
+ * carries seq and ~seq), frames come out in order, and every gap in the
+ * sequence shows up in the lost count. The writer owns s_t meanwhile. */
+static void test_cap_overwrite_race(void)
+{
+    can_mon_capture_set_policy(CAN_MON_CAP_OVERWRITE_OLDEST);
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(done);
+    s_cap_stop = false;
+    s_cap_written = 0;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(cap_writer, "cap_wr", 4096, done,
+                                          uxTaskPriorityGet(NULL), NULL));
+
+    can_mon_cap_cursor_t c;
+    can_mon_capture_cursor_oldest(&c);
+    can_evt_t e[8];
+    uint32_t next = 0, read = 0;
+    int64_t last_t = -1;
+
+    while (s_cap_written < 100000) {
+        const uint32_t lost0 = c.lost;
+        size_t k = can_mon_capture_read(&c, e, 8);
+        for (size_t i = 0; i < k; i++) {
+            uint32_t seq = frame_seq(&e[i].msg);
+            TEST_ASSERT_GREATER_OR_EQUAL_UINT32(next, seq);
+            TEST_ASSERT_GREATER_THAN(last_t, e[i].t_us);
+            if (seq != next) TEST_ASSERT_GREATER_THAN_UINT32(lost0, c.lost);
+            next = seq + 1;
+            last_t = e[i].t_us;
+        }
+        read += k;
+        taskYIELD();
+    }
+    s_cap_stop = true;
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(done, portMAX_DELAY));
+    vSemaphoreDelete(done);
+    discard();
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, read);
+}
+
+void test_can_mon_run(void)
+{
+    ESP_ERROR_CHECK(can_mon_init(TEST_RX_RING));
+
+    RUN_TEST(test_ring_wrap);
+    RUN_TEST(test_ring_full);
+    RUN_TEST(test_ring_partial_release);
+    RUN_TEST(test_ring_merge_rx_tx);
+
+    ESP_ERROR_CHECK(can_mon_capture_init(TEST_CAP_RECS * sizeof(can_rec_t), CAN_MON_CAP_OVERWRITE_OLDEST));
+    RUN_TEST(test_cap_overwrite);
+    RUN_TEST(test_cap_stop_when_full);
+    RUN_TEST(test_cap_drop_newest);
+    RUN_TEST(test_cap_overwrite_race);
+}
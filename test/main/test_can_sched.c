@@ -0,0 +1,317 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "can_bus.h"
+#include "can_sched.h"
+#include "can_tx.h"
+#include "can_vbus.h"
+
+#include "test_main.h"
+
+#define TEST_SCHED_MSGS  64
+#define TEST_SCHED_LOG   2048
+
+/* The scheduler takes deadlines from esp_timer at add time; runs are driven
+ * with explicit times from just after the adds, offset by half a tick past
+ * the due tick so the rounding never decides a test */
+#define LATE_US  (CAN_SCHED_TICK_US + CAN_SCHED_TICK_US / 2)
+
+static struct {
+    int64_t  now;                       /* time of the run in progress */
+    bool     refuse;                    /* hook reports a full TX queue */
+    size_t   n;
+    uint32_t id[TEST_SCHED_LOG];
+    int64_t  at[TEST_SCHED_LOG];
+} s_log;
+
+static esp_err_t log_tx(const twai_message_t *m)
+{
+    if (s_log.refuse) return ESP_ERR_NO_MEM;
+    if (s_log.n < TEST_SCHED_LOG) {
+        s_log.id[s_log.n] = m->identifier;
+        s_log.at[s_log.n] = s_log.now;
+        s_log.n++;
+    }
+    return ESP_OK;
+}
+
+static size_t run(int64_t t)
+{
+    s_log.now = t;
+    return can_sched_run(t);
+}
+
+static can_sched_handle_t add(uint32_t id, uint32_t period_us, uint32_t phase_us)
+{
+    const twai_message_t m = { .identifier = id, .data_length_code = 8 };
+    can_sched_handle_t h = can_sched_add(&m, period_us, phase_us);
+    TEST_ASSERT_NOT_EQUAL(0, h);
+    return h;
+}
+
+static size_t sends(uint32_t id)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s_log.n; i++) n += (s_log.id[i] == id);
+    return n;
+}
+
+static void setup(void)
+{
+    memset(&s_log, 0, sizeof(s_log));
+}
+
+/* Every test leaves the table empty */
+static void teardown(can_sched_handle_t *h, size_t n)
+{
+    for (size_t i = 0; i < n; i++) TEST_ASSERT_EQUAL(ESP_OK, can_sched_remove(h[i]));
+    TEST_ASSERT_EQUAL(0, can_sched_count());
+}
+
+/* One second in 1 ms runs: each message sends once per period, starting at
+ * its phase, and never early */
+static void test_sched_period_phase(void)
+{
+    setup();
+    can_sched_handle_t h[3] = {
+        add(0x100, 10000, 0),
+        add(0x200, 20000, 5000),
+        add(0x300, 100000, 37000),
+    };
+    const int64_t t0 = esp_timer_get_time();
+
+    for (int64_t t = t0; t <= t0 + 999000; t += CAN_SCHED_TICK_US) run(t);
+
+    TEST_ASSERT_EQUAL(100, sends(0x100));
+    TEST_ASSERT_EQUAL(50, sends(0x200));
+    TEST_ASSERT_EQUAL(10, sends(0x300));
+
+    static const struct { uint32_t id, period, phase; } k_msgs[] = {
+        { 0x100, 10000, 0 }, { 0x200, 20000, 5000 }, { 0x300, 100000, 37000 },
+    };
+    for (size_t k = 0; k < 3; k++) {
+        size_t n = 0;
+        for (size_t i = 0; i < s_log.n; i++) {
+            if (s_log.id[i] != k_msgs[k].id) continue;
+            /* Deadline n is phase + n * period after the add, which came
+             * just before t0. It goes out on the first 1 ms run at or after
+             * its due tick: [due - add time, due + 2 ticks). */
+            const int64_t due = t0 + k_msgs[k].phase + (int64_t)n * k_msgs[k].period;
+            TEST_ASSERT_INT64_WITHIN(3 * CAN_SCHED_TICK_US / 2, due + CAN_SCHED_TICK_US / 2, s_log.at[i]);
+            n++;
+        }
+
+        can_sched_stats_t st;
+        TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h[k], &st));
+        TEST_ASSERT_EQUAL_UINT32(n, st.sent);
+        TEST_ASSERT_EQUAL_UINT32(0, st.missed);
+        TEST_ASSERT_EQUAL_UINT32(0, st.tx_fail);
+        TEST_ASSERT_LESS_THAN_UINT32(2 * CAN_SCHED_TICK_US, st.jit_max_us);
+    }
+    teardown(h, 3);
+}
+
+/* A run a few periods late sends once and skips the lost cycles; the next
+ * deadline keeps the original phase. Lateness lands in the histogram. */
+static void test_sched_missed_and_jitter(void)
+{
+    setup();
+    can_sched_handle_t h = add(0x123, 10000, 0);
+    const int64_t t0 = esp_timer_get_time();
+
+    TEST_ASSERT_EQUAL(1, run(t0 + LATE_US));
+    TEST_ASSERT_EQUAL(1, run(t0 + 35000 + LATE_US));     /* sends 10 ms, 20 and 30 ms lost */
+    TEST_ASSERT_EQUAL(0, run(t0 + 39000));
+    TEST_ASSERT_EQUAL(1, run(t0 + 40000 + LATE_US));
+    TEST_ASSERT_EQUAL(0, run(t0 + 40000 + LATE_US + 100));
+
+    can_sched_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h, &st));
+    TEST_ASSERT_EQUAL_UINT32(3, st.sent);
+    TEST_ASSERT_EQUAL_UINT32(2, st.missed);
+
+    /* 1.5 ms twice: [1024, 2048) is bucket 5. 26.5 ms: [16384, 32768) is 9. */
+    uint32_t total = 0;
+    for (int b = 0; b < CAN_SCHED_JIT_BUCKETS; b++) total += st.hist[b];
+    TEST_ASSERT_EQUAL_UINT32(3, total);
+    TEST_ASSERT_EQUAL_UINT32(2, st.hist[5]);
+    TEST_ASSERT_EQUAL_UINT32(1, st.hist[9]);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(25000 + LATE_US, st.jit_max_us);
+    TEST_ASSERT_LESS_THAN_UINT32(27000 + LATE_US, st.jit_max_us);
+
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_reset_stats(h));
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h, &st));
+    TEST_ASSERT_EQUAL_UINT32(0, st.sent + st.missed + st.jit_max_us);
+    teardown(&h, 1);
+}
+
+/* A new period counts from the last deadline */
+static void test_sched_set_period(void)
+{
+    setup();
+    can_sched_handle_t h = add(0x321, 10000, 0);
+    const int64_t t0 = esp_timer_get_time();
+
+    TEST_ASSERT_EQUAL(1, run(t0 + LATE_US));
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_set_period(h, 25000));
+    TEST_ASSERT_EQUAL(0, run(t0 + 24000));
+    TEST_ASSERT_EQUAL(1, run(t0 + 25000 + LATE_US));
+    TEST_ASSERT_EQUAL(0, run(t0 + 49000));
+    TEST_ASSERT_EQUAL(1, run(t0 + 50000 + LATE_US));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, can_sched_set_period(h, CAN_SCHED_TICK_US - 1));
+    teardown(&h, 1);
+
+    /* Stale handles miss */
+    can_sched_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, can_sched_get_stats(h, &st));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, can_sched_set_period(h, 10000));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, can_sched_remove(h));
+}
+
+/* A crowded tick goes out in bursts. A frame the hook refuses waits for its
+ * next cycle; the rest go out on the next run. */
+static void test_sched_burst(void)
+{
+    setup();
+    static can_sched_handle_t h[CAN_SCHED_MAX_BURST + 8];
+    const size_t n = sizeof(h) / sizeof(h[0]);
+    for (size_t i = 0; i < n; i++) h[i] = add(0x400 + i, 100000, 0);
+    const int64_t t0 = esp_timer_get_time();
+
+    TEST_ASSERT_EQUAL(CAN_SCHED_MAX_BURST, run(t0 + LATE_US));
+    s_log.refuse = true;
+    TEST_ASSERT_EQUAL(0, run(t0 + LATE_US + 100));
+    s_log.refuse = false;
+    TEST_ASSERT_EQUAL(n - CAN_SCHED_MAX_BURST - 1, run(t0 + LATE_US + 200));
+    TEST_ASSERT_EQUAL(n - 1, s_log.n);
+
+    /* In order of addition */
+    for (size_t i = 0; i < s_log.n; i++) {
+        TEST_ASSERT_EQUAL_HEX32(0x400 + i + (i >= CAN_SCHED_MAX_BURST), s_log.id[i]);
+    }
+
+    can_sched_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h[CAN_SCHED_MAX_BURST], &st));
+    TEST_ASSERT_EQUAL_UINT32(1, st.tx_fail);
+    TEST_ASSERT_EQUAL_UINT32(0, st.sent);
+    teardown(h, n);
+}
+
+/* Periods past the first wheel level cascade through L1 and past its 64
+ * rounds through the parking slot; a run after a long gap does not walk it */
+static void test_sched_long_periods(void)
+{
+    setup();
+    can_sched_handle_t h[2] = {
+        add(0x500, 1000000, 0),        /* 1 s: L1 */
+        add(0x501, 30000000, 0),       /* 30 s: parked past L1 */
+    };
+    const int64_t t0 = esp_timer_get_time();
+
+    TEST_ASSERT_EQUAL(2, run(t0 + LATE_US));
+    for (int64_t t = t0 + 100000; t < t0 + 30000000; t += 100000) run(t);
+    TEST_ASSERT_EQUAL(30, sends(0x500));
+    TEST_ASSERT_EQUAL(1, sends(0x501));
+    TEST_ASSERT_EQUAL(2, run(t0 + 30000000 + LATE_US));
+
+    /* An hour without a run: one send each, the hour counted as missed */
+    TEST_ASSERT_EQUAL(2, run(t0 + 3630000000LL + LATE_US));
+    can_sched_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h[0], &st));
+    TEST_ASSERT_EQUAL_UINT32(3600 - 1, st.missed);
+    teardown(h, 2);
+}
+
+/* An empty scheduler does not advance. Adding to it starts the wheel at
+ * now, whatever time the last run saw. */
+static void test_sched_idle_restart(void)
+{
+    setup();
+    const int64_t t0 = esp_timer_get_time();
+
+    /* Empty: a run far ahead costs nothing and sends nothing */
+    TEST_ASSERT_EQUAL(0, run(t0 + 86400000000LL));
+
+    can_sched_handle_t h = add(0x600, 50000, 20000);
+    const int64_t t1 = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, run(t1 + 10000));
+    TEST_ASSERT_EQUAL(1, run(t1 + 20000 + LATE_US));
+    TEST_ASSERT_EQUAL(1, run(t1 + 70000 + LATE_US));
+    TEST_ASSERT_EQUAL(2, s_log.n);
+    teardown(&h, 1);
+}
+
+/* Without a hook the frames go to can_tx and out on the bus: a second node
+ * on the virtual bus receives them */
+static void test_sched_default_hook(void)
+{
+    setup();
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_deinit());
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_init(TEST_SCHED_MSGS, NULL));
+    ESP_ERROR_CHECK(can_tx_init());
+    ESP_ERROR_CHECK(can_tx_start(uxTaskPriorityGet(NULL), 0));
+
+    const can_bus_cfg_t cfg = { .bitrate = 500000, .mode = TWAI_MODE_NORMAL };
+    ESP_ERROR_CHECK(can_vbus_init(NULL));
+    ESP_ERROR_CHECK(can_bus_deinit());
+    ESP_ERROR_CHECK(can_bus_init(&can_vbus_bus, &cfg));
+    const int peer = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    TEST_ASSERT_GREATER_THAN(0, peer);
+
+    can_sched_handle_t h = add(0x700, 10000, 0);
+    const int64_t t0 = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(1, run(t0 + LATE_US));
+    TEST_ASSERT_EQUAL(1, run(t0 + 10000 + LATE_US));
+
+    twai_message_t rx[4];
+    int got = 0;
+    for (int ms = 0; ms < 1000 && got < 2; ms += 10) {
+        can_vbus_advance(1000);
+        got += can_vbus_node_rx(peer, rx + got, 4 - got);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(2, got);
+    TEST_ASSERT_EQUAL_HEX32(0x700, rx[0].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x700, rx[1].identifier);
+    TEST_ASSERT_EQUAL(0, s_log.n);
+
+    can_sched_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_get_stats(h, &st));
+    TEST_ASSERT_EQUAL_UINT32(2, st.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, st.tx_fail);
+
+    /* Let can_tx settle what it sent */
+    can_tx_stats_t ts;
+    for (int ms = 0; ms < 1000; ms += 10) {
+        uint32_t alerts;
+        if (can_bus_read_alerts(&alerts, 0) == ESP_OK) can_tx_on_alerts(alerts);
+        can_tx_get_stats(&ts);
+        if (ts.inflight == 0) break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, ts.inflight);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, can_sched_deinit());
+    teardown(&h, 1);
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_deinit());
+    TEST_ASSERT_EQUAL(ESP_OK, can_sched_init(TEST_SCHED_MSGS, log_tx));
+}
+
+void test_can_sched_run(void)
+{
+    ESP_ERROR_CHECK(can_sched_init(TEST_SCHED_MSGS, log_tx));
+
+    RUN_TEST(test_sched_period_phase);
+    RUN_TEST(test_sched_missed_and_jitter);
+    RUN_TEST(test_sched_set_period);
+    RUN_TEST(test_sched_burst);
+    RUN_TEST(test_sched_long_periods);
+    RUN_TEST(test_sched_idle_restart);
+    RUN_TEST(test_sched_default_hook);
+}
@@ -0,0 +1,186 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "can_bus.h"
+#include "can_tx.h"
+#include "can_vbus.h"
+
+#include "test_main.h"
+
+#define TEST_TX_WAIT_MS  1000
+
+/*
+ * The worker runs against the virtual bus: node 0 is the controller it fills,
+ * a second node ACKs and receives. Virtual time only moves when a case
+ * advances it, so what sits in the driver queue can be looked at before it
+ * goes out. The case plays the supervisor and forwards the alerts.
+ */
+static int s_peer;
+
+static struct {
+    size_t    n;
+    uint32_t  id[64];
+    esp_err_t err[64];
+} s_done;
+
+static void done_cb(can_tx_handle_t h, const twai_message_t *m, esp_err_t err, void *ctx)
+{
+    (void)h;
+    (void)ctx;
+    if (s_done.n < 64) {
+        s_done.id[s_done.n] = m->identifier;
+        s_done.err[s_done.n] = err;
+        s_done.n++;
+    }
+}
+
+static void bus_start(void)
+{
+    const can_bus_cfg_t cfg = { .bitrate = 500000, .mode = TWAI_MODE_NORMAL };
+    ESP_ERROR_CHECK(can_vbus_init(NULL));
+    ESP_ERROR_CHECK(can_bus_deinit());
+    ESP_ERROR_CHECK(can_bus_init(&can_vbus_bus, &cfg));
+    s_peer = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    TEST_ASSERT_GREATER_THAN(0, s_peer);
+    memset(&s_done, 0, sizeof(s_done));
+}
+
+static void submit(uint32_t id, can_tx_prio_t prio)
+{
+    const twai_message_t m = { .identifier = id, .data_length_code = 8 };
+    TEST_ASSERT_NOT_EQUAL(0, can_tx_submit(&m, prio, done_cb, NULL));
+}
+
+static void forward_alerts(void)
+{
+    uint32_t alerts;
+    if (can_bus_read_alerts(&alerts, 0) == ESP_OK) can_tx_on_alerts(alerts);
+}
+
+/* Wait for the worker to put n frames in the driver queue */
+static void wait_inflight(uint32_t n)
+{
+    can_tx_stats_t st;
+    for (int ms = 0; ms < TEST_TX_WAIT_MS; ms += 10) {
+        can_tx_get_stats(&st);
+        if (st.inflight == n) break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_UINT32(n, st.inflight);
+
+    twai_status_info_t si;
+    TEST_ASSERT_EQUAL(ESP_OK, can_bus_get_status(&si));
+    TEST_ASSERT_EQUAL_UINT32(n, si.msgs_to_tx);
+}
+
+static void wait_done(size_t n)
+{
+    for (int ms = 0; ms < TEST_TX_WAIT_MS && s_done.n < n; ms += 10) {
+        forward_alerts();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(n, s_done.n);
+}
+
+/* A burst fills the driver queue up to CAN_TX_INFLIGHT and goes out in one
+ * stretch of bus time; completions come back in order */
+static void test_tx_pipeline(void)
+{
+    bus_start();
+    can_tx_stats_t st0, st;
+    can_tx_get_stats(&st0);
+
+    const size_t n = CAN_TX_INFLIGHT + 4;
+    for (size_t i = 0; i < n; i++) submit(0x200 + i, CAN_TX_PRIO_LOW);
+    wait_inflight(CAN_TX_INFLIGHT);
+
+    TEST_ASSERT_EQUAL_UINT32(CAN_TX_INFLIGHT, can_vbus_advance(10000));
+    wait_done(CAN_TX_INFLIGHT);
+    wait_inflight(4);
+    TEST_ASSERT_EQUAL_UINT32(4, can_vbus_advance(10000));
+    wait_done(n);
+
+    twai_message_t rx[32];
+    TEST_ASSERT_EQUAL(n, can_vbus_node_rx(s_peer, rx, 32));
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_HEX32(0x200 + i, rx[i].identifier);
+        TEST_ASSERT_EQUAL_HEX32(0x200 + i, s_done.id[i]);
+        TEST_ASSERT_EQUAL(ESP_OK, s_done.err[i]);
+    }
+
+    can_tx_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT32(n, st.sent - st0.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, st.queued);
+    TEST_ASSERT_EQUAL_UINT32(0, st.inflight);
+}
+
+/* An urgent frame waits behind what is already in the driver queue only */
+static void test_tx_priority(void)
+{
+    bus_start();
+
+    for (size_t i = 0; i < CAN_TX_INFLIGHT + 2; i++) submit(0x300 + i, CAN_TX_PRIO_LOW);
+    wait_inflight(CAN_TX_INFLIGHT);
+    submit(0x7FF, CAN_TX_PRIO_HIGH);
+
+    TEST_ASSERT_EQUAL_UINT32(CAN_TX_INFLIGHT, can_vbus_advance(10000));
+    wait_done(CAN_TX_INFLIGHT);
+    wait_inflight(3);
+    TEST_ASSERT_EQUAL_UINT32(3, can_vbus_advance(10000));
+    wait_done(CAN_TX_INFLIGHT + 3);
+
+    TEST_ASSERT_EQUAL_HEX32(0x7FF, s_done.id[CAN_TX_INFLIGHT]);
+    TEST_ASSERT_EQUAL_HEX32(0x300 + CAN_TX_INFLIGHT, s_done.id[CAN_TX_INFLIGHT + 1]);
+}
+
+/* A reinstall empties the driver queue: what was in it failed */
+static void test_tx_reinstall(void)
+{
+    bus_start();
+
+    for (size_t i = 0; i < 3; i++) submit(0x400 + i, CAN_TX_PRIO_NORMAL);
+    wait_inflight(3);
+
+    const can_bus_cfg_t cfg = { .bitrate = 500000, .mode = TWAI_MODE_NORMAL };
+    TEST_ASSERT_EQUAL(ESP_OK, can_bus_reconfigure(&cfg));
+    wait_done(3);
+    for (size_t i = 0; i < 3; i++) TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, s_done.err[i]);
+
+    TEST_ASSERT_EQUAL_UINT32(0, can_vbus_advance(10000));
+    twai_message_t rx;
+    TEST_ASSERT_EQUAL(0, can_vbus_node_rx(s_peer, &rx, 1));
+}
+
+/* Bus-off drops the driver queue; the failure count settles every frame */
+static void test_tx_bus_off(void)
+{
+    bus_start();
+
+    for (size_t i = 0; i < 4; i++) submit(0x500 + i, CAN_TX_PRIO_NORMAL);
+    wait_inflight(4);
+
+    /* 32 destroyed frames at 8 each take the TEC to 256 */
+    can_vbus_inject_errors(32);
+    can_vbus_advance(100000);
+    wait_done(4);
+    for (size_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL(ESP_FAIL, s_done.err[i]);
+
+    twai_status_info_t si;
+    TEST_ASSERT_EQUAL(ESP_OK, can_bus_get_status(&si));
+    TEST_ASSERT_EQUAL(TWAI_STATE_BUS_OFF, si.state);
+}
+
+void test_can_tx_run(void)
+{
+    ESP_ERROR_CHECK(can_tx_init());
+    ESP_ERROR_CHECK(can_tx_start(uxTaskPriorityGet(NULL), 0));
+
+    RUN_TEST(test_tx_pipeline);
+    RUN_TEST(test_tx_priority);
+    RUN_TEST(test_tx_reinstall);
+    RUN_TEST(test_tx_bus_off);
+}
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "can_load.h"
+#include "can_vbus.h"
+
+#include "test_main.h"
+
+static twai_message_t frame(uint32_t id, bool ext)
+{
+    twai_message_t m = {
+        .identifier = id,
+        .data_length_code = 8,
+        .flags = ext ? TWAI_MSG_FLAG_EXTD : 0,
+    };
+    for (int i = 0; i < 8; i++) m.data[i] = (uint8_t)(id + i);
+    return m;
+}
+
+/* Nodes with a frame pending arbitrate, lowest field first; each node's own
+ * queue goes out in order */
+static void test_vbus_arbitration_by_id(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(NULL));
+    const twai_message_t q[] = {
+        frame(0x300, false), frame(0x100 << 18, true), frame(0x100, false), frame(0x0FF, false),
+    };
+    int tx[4];
+    for (size_t i = 0; i < 4; i++) {
+        tx[i] = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+        TEST_ASSERT_GREATER_THAN(0, tx[i]);
+    }
+    int rx_node = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    TEST_ASSERT_GREATER_THAN(0, rx_node);
+
+    for (size_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(tx[i], &q[i]));
+    /* Queued behind 0x300 on the same node: waits for it despite the lower ID */
+    const twai_message_t late = frame(0x001, false);
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(tx[0], &late));
+    TEST_ASSERT_EQUAL_UINT32(5, can_vbus_advance(10000));
+
+    twai_message_t rx[8];
+    TEST_ASSERT_EQUAL(5, can_vbus_node_rx(rx_node, rx, 8));
+    /* Same 11 leading bits: standard before extended */
+    TEST_ASSERT_EQUAL_HEX32(0x0FF, rx[0].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x100, rx[1].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x100 << 18, rx[2].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x300, rx[3].identifier);
+    TEST_ASSERT_EQUAL_HEX32(0x001, rx[4].identifier);
+    TEST_ASSERT_EQUAL_MEMORY(q[0].data, rx[3].data, 8);
+
+    twai_status_info_t st;
+    can_vbus_node_status(tx[0], &st);
+    TEST_ASSERT_EQUAL_UINT32(3, st.arb_lost_count);
+
+    /* Senders see each other's frames, never their own; node 0 is stopped */
+    TEST_ASSERT_EQUAL(3, can_vbus_node_rx(tx[0], rx, 8));
+    for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(rx[i].identifier != 0x300 && rx[i].identifier != 0x001);
+    TEST_ASSERT_EQUAL(0, can_vbus_node_rx(0, rx, 8));
+}
+
+static void test_vbus_arbitration_fifo(void)
+{
+    const can_vbus_cfg_t cfg = { .arb = CAN_VBUS_ARB_FIFO };
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(&cfg));
+    int a = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    int b = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+
+    const uint32_t ids[] = { 0x300, 0x100, 0x200 };
+    for (size_t i = 0; i < 3; i++) {
+        twai_message_t m = frame(ids[i], false);
+        TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    }
+    can_vbus_advance(10000);
+
+    twai_message_t rx[4];
+    TEST_ASSERT_EQUAL(3, can_vbus_node_rx(b, rx, 4));
+    for (size_t i = 0; i < 3; i++) TEST_ASSERT_EQUAL_HEX32(ids[i], rx[i].identifier);
+}
+
+/* A frame completes after its wire time at the sender's rate, not before */
+static void test_vbus_clock(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(NULL));
+    int a = can_vbus_add_node(250000, TWAI_MODE_NORMAL);
+    int b = can_vbus_add_node(250000, TWAI_MODE_NORMAL);
+
+    twai_message_t m = frame(0x123, false);
+    const int64_t us = can_load_frame_bits(&m, true) * 4;   /* 4 us per bit */
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+
+    TEST_ASSERT_EQUAL_UINT32(0, can_vbus_advance(us - 1));
+    TEST_ASSERT_EQUAL_INT64(us - 1, can_vbus_now_us());
+    twai_message_t rx;
+    TEST_ASSERT_EQUAL(0, can_vbus_node_rx(b, &rx, 1));
+
+    TEST_ASSERT_EQUAL_UINT32(1, can_vbus_advance(1));
+    TEST_ASSERT_EQUAL(1, can_vbus_node_rx(b, &rx, 1));
+
+    /* Steps shorter than a frame add up to it */
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    uint32_t done = 0;
+    for (int64_t t = 0; t < us; t += 7) done += can_vbus_advance(7);
+    TEST_ASSERT_EQUAL_UINT32(1, done);
+}
+
+/* Alone on the bus nobody ACKs: every attempt is an ACK error (+8 TEC) */
+static void test_vbus_no_ack(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(NULL));
+    int a = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+
+    twai_message_t m = frame(0x123, false);
+    const int64_t us = can_load_frame_bits(&m, true) * 2;   /* 2 us per bit */
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    can_vbus_advance(us * 5);
+
+    twai_status_info_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_status(a, &st));
+    TEST_ASSERT_EQUAL_UINT32(5, st.bus_error_count);
+    TEST_ASSERT_EQUAL_UINT32(40, st.tx_error_counter);
+    TEST_ASSERT_EQUAL_UINT32(1, st.msgs_to_tx);
+
+    /* In no-ACK mode the same frame goes through */
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_set(a, 500000, TWAI_MODE_NO_ACK));
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    TEST_ASSERT_EQUAL_UINT32(1, can_vbus_advance(us * 5));
+}
+
+/* A node at another rate only sees errors; unless it is listen-only its
+ * error flags destroy the frame for everyone */
+static void test_vbus_wrong_rate(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(NULL));
+    int a = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    int b = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    int c = can_vbus_add_node(250000, TWAI_MODE_LISTEN_ONLY);
+
+    twai_message_t m = frame(0x123, false), rx;
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    can_vbus_advance(1000);
+    TEST_ASSERT_EQUAL(1, can_vbus_node_rx(b, &rx, 1));
+    TEST_ASSERT_EQUAL(0, can_vbus_node_rx(c, &rx, 1));
+
+    twai_status_info_t st;
+    can_vbus_node_status(c, &st);
+    TEST_ASSERT_EQUAL_UINT32(1, st.bus_error_count);
+    TEST_ASSERT_EQUAL_UINT32(0, st.rx_error_counter);   /* listen-only: frozen */
+
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_set(c, 250000, TWAI_MODE_NORMAL));
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    can_vbus_advance(1000);
+    TEST_ASSERT_EQUAL(0, can_vbus_node_rx(b, &rx, 1));
+    can_vbus_node_status(a, &st);
+    TEST_ASSERT_GREATER_THAN(0, st.tx_error_counter);
+    TEST_ASSERT_EQUAL_UINT32(1, st.msgs_to_tx);
+}
+
+/* One-shot errors destroy the next frames; the sender retries each */
+static void test_vbus_inject_errors(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_init(NULL));
+    int a = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+    int b = can_vbus_add_node(500000, TWAI_MODE_NORMAL);
+
+    can_vbus_inject_errors(2);
+    twai_message_t m = frame(0x7E8, false), rx;
+    TEST_ASSERT_EQUAL(ESP_OK, can_vbus_node_tx(a, &m));
+    TEST_ASSERT_EQUAL_UINT32(3, can_vbus_advance(10000));
+    TEST_ASSERT_EQUAL(1, can_vbus_node_rx(b, &rx, 1));
+
+    twai_status_info_t st;
+    can_vbus_node_status(a, &st);
+    TEST_ASSERT_EQUAL_UINT32(2 * 8 - 1, st.tx_error_counter);
+    can_vbus_node_status(b, &st);
+    TEST_ASSERT_EQUAL_UINT32(2 - 1, st.rx_error_counter);
+}
+
+void test_can_vbus_run(void)
+{
+    RUN_TEST(test_vbus_arbitration_by_id);
+    RUN_TEST(test_vbus_arbitration_fifo);
+    RUN_TEST(test_vbus_clock);
+    RUN_TEST(test_vbus_no_ack);
+    RUN_TEST(test_vbus_wrong_rate);
+    RUN_TEST(test_vbus_inject_errors);
+}
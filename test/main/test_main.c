@@ -0,0 +1,38 @@
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "test_main.h"
+
+/*
+ * Host unit tests (ESP-IDF linux target).
+ *
+ * test_<module>.c holds the cases for one firmware module and registers
+ * them from test_<module>_run(). Modules keep their state in statics and
+ * most can only be initialized once, so a case leaves its module the way it
+ * found it (rings drained, filters removed) for the next one.
+ *
+ * The process exits with the number of failed cases.
+ */
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    test_can_baud_run();
+    test_can_filter_run();
+    test_can_fmt_run();
+    test_can_hwf_run();
+    test_can_mon_run();
+    test_can_sched_run();
+    test_can_tx_run();
+    test_can_vbus_run();
+    exit(UNITY_END());
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+/* One entry per test_<module>.c; each runs that module's cases */
+void test_can_baud_run(void);
+void test_can_filter_run(void);
+void test_can_fmt_run(void);
+void test_can_hwf_run(void);
+void test_can_mon_run(void);
+void test_can_sched_run(void);
+void test_can_tx_run(void);
+void test_can_vbus_run(void);